@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui xml
+QT       += core gui xml concurrent
 
 CONFIG += c++11
 
@@ -28,7 +28,21 @@ SOURCES += main.cpp\
     booleansignaltransition.cpp \
     scxmlexecutablecontent.cpp \
     xmlutilities.cpp \
-    connectionpointsupport.cpp
+    connectionpointsupport.cpp \
+    scxmlsourcebuffer.cpp \
+    workflowcache.cpp \
+    scxmlatoms.cpp \
+    workflowmodel.cpp \
+    workflowloader.cpp \
+    workflowsaver.cpp \
+    workflowjournal.cpp \
+    scxmlcompresseddevice.cpp \
+    scxmlcompiledchart.cpp \
+    scxmlengine.cpp \
+    scxmlexpressions.cpp \
+    scxmlscheduler.cpp \
+    scxmleventqueue.cpp \
+    scxmltimerwheel.cpp
 
 HEADERS  += mainwindow.h \
     scxmlstate.h \
@@ -45,7 +59,21 @@ HEADERS  += mainwindow.h \
     booleansignaltransition.h \
     scxmlexecutablecontent.h \
     xmlutilities.h \
-    connectionpointsupport.h
+    connectionpointsupport.h \
+    scxmlsourcebuffer.h \
+    workflowcache.h \
+    scxmlatoms.h \
+    workflowmodel.h \
+    workflowloader.h \
+    workflowsaver.h \
+    workflowjournal.h \
+    scxmlcompresseddevice.h \
+    scxmlcompiledchart.h \
+    scxmlengine.h \
+    scxmlexpressions.h \
+    scxmlscheduler.h \
+    scxmleventqueue.h \
+    scxmltimerwheel.h
 
 FORMS    +=
 
@@ -61,3 +89,5 @@ OTHER_FILES += \
 RESOURCES += \
     resources.qrc
 
+win32: LIBS += -lpsapi
+
@@ -1,17 +1,28 @@
+#include <QBuffer>
 #include <QDebug>
 #include <QDockWidget>
+#include <QElapsedTimer>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QXmlStreamWriter>
 
 #include "mainwindow.h"
 #include "workflowtab.h"
 #include "scxmltransition.h"
+#include "workflowcache.h"
+#include "workflowloader.h"
+#include "workflowsaver.h"
+#include "workflowjournal.h"
+#include "scxmlcompresseddevice.h"
+#include "scxmlcompiledchart.h"
+#include "scxmlengine.h"
 
 //!
 //! \brief MainWindow::MainWindow
 //! \param parent
 //! Construct the main window and child widgets
 MainWindow::MainWindow(QWidget *parent) :
-    QMainWindow(parent)
+    QMainWindow(parent), mLoader(nullptr), mLoadPeakMemoryBefore(0), mSaver(nullptr)
 {
     CreateWidgets();
     CreateActions();
@@ -62,6 +73,7 @@ void MainWindow::CreateWidgets()
     mTabWidget = new QTabWidget();
     mTabWidget->setTabsClosable(true);
     mTabWidget->setCurrentIndex(-1);
+    connect(mTabWidget,SIGNAL(tabCloseRequested(int)),this,SLOT(CloseTabRequested(int)));
 
     mHorizontalLayout->addWidget(mTabWidget);
 
@@ -107,6 +119,31 @@ void MainWindow::CreateActions()
     mActionAnimate->setStatusTip(tr("Animate"));
     QObject::connect(mActionAnimate, SIGNAL(triggered()), this, SLOT(TestAnimation()));
 
+    mActionUseCompiledEngine = new QAction(tr("Animate with Compiled &Engine"), this);
+    mActionUseCompiledEngine->setStatusTip(tr("Run workflows on the compiled engine rather than the QStateMachine"));
+    mActionUseCompiledEngine->setCheckable(true);
+    mActionUseCompiledEngine->setChecked(false);
+
+    mActionUseDomLoader = new QAction(tr("Use &DOM Loader"), this);
+    mActionUseDomLoader->setStatusTip(tr("Load workflows through the DOM rather than the streaming reader"));
+    mActionUseDomLoader->setCheckable(true);
+    mActionUseDomLoader->setChecked(false);
+
+    mActionUseDomWriter = new QAction(tr("Use DOM &Writer"), this);
+    mActionUseDomWriter->setStatusTip(tr("Save workflows through the DOM rather than the streaming writer"));
+    mActionUseDomWriter->setCheckable(true);
+    mActionUseDomWriter->setChecked(false);
+
+    mActionMapFiles = new QAction(tr("&Memory Map Files"), this);
+    mActionMapFiles->setStatusTip(tr("Parse workflows directly from a memory mapping of the file"));
+    mActionMapFiles->setCheckable(true);
+    mActionMapFiles->setChecked(true);
+
+    mActionUseCache = new QAction(tr("Use Workflow &Cache"), this);
+    mActionUseCache->setStatusTip(tr("Reopen unchanged workflows from their precompiled .scxmlc file"));
+    mActionUseCache->setCheckable(true);
+    mActionUseCache->setChecked(true);
+
     //TODO: connect these
     mActionAbout = new QAction(tr("&About"), this);
     mActionShowChildStates = new QAction(tr("&Show"), this);
@@ -136,6 +173,11 @@ void MainWindow::CreateMenus()
 
     mMenuTest = menuBar()->addMenu(tr("&Test"));
     mMenuTest->addAction(mActionShowChildStates);
+    mMenuTest->addAction(mActionUseCompiledEngine);
+    mMenuTest->addAction(mActionUseDomLoader);
+    mMenuTest->addAction(mActionUseDomWriter);
+    mMenuTest->addAction(mActionMapFiles);
+    mMenuTest->addAction(mActionUseCache);
 }
 
 //!
@@ -154,6 +196,19 @@ void MainWindow::CreateToolbars()
     mInsertToolBar->addAction(mActionAnimate);
 
     statusBar()->showMessage(QString("Version: %1").arg(VERSION));
+
+    // shown while a workflow is loading
+    mLoadProgressBar = new QProgressBar(this);
+    mLoadProgressBar->setRange(0, 100);
+    mLoadProgressBar->setMaximumWidth(200);
+    mLoadProgressBar->hide();
+    statusBar()->addPermanentWidget(mLoadProgressBar);
+    mLoadCancelButton = new QToolButton(this);
+    mLoadCancelButton->setText(tr("Cancel"));
+    mLoadCancelButton->setToolTip(tr("Cancel loading the workflow"));
+    mLoadCancelButton->hide();
+    QObject::connect(mLoadCancelButton, SIGNAL(clicked()), this, SLOT(CancelWorkflowLoad()));
+    statusBar()->addPermanentWidget(mLoadCancelButton);
 }
 
 //!
@@ -165,15 +220,20 @@ void MainWindow::InsertState()
     WorkflowTab* activeTab = GetActiveWorkflowTab();
     if (activeTab == NULL) return;
     Workflow* activeWorkflow = activeTab->GetWorkflow();
-    int nodeCount = activeWorkflow->children().length();
-    QMap<QString,QString> metaData;
-    metaData["x"] = "10";
-    metaData["y"] = "10";
-    metaData["height"] = "50";
-    metaData["width"] = "100";
-    metaData["description"] = "new state";
-    SCXMLState *newState = new SCXMLState(QString("state_%1").arg(nodeCount), &metaData);
-    activeWorkflow->addState(newState);
+    int nodeCount = activeWorkflow->GetStates().length();
+    while (activeWorkflow->GetStateById(QString("state_%1").arg(nodeCount)) != nullptr) {
+        nodeCount++;
+    }
+    MetaData metaData;
+    metaData.x = 10;
+    metaData.y = 10;
+    metaData.height = 50;
+    metaData.width = 100;
+    metaData.description = "new state";
+    metaData.fields = MetaData::FIELD_X | MetaData::FIELD_Y | MetaData::FIELD_HEIGHT |
+            MetaData::FIELD_WIDTH | MetaData::FIELD_DESCRIPTION;
+    SCXMLState *newState = new SCXMLState(QString("state_%1").arg(nodeCount), metaData);
+    activeWorkflow->AddState(newState);
     activeWorkflow->setInitialState(newState);
     activeTab->AddItemToScene(newState);
 }
@@ -182,6 +242,10 @@ void MainWindow::TestAnimation()
 {
     WorkflowTab* activeTab = GetActiveWorkflowTab();
     if (activeTab == NULL) return;
+    if (mActionUseCompiledEngine->isChecked()) {
+        RunCompiledWorkflow(activeTab);
+        return;
+    }
     Workflow* activeWorkflow = activeTab->GetWorkflow();
 //    QObjectList nodes = activeWorkflow->children();
 //    foreach (QObject *obj, nodes) {
@@ -204,6 +268,45 @@ void MainWindow::TestAnimation()
 
 }
 
+//!
+//! \brief Runs a workflow on the compiled engine rather than its QStateMachine
+//!
+//! The chart is compiled from a snapshot of the workflow and run until it waits for an
+//! external event. The state it stops in is selected.
+//!
+void MainWindow::RunCompiledWorkflow(WorkflowTab *tab)
+{
+    Workflow* workflow = tab->GetWorkflow();
+    if (workflow->isRunning()) {
+        workflow->stop();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    WorkflowModel model;
+    workflow->ConstructModelFromStateMachine(model);
+    QSharedPointer<SCXMLCompiledChart> chart(new SCXMLCompiledChart());
+    if (!chart->Compile(model)) {
+        statusBar()->showMessage(tr("The workflow cannot be compiled: %1").arg(chart->GetErrorString()));
+        return;
+    }
+    qint64 compileTime = timer.elapsed();
+
+    SCXMLEngine engine(chart);
+    SCXMLSession session;
+    engine.Start(session);
+    SCXMLAtom activeId = chart->GetState(session.GetActiveState()).id;
+    SCXMLState* activeState = workflow->GetStateById(activeId);
+    if (activeState != nullptr && activeState->scene() != nullptr) {
+        activeState->scene()->clearSelection();
+        activeState->setSelected(true);
+    }
+    statusBar()->showMessage(tr("Compiled %1 states and %2 transitions in %3 ms, %4 in %5 after %6 transitions")
+                             .arg(chart->GetStateCount() - 1).arg(chart->GetTransitionCount()).arg(compileTime)
+                             .arg(session.IsRunning() ? tr("waiting") : tr("finished"))
+                             .arg(SCXMLAtomString(activeId)).arg(engine.GetMicrostepCount()));
+}
+
 //!
 //! \brief MainWindow::insertTransition
 //! Add a new transition to the workflow between two selected states
@@ -213,17 +316,16 @@ void MainWindow::InsertTransition()
     WorkflowTab* activeTab = GetActiveWorkflowTab();
     if (activeTab == NULL) return;
     Workflow* activeWorkflow = activeTab->GetWorkflow();
-    QObjectList nodes = activeWorkflow->children();
     QList<SCXMLState*> nodesSelected;
-    foreach (QObject *obj, nodes) {
-        SCXMLState* state = static_cast<SCXMLState*>(obj);
+    foreach (SCXMLState* state, activeWorkflow->GetStates()) {
         if (state->isSelected()) nodesSelected.append(state);
     }
 
     if (nodesSelected.count() == 2) {
         SCXMLState* stateFrom = nodesSelected.at(0);
         SCXMLState* stateTo = nodesSelected.at(1);
-        SCXMLTransition* transition = new SCXMLTransition(stateFrom, stateTo, "", "", nullptr);
+        SCXMLTransition* transition = new SCXMLTransition(stateFrom, stateTo, "", "", MetaData());
+        activeWorkflow->AddTransition(transition);
 
         // add the new transition to the scene
         QGraphicsItem* itemTran = dynamic_cast<QGraphicsItem*>(transition);
@@ -232,68 +334,307 @@ void MainWindow::InsertTransition()
 }
 
 //!
-//! \brief Saves the current workflow to a file in SCXML format
+//! \brief Saves the active workflow to a file chosen by the user
+//!
+//! The workflow is written on a worker thread from a snapshot (see WorkflowSaver), so it can
+//! be edited while the save runs and the outcome is reported in the status bar. The DOM
+//! writer, when selected from the test menu, still saves synchronously.
 //!
 void MainWindow::SaveCurrentWorkflow()
 {
+    // only one workflow is saved at a time
+    if (mSaver != nullptr) {
+        statusBar()->showMessage(tr("Still saving %1").arg(mSaver->GetFilename()));
+        return;
+    }
+
     QFileDialog fileSelector(this);
     fileSelector.setWindowTitle(tr("Save SCXML workflow"));
-    fileSelector.setNameFilter(tr("SCXML Files (*.scxml);;All Files (*.*)"));
+    fileSelector.setNameFilter(tr("SCXML Files (*.scxml *.scxmlz);;Compressed SCXML Files (*.scxmlz);;All Files (*.*)"));
     fileSelector.setFileMode(QFileDialog::AnyFile);
     fileSelector.setViewMode(QFileDialog::Detail);
     fileSelector.setAcceptMode(QFileDialog::AcceptSave);
     fileSelector.setDefaultSuffix(tr("scxml"));
     if (fileSelector.exec() && !fileSelector.selectedFiles().isEmpty()) {
         QString workflowFilename = fileSelector.selectedFiles().first();
-        QDomDocument doc;
         WorkflowTab* activeTab = GetActiveWorkflowTab();
-        activeTab->GetWorkflow()->ConstructSCXMLFromStateMachine(doc);
-
-        QFile scxmlFile(workflowFilename);
-        if (!scxmlFile.open(QIODevice::Truncate | QIODevice::WriteOnly)) {
-            Utilities::ShowWarning("SCXML file cannot be written");
+        if (mActionUseDomWriter->isChecked()) {
+            SaveWorkflowWithDom(activeTab, workflowFilename);
             return;
         }
-        QByteArray xml = doc.toByteArray();
-        scxmlFile.write(xml);
-        scxmlFile.close();
+
+        mSaveTimer.start();
+        mSaver = new WorkflowSaver(activeTab, workflowFilename, this);
+        mSaver->SetUseCache(mActionUseCache->isChecked());
+        connect(mSaver, SIGNAL(Finished(bool)), this, SLOT(WorkflowSaveFinished(bool)));
+        statusBar()->showMessage(tr("Saving %1").arg(workflowFilename));
+        if (activeTab->GetJournal() != nullptr) {
+            activeTab->GetJournal()->BeginSave();
+        }
+        mSaver->Start();
+    }
+}
+
+void MainWindow::WorkflowSaveFinished(bool succeeded)
+{
+    WorkflowSaver* saver = qobject_cast<WorkflowSaver*>(sender());
+    if (saver == nullptr) return;
+    saver->deleteLater();
+    if (saver == mSaver) {
+        mSaver = nullptr;
+    }
+    FinishJournalSave(saver->GetTab(), saver->GetFilename(), saver->GetSavedHash(), succeeded);
+
+    if (!succeeded) {
+        statusBar()->showMessage(tr("Saving %1 failed: %2").arg(saver->GetFilename()).arg(saver->GetErrorString()));
+        return;
+    }
+
+    // an incremental save only hashes what it writes, to key the journal, and leaves the cache
+    // to be rebuilt on the next load rather than taking a snapshot of the whole workflow
+    QString report = saver->IsIncremental() ? tr("Saved changes to %1 in %2 ms") : tr("Saved %1 in %2 ms");
+    statusBar()->showMessage(report.arg(saver->GetFilename()).arg(mSaveTimer.elapsed()));
+}
+
+//!
+//! \brief Saves a workflow through a DOM of the whole file, on the GUI thread
+//!
+void MainWindow::SaveWorkflowWithDom(WorkflowTab *tab, QString workflowFilename)
+{
+    if (tab->GetJournal() != nullptr) {
+        tab->GetJournal()->BeginSave();
+    }
+
+    // writing over a mapped file would invalidate the mapping
+    QSharedPointer<SCXMLSourceBuffer> source = tab->GetWorkflow()->GetSource();
+    if (!source.isNull() && QFileInfo(source->GetFilename()) == QFileInfo(workflowFilename)) {
+        tab->GetWorkflow()->ReleaseSource();
+        source->Close();
+    }
+
+    QFile scxmlFile(workflowFilename);
+    if (!scxmlFile.open(QIODevice::Truncate | QIODevice::WriteOnly)) {
+        FinishJournalSave(tab, workflowFilename, QByteArray(), false);
+        Utilities::ShowWarning("SCXML file cannot be written");
+        return;
+    }
+    QDomDocument doc;
+    tab->GetWorkflow()->ConstructSCXMLFromStateMachine(doc);
+    QByteArray scxml = doc.toByteArray();
+    bool written;
+    if (SCXMLCompressedDevice::IsCompressedFilename(workflowFilename)) {
+        SCXMLCompressedDevice compressedDevice(&scxmlFile);
+        written = compressedDevice.open(QIODevice::WriteOnly) &&
+                  compressedDevice.write(scxml) == scxml.size() && compressedDevice.Finish();
+    }
+    else {
+        written = (scxmlFile.write(scxml) == scxml.size());
+    }
+    // close cannot report an error, so anything still buffered is flushed first
+    written = written && scxmlFile.flush();
+    scxmlFile.close();
+    if (!written) {
+        FinishJournalSave(tab, workflowFilename, QByteArray(), false);
+        Utilities::ShowWarning("SCXML file cannot be written");
+        return;
+    }
+
+    // refresh the cache so the saved file reopens from it
+    QByteArray savedHash;
+    SCXMLSourceBuffer saved;
+    if (saved.Open(workflowFilename)) {
+        savedHash = WorkflowCache::HashSource(saved.GetData());
+        if (mActionUseCache->isChecked()) {
+            WorkflowCache::Write(tab->GetWorkflow(), WorkflowCache::GetCacheFilename(workflowFilename), savedHash);
+        }
+    }
+    FinishJournalSave(tab, workflowFilename, savedHash, true);
+    statusBar()->showMessage(tr("Saved %1").arg(workflowFilename));
+}
+
+//!
+//! \brief Moves the journal of a workflow on to the file it was saved to
+//!
+//! A workflow without a journal, e.g. a new one, is journaled from its first save.
+//!
+void MainWindow::FinishJournalSave(WorkflowTab *tab, QString workflowFilename, QByteArray savedHash, bool succeeded)
+{
+    // the saved file cannot key a journal unless it could be read back
+    if (tab == nullptr || mTabWidget->indexOf(tab) < 0) return;
+    succeeded = succeeded && !savedHash.isEmpty();
+    if (tab->GetJournal() != nullptr) {
+        tab->GetJournal()->FinishSave(workflowFilename, savedHash, succeeded);
+    }
+    else if (succeeded) {
+        tab->SetJournal(new WorkflowJournal(tab->GetWorkflow(), workflowFilename, savedHash, false));
     }
 }
 
 //!
 //! \brief Loads an SCXML file as a new workflow
 //!
+//! The file is read on a worker thread and the workflow built in batches (see WorkflowLoader),
+//! so the window stays responsive and the load can be cancelled from the status bar. The DOM
+//! loader, when selected from the test menu, still loads synchronously.
+//!
 bool MainWindow::LoadWorkflowFromFile(QString workflowFilename) {
-    QDomDocument doc;
-    QFile scxmlFile(workflowFilename);
-    if (!scxmlFile.open(QIODevice::ReadOnly)) {
+    mLoadTimer.start();
+    mLoadPeakMemoryBefore = Utilities::GetPeakMemoryUsage();
+
+    if (mActionUseDomLoader->isChecked()) {
+        QSharedPointer<SCXMLSourceBuffer> source(new SCXMLSourceBuffer());
+        if (!source->Open(workflowFilename, mActionMapFiles->isChecked())) {
+            Utilities::ShowWarning("SCXML file cannot be read");
+            return false;
+        }
+        return LoadWorkflowWithDom(workflowFilename, source);
+    }
+
+    // only one workflow is loaded at a time
+    if (mLoader != nullptr) {
+        mLoader->Cancel();
+    }
+
+    WorkflowTab* newTab = CreateWorkflow();
+    mLoader = new WorkflowLoader(newTab, workflowFilename, this);
+    mLoader->SetUseMapping(mActionMapFiles->isChecked());
+    mLoader->SetUseCache(mActionUseCache->isChecked());
+    connect(mLoader, SIGNAL(Progress(QString,int)), this, SLOT(WorkflowLoadProgress(QString,int)));
+    connect(mLoader, SIGNAL(Finished(bool,bool)), this, SLOT(WorkflowLoadFinished(bool,bool)));
+    mLoadProgressBar->show();
+    mLoadCancelButton->show();
+    mLoader->Start();
+    return true;
+}
+
+void MainWindow::WorkflowLoadProgress(QString stage, int percent)
+{
+    // ignore a load that has been replaced by a newer one
+    if (sender() != mLoader) return;
+    mLoadProgressBar->setFormat(stage + " %p%");
+    mLoadProgressBar->setValue(percent);
+}
+
+void MainWindow::WorkflowLoadFinished(bool succeeded, bool cancelled)
+{
+    WorkflowLoader* loader = qobject_cast<WorkflowLoader*>(sender());
+    if (loader == nullptr) return;
+    loader->deleteLater();
+    if (loader == mLoader) {
+        mLoader = nullptr;
+        mLoadProgressBar->hide();
+        mLoadCancelButton->hide();
+    }
+
+    WorkflowTab* tab = loader->GetTab();
+    if (succeeded) {
+        CompleteWorkflowLoad(tab, loader->GetFilename(), loader->GetLoaderName(), loader->GetSourceHash(),
+                             loader->GetRecoveredEdits());
+        return;
+    }
+
+    if (tab != nullptr) {
+        RemoveWorkflowTab(tab);
+    }
+    if (cancelled) {
+        statusBar()->showMessage(tr("Loading %1 cancelled").arg(loader->GetFilename()));
+        return;
+    }
+    QSharedPointer<SCXMLSourceBuffer> source = loader->GetSource();
+    if (source.isNull()) {
         Utilities::ShowWarning("SCXML file cannot be read");
+        return;
+    }
+
+    // the DOM loader reports the errors of files the streaming reader could not parse
+    LoadWorkflowWithDom(loader->GetFilename(), source);
+}
+
+void MainWindow::CancelWorkflowLoad()
+{
+    if (mLoader != nullptr) {
+        mLoader->Cancel();
+    }
+}
+
+//!
+//! \brief Shows a workflow that has been loaded and reports the load time
+//!
+//! The load time and the peak memory of the process are reported in the status bar so the
+//! loaders can be compared. The edits to a workflow read by the WorkflowLoader are journaled
+//! from here on, the DOM loader does not replay a journal so leaves it for the next load.
+//!
+void MainWindow::CompleteWorkflowLoad(WorkflowTab *tab, QString workflowFilename, QString loaderName, QByteArray sourceHash,
+                                      int recoveredEdits)
+{
+    // recovered edits are not in the file the cache is keyed by
+    QSharedPointer<SCXMLSourceBuffer> source = tab->GetWorkflow()->GetSource();
+    if (mActionUseCache->isChecked() && loaderName != "cache" && recoveredEdits == 0 && !source.isNull()) {
+        if (sourceHash.isEmpty()) {
+            sourceHash = WorkflowCache::HashSource(source->GetData());
+        }
+        WorkflowCache::Write(tab->GetWorkflow(), WorkflowCache::GetCacheFilename(workflowFilename), sourceHash);
+    }
+
+    tab->SetFilename(workflowFilename);
+    if (loaderName != "DOM" && !sourceHash.isEmpty()) {
+        tab->SetJournal(new WorkflowJournal(tab->GetWorkflow(), workflowFilename, sourceHash, recoveredEdits > 0));
+    }
+    QString name = tab->GetWorkflow()->GetWorkflowName();
+    if (name == "") {
+        name = "unnamed";
+    }
+    tab->SetWorkflowName(name);
+    tab->UpdateSCXMLText();
+    tab->TestDataModel(mDataModelTable);
+
+    qint64 peakMemoryAfter = Utilities::GetPeakMemoryUsage();
+    bool mapped = !source.isNull() && source->IsMapped();
+    QString report = QString("Loaded %1 (%2 loader, %3 file) in %4 ms, peak memory %5 KB (+%6 KB)")
+            .arg(name).arg(loaderName).arg(mapped ? "mapped" : "read").arg(mLoadTimer.elapsed())
+            .arg(peakMemoryAfter / 1024).arg((peakMemoryAfter - mLoadPeakMemoryBefore) / 1024);
+    if (recoveredEdits > 0) {
+        report += QString(", recovered %1 unsaved edits").arg(recoveredEdits);
+    }
+    statusBar()->showMessage(report);
+}
+
+//!
+//! \brief Builds a new workflow from a DOM of the whole file, on the GUI thread
+//!
+bool MainWindow::LoadWorkflowWithDom(QString workflowFilename, QSharedPointer<SCXMLSourceBuffer> source)
+{
+    QDomDocument doc;
+    QByteArray data = source->GetData();
+    QBuffer device(&data);
+    device.open(QIODevice::ReadOnly);
+    SCXMLCompressedDevice compressedDevice(&device);
+    bool compressed = SCXMLCompressedDevice::IsCompressed(data);
+    if (compressed && !compressedDevice.open(QIODevice::ReadOnly)) {
+        Utilities::ShowWarning("Compressed SCXML file is corrupt");
         return false;
     }
-    if (!doc.setContent(&scxmlFile)) {
+    if (!doc.setContent(compressed ? static_cast<QIODevice*>(&compressedDevice) : &device)) {
         qDebug() << doc.lineNumber();
         qDebug() << doc.columnNumber();
         Utilities::ShowWarning("SCXML file cannot be parsed");
-        scxmlFile.close();
         return false;
     }
-    scxmlFile.close();
 
-    // create a new tab and add the workflow to it
     WorkflowTab* newTab = CreateWorkflow();
-    newTab->SetFilename(workflowFilename);
+    newTab->GetWorkflow()->SetSource(source);
     newTab->GetWorkflow()->ConstructStateMachineFromSCXML(doc);
-    QString name = newTab->GetWorkflow()->GetWorkflowName();
-    if (name == "") {
-        name = "unnamed";
-    }
-    newTab->SetWorkflowName(name);
-    newTab->Update();
-    newTab->TestDataModel(mDataModelTable);
-
+    newTab->CreateSceneObjects();
+    CompleteWorkflowLoad(newTab, workflowFilename, "DOM", QByteArray(), 0);
     return true;
 }
 
+void MainWindow::RemoveWorkflowTab(WorkflowTab *tab)
+{
+    mTabWidget->removeTab(mTabWidget->indexOf(tab));
+    tab->deleteLater();
+}
+
 //!
 //! \brief Loads an SCXML file via the file selection dialog
 //!
@@ -301,7 +642,7 @@ bool MainWindow::LoadWorkflowFromDialog()
 {
     QFileDialog fileSelector(this);
     fileSelector.setWindowTitle(tr("Open SCXML workflow"));
-    fileSelector.setNameFilter(tr("SCXML Files (*.scxml);;All Files (*.*)"));
+    fileSelector.setNameFilter(tr("SCXML Files (*.scxml *.scxmlz);;Compressed SCXML Files (*.scxmlz);;All Files (*.*)"));
     fileSelector.setFileMode(QFileDialog::AnyFile);
     fileSelector.setViewMode(QFileDialog::Detail);
     fileSelector.setAcceptMode(QFileDialog::AcceptOpen);
@@ -315,9 +656,25 @@ bool MainWindow::LoadWorkflowFromDialog()
 
 void MainWindow::CloseTabRequested(int index)
 {
-    Q_UNUSED(index)
+    // resolve the tab once, the indices move as soon as one is removed
+    QWidget* widget = mTabWidget->widget(index);
+    if (widget == nullptr) {
+        return;
+    }
+
+    // stop building a workflow that is no longer wanted
+    if (mLoader != nullptr && widget == mLoader->GetTab()) {
+        mLoader->Cancel();
+    }
+
+    // closing the tab abandons its unsaved edits, so they are not recovered
+    WorkflowTab* tab = qobject_cast<WorkflowTab*>(widget);
+    if (tab != nullptr) {
+        tab->SetJournal(nullptr);
+    }
+
     //TODO: close the tab after save check
-    mTabWidget->removeTab(index);
+    mTabWidget->removeTab(mTabWidget->indexOf(widget));
 }
 
 //!
@@ -328,7 +685,6 @@ WorkflowTab* MainWindow::CreateWorkflow()
     WorkflowTab* tab = new WorkflowTab(mTabWidget, "");
     int index = mTabWidget->addTab(tab, "Unnamed");
     mTabWidget->setCurrentIndex(index);
-    connect(mTabWidget,SIGNAL(tabCloseRequested(int)),this,SLOT(CloseTabRequested(int)));
     return tab;
 }
 
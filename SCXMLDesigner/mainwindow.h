@@ -18,13 +18,20 @@
 #include <QToolBox>
 #include <QWidget>
 #include <QTableWidget>
+#include <QProgressBar>
+#include <QToolButton>
+#include <QElapsedTimer>
 #include <QMainWindow>
 #include <QStateMachine>
 #include <QDomDocument>
+#include <QSharedPointer>
 
 #include "scxmlstate.h"
 #include "workflow.h"
 #include "workflowtab.h"
+#include "scxmlsourcebuffer.h"
+#include "workflowloader.h"
+#include "workflowsaver.h"
 #include "utilities.h"
 #include "version.h"
 
@@ -53,8 +60,20 @@ private slots:
     bool LoadWorkflowFromDialog();
     WorkflowTab* CreateWorkflow();
     WorkflowTab* GetActiveWorkflowTab();
+    void WorkflowLoadProgress(QString stage, int percent);
+    void WorkflowLoadFinished(bool succeeded, bool cancelled);
+    void CancelWorkflowLoad();
+    void WorkflowSaveFinished(bool succeeded);
 
 private:
+    void CompleteWorkflowLoad(WorkflowTab* tab, QString workflowFilename, QString loaderName, QByteArray sourceHash,
+                              int recoveredEdits);
+    bool LoadWorkflowWithDom(QString workflowFilename, QSharedPointer<SCXMLSourceBuffer> source);
+    void SaveWorkflowWithDom(WorkflowTab* tab, QString workflowFilename);
+    void FinishJournalSave(WorkflowTab* tab, QString workflowFilename, QByteArray savedHash, bool succeeded);
+    void RemoveWorkflowTab(WorkflowTab* tab);
+    void RunCompiledWorkflow(WorkflowTab* tab);
+
     QMenu *mMenuFile;
     QMenu *mMenuHelp;
     QMenu *mMenuEdit;
@@ -70,6 +89,11 @@ private:
     QAction *mActionTransition;
     QAction *mActionShowChildStates;
     QAction *mActionAnimate;
+    QAction *mActionUseCompiledEngine;
+    QAction *mActionUseDomLoader;
+    QAction *mActionUseDomWriter;
+    QAction *mActionMapFiles;
+    QAction *mActionUseCache;
 
     QToolBar *mFileToolBar;
     QToolBar *mInsertToolBar;
@@ -87,6 +111,15 @@ private:
     QWidget *page_2;
 
     QTableWidget *mDataModelTable;
+
+    WorkflowLoader *mLoader;
+    QProgressBar *mLoadProgressBar;
+    QToolButton *mLoadCancelButton;
+    QElapsedTimer mLoadTimer;
+    qint64 mLoadPeakMemoryBefore;
+
+    WorkflowSaver *mSaver;
+    QElapsedTimer mSaveTimer;
 };
 
 #endif // MAINWINDOW_H
@@ -3,3 +3,164 @@
 MetaDataSupport::MetaDataSupport()
 {
 }
+
+//! Compares a key in place with a latin1 name
+static bool KeyEquals(const QChar* key, int length, const char* name)
+{
+    int pos = 0;
+    for (; pos < length && name[pos] != 0; pos++) {
+        if (key[pos] != QLatin1Char(name[pos])) return false;
+    }
+    return pos == length && name[pos] == 0;
+}
+
+void MetaDataSupport::ParseMetaData(const QString &text, MetaData &metaData)
+{
+    ParseMetaData(&text, 0, text.length(), metaData);
+}
+
+void MetaDataSupport::ParseMetaData(const QStringRef &text, MetaData &metaData)
+{
+    if (text.string() == nullptr) return;
+    ParseMetaData(text.string(), text.position(), text.position() + text.length(), metaData);
+}
+
+//!
+//! \brief MetaDataSupport::ParseMetaData
+//!
+//! Scans the text in place for "[key=value]" entries. Nothing is allocated except for the
+//! description and control point values and any unknown keys.
+//!
+void MetaDataSupport::ParseMetaData(const QString *text, int start, int end, MetaData &metaData)
+{
+    const QChar* data = text->constData();
+    int pos = start;
+    while (pos < end) {
+        // find the start of the next entry
+        while (pos < end && data[pos] != QLatin1Char('[')) pos++;
+        int keyStart = ++pos;
+        while (pos < end && data[pos] != QLatin1Char('=') && data[pos] != QLatin1Char(']') && data[pos] != QLatin1Char('[')) pos++;
+        if (pos >= end) break;
+        if (data[pos] != QLatin1Char('=')) continue;
+
+        int keyEnd = pos++;
+        int valueStart = pos;
+        while (pos < end && data[pos] != QLatin1Char(']') && data[pos] != QLatin1Char('[')) pos++;
+        if (pos >= end) break;
+        if (data[pos] != QLatin1Char(']')) continue;
+
+        DecodeEntry(text, keyStart, keyEnd, valueStart, pos, metaData);
+        pos++;
+    }
+}
+
+void MetaDataSupport::DecodeEntry(const QString *text, int keyStart, int keyEnd, int valueStart, int valueEnd, MetaData &metaData)
+{
+    const QChar* key = text->constData() + keyStart;
+    int keyLength = keyEnd - keyStart;
+    QStringRef value(text, valueStart, valueEnd - valueStart);
+
+    // dispatch on the key length first so most keys need a single comparison
+    MetaData::Field field = MetaData::Field(0);
+    switch (keyLength) {
+    case 1:
+        if (key[0] == QLatin1Char('x')) field = MetaData::FIELD_X;
+        else if (key[0] == QLatin1Char('y')) field = MetaData::FIELD_Y;
+        break;
+    case 2:
+        if (KeyEquals(key, keyLength, "cp")) field = MetaData::FIELD_CONTROL_POINTS;
+        break;
+    case 5:
+        if (KeyEquals(key, keyLength, "width")) field = MetaData::FIELD_WIDTH;
+        break;
+    case 6:
+        if (KeyEquals(key, keyLength, "height")) field = MetaData::FIELD_HEIGHT;
+        break;
+    case 11:
+        if (KeyEquals(key, keyLength, "description")) field = MetaData::FIELD_DESCRIPTION;
+        break;
+    }
+
+    bool ok = true;
+    switch (field) {
+    case MetaData::FIELD_X:
+        metaData.x = value.toDouble(&ok);
+        break;
+    case MetaData::FIELD_Y:
+        metaData.y = value.toDouble(&ok);
+        break;
+    case MetaData::FIELD_WIDTH:
+        metaData.width = value.toDouble(&ok);
+        break;
+    case MetaData::FIELD_HEIGHT:
+        metaData.height = value.toDouble(&ok);
+        break;
+    case MetaData::FIELD_DESCRIPTION:
+        metaData.description = value.toString();
+        break;
+    case MetaData::FIELD_CONTROL_POINTS:
+        ParseControlPoints(value, metaData.controlPoints);
+        break;
+    default:
+        {
+            // unknown key, replace any earlier entry with the same key
+            QString unknownKey(key, keyLength);
+            for (int pos=0; pos<metaData.extra.count(); pos++) {
+                if (metaData.extra[pos].first == unknownKey) {
+                    metaData.extra.remove(pos);
+                    break;
+                }
+            }
+            metaData.extra.append(qMakePair(unknownKey, value.toString()));
+        }
+        return;
+    }
+
+    if (ok) metaData.Set(field);
+}
+
+void MetaDataSupport::ParseControlPoints(const QStringRef &text, QVector<QPointF> &points)
+{
+    points.resize(0);
+    const QString* string = text.string();
+    if (string == nullptr) return;
+
+    const QChar* data = text.unicode();
+    int length = text.length();
+    int pos = 0;
+    while (pos < length) {
+        int pointEnd = pos;
+        while (pointEnd < length && data[pointEnd] != QLatin1Char(':')) pointEnd++;
+        int comma = pos;
+        while (comma < pointEnd && data[comma] != QLatin1Char(',')) comma++;
+
+        if (comma < pointEnd) {
+            bool okX = false;
+            bool okY = false;
+            qreal x = QStringRef(string, text.position() + pos, comma - pos).toDouble(&okX);
+            qreal y = QStringRef(string, text.position() + comma + 1, pointEnd - comma - 1).toDouble(&okY);
+            if (okX && okY) {
+                points.append(QPointF(x, y));
+            }
+        }
+        pos = pointEnd + 1;
+    }
+}
+
+QString MetaDataSupport::FormatStateMetaData(const MetaData &metaData)
+{
+    return QString(" META-DATA [x=%1] [y=%2] [width=%3] [height=%4] [description=%5]")
+            .arg(metaData.x).arg(metaData.y).arg(metaData.width).arg(metaData.height).arg(metaData.description);
+}
+
+QString MetaDataSupport::FormatTransitionMetaData(const MetaData &metaData)
+{
+    QString controlPoints = "";
+    foreach (QPointF point, metaData.controlPoints) {
+        if (controlPoints.length() > 0) {
+            controlPoints.append(":");
+        }
+        controlPoints.append(QString("%1,%2").arg(point.x()).arg(point.y()));
+    }
+    return QString(" META-DATA [cp=%1] [description=%2]").arg(controlPoints).arg(metaData.description);
+}
@@ -1,14 +1,72 @@
 #ifndef METADATASUPPORT_H
 #define METADATASUPPORT_H
 
-#include <QMap>
+#include <QString>
+#include <QStringRef>
+#include <QVector>
+#include <QPair>
+#include <QPointF>
+
+//! Meta data decoded from a META-DATA comment, e.g. " META-DATA [x=10] [y=20] [description=start]"
+//!
+//! The known keys are decoded into typed fields, any other keys are kept in document order.
+struct MetaData
+{
+    enum Field {
+        FIELD_X = 0x01,
+        FIELD_Y = 0x02,
+        FIELD_WIDTH = 0x04,
+        FIELD_HEIGHT = 0x08,
+        FIELD_DESCRIPTION = 0x10,
+        FIELD_CONTROL_POINTS = 0x20
+    };
+
+    MetaData() : fields(0), x(0), y(0), width(0), height(0) {}
+
+    bool Has(Field field) const { return (fields & field) != 0; }
+    void Set(Field field) { fields |= field; }
+
+    //! Empties the meta data, keeping any allocated capacity for reuse
+    void Clear() {
+        fields = 0;
+        description.clear();
+        controlPoints.resize(0);
+        extra.resize(0);
+    }
+
+    int fields;
+    qreal x;
+    qreal y;
+    qreal width;
+    qreal height;
+    QString description;
+    QVector<QPointF> controlPoints;
+    QVector<QPair<QString, QString> > extra;
+};
 
 class MetaDataSupport
 {
 public:
     MetaDataSupport();
-    virtual void ApplyMetaData(QMap<QString, QString>* mapMetaData) = 0;
+    virtual void ApplyMetaData(const MetaData& metaData) = 0;
     virtual QString GetMetaDataString() = 0;
+
+    //! Decodes the [key=value] entries of a META-DATA comment, later entries replace earlier ones
+    static void ParseMetaData(const QString& text, MetaData& metaData);
+    static void ParseMetaData(const QStringRef& text, MetaData& metaData);
+
+    //! Decodes control points of the form "x1,y1:x2,y2", malformed points are skipped
+    static void ParseControlPoints(const QStringRef& text, QVector<QPointF>& points);
+
+    //! Formats the META-DATA comment of a state from its position, size and description
+    static QString FormatStateMetaData(const MetaData& metaData);
+
+    //! Formats the META-DATA comment of a transition from its control points and description
+    static QString FormatTransitionMetaData(const MetaData& metaData);
+
+private:
+    static void ParseMetaData(const QString* text, int start, int end, MetaData& metaData);
+    static void DecodeEntry(const QString* text, int keyStart, int keyEnd, int valueStart, int valueEnd, MetaData& metaData);
 };
 
 #endif // METADATASUPPORT_H
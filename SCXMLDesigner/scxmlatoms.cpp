@@ -0,0 +1,124 @@
+#include "scxmlatoms.h"
+
+// slots in the index when the pool is created, enough for the atoms of a small workflow
+#define INITIAL_INDEX_SIZE 1024
+
+SCXMLAtomTable::SCXMLAtomTable() :
+    mIndex(new AtomIndex(INITIAL_INDEX_SIZE))
+{
+    // must match the order of KnownAtom
+    const char* knownAtoms[] = {
+        "", "scxml", "state", "final", "transition", "onentry", "onexit", "datamodel", "data",
+        "log", "raise", "send", "script", "assign", "cancel", "if", "foreach"
+    };
+    for (unsigned int pos=0; pos<sizeof(knownAtoms)/sizeof(knownAtoms[0]); pos++) {
+        Intern(QString::fromLatin1(knownAtoms[pos]));
+    }
+}
+
+SCXMLAtomTable::~SCXMLAtomTable()
+{
+    for (int chunk=0; chunk<MAX_CHUNKS; chunk++) {
+        delete[] mChunks[chunk].load();
+    }
+    delete mIndex.load();
+    qDeleteAll(mRetiredIndexes);
+}
+
+SCXMLAtomTable* SCXMLAtomTable::Instance()
+{
+    static SCXMLAtomTable instance;
+    return &instance;
+}
+
+//!
+//! \brief SCXMLAtomTable::Intern
+//!
+//! The string is written before the count and the index slot that publish it, each stored
+//! with release ordering, so a reader that sees the atom also sees its string.
+//!
+SCXMLAtom SCXMLAtomTable::Intern(const QString &text)
+{
+    SCXMLAtom atom = Find(text);
+    if (atom != ATOM_INVALID) return atom;
+
+    QMutexLocker locker(&mWriteLock);
+
+    // another thread may have added it since the lookup
+    atom = Find(text);
+    if (atom != ATOM_INVALID) return atom;
+
+    atom = mCount.load();
+    int chunk = atom >> CHUNK_BITS;
+    if (chunk >= MAX_CHUNKS) {
+        qFatal("Too many strings interned");
+    }
+    if (mChunks[chunk].load() == nullptr) {
+        mChunks[chunk].store(new QString[CHUNK_SIZE]);
+    }
+    mChunks[chunk].load()[atom & (CHUNK_SIZE - 1)] = text;
+    mCount.storeRelease(atom + 1);
+
+    AtomIndex* index = mIndex.load();
+    if ((atom + 1) * 2 > index->mask + 1) {
+        AtomIndex* grownIndex = new AtomIndex((index->mask + 1) * 2);
+        for (SCXMLAtom pos=0; pos<=atom; pos++) {
+            AddToIndex(grownIndex, StringAt(pos), pos);
+        }
+        mIndex.storeRelease(grownIndex);
+        mRetiredIndexes.append(index);
+    }
+    else {
+        AddToIndex(index, text, atom);
+    }
+    return atom;
+}
+
+SCXMLAtom SCXMLAtomTable::Intern(const QStringRef &text)
+{
+    // only copy the text when it is new
+    SCXMLAtom atom = Find(text);
+    if (atom != ATOM_INVALID) return atom;
+    return Intern(text.toString());
+}
+
+void SCXMLAtomTable::AddToIndex(AtomIndex *index, const QString &text, SCXMLAtom atom)
+{
+    int pos = int(qHash(text) & uint(index->mask));
+    while (index->slots[pos].load() != 0) {
+        pos = (pos + 1) & index->mask;
+    }
+    index->slots[pos].storeRelease(atom + 1);
+}
+
+SCXMLAtom SCXMLAtomTable::Find(const QString &text) const
+{
+    const AtomIndex* index = mIndex.loadAcquire();
+    for (int pos=int(qHash(text) & uint(index->mask)); ; pos = (pos + 1) & index->mask) {
+        int slot = index->slots[pos].loadAcquire();
+        if (slot == 0) return ATOM_INVALID;
+        if (StringAt(slot - 1) == text) return slot - 1;
+    }
+}
+
+SCXMLAtom SCXMLAtomTable::Find(const QStringRef &text) const
+{
+    // look up without copying the characters
+    QString key = QString::fromRawData(text.unicode(), text.length());
+    return Find(key);
+}
+
+const QString& SCXMLAtomTable::GetString(SCXMLAtom atom) const
+{
+    // the strings below the published count are never written again
+    if (atom < 0 || atom >= mCount.loadAcquire()) {
+        static const QString emptyString;
+        return emptyString;
+    }
+    return StringAt(atom);
+}
+
+int SCXMLAtomTable::GetCount() const
+{
+    return mCount.loadAcquire();
+}
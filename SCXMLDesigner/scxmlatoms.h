@@ -0,0 +1,107 @@
+#ifndef SCXMLATOMS_H
+#define SCXMLATOMS_H
+
+#include <QString>
+#include <QStringRef>
+#include <QHash>
+#include <QVector>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QMutex>
+
+//! Compact identifier of an interned string, equal atoms mean equal strings
+typedef int SCXMLAtom;
+
+//! Interning pool shared by all workflows
+//!
+//! State ids, event names and SCXML tag names are interned when a workflow is loaded so they
+//! can be compared as integers, and a name repeated across workflows is held only once. The
+//! pool is thread safe and atoms are never released. Only adding a string takes a lock, so
+//! reading the string of an atom while charts run on several threads costs no more than an
+//! array lookup.
+class SCXMLAtomTable
+{
+public:
+    //! Well known atoms, interned in this order when the pool is created
+    enum KnownAtom {
+        ATOM_INVALID = -1,
+        ATOM_EMPTY = 0,
+        ATOM_SCXML,
+        ATOM_STATE,
+        ATOM_FINAL,
+        ATOM_TRANSITION,
+        ATOM_ONENTRY,
+        ATOM_ONEXIT,
+        ATOM_DATAMODEL,
+        ATOM_DATA,
+        ATOM_LOG,
+        ATOM_RAISE,
+        ATOM_SEND,
+        ATOM_SCRIPT,
+        ATOM_ASSIGN,
+        ATOM_CANCEL,
+        ATOM_IF,
+        ATOM_FOREACH
+    };
+
+    //! Gets the pool shared by all workflows
+    static SCXMLAtomTable* Instance();
+
+    //! Gets the atom for the text, adding it to the pool if needed
+    SCXMLAtom Intern(const QString& text);
+    SCXMLAtom Intern(const QStringRef& text);
+
+    //! Gets the atom for the text if it has been interned, ATOM_INVALID otherwise
+    SCXMLAtom Find(const QString& text) const;
+    SCXMLAtom Find(const QStringRef& text) const;
+
+    //! Gets the interned string for an atom, the string data is shared by all users. The
+    //! string is never moved or changed, so the reference stays valid
+    const QString& GetString(SCXMLAtom atom) const;
+
+    //! Gets the number of interned strings
+    int GetCount() const;
+
+private:
+    SCXMLAtomTable();
+    ~SCXMLAtomTable();
+    Q_DISABLE_COPY(SCXMLAtomTable)
+
+    //! Open addressing hash of the atoms by string, each slot holds an atom + 1, or 0 if it is
+    //! empty. It is kept at most half full, so a lookup always reaches an empty slot
+    struct AtomIndex {
+        explicit AtomIndex(int size) : mask(size - 1), slots(new QAtomicInt[size]) {}
+        ~AtomIndex() { delete[] slots; }
+
+        int mask;
+        QAtomicInt* slots;
+    };
+
+    //! Gets the string of an atom below the published count
+    const QString& StringAt(SCXMLAtom atom) const {
+        return mChunks[atom >> CHUNK_BITS].load()[atom & (CHUNK_SIZE - 1)];
+    }
+
+    //! Publishes an atom in an index with an empty slot for it
+    static void AddToIndex(AtomIndex* index, const QString& text, SCXMLAtom atom);
+
+    // the strings are held in chunks that are never moved, so a string can be read while
+    // others are added. The count is published once the string and its chunk are written
+    static const int CHUNK_BITS = 12;
+    static const int CHUNK_SIZE = 1 << CHUNK_BITS;
+    static const int MAX_CHUNKS = 8192;
+    QAtomicPointer<QString> mChunks[MAX_CHUNKS];
+    QAtomicInt mCount;
+    // replaced by a larger copy as it fills, the old ones are kept as readers may be using them
+    QAtomicPointer<AtomIndex> mIndex;
+    QVector<AtomIndex*> mRetiredIndexes;
+    //! Held while a string is added
+    QMutex mWriteLock;
+};
+
+//! Shorthand for interning with the shared pool
+inline SCXMLAtom SCXMLIntern(const QString& text) { return SCXMLAtomTable::Instance()->Intern(text); }
+inline SCXMLAtom SCXMLIntern(const QStringRef& text) { return SCXMLAtomTable::Instance()->Intern(text); }
+inline const QString& SCXMLAtomString(SCXMLAtom atom) { return SCXMLAtomTable::Instance()->GetString(atom); }
+
+#endif // SCXMLATOMS_H
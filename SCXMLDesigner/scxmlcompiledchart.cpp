@@ -0,0 +1,487 @@
+#include <limits>
+#include <QDebug>
+#include <QStringList>
+#include "scxmlcompiledchart.h"
+
+SCXMLCompiledChart::SCXMLCompiledChart()
+{
+}
+
+//!
+//! \brief SCXMLCompiledChart::Compile
+//!
+//! The states are renumbered so each state is followed by its descendants, whatever order
+//! the model holds them in, then the transitions are grouped by their source state.
+//!
+bool SCXMLCompiledChart::Compile(const WorkflowModel &model)
+{
+    mName = model.name;
+    mErrorString.clear();
+    mStates.clear();
+    mTransitions.clear();
+    mDescriptors.clear();
+    mCode.clear();
+    mStrings.clear();
+    mData.clear();
+    mDataIndex.clear();
+    mExpressions.Clear();
+    mStateIndex.clear();
+    mDispatch.clear();
+    mDescriptorEvents.clear();
+    if (model.states.isEmpty()) {
+        mErrorString = "The workflow has no states";
+        return false;
+    }
+
+    QVector<QList<int> > children(model.states.count() + 1);
+    for (int statePos=0; statePos<model.states.count(); statePos++) {
+        children[model.states.at(statePos).parentIndex + 1].append(statePos);
+    }
+
+    State root;
+    root.id = SCXMLAtomTable::ATOM_SCXML;
+    mStates.reserve(model.states.count() + 1);
+    mStates.append(root);
+    QVector<int> compiledIndexes(model.states.count(), -1);
+    foreach (int topLevelState, children.at(0)) {
+        AddState(model, children, topLevelState, 0, compiledIndexes);
+    }
+    mStates[0].lastDescendant = mStates.count() - 1;
+
+    // compiled once all the states are numbered, so In() can refer to any of them
+    AddData(model);
+    for (int statePos=0; statePos<model.states.count(); statePos++) {
+        State& state = mStates[compiledIndexes.at(statePos)];
+        state.onEntry = AddActions(model.states.at(statePos).onEntry);
+        state.onExit = AddActions(model.states.at(statePos).onExit);
+    }
+
+    // the initial state may be nested anywhere, otherwise it is the first top level state
+    int initial = model.initialStateName.isEmpty() ? -1 : FindState(SCXMLIntern(model.initialStateName));
+    mStates[0].initial = (initial > 0) ? initial : 1;
+
+    QVector<QList<int> > transitionsBySource(mStates.count());
+    for (int transitionPos=0; transitionPos<model.transitions.count(); transitionPos++) {
+        int sourceIndex = model.transitions.at(transitionPos).sourceIndex;
+        if (sourceIndex < 0 || sourceIndex >= compiledIndexes.count()) continue;
+        transitionsBySource[compiledIndexes.at(sourceIndex)].append(transitionPos);
+    }
+    mTransitions.reserve(model.transitions.count());
+    for (int statePos=0; statePos<mStates.count(); statePos++) {
+        mStates[statePos].transitions.first = mTransitions.count();
+        foreach (int transitionPos, transitionsBySource.at(statePos)) {
+            const WorkflowTransitionModel& transitionModel = model.transitions.at(transitionPos);
+            Transition transition;
+            transition.source = statePos;
+            if (transitionModel.target != SCXMLAtomTable::ATOM_EMPTY) {
+                transition.target = FindState(transitionModel.target);
+                if (transition.target < 0) {
+                    qDebug() << "Transition target not found:" << SCXMLAtomString(transitionModel.target);
+                    continue;
+                }
+            }
+            transition.internal = (transitionModel.type == "internal");
+            if (!transitionModel.cond.isEmpty()) {
+                transition.cond = AddExpression(transitionModel.cond);
+            }
+            transition.descriptors = AddDescriptors(transitionModel.event);
+            transition.actions = AddActions(transitionModel.content);
+            mTransitions.append(transition);
+            AddDispatch(mTransitions.count() - 1);
+        }
+        mStates[statePos].transitions.count = mTransitions.count() - mStates.at(statePos).transitions.first;
+    }
+    return true;
+}
+
+int SCXMLCompiledChart::FindState(SCXMLAtom id) const
+{
+    return mStateIndex.value(id, -1);
+}
+
+//!
+//! \brief SCXMLCompiledChart::AddData
+//!
+//! A nested data item is a slot of its own, found by its path from the top level item, e.g.
+//! parameters.first, so reading it is as quick as reading a top level item. The item it is
+//! nested in keeps a slot too, for its own expr.
+//!
+void SCXMLCompiledChart::AddData(const WorkflowModel &model)
+{
+    QVector<QString> paths;
+    QVector<int> itemSlots;
+    foreach (const WorkflowDataItemModel& item, model.dataItems) {
+        QString path = (item.parent >= 0) ? paths.at(item.parent) + "." + item.id : item.id;
+        paths.append(path);
+        int slot = mDataIndex.value(path, -1);
+        if (slot >= 0) {
+            qDebug() << "Data id repeated:" << path;
+        }
+        else {
+            Data data;
+            data.id = SCXMLIntern(path);
+            data.parent = (item.parent >= 0) ? itemSlots.at(item.parent) : -1;
+            slot = mData.count();
+            mDataIndex.insert(path, slot);
+            mData.append(data);
+        }
+        itemSlots.append(slot);
+    }
+
+    // the initial values may refer to any data
+    for (int itemPos=0; itemPos<model.dataItems.count(); itemPos++) {
+        const WorkflowDataItemModel& item = model.dataItems.at(itemPos);
+        Data& data = mData[itemSlots.at(itemPos)];
+        if (!item.expr.isEmpty() && data.expr < 0) {
+            data.expr = AddExpression(item.expr);
+        }
+    }
+}
+
+int SCXMLCompiledChart::AddExpression(const QString &text)
+{
+    int expression = mExpressions.Compile(text,
+        [this](const QString& path) { return FindData(path); },
+        [this](const QString& id) { return FindState(SCXMLAtomTable::Instance()->Find(id)); });
+    if (!mExpressions.IsValid(expression)) {
+        qDebug() << "Expression" << text << "does not compile:" << mExpressions.GetError(expression);
+    }
+    return expression;
+}
+
+//!
+//! \brief SCXMLCompiledChart::GetMatchingDescriptors
+//!
+//! A descriptor matches an event it equals, or that it is a prefix of up to a dot, so only
+//! the prefixes of the event at each dot need be looked up. Those that are not descriptors
+//! of any transition are left out.
+//!
+void SCXMLCompiledChart::GetMatchingDescriptors(SCXMLAtom event, QVector<SCXMLAtom> &descriptors) const
+{
+    descriptors.clear();
+    QString name = SCXMLAtomString(event);
+    SCXMLAtomTable* atoms = SCXMLAtomTable::Instance();
+    for (int dotPos=name.indexOf('.'); dotPos>=0; dotPos=name.indexOf('.', dotPos + 1)) {
+        SCXMLAtom prefix = atoms->Find(name.leftRef(dotPos));
+        if (mDescriptorEvents.contains(prefix)) {
+            descriptors.append(prefix);
+        }
+    }
+    if (mDescriptorEvents.contains(event)) {
+        descriptors.append(event);
+    }
+}
+
+void SCXMLCompiledChart::AddState(const WorkflowModel &model, const QVector<QList<int> > &children, int modelIndex, int parent,
+                                  QVector<int> &compiledIndexes)
+{
+    const WorkflowStateModel& stateModel = model.states.at(modelIndex);
+    int index = mStates.count();
+    compiledIndexes[modelIndex] = index;
+    mStateIndex.insert(stateModel.id, index);
+
+    State state;
+    state.id = stateModel.id;
+    state.parent = parent;
+    state.depth = mStates.at(parent).depth + 1;
+    state.final = stateModel.final;
+    if (state.final && parent != 0) {
+        state.doneEvent = SCXMLIntern("done.state." + SCXMLAtomString(mStates.at(parent).id));
+    }
+    mStates.append(state);
+
+    const QList<int>& nestedStates = children.at(modelIndex + 1);
+    foreach (int nestedState, nestedStates) {
+        AddState(model, children, nestedState, index, compiledIndexes);
+    }
+    mStates[index].lastDescendant = mStates.count() - 1;
+    if (!nestedStates.isEmpty()) {
+        mStates[index].initial = index + 1;
+    }
+}
+
+int SCXMLCompiledChart::GetInstructionLength(Opcode opcode)
+{
+    switch (opcode) {
+    case OP_SEND_DELAYED:
+        return 5;
+    case OP_LOG:
+    case OP_JUMP_UNLESS:
+    case OP_ASSIGN:
+    case OP_CANCEL:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+bool SCXMLCompiledChart::ParseDelay(const QString &text, qint64 &delay)
+{
+    QString time = text.trimmed();
+    double scale = 1;
+    if (time.endsWith("ms")) {
+        time.chop(2);
+    }
+    else if (time.endsWith('s')) {
+        time.chop(1);
+        scale = 1000;
+    }
+    else {
+        return false;
+    }
+    bool ok = false;
+    double value = time.toDouble(&ok);
+    if (!ok || value < 0 || time.startsWith('+')) return false;
+    delay = qint64(value * scale + 0.5);
+    return true;
+}
+
+SCXMLCompiledChart::Range SCXMLCompiledChart::AddActions(SCXMLExecutableContent *content)
+{
+    Range range;
+    range.first = mCode.count();
+    if (content != nullptr) {
+        CompileActions(content);
+    }
+    range.count = mCode.count() - range.first;
+    return range;
+}
+
+//!
+//! \brief SCXMLCompiledChart::CompileActions
+//!
+//! Scripts and foreach are not supported, so they raise error.execution as SCXML does when an
+//! expression cannot be evaluated.
+//!
+void SCXMLCompiledChart::CompileActions(SCXMLExecutableContent *content)
+{
+    SCXMLAtom errorExecution = SCXMLIntern(QString("error.execution"));
+    foreach (SCXMLExecutableActionBase* action, content->GetActions()) {
+        switch (action->GetActionType()) {
+        case SCXMLExecutableActionBase::ACTION_LOG: {
+            SCXMLLog* log = static_cast<SCXMLLog*>(action);
+            mCode.append(OP_LOG);
+            mCode.append(AddString(log->GetLabel()));
+            mCode.append(AddString(log->GetExpr()));
+            break;
+        }
+        case SCXMLExecutableActionBase::ACTION_RAISE: {
+            QString event = static_cast<SCXMLElementAction*>(action)->GetElement().GetAttribute(XMLUtilities::SCXML_TAG_EVENT);
+            if (event.isEmpty()) {
+                AddInstruction(OP_FAIL, errorExecution);
+            }
+            else {
+                AddInstruction(OP_RAISE, SCXMLIntern(event));
+            }
+            break;
+        }
+        case SCXMLExecutableActionBase::ACTION_SEND:
+            CompileSend(static_cast<SCXMLElementAction*>(action)->GetElement());
+            break;
+        case SCXMLExecutableActionBase::ACTION_IF:
+            CompileIf(static_cast<SCXMLIf*>(action));
+            break;
+        case SCXMLExecutableActionBase::ACTION_ASSIGN:
+            CompileAssign(static_cast<SCXMLElementAction*>(action)->GetElement());
+            break;
+        case SCXMLExecutableActionBase::ACTION_CANCEL:
+            CompileCancel(static_cast<SCXMLElementAction*>(action)->GetElement());
+            break;
+        case SCXMLExecutableActionBase::ACTION_SCRIPT:
+        case SCXMLExecutableActionBase::ACTION_FOREACH:
+            AddInstruction(OP_FAIL, errorExecution);
+            break;
+        case SCXMLExecutableActionBase::ACTION_CONTENT:
+            CompileActions(static_cast<SCXMLExecutableContent*>(action));
+            break;
+        }
+    }
+}
+
+//!
+//! \brief SCXMLCompiledChart::CompileIf
+//!
+//! Each branch tests its condition and jumps to the next if it is not met. The branches
+//! after the else are left out.
+//!
+void SCXMLCompiledChart::CompileIf(SCXMLIf *action)
+{
+    QList<int> endJumps;
+    const QList<SCXMLIf::Branch>& branches = action->GetBranches();
+    for (int branchPos=0; branchPos<branches.count(); branchPos++) {
+        const SCXMLIf::Branch& branch = branches.at(branchPos);
+        int nextJump = branch.isElse ? -1 : AddJump(OP_JUMP_UNLESS, AddExpression(branch.cond));
+        CompileActions(branch.content);
+        if (nextJump < 0) break;
+        if (branchPos < branches.count() - 1) {
+            endJumps.append(AddJump(OP_JUMP));
+        }
+        SetJumpTarget(nextJump);
+    }
+    foreach (int endJump, endJumps) {
+        SetJumpTarget(endJump);
+    }
+}
+
+//!
+//! \brief SCXMLCompiledChart::CompileSend
+//!
+//! Events only carry their name, so the params, namelist and content of a send are not
+//! used. A send that needs the event, target or type evaluated, or its id stored, raises
+//! error.execution, one to a target other than this session raises error.communication. A
+//! delayed send goes to the external queue when it fires, so one to #_internal raises
+//! error.execution too. A delay of 0 is an ordinary send, unless it has an id to cancel.
+//!
+void SCXMLCompiledChart::CompileSend(const SCXMLActionElement &element)
+{
+    SCXMLAtom errorExecution = SCXMLIntern(QString("error.execution"));
+    QString event = element.GetAttribute(XMLUtilities::SCXML_TAG_EVENT);
+    QString target = element.GetAttribute(XMLUtilities::SCXML_TAG_TARGET);
+    QString type = element.GetAttribute(XMLUtilities::SCXML_TAG_TYPE);
+    QString id = element.GetAttribute(XMLUtilities::SCXML_TAG_ID);
+    if (event.isEmpty() || element.HasAttribute(XMLUtilities::SCXML_TAG_EVENTEXPR) ||
+            element.HasAttribute(XMLUtilities::SCXML_TAG_TARGETEXPR) ||
+            element.HasAttribute(XMLUtilities::SCXML_TAG_TYPEEXPR) ||
+            element.HasAttribute(XMLUtilities::SCXML_TAG_IDLOCATION) ||
+            (!type.isEmpty() && type != "http://www.w3.org/TR/scxml/#SCXMLEventProcessor" && type != "scxml")) {
+        AddInstruction(OP_FAIL, errorExecution);
+        return;
+    }
+
+    qint64 delay = 0;
+    int delayExpr = -1;
+    if (element.HasAttribute(XMLUtilities::SCXML_TAG_DELAYEXPR)) {
+        delayExpr = AddExpression(element.GetAttribute(XMLUtilities::SCXML_TAG_DELAYEXPR));
+    }
+    else if (element.HasAttribute(XMLUtilities::SCXML_TAG_DELAY) &&
+             !ParseDelay(element.GetAttribute(XMLUtilities::SCXML_TAG_DELAY), delay)) {
+        qDebug() << "Unsupported send delay" << element.GetAttribute(XMLUtilities::SCXML_TAG_DELAY);
+        AddInstruction(OP_FAIL, errorExecution);
+        return;
+    }
+
+    if (!target.isEmpty() && target != "#_internal") {
+        AddInstruction(OP_FAIL, SCXMLIntern(QString("error.communication")));
+    }
+    else if (delay > 0 || delayExpr >= 0 || !id.isEmpty()) {
+        if (!target.isEmpty()) {
+            AddInstruction(OP_FAIL, errorExecution);
+            return;
+        }
+        mCode.append(OP_SEND_DELAYED);
+        mCode.append(SCXMLIntern(event));
+        mCode.append(qint32(qMin(delay, qint64(std::numeric_limits<qint32>::max()))));
+        mCode.append(delayExpr);
+        mCode.append(id.isEmpty() ? SCXMLAtom(SCXMLAtomTable::ATOM_INVALID) : SCXMLIntern(id));
+    }
+    else if (target.isEmpty()) {
+        AddInstruction(OP_SEND, SCXMLIntern(event));
+    }
+    else {
+        AddInstruction(OP_RAISE, SCXMLIntern(event));
+    }
+}
+
+void SCXMLCompiledChart::CompileCancel(const SCXMLActionElement &element)
+{
+    mCode.append(OP_CANCEL);
+    if (element.HasAttribute(XMLUtilities::SCXML_TAG_SENDIDEXPR)) {
+        mCode.append(SCXMLAtomTable::ATOM_INVALID);
+        mCode.append(AddExpression(element.GetAttribute(XMLUtilities::SCXML_TAG_SENDIDEXPR)));
+    }
+    else {
+        mCode.append(SCXMLIntern(element.GetAttribute(XMLUtilities::SCXML_TAG_SENDID)));
+        mCode.append(-1);
+    }
+}
+
+//!
+//! \brief SCXMLCompiledChart::CompileAssign
+//!
+//! The location must be a data id, content in place of an expr is not supported.
+//!
+void SCXMLCompiledChart::CompileAssign(const SCXMLActionElement &element)
+{
+    int slot = FindData(element.GetAttribute(XMLUtilities::SCXML_TAG_LOCATION).trimmed());
+    if (slot < 0 || !element.HasAttribute(XMLUtilities::SCXML_TAG_EXPR)) {
+        qDebug() << "Unsupported assign to" << element.GetAttribute(XMLUtilities::SCXML_TAG_LOCATION);
+        AddInstruction(OP_FAIL, SCXMLIntern(QString("error.execution")));
+        return;
+    }
+    mCode.append(OP_ASSIGN);
+    mCode.append(slot);
+    mCode.append(AddExpression(element.GetAttribute(XMLUtilities::SCXML_TAG_EXPR)));
+}
+
+int SCXMLCompiledChart::AddJump(Opcode opcode, int expr)
+{
+    mCode.append(opcode);
+    if (opcode == OP_JUMP_UNLESS) {
+        mCode.append(expr);
+    }
+    mCode.append(-1);
+    return mCode.count() - 1;
+}
+
+void SCXMLCompiledChart::AddInstruction(Opcode opcode, qint32 operand)
+{
+    mCode.append(opcode);
+    mCode.append(operand);
+}
+
+int SCXMLCompiledChart::AddString(const QString &text)
+{
+    mStrings.append(text);
+    return mStrings.count() - 1;
+}
+
+SCXMLCompiledChart::Range SCXMLCompiledChart::AddDescriptors(const QString &event)
+{
+    Range range;
+    range.first = mDescriptors.count();
+    foreach (QString text, event.split(' ', QString::SkipEmptyParts)) {
+        EventDescriptor descriptor;
+        if (text == "*") {
+            descriptor.wildcard = true;
+        }
+        else {
+            // error.* and error. are both the same descriptor as error
+            if (text.endsWith(".*")) text.chop(2);
+            if (text.endsWith('.')) text.chop(1);
+            descriptor.event = SCXMLIntern(text);
+            mDescriptorEvents.insert(descriptor.event);
+        }
+        mDescriptors.append(descriptor);
+    }
+    range.count = mDescriptors.count() - range.first;
+    return range;
+}
+
+//!
+//! \brief SCXMLCompiledChart::AddDispatch
+//!
+//! The transitions are added in document order, so each entry keeps the first transition of
+//! the state with the descriptor, which is the one SCXML selects.
+//!
+void SCXMLCompiledChart::AddDispatch(int transitionIndex)
+{
+    const Transition& transition = mTransitions.at(transitionIndex);
+    State& source = mStates[transition.source];
+    if (transition.descriptors.count == 0) {
+        if (source.firstEventless < 0) source.firstEventless = transitionIndex;
+        return;
+    }
+
+    int end = transition.descriptors.first + transition.descriptors.count;
+    for (int descriptorPos=transition.descriptors.first; descriptorPos<end; descriptorPos++) {
+        const EventDescriptor& descriptor = mDescriptors.at(descriptorPos);
+        if (descriptor.wildcard) {
+            if (source.firstWildcard < 0) source.firstWildcard = transitionIndex;
+            continue;
+        }
+        quint64 key = GetDispatchKey(transition.source, descriptor.event);
+        if (!mDispatch.contains(key)) {
+            mDispatch.insert(key, transitionIndex);
+        }
+    }
+}
@@ -0,0 +1,230 @@
+#ifndef SCXMLCOMPILEDCHART_H
+#define SCXMLCOMPILEDCHART_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include "scxmlatoms.h"
+#include "scxmlexecutablecontent.h"
+#include "scxmlexpressions.h"
+#include "workflowmodel.h"
+
+//! A workflow compiled into flat tables for execution (see SCXMLEngine)
+//!
+//! The states, transitions and executable content are held in contiguous arrays and refer to
+//! each other by index. State 0 is the scxml element itself. The states are numbered in
+//! document order, so the descendants of a state are the states that follow it up to its
+//! lastDescendant. The transitions of a state are contiguous and in document order. The
+//! executable content of each onentry, onexit and transition is compiled into a run of
+//! instructions in a single code buffer, with event names, states and jumps resolved to
+//! atoms and indexes, so running it is a linear scan. The datamodel is a vector of slots,
+//! one for each data id, nested data by its dotted path, and the expr and cond expressions are
+//! compiled against it (see SCXMLExpressions). The event descriptors of the transitions are compiled into
+//! a dispatch table keyed by state and descriptor, so finding the transition a state takes
+//! for an event does not depend on how many transitions it has. Once compiled the chart is
+//! not changed, so it can be shared by any number of engines on any thread.
+class SCXMLCompiledChart
+{
+public:
+    //! Where a run of a table starts and how long it is
+    struct Range {
+        Range() : first(0), count(0) {}
+
+        int first;
+        int count;
+    };
+
+    struct State {
+        State() : id(SCXMLAtomTable::ATOM_EMPTY), parent(-1), lastDescendant(0), depth(0), initial(-1),
+            final(false), doneEvent(SCXMLAtomTable::ATOM_INVALID), firstEventless(-1), firstWildcard(-1) {}
+
+        SCXMLAtom id;
+        //! -1 for the scxml element
+        int parent;
+        int lastDescendant;
+        //! 0 for the scxml element, 1 for a top level state
+        int depth;
+        //! The descendant entered with the state, -1 for an atomic state
+        int initial;
+        bool final;
+        //! The event raised when the state is entered, done.state.<parent id> for a final
+        //! state, ATOM_INVALID otherwise
+        SCXMLAtom doneEvent;
+        //! The first transition without an event, -1 if there is none
+        int firstEventless;
+        //! The first transition with the * descriptor, -1 if there is none
+        int firstWildcard;
+        Range transitions;
+        Range onEntry;
+        Range onExit;
+    };
+
+    struct Transition {
+        Transition() : source(0), target(-1), internal(false), cond(-1) {}
+
+        int source;
+        //! -1 for a targetless transition
+        int target;
+        bool internal;
+        //! The guard, an index into the expressions, -1 if there is none
+        int cond;
+        //! The event descriptors, none for an eventless transition
+        Range descriptors;
+        Range actions;
+    };
+
+    //! One descriptor of the event attribute of a transition, e.g. error.send for "error.send.*"
+    struct EventDescriptor {
+        EventDescriptor() : event(SCXMLAtomTable::ATOM_EMPTY), wildcard(false) {}
+
+        //! The descriptor without any trailing .*
+        SCXMLAtom event;
+        //! Set for *, which matches every event
+        bool wildcard;
+    };
+
+    //! A slot of the datamodel
+    struct Data {
+        Data() : id(SCXMLAtomTable::ATOM_EMPTY), parent(-1), expr(-1) {}
+
+        //! The path of the data, e.g. parameters.first for first nested in parameters
+        SCXMLAtom id;
+        //! The slot of the data it is nested in, -1 for a top level item
+        int parent;
+        //! The initial value, an index into the expressions, -1 if there is none
+        int expr;
+    };
+
+    //! An instruction is its opcode followed by its operands
+    enum Opcode {
+        //! label, expr: passes the strings to the log callback
+        OP_LOG,
+        //! event: places the event on the internal queue
+        OP_RAISE,
+        //! event: places the event on the external queue
+        OP_SEND,
+        //! event, delay, delayExpr, sendid: hands the event to the engine's timers to send to
+        //! the session after the delay in ms, or after the value of the expression if it is not
+        //! -1. sendid is ATOM_INVALID for a send without an id
+        OP_SEND_DELAYED,
+        //! sendid, sendidExpr: cancels the delayed send with the id, or with the value of the
+        //! expression if it is not -1
+        OP_CANCEL,
+        //! target: goes on from the code index
+        OP_JUMP,
+        //! expr, target: goes on from the code index unless the expression is true. If it fails
+        //! error.execution is raised and it is taken as false
+        OP_JUMP_UNLESS,
+        //! slot, expr: sets the slot to the value of the expression, or fails as OP_FAIL does
+        OP_ASSIGN,
+        //! event: places the error event on the internal queue and ends the block, for an
+        //! action the engine cannot run
+        OP_FAIL
+    };
+
+    SCXMLCompiledChart();
+
+    //! Compiles the chart from a model, replacing anything compiled before. Transitions to a
+    //! state that does not exist are left out. Returns false if the model has no states
+    bool Compile(const WorkflowModel& model);
+
+    QString GetName() const { return mName; }
+    QString GetErrorString() const { return mErrorString; }
+
+    int GetStateCount() const { return mStates.count(); }
+    int GetTransitionCount() const { return mTransitions.count(); }
+
+    const State& GetState(int index) const { return mStates.at(index); }
+    const Transition& GetTransition(int index) const { return mTransitions.at(index); }
+    const EventDescriptor& GetDescriptor(int index) const { return mDescriptors.at(index); }
+    const QString& GetString(int index) const { return mStrings.at(index); }
+
+    int GetDataCount() const { return mData.count(); }
+    const Data& GetData(int slot) const { return mData.at(slot); }
+    const SCXMLExpressions& GetExpressions() const { return mExpressions; }
+
+    //! Gets the slot of a data id or path, -1 if there is none
+    int FindData(const QString& id) const { return mDataIndex.value(id, -1); }
+
+    //! Direct access to the tables, for the engine's inner loops
+    const State* GetStates() const { return mStates.constData(); }
+    const Transition* GetTransitions() const { return mTransitions.constData(); }
+    const qint32* GetCode() const { return mCode.constData(); }
+
+    //! Gets the number of code entries an instruction takes, with its operands
+    static int GetInstructionLength(Opcode opcode);
+
+    //! Parses a CSS2 time, e.g. 500ms or 2.5s, into ms. Returns false if it is not one
+    static bool ParseDelay(const QString& text, qint64& delay);
+
+    //! Gets the index of the state with the id, -1 if there is none
+    int FindState(SCXMLAtom id) const;
+
+    //! Gets the first transition of the state with the descriptor, -1 if there is none
+    int FindTransition(int state, SCXMLAtom descriptor) const {
+        return mDispatch.value(GetDispatchKey(state, descriptor), -1);
+    }
+
+    //! Gets the descriptors of the chart that match an event, e.g. done, done.invoke and
+    //! done.invoke.adder for done.invoke.adder. The * descriptor is not included
+    void GetMatchingDescriptors(SCXMLAtom event, QVector<SCXMLAtom>& descriptors) const;
+
+    //! Checks whether a state is the given ancestor or one of its descendants
+    bool IsDescendantOrSelf(int state, int ancestor) const {
+        return state >= ancestor && state <= mStates.at(ancestor).lastDescendant;
+    }
+
+private:
+    //! Adds a slot for each data id or path, then compiles the initial values
+    void AddData(const WorkflowModel& model);
+
+    //! Compiles an expr or cond, logging why if it does not compile
+    int AddExpression(const QString& text);
+
+    //! Numbers the state and its descendants in document order, children holds the nested
+    //! states of each model state (offset by one, the top level states first)
+    void AddState(const WorkflowModel& model, const QVector<QList<int> >& children, int modelIndex, int parent,
+                  QVector<int>& compiledIndexes);
+
+    //! Compiles the executable content, returns where its instructions are
+    Range AddActions(SCXMLExecutableContent* content);
+    void CompileActions(SCXMLExecutableContent* content);
+    void CompileIf(SCXMLIf* action);
+    void CompileSend(const SCXMLActionElement& element);
+    void CompileCancel(const SCXMLActionElement& element);
+    void CompileAssign(const SCXMLActionElement& element);
+
+    //! Appends a jump whose target is set later with SetJumpTarget, returns where the
+    //! target goes. OP_JUMP_UNLESS takes the expression
+    int AddJump(Opcode opcode, int expr = -1);
+    void SetJumpTarget(int targetPos) { mCode[targetPos] = mCode.count(); }
+    void AddInstruction(Opcode opcode, qint32 operand);
+    int AddString(const QString& text);
+
+    //! Splits the event attribute of a transition into its descriptors
+    Range AddDescriptors(const QString& event);
+
+    //! Adds a transition to the dispatch table of its source state
+    void AddDispatch(int transition);
+
+    static quint64 GetDispatchKey(int state, SCXMLAtom descriptor) {
+        return (quint64(quint32(state)) << 32) | quint32(descriptor);
+    }
+
+    QString mName;
+    QString mErrorString;
+    QVector<State> mStates;
+    QVector<Transition> mTransitions;
+    QVector<EventDescriptor> mDescriptors;
+    QVector<qint32> mCode;
+    QVector<QString> mStrings;
+    QVector<Data> mData;
+    QHash<QString, int> mDataIndex;
+    SCXMLExpressions mExpressions;
+    QHash<SCXMLAtom, int> mStateIndex;
+    QHash<quint64, int> mDispatch;
+    QSet<SCXMLAtom> mDescriptorEvents;
+};
+
+#endif // SCXMLCOMPILEDCHART_H
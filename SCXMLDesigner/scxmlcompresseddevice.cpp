@@ -0,0 +1,226 @@
+#include <QDebug>
+#include <QBuffer>
+#include <QFileInfo>
+#include <QtEndian>
+#include "scxmlcompresseddevice.h"
+
+// SCXML compressed in each frame, large enough for the dictionary to find the repeats of
+// the META-DATA comments, transitions and data items
+#define FRAME_SIZE (256 * 1024)
+
+// no frame written is near this size, a larger length is a corrupt container
+#define MAX_COMPRESSED_FRAME_SIZE (64 * 1024 * 1024)
+
+const quint32 SCXMLCompressedDevice::MAGIC = 0x5343585A;   // "SCXZ"
+const quint32 SCXMLCompressedDevice::VERSION = 1;
+
+SCXMLCompressedDevice::SCXMLCompressedDevice(QIODevice *device, QObject *parent) :
+    QIODevice(parent), mDevice(device), mFramePos(0), mEnded(false), mError(false)
+{
+}
+
+SCXMLCompressedDevice::~SCXMLCompressedDevice()
+{
+    close();
+}
+
+bool SCXMLCompressedDevice::IsCompressed(const QByteArray &data)
+{
+    if (data.size() < 4) return false;
+    return qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data.constData())) == MAGIC;
+}
+
+bool SCXMLCompressedDevice::IsCompressedFilename(QString filename)
+{
+    return QFileInfo(filename).suffix().compare("scxmlz", Qt::CaseInsensitive) == 0;
+}
+
+bool SCXMLCompressedDevice::Decompress(const QByteArray &data, QByteArray &scxml)
+{
+    QByteArray source = data;
+    QBuffer buffer(&source);
+    buffer.open(QIODevice::ReadOnly);
+    SCXMLCompressedDevice device(&buffer);
+    if (!device.open(QIODevice::ReadOnly)) return false;
+    scxml = device.readAll();
+    return !device.HasError();
+}
+
+//!
+//! \brief SCXMLCompressedDevice::open
+//!
+//! The device is either read or written, not both. The header is checked on open for reading
+//! and written on open for writing.
+//!
+bool SCXMLCompressedDevice::open(OpenMode mode)
+{
+    bool reading = (mode & ReadOnly) != 0;
+    bool writing = (mode & WriteOnly) != 0;
+    if (reading == writing || mDevice == nullptr) return false;
+
+    mFrame.clear();
+    mFramePos = 0;
+    mEnded = false;
+    mError = false;
+    if (reading) {
+        quint32 magic = 0;
+        quint32 version = 0;
+        if (!ReadUInt32(magic) || !ReadUInt32(version) || magic != MAGIC || version != VERSION) {
+            qDebug() << "Not a compressed SCXML container";
+            mError = true;
+            return false;
+        }
+    }
+    else if (!WriteHeader()) {
+        return false;
+    }
+    return QIODevice::open(mode);
+}
+
+void SCXMLCompressedDevice::close()
+{
+    if (!isOpen()) return;
+    if (openMode() & WriteOnly) {
+        Finish();
+    }
+    QIODevice::close();
+    mFrame.clear();
+    mFramePos = 0;
+}
+
+bool SCXMLCompressedDevice::atEnd() const
+{
+    return mEnded && QIODevice::atEnd();
+}
+
+qint64 SCXMLCompressedDevice::bytesAvailable() const
+{
+    return (mFrame.size() - mFramePos) + QIODevice::bytesAvailable();
+}
+
+bool SCXMLCompressedDevice::Finish()
+{
+    if (!(openMode() & WriteOnly) || mEnded) return !mError;
+    if (!mFrame.isEmpty()) {
+        WriteFrame();
+    }
+    WriteUInt32(0);
+    mEnded = true;
+    return !mError;
+}
+
+//!
+//! \brief SCXMLCompressedDevice::readData
+//!
+//! Frames are only decompressed as the reader reaches them.
+//!
+qint64 SCXMLCompressedDevice::readData(char *data, qint64 maxSize)
+{
+    qint64 read = 0;
+    while (read < maxSize) {
+        if (mFramePos >= mFrame.size() && !ReadFrame()) break;
+        int count = int(qMin(maxSize - read, qint64(mFrame.size() - mFramePos)));
+        memcpy(data + read, mFrame.constData() + mFramePos, count);
+        mFramePos += count;
+        read += count;
+    }
+    if (read == 0 && mError) return -1;
+    return read;
+}
+
+//!
+//! \brief SCXMLCompressedDevice::writeData
+//!
+//! A large write, such as a whole document, is split across frames, so no frame holds more
+//! than FRAME_SIZE of SCXML and the reader never sees a frame over MAX_COMPRESSED_FRAME_SIZE.
+//!
+qint64 SCXMLCompressedDevice::writeData(const char *data, qint64 maxSize)
+{
+    if (mEnded || mError) return -1;
+    qint64 written = 0;
+    while (written < maxSize) {
+        int count = int(qMin(maxSize - written, qint64(FRAME_SIZE - mFrame.size())));
+        mFrame.append(data + written, count);
+        written += count;
+        if (mFrame.size() >= FRAME_SIZE && !WriteFrame()) return -1;
+    }
+    return maxSize;
+}
+
+bool SCXMLCompressedDevice::ReadFrame()
+{
+    if (mEnded || mError) return false;
+    mFrame.clear();
+    mFramePos = 0;
+
+    quint32 length = 0;
+    if (!ReadUInt32(length) || length > MAX_COMPRESSED_FRAME_SIZE) {
+        mError = true;
+        return false;
+    }
+    if (length == 0) {
+        mEnded = true;
+        return false;
+    }
+    QByteArray compressed = mDevice->read(length);
+    if (compressed.size() != int(length)) {
+        mError = true;
+        return false;
+    }
+
+    // qUncompress allocates the size the frame claims before it looks at the data, and no
+    // frame is written empty or larger than FRAME_SIZE
+    if (compressed.size() < 4) {
+        mError = true;
+        return false;
+    }
+    quint32 frameSize = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(compressed.constData()));
+    if (frameSize == 0 || frameSize > FRAME_SIZE) {
+        mError = true;
+        return false;
+    }
+
+    // qUncompress gives nothing for corrupt data
+    mFrame = qUncompress(compressed);
+    if (mFrame.isEmpty()) {
+        mError = true;
+        return false;
+    }
+    return true;
+}
+
+bool SCXMLCompressedDevice::WriteFrame()
+{
+    QByteArray compressed = qCompress(mFrame);
+    mFrame.resize(0);
+    if (!WriteUInt32(compressed.size())) return false;
+    if (mDevice->write(compressed) != compressed.size()) {
+        mError = true;
+        return false;
+    }
+    return true;
+}
+
+bool SCXMLCompressedDevice::WriteHeader()
+{
+    return WriteUInt32(MAGIC) && WriteUInt32(VERSION);
+}
+
+bool SCXMLCompressedDevice::WriteUInt32(quint32 value)
+{
+    uchar bytes[4];
+    qToBigEndian(value, bytes);
+    if (mDevice->write(reinterpret_cast<const char*>(bytes), 4) != 4) {
+        mError = true;
+        return false;
+    }
+    return true;
+}
+
+bool SCXMLCompressedDevice::ReadUInt32(quint32 &value)
+{
+    uchar bytes[4];
+    if (mDevice->read(reinterpret_cast<char*>(bytes), 4) != 4) return false;
+    value = qFromBigEndian<quint32>(bytes);
+    return true;
+}
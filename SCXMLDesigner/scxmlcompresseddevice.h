@@ -0,0 +1,67 @@
+#ifndef SCXMLCOMPRESSEDDEVICE_H
+#define SCXMLCOMPRESSEDDEVICE_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QString>
+
+//! Reads or writes compressed SCXML (.scxmlz) through another device
+//!
+//! The container is a header followed by frames of SCXML, each compressed on its own with
+//! qCompress, and an empty frame at the end. Only one frame is held in memory at a time, so a
+//! reader can parse a compressed file without the whole of the SCXML being decompressed.
+class SCXMLCompressedDevice : public QIODevice
+{
+    Q_OBJECT
+public:
+    //! Wraps device, which must already be open for reading or writing. It is not closed with this device
+    explicit SCXMLCompressedDevice(QIODevice* device, QObject *parent = 0);
+    ~SCXMLCompressedDevice();
+
+    //! Checks whether the bytes of a file start with the header of the container
+    static bool IsCompressed(const QByteArray& data);
+
+    //! Checks whether a file should be saved compressed, e.g. Adder.scxmlz
+    static bool IsCompressedFilename(QString filename);
+
+    //! Decompresses the whole of a container, false if it is corrupt
+    static bool Decompress(const QByteArray& data, QByteArray& scxml);
+
+    virtual bool open(OpenMode mode);
+    virtual void close();
+    virtual bool isSequential() const { return true; }
+    virtual bool atEnd() const;
+    virtual qint64 bytesAvailable() const;
+
+    //! Writes the last frame and the end of the container, false if anything could not be written
+    bool Finish();
+
+    //! Whether the container was corrupt or could not be written
+    bool HasError() const { return mError; }
+
+protected:
+    virtual qint64 readData(char* data, qint64 maxSize);
+    virtual qint64 writeData(const char* data, qint64 maxSize);
+
+private:
+    //! Reads and decompresses the next frame, false at the end of the container or on an error
+    bool ReadFrame();
+
+    //! Compresses and writes the buffered SCXML as a frame
+    bool WriteFrame();
+
+    bool WriteHeader();
+    bool WriteUInt32(quint32 value);
+    bool ReadUInt32(quint32& value);
+
+    QIODevice* mDevice;
+    QByteArray mFrame;
+    int mFramePos;
+    bool mEnded;
+    bool mError;
+
+    static const quint32 MAGIC;
+    static const quint32 VERSION;
+};
+
+#endif // SCXMLCOMPRESSEDDEVICE_H
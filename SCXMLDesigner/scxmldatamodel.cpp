@@ -1,21 +1,41 @@
 #include "scxmldatamodel.h"
 
-SCXMLDataModel::SCXMLDataModel()
+SCXMLDataModel::SCXMLDataModel() :
+    mDirty(false), mRevision(0)
 {
 }
 
-void SCXMLDataModel::AddDataItem(SCXMLDataItem* item)
+int SCXMLDataModel::AddDataItem(const SCXMLDataItem& item)
 {
-    mDataItems.insert(item->GetId(), item);
+    int index = mDataItems.count();
+    mDataItems.append(item);
+    SCXMLDataItem& added = mDataItems.last();
+    if (added.mParent >= 0 && added.mParent < index) {
+        added.mPath = SCXMLIntern(SCXMLAtomString(mDataItems.at(added.mParent).mPath) + "." + SCXMLAtomString(added.mId));
+    }
+    else {
+        added.mParent = -1;
+        added.mPath = added.mId;
+    }
+    if (!mDataItemIndex.contains(added.mPath)) {
+        mDataItemIndex.insert(added.mPath, index);
+    }
+    mDirty = true;
+    mRevision++;
+    return index;
 }
 
-SCXMLDataItem* SCXMLDataModel::GetDataItem(const QString id)
+void SCXMLDataModel::Clear()
 {
-    if (mDataItems.contains(id)) return mDataItems[id];
-    return nullptr;
+    mDataItems.clear();
+    mDataItemIndex.clear();
+    mDirty = true;
+    mRevision++;
 }
 
-QList<SCXMLDataItem*> SCXMLDataModel::GetDataItemList()
+const SCXMLDataItem* SCXMLDataModel::GetDataItem(const QString path) const
 {
-    return mDataItems.values();
+    SCXMLAtom atom = SCXMLAtomTable::Instance()->Find(path);
+    if (atom == SCXMLAtomTable::ATOM_INVALID) return nullptr;
+    return GetDataItem(atom);
 }
@@ -1,41 +1,87 @@
 #ifndef SCXMLDATAMODEL_H
 #define SCXMLDATAMODEL_H
 
-#include <QMap>
+#include <QHash>
 #include <QString>
+#include <QVector>
+#include "scxmlatoms.h"
+#include "scxmlsourcebuffer.h"
 
 class SCXMLDataItem
 {
 public:
-    SCXMLDataItem(QString id, QString src, QString expr) :
-        mId(id), mSrc(src), mExpr(expr)
+    SCXMLDataItem(QString id, QString src, QString expr, int parent = -1) :
+        mId(SCXMLIntern(id)), mSrc(src), mExpr(expr), mParent(parent), mPath(mId)
     {}
 
 public:
-    QString GetId() { return mId; }
-    QString GetSrc() { return mSrc; }
-    QString GetExpr() { return mExpr; }
+    QString GetId() const { return SCXMLAtomString(mId); }
+    SCXMLAtom GetIdAtom() const { return mId; }
+    QString GetSrc() const { return mSrc; }
+    QString GetExpr() const { return mExpr; }
+
+    //! Gets the index of the item this one is nested in, -1 for a top level item
+    int GetParent() const { return mParent; }
+
+    //! Gets the ids from the top level item down joined with dots, e.g. parameters.first, as
+    //! expressions refer to the item
+    QString GetPath() const { return SCXMLAtomString(mPath); }
+    SCXMLAtom GetPathAtom() const { return mPath; }
 
 private:
-    QString mId;
+    friend class SCXMLDataModel;
+
+    SCXMLAtom mId;
     QString mSrc;
     QString mExpr;
+    int mParent;
+    SCXMLAtom mPath;
 };
 
+//! The datamodel of a workflow
+//!
+//! The items are held by value in document order, so a nested item follows the item it is in,
+//! and are found by path through an index of atoms.
 class SCXMLDataModel
 {
 public:
     SCXMLDataModel();
 
-    void AddDataItem(SCXMLDataItem *item);
-    SCXMLDataItem* GetDataItem(const QString id);
+    //! Adds an item after the others, returns its index. Its parent must already be added
+    int AddDataItem(const SCXMLDataItem& item);
+    void Clear();
+
+    //! Gets an item by path, the first if the path is repeated, nullptr if there is none. The
+    //! item is only valid until another is added
+    const SCXMLDataItem* GetDataItem(const QString path) const;
+    const SCXMLDataItem* GetDataItem(SCXMLAtom path) const {
+        int index = mDataItemIndex.value(path, -1);
+        return (index >= 0) ? &mDataItems.at(index) : nullptr;
+    }
+
+    bool HasItems() const { return !mDataItems.isEmpty(); }
+
+    //! Gets the items in document order
+    const QVector<SCXMLDataItem>& GetDataItems() const { return mDataItems; }
+
+    //! Checks whether items have been added or removed since the workflow was loaded or last saved
+    bool IsDirty() { return mDirty; }
+    void ClearDirty() { mDirty = false; }
 
-    bool HasItems() { return mDataItems.count() > 0; }
+    //! Gets a count of the changes to the items, for the journal to tell when they have changed
+    int GetRevision() { return mRevision; }
 
-    QList<SCXMLDataItem*> GetDataItemList();
+    //! Gets where the datamodel element was in the source, invalid unless it was the only one
+    const SCXMLSourceRange& GetElementRange() { return mElementRange; }
+    void SetElementRange(const SCXMLSourceRange& range) { mElementRange = range; }
 
 private:
-    QMap<QString, SCXMLDataItem*> mDataItems;
+    QVector<SCXMLDataItem> mDataItems;
+    //! The index of the first item with each path
+    QHash<SCXMLAtom, int> mDataItemIndex;
+    bool mDirty;
+    int mRevision;
+    SCXMLSourceRange mElementRange;
 };
 
 #endif // SCXMLDATAMODEL_H
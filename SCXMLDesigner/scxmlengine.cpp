@@ -0,0 +1,341 @@
+#include <QDebug>
+#include <QVarLengthArray>
+#include "scxmlengine.h"
+
+// a chart whose eventless transitions loop forever is stopped after this many in a macrostep
+#define MAX_MACROSTEP_MICROSTEPS 100000
+
+//! Gets the delay in ms of a delayexpr, a CSS2 time or a number of ms
+static bool GetDelay(const SCXMLValue& value, qint64& delay)
+{
+    if (value.type == SCXMLValue::TYPE_STRING) {
+        return SCXMLCompiledChart::ParseDelay(value.ToString(), delay);
+    }
+    double number = value.ToNumber();
+    // also false for NaN
+    if (!(number >= 0 && number < 1e15)) return false;
+    delay = qint64(number + 0.5);
+    return true;
+}
+
+int SCXMLSession::GetAllocatedBytes() const
+{
+    int bytes = sizeof(SCXMLSession);
+    if (mData.capacity() > 0) {
+        bytes += sizeof(QArrayData) + mData.capacity() * sizeof(SCXMLValue);
+    }
+    if (!mExternalQueue.isEmpty()) {
+        // the events are stored in the list's array of pointers
+        bytes += sizeof(QListData::Data) + mExternalQueue.count() * sizeof(void*);
+    }
+    return bytes;
+}
+
+SCXMLEngine::SCXMLEngine(QSharedPointer<const SCXMLCompiledChart> chart) :
+    mChart(chart), mStates(chart->GetStates()), mTransitions(chart->GetTransitions()),
+    mCode(chart->GetCode()), mErrorExecution(SCXMLIntern(QString("error.execution"))), mMicrostepCount(0),
+    mSession(nullptr)
+{
+}
+
+void SCXMLEngine::Start(SCXMLSession &session)
+{
+    mInternalQueue.clear();
+    session.mExternalQueue.clear();
+    session.mActiveState = 0;
+    session.mRunning = (mChart->GetStateCount() > 1);
+    if (!session.mRunning) return;
+    mSession = &session;
+
+    // the datamodel is initialised before the first states are entered, in document order
+    session.mData.fill(SCXMLValue(), mChart->GetDataCount());
+    session.mData.squeeze();
+    for (int slot=0; slot<session.mData.count(); slot++) {
+        int expr = mChart->GetData(slot).expr;
+        if (expr >= 0) {
+            Evaluate(expr, session.mData[slot]);
+        }
+    }
+
+    EnterStates(0, mStates[0].initial);
+    RunToStable();
+    mSession = nullptr;
+}
+
+//!
+//! \brief SCXMLEngine::ProcessEvents
+//!
+//! Once the queue is drained it is cleared, which frees its storage, so an idle session
+//! holds no memory for events.
+//!
+int SCXMLEngine::ProcessEvents(SCXMLSession &session)
+{
+    mSession = &session;
+    int processed = 0;
+    while (!session.mExternalQueue.isEmpty()) {
+        ProcessEvent(session.mExternalQueue.dequeue());
+        processed++;
+    }
+    session.mExternalQueue.clear();
+    mSession = nullptr;
+    return processed;
+}
+
+void SCXMLEngine::ProcessEvent(SCXMLAtom event)
+{
+    if (!mSession->mRunning) return;
+    int transition = SelectTransition(event);
+    if (transition >= 0) {
+        Microstep(transition);
+    }
+    RunToStable();
+}
+
+void SCXMLEngine::RunToStable()
+{
+    for (int microstepPos=0; mSession->mRunning && microstepPos<MAX_MACROSTEP_MICROSTEPS; microstepPos++) {
+        int transition = SelectTransition(SCXMLAtomTable::ATOM_INVALID);
+        while (transition < 0 && !mInternalQueue.isEmpty()) {
+            transition = SelectTransition(mInternalQueue.dequeue());
+        }
+        if (transition < 0) return;
+        Microstep(transition);
+    }
+    if (mSession->mRunning) {
+        qDebug() << "Macrostep stopped after" << MAX_MACROSTEP_MICROSTEPS << "microsteps in"
+                 << SCXMLAtomString(mStates[mSession->mActiveState].id);
+    }
+
+    // the session stopped, or the macrostep was cut short, with internal events left. They
+    // belong to this session, so must not be run by the next macrostep of another one
+    mInternalQueue.clear();
+}
+
+//!
+//! \brief SCXMLEngine::SelectTransition
+//!
+//! Each state looks up the descriptors matching the event in its dispatch table, so the cost
+//! is the number of tokens in the event name for each state rather than its transitions. Of
+//! the transitions found, the first in document order is taken. Only if its guard is false are
+//! the rest of the state's transitions checked in turn.
+//!
+int SCXMLEngine::SelectTransition(SCXMLAtom event)
+{
+    if (event == SCXMLAtomTable::ATOM_INVALID) {
+        for (int state=mSession->mActiveState; state>0; state=mStates[state].parent) {
+            const SCXMLCompiledChart::State& candidate = mStates[state];
+            int end = candidate.transitions.first + candidate.transitions.count;
+            for (int transition=candidate.firstEventless; transition>=0 && transition<end; transition++) {
+                if (mTransitions[transition].descriptors.count == 0 && IsEnabled(mTransitions[transition])) {
+                    return transition;
+                }
+            }
+        }
+        return -1;
+    }
+
+    const QVector<SCXMLAtom>& descriptors = GetMatchingDescriptors(event);
+    for (int state=mSession->mActiveState; state>0; state=mStates[state].parent) {
+        int selected = mStates[state].firstWildcard;
+        foreach (SCXMLAtom descriptor, descriptors) {
+            int transition = mChart->FindTransition(state, descriptor);
+            if (transition >= 0 && (selected < 0 || transition < selected)) {
+                selected = transition;
+            }
+        }
+        if (selected < 0) continue;
+
+        int end = mStates[state].transitions.first + mStates[state].transitions.count;
+        for (int transition=selected; transition<end; transition++) {
+            if ((transition == selected || HasDescriptor(mTransitions[transition], descriptors)) &&
+                    IsEnabled(mTransitions[transition])) {
+                return transition;
+            }
+        }
+    }
+    return -1;
+}
+
+bool SCXMLEngine::HasDescriptor(const SCXMLCompiledChart::Transition &transition, const QVector<SCXMLAtom> &descriptors) const
+{
+    int end = transition.descriptors.first + transition.descriptors.count;
+    for (int descriptorPos=transition.descriptors.first; descriptorPos<end; descriptorPos++) {
+        const SCXMLCompiledChart::EventDescriptor& descriptor = mChart->GetDescriptor(descriptorPos);
+        if (descriptor.wildcard || descriptors.contains(descriptor.event)) return true;
+    }
+    return false;
+}
+
+bool SCXMLEngine::IsEnabled(const SCXMLCompiledChart::Transition &transition)
+{
+    if (transition.cond < 0) return true;
+    SCXMLValue result;
+    return Evaluate(transition.cond, result) && result.ToBoolean();
+}
+
+bool SCXMLEngine::Evaluate(int expr, SCXMLValue &result)
+{
+    if (mChart->GetExpressions().Evaluate(expr, *this, result)) return true;
+    mInternalQueue.enqueue(mErrorExecution);
+    return false;
+}
+
+const QVector<SCXMLAtom> &SCXMLEngine::GetMatchingDescriptors(SCXMLAtom event)
+{
+    QHash<SCXMLAtom, QVector<SCXMLAtom> >::iterator it = mMatchingDescriptors.find(event);
+    if (it == mMatchingDescriptors.end()) {
+        it = mMatchingDescriptors.insert(event, QVector<SCXMLAtom>());
+        mChart->GetMatchingDescriptors(event, it.value());
+    }
+    return it.value();
+}
+
+//!
+//! \brief SCXMLEngine::Microstep
+//!
+//! The states are exited from the active state up to the domain of the transition, the
+//! actions of the transition run, then the states are entered from below the domain down to
+//! the target. The domain is the source for an
+//! internal transition to one of its descendants, otherwise the nearest proper ancestor of
+//! both the source and the target.
+//!
+void SCXMLEngine::Microstep(int transitionIndex)
+{
+    mMicrostepCount++;
+    const SCXMLCompiledChart::Transition& transition = mTransitions[transitionIndex];
+    if (transition.target < 0) {
+        ExecuteActions(transition.actions);
+        return;
+    }
+
+    int source = transition.source;
+    int domain;
+    if (transition.internal && transition.target != source && mChart->IsDescendantOrSelf(transition.target, source)) {
+        domain = source;
+    }
+    else {
+        domain = mStates[source].parent;
+        while (domain > 0 && (domain == transition.target || !mChart->IsDescendantOrSelf(transition.target, domain))) {
+            domain = mStates[domain].parent;
+        }
+    }
+
+    // each state leaves the configuration once its onexit has run
+    while (mSession->mActiveState != domain) {
+        ExecuteActions(mStates[mSession->mActiveState].onExit);
+        mSession->mActiveState = mStates[mSession->mActiveState].parent;
+    }
+    ExecuteActions(transition.actions);
+    EnterStates(domain, transition.target);
+}
+
+void SCXMLEngine::EnterStates(int ancestor, int state)
+{
+    while (state >= 0) {
+        // entered from the outermost state down
+        QVarLengthArray<int, 16> path;
+        for (int pathState=state; pathState!=ancestor; pathState=mStates[pathState].parent) {
+            path.append(pathState);
+        }
+        for (int pathPos=path.count()-1; pathPos>=0; pathPos--) {
+            // a state joins the configuration before its onentry runs
+            mSession->mActiveState = path[pathPos];
+            const SCXMLCompiledChart::State& entered = mStates[mSession->mActiveState];
+            ExecuteActions(entered.onEntry);
+            if (!entered.final) continue;
+            if (entered.parent == 0) {
+                mSession->mRunning = false;
+            }
+            else {
+                mInternalQueue.enqueue(entered.doneEvent);
+            }
+        }
+
+        // a compound state goes on to enter its initial state
+        ancestor = state;
+        state = mStates[state].initial;
+    }
+    mSession->mActiveState = ancestor;
+}
+
+//!
+//! \brief SCXMLEngine::ExecuteActions
+//!
+//! The operands were resolved when the chart was compiled, so each instruction is its opcode
+//! and a few integers. An action that fails ends the rest of the block, as in SCXML.
+//!
+void SCXMLEngine::ExecuteActions(const SCXMLCompiledChart::Range &actions)
+{
+    const qint32* code = mCode;
+    int pos = actions.first;
+    int end = actions.first + actions.count;
+    while (pos < end) {
+        switch (code[pos]) {
+        case SCXMLCompiledChart::OP_LOG:
+            if (mLogCallback) {
+                mLogCallback(mChart->GetString(code[pos + 1]), mChart->GetString(code[pos + 2]));
+            }
+            else {
+                qDebug() << mChart->GetString(code[pos + 2]);
+            }
+            pos += 3;
+            break;
+        case SCXMLCompiledChart::OP_RAISE:
+            mInternalQueue.enqueue(code[pos + 1]);
+            pos += 2;
+            break;
+        case SCXMLCompiledChart::OP_SEND:
+            mSession->mExternalQueue.enqueue(code[pos + 1]);
+            pos += 2;
+            break;
+        case SCXMLCompiledChart::OP_SEND_DELAYED: {
+            qint64 delay = code[pos + 2];
+            if (code[pos + 3] >= 0) {
+                SCXMLValue value;
+                if (!Evaluate(code[pos + 3], value)) return;
+                if (!GetDelay(value, delay)) {
+                    mInternalQueue.enqueue(mErrorExecution);
+                    return;
+                }
+            }
+            if (!mDelayedSendCallback || !mDelayedSendCallback(*mSession, delay, code[pos + 1], code[pos + 4])) {
+                mInternalQueue.enqueue(mErrorExecution);
+                return;
+            }
+            pos += 5;
+            break;
+        }
+        case SCXMLCompiledChart::OP_CANCEL: {
+            SCXMLAtom sendid = code[pos + 1];
+            if (code[pos + 2] >= 0) {
+                SCXMLValue value;
+                if (!Evaluate(code[pos + 2], value)) return;
+                sendid = (value.type == SCXMLValue::TYPE_STRING) ? value.string : SCXMLIntern(value.ToString());
+            }
+            if (mCancelCallback) {
+                mCancelCallback(*mSession, sendid);
+            }
+            pos += 3;
+            break;
+        }
+        case SCXMLCompiledChart::OP_JUMP:
+            pos = code[pos + 1];
+            break;
+        case SCXMLCompiledChart::OP_JUMP_UNLESS: {
+            SCXMLValue result;
+            pos = (Evaluate(code[pos + 1], result) && result.ToBoolean()) ? pos + 3 : code[pos + 2];
+            break;
+        }
+        case SCXMLCompiledChart::OP_ASSIGN:
+            if (!Evaluate(code[pos + 2], mSession->mData[code[pos + 1]])) return;
+            pos += 3;
+            break;
+        case SCXMLCompiledChart::OP_FAIL:
+            mInternalQueue.enqueue(code[pos + 1]);
+            return;
+        default:
+            qDebug() << "Unknown opcode" << code[pos] << "at" << pos;
+            return;
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#ifndef SCXMLENGINE_H
+#define SCXMLENGINE_H
+
+#include <functional>
+#include <QQueue>
+#include <QHash>
+#include <QSharedPointer>
+#include "scxmlcompiledchart.h"
+
+//! One run of a compiled chart, run by an SCXMLEngine
+//!
+//! A session holds only what differs between runs of the same chart: its active state, the
+//! values of the datamodel slots and the external events waiting for it. The states,
+//! transitions, code and expressions stay in the chart, shared by every session, so an idle
+//! session is a few dozen bytes plus 16 for each data slot and millions fit in memory. The
+//! workflows have no parallel states, so the configuration is the active atomic state and its
+//! ancestors, and the one state index describes it completely.
+class SCXMLSession
+{
+public:
+    SCXMLSession() : mId(-1), mActiveState(0), mRunning(false) {}
+
+    //! The id the owner of the session knows it by, passed back with its delayed sends
+    int GetId() const { return mId; }
+    void SetId(int id) { mId = id; }
+
+    //! Queues an external event, taken when the session's events are processed
+    void PostEvent(SCXMLAtom event) { mExternalQueue.enqueue(event); }
+    void PostEvent(const QString& event) { PostEvent(SCXMLIntern(event)); }
+
+    bool HasEvents() const { return !mExternalQueue.isEmpty(); }
+
+    //! Whether the session has started and not reached a top level final state
+    bool IsRunning() const { return mRunning; }
+
+    //! Gets the active atomic state, an index into the chart
+    int GetActiveState() const { return mActiveState; }
+
+    //! Gets the value of a datamodel slot of the chart
+    const SCXMLValue& GetDataValue(int slot) const { return mData.at(slot); }
+
+    //! Gets the memory the session takes, itself and what it has allocated
+    int GetAllocatedBytes() const;
+
+private:
+    friend class SCXMLEngine;
+
+    int mId;
+    int mActiveState;
+    bool mRunning;
+    QVector<SCXMLValue> mData;
+    QQueue<SCXMLAtom> mExternalQueue;
+};
+
+//! Runs sessions of a compiled chart (see SCXMLCompiledChart) without QStateMachine
+//!
+//! The engine follows the SCXML algorithm: each external event is a macrostep, in which the
+//! eventless transitions and then the internal events are taken as microsteps until the
+//! configuration is stable. The workflows have no parallel states, so at most one transition
+//! is taken per microstep. Executable content is run from the chart's code buffer, see
+//! ExecuteActions. The engine holds no state of its own between macrosteps, only a cache of
+//! the descriptors matching each event and the internal queue, which is empty once a macrostep
+//! ends, so one engine runs any number of sessions of its chart. An engine is only used from
+//! one thread at a time, but any number can share a chart. Delayed sends and cancels are
+//! handed to the timer callbacks, so whoever runs the sessions keeps their timers (see
+//! SCXMLTimerWheel) and posts the events when they fire.
+class SCXMLEngine : private SCXMLExpressionContext
+{
+public:
+    //! Receives the log actions executed, in place of qDebug
+    typedef std::function<void(const QString& label, const QString& expr)> LogCallback;
+
+    //! Receives the delayed sends executed, to post the event to the session after the delay in
+    //! ms, replacing any of the session's sends with the same sendid (ATOM_INVALID for none).
+    //! Returns false if it cannot, which raises error.execution
+    typedef std::function<bool(const SCXMLSession& session, qint64 delay, SCXMLAtom event, SCXMLAtom sendid)>
+        DelayedSendCallback;
+
+    //! Receives the cancels executed, for a delayed send of the session that may have fired
+    typedef std::function<void(const SCXMLSession& session, SCXMLAtom sendid)> CancelCallback;
+
+    explicit SCXMLEngine(QSharedPointer<const SCXMLCompiledChart> chart);
+
+    void SetLogCallback(LogCallback callback) { mLogCallback = callback; }
+
+    //! Without them a delayed send raises error.execution and a cancel does nothing
+    void SetTimerCallbacks(DelayedSendCallback delayedSendCallback, CancelCallback cancelCallback) {
+        mDelayedSendCallback = delayedSendCallback;
+        mCancelCallback = cancelCallback;
+    }
+
+    //! Enters the initial configuration of the session and runs until it is stable
+    void Start(SCXMLSession& session);
+
+    //! Runs a macrostep for each queued external event of the session, including those the
+    //! chart sends to itself while they are processed, returns the number of events taken
+    int ProcessEvents(SCXMLSession& session);
+
+    //! Checks whether a state is in the configuration of the session
+    bool IsActive(const SCXMLSession& session, int state) const {
+        return mChart->IsDescendantOrSelf(session.mActiveState, state);
+    }
+
+    //! Gets the number of transitions taken in all the sessions the engine has run
+    qint64 GetMicrostepCount() const { return mMicrostepCount; }
+
+    const SCXMLCompiledChart* GetChart() const { return mChart.data(); }
+
+private:
+    //! Runs one macrostep for an external event
+    void ProcessEvent(SCXMLAtom event);
+
+    //! Takes eventless transitions and internal events until there are none left
+    void RunToStable();
+
+    //! Finds the first enabled transition of the active state or its ancestors in document
+    //! order, -1 if there is none. ATOM_INVALID selects eventless transitions
+    int SelectTransition(SCXMLAtom event);
+
+    //! Gets the descriptors of the chart that match the event, looked up once per event name
+    const QVector<SCXMLAtom>& GetMatchingDescriptors(SCXMLAtom event);
+
+    //! Checks whether the transition has one of the descriptors, or the * descriptor
+    bool HasDescriptor(const SCXMLCompiledChart::Transition& transition, const QVector<SCXMLAtom>& descriptors) const;
+
+    //! Checks the guard of a transition, a guard that fails raises error.execution
+    bool IsEnabled(const SCXMLCompiledChart::Transition& transition);
+
+    //! Evaluates an expression of the chart, raising error.execution if it fails
+    bool Evaluate(int expr, SCXMLValue& result);
+
+    virtual const SCXMLValue* GetDataSlots() const { return mSession->mData.constData(); }
+    virtual bool IsInState(int state) const { return IsActive(*mSession, state); }
+
+    void Microstep(int transition);
+
+    //! Enters the states from below the ancestor down to the state, then its initial states
+    void EnterStates(int ancestor, int state);
+
+    //! Interprets a block of the chart's code
+    void ExecuteActions(const SCXMLCompiledChart::Range& actions);
+
+    QSharedPointer<const SCXMLCompiledChart> mChart;
+    const SCXMLCompiledChart::State* mStates;
+    const SCXMLCompiledChart::Transition* mTransitions;
+    const qint32* mCode;
+    QHash<SCXMLAtom, QVector<SCXMLAtom> > mMatchingDescriptors;
+    SCXMLAtom mErrorExecution;
+    LogCallback mLogCallback;
+    DelayedSendCallback mDelayedSendCallback;
+    CancelCallback mCancelCallback;
+    qint64 mMicrostepCount;
+    //! The session being run, set for the length of Start or ProcessEvents
+    SCXMLSession* mSession;
+    QQueue<SCXMLAtom> mInternalQueue;
+};
+
+#endif // SCXMLENGINE_H
@@ -0,0 +1,79 @@
+#include "scxmleventqueue.h"
+
+SCXMLEventQueue::SCXMLEventQueue(int capacity) :
+    mTail(0), mHead(0)
+{
+    quint32 size = 2;
+    while (size < quint32(capacity)) {
+        size *= 2;
+    }
+    mMask = size - 1;
+    mCells = new Cell[size];
+    for (quint32 pos=0; pos<size; pos++) {
+        mCells[pos].sequence.store(pos);
+        mCells[pos].event = SCXMLAtomTable::ATOM_INVALID;
+    }
+}
+
+SCXMLEventQueue::~SCXMLEventQueue()
+{
+    delete [] mCells;
+}
+
+//!
+//! \brief SCXMLEventQueue::Post
+//!
+//! The cell at the tail is free when its sequence is the tail position. If it is behind, the
+//! consumer has not yet taken the event a lap before and the queue is full. If it is ahead,
+//! another producer claimed the position first and the tail is read again. Positions wrap
+//! around, so they are compared by their difference.
+//!
+bool SCXMLEventQueue::Post(SCXMLAtom event)
+{
+    quint32 pos = mTail.load();
+    forever {
+        Cell& cell = mCells[pos & mMask];
+        qint32 difference = qint32(cell.sequence.loadAcquire() - pos);
+        if (difference == 0) {
+            if (mTail.testAndSetRelaxed(pos, pos + 1, pos)) {
+                cell.event = event;
+                cell.sequence.storeRelease(pos + 1);
+                return true;
+            }
+        }
+        else if (difference < 0) {
+            return false;
+        }
+        else {
+            pos = mTail.load();
+        }
+    }
+}
+
+//!
+//! \brief SCXMLEventQueue::Take
+//!
+//! Taking stops at the first cell not yet published, even if producers that claimed later
+//! positions have finished, so the events are taken in the order their positions were
+//! claimed. A taken cell is freed for the position a lap ahead.
+//!
+int SCXMLEventQueue::Take(SCXMLAtom *events, int maxCount)
+{
+    quint32 head = mHead.load();
+    int count = 0;
+    while (count < maxCount) {
+        Cell& cell = mCells[head & mMask];
+        if (cell.sequence.loadAcquire() != head + 1) break;
+        events[count++] = cell.event;
+        cell.sequence.storeRelease(head + mMask + 1);
+        head++;
+    }
+    mHead.storeRelease(head);
+    return count;
+}
+
+bool SCXMLEventQueue::IsEmpty() const
+{
+    quint32 head = mHead.loadAcquire();
+    return mCells[head & mMask].sequence.loadAcquire() != head + 1;
+}
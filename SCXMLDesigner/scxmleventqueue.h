@@ -0,0 +1,52 @@
+#ifndef SCXMLEVENTQUEUE_H
+#define SCXMLEVENTQUEUE_H
+
+#include <QAtomicInteger>
+#include "scxmlatoms.h"
+
+//! The external events of a session, posted from any thread and taken by the thread running it
+//!
+//! The queue is a ring of cells, each with a sequence number saying whether it is free for the
+//! position a producer claims or holds an event for the consumer. A producer claims a position
+//! by advancing the tail with a compare and swap, writes the event and publishes it through
+//! the cell's sequence, so posting takes no lock and allocates nothing. The consumer takes the
+//! events published in order in batches. The ring is allocated once, when the queue is
+//! created, and Post fails while it is full, leaving the producer to post again later.
+class SCXMLEventQueue
+{
+public:
+    //! Creates the queue, the capacity is rounded up to a power of two
+    explicit SCXMLEventQueue(int capacity);
+    ~SCXMLEventQueue();
+
+    int GetCapacity() const { return int(mMask + 1); }
+
+    //! Adds an event, from any thread. Returns false if the queue is full
+    bool Post(SCXMLAtom event);
+
+    //! Takes up to maxCount events, oldest first, returns the number taken. Only one thread
+    //! takes events at a time
+    int Take(SCXMLAtom* events, int maxCount);
+
+    //! Checks whether there is an event to take. From a thread other than the consumer's the
+    //! answer may be out of date, but an event that was published before is seen
+    bool IsEmpty() const;
+
+private:
+    Q_DISABLE_COPY(SCXMLEventQueue)
+
+    struct Cell {
+        //! The position the cell is free for, or that position + 1 once it holds its event
+        QAtomicInteger<quint32> sequence;
+        SCXMLAtom event;
+    };
+
+    Cell* mCells;
+    quint32 mMask;
+    //! The next position a producer claims
+    QAtomicInteger<quint32> mTail;
+    //! The next position the consumer takes
+    QAtomicInteger<quint32> mHead;
+};
+
+#endif // SCXMLEVENTQUEUE_H
@@ -1,4 +1,8 @@
 #include "scxmlexecutablecontent.h"
+#include "scxmlatoms.h"
+
+// nested actions deeper than this in the cache are taken to be corrupt
+#define MAX_DATA_STREAM_DEPTH 256
 
 SCXMLExecutableActionBase::SCXMLExecutableActionBase()
 {
@@ -8,54 +12,506 @@ SCXMLExecutableContent::SCXMLExecutableContent()
 {
 }
 
-SCXMLExecutableContent* SCXMLExecutableContent::FromXmlElement(QDomNodeList content)
+SCXMLExecutableContent::~SCXMLExecutableContent()
+{
+    qDeleteAll(mActions);
+}
+
+SCXMLExecutableContent* SCXMLExecutableContent::Clone()
+{
+    SCXMLExecutableContent* copy = new SCXMLExecutableContent();
+    foreach (SCXMLExecutableActionBase* action, mActions) {
+        copy->AddAction(action->Clone());
+    }
+    return copy;
+}
+
+SCXMLExecutableContent* SCXMLExecutableContent::FromXmlElement(QDomNodeList content, bool* skipped)
 {
     SCXMLExecutableContent* newContent = new SCXMLExecutableContent();
     for (int elementPos=0; elementPos<content.length(); elementPos++) {
-        QDomNode node = content.at(elementPos);
-        QDomElement element = node.toElement();
-        QString tag = element.tagName();
+        QDomElement element = content.at(elementPos).toElement();
+        if (element.isNull()) continue;
+        SCXMLExecutableActionBase* action = ActionFromXmlElement(element);
+        if (action == nullptr && skipped != nullptr) *skipped = true;
+        newContent->AddAction(action);
+    }
 
-        if (tag == XMLUtilities::SCXML_TAG_LOG) {
-            newContent->AddAction(SCXMLLog::FromXmlElement(&element));
-            continue;
+    return newContent;
+}
+
+SCXMLExecutableActionBase* SCXMLExecutableContent::ActionFromXmlElement(QDomElement &element)
+{
+    QString tag = element.tagName();
+    if (tag == XMLUtilities::SCXML_TAG_LOG) {
+        return SCXMLLog::FromXmlElement(&element);
+    }
+    if (tag == XMLUtilities::SCXML_TAG_RAISE) {
+        return new SCXMLElementAction(ACTION_RAISE, SCXMLActionElement::FromXmlElement(element));
+    }
+    if (tag == XMLUtilities::SCXML_TAG_SEND) {
+        return new SCXMLElementAction(ACTION_SEND, SCXMLActionElement::FromXmlElement(element));
+    }
+    if (tag == XMLUtilities::SCXML_TAG_SCRIPT) {
+        return new SCXMLElementAction(ACTION_SCRIPT, SCXMLActionElement::FromXmlElement(element));
+    }
+    if (tag == XMLUtilities::SCXML_TAG_ASSIGN) {
+        return new SCXMLElementAction(ACTION_ASSIGN, SCXMLActionElement::FromXmlElement(element));
+    }
+    if (tag == XMLUtilities::SCXML_TAG_CANCEL) {
+        return new SCXMLElementAction(ACTION_CANCEL, SCXMLActionElement::FromXmlElement(element));
+    }
+    if (tag == XMLUtilities::SCXML_TAG_IF) {
+        return SCXMLIf::FromXmlElement(&element);
+    }
+    if (tag == XMLUtilities::SCXML_TAG_FOREACH) {
+        return SCXMLForEach::FromXmlElement(&element);
+    }
+    return nullptr;
+}
+
+SCXMLExecutableContent* SCXMLExecutableContent::FromXmlStream(QXmlStreamReader &reader, bool* skipped)
+{
+    SCXMLExecutableContent* newContent = new SCXMLExecutableContent();
+    while (reader.readNextStartElement()) {
+        SCXMLExecutableActionBase* action = ActionFromXmlStream(reader);
+        if (action == nullptr && skipped != nullptr) *skipped = true;
+        newContent->AddAction(action);
+    }
+
+    return newContent;
+}
+
+SCXMLExecutableActionBase* SCXMLExecutableContent::ActionFromXmlStream(QXmlStreamReader &reader)
+{
+    switch (SCXMLAtomTable::Instance()->Find(reader.name())) {
+    case SCXMLAtomTable::ATOM_LOG:
+        return SCXMLLog::FromXmlStream(reader);
+    case SCXMLAtomTable::ATOM_RAISE:
+        return new SCXMLElementAction(ACTION_RAISE, SCXMLActionElement::FromXmlStream(reader));
+    case SCXMLAtomTable::ATOM_SEND:
+        return new SCXMLElementAction(ACTION_SEND, SCXMLActionElement::FromXmlStream(reader));
+    case SCXMLAtomTable::ATOM_SCRIPT:
+        return new SCXMLElementAction(ACTION_SCRIPT, SCXMLActionElement::FromXmlStream(reader));
+    case SCXMLAtomTable::ATOM_ASSIGN:
+        return new SCXMLElementAction(ACTION_ASSIGN, SCXMLActionElement::FromXmlStream(reader));
+    case SCXMLAtomTable::ATOM_CANCEL:
+        return new SCXMLElementAction(ACTION_CANCEL, SCXMLActionElement::FromXmlStream(reader));
+    case SCXMLAtomTable::ATOM_IF:
+        return SCXMLIf::FromXmlStream(reader);
+    case SCXMLAtomTable::ATOM_FOREACH:
+        return SCXMLForEach::FromXmlStream(reader);
+    default:
+        reader.skipCurrentElement();
+        return nullptr;
+    }
+}
+
+void SCXMLExecutableContent::ToXmlElement(QDomDocument &doc, QDomElement containerElement)
+{
+    foreach (SCXMLExecutableActionBase* action, mActions) {
+        action->ToXmlElement(doc, containerElement);
+    }
+}
+
+void SCXMLExecutableContent::ToXmlStream(QXmlStreamWriter &writer, int depth)
+{
+    foreach (SCXMLExecutableActionBase* action, mActions) {
+        action->ToXmlStream(writer, depth);
+    }
+}
+
+SCXMLExecutableContent* SCXMLExecutableContent::FromDataStream(QDataStream &stream)
+{
+    quint8 type;
+    quint32 actionCount;
+    stream >> type >> actionCount;
+    if (type != ACTION_CONTENT) {
+        stream.setStatus(QDataStream::ReadCorruptData);
+        return nullptr;
+    }
+
+    SCXMLExecutableContent* newContent = new SCXMLExecutableContent();
+    for (quint32 actionPos=0; actionPos<actionCount && stream.status() == QDataStream::Ok; actionPos++) {
+        stream >> type;
+        switch (type) {
+        case ACTION_LOG:
+            newContent->AddAction(SCXMLLog::FromDataStream(stream));
+            break;
+        case ACTION_RAISE:
+        case ACTION_SEND:
+        case ACTION_ASSIGN:
+        case ACTION_CANCEL:
+        case ACTION_SCRIPT:
+            newContent->AddAction(SCXMLElementAction::FromDataStream(stream, ActionType(type)));
+            break;
+        case ACTION_IF:
+            newContent->AddAction(SCXMLIf::FromDataStream(stream));
+            break;
+        case ACTION_FOREACH:
+            newContent->AddAction(SCXMLForEach::FromDataStream(stream));
+            break;
+        default:
+            stream.setStatus(QDataStream::ReadCorruptData);
+            break;
         }
-        if (tag == XMLUtilities::SCXML_TAG_RAISE) {
-            //newContent->AddAction(SCXMLRaise::FromXmlElement(element));
-            continue;
+    }
+
+    return newContent;
+}
+
+void SCXMLExecutableContent::ToDataStream(QDataStream &stream)
+{
+    stream << quint8(ACTION_CONTENT) << quint32(mActions.count());
+    foreach (SCXMLExecutableActionBase* action, mActions) {
+        action->ToDataStream(stream);
+    }
+}
+
+QString SCXMLActionElement::GetAttribute(const QString &name) const
+{
+    for (int attributePos=0; attributePos<attributes.count(); attributePos++) {
+        if (attributes.at(attributePos).first == name) return attributes.at(attributePos).second;
+    }
+    return QString();
+}
+
+bool SCXMLActionElement::HasAttribute(const QString &name) const
+{
+    for (int attributePos=0; attributePos<attributes.count(); attributePos++) {
+        if (attributes.at(attributePos).first == name) return true;
+    }
+    return false;
+}
+
+SCXMLActionElement SCXMLActionElement::FromXmlElement(const QDomElement &element)
+{
+    SCXMLActionElement actionElement;
+    actionElement.tag = element.tagName();
+    QDomNamedNodeMap attributes = element.attributes();
+    for (int attributePos=0; attributePos<attributes.count(); attributePos++) {
+        QDomAttr attribute = attributes.item(attributePos).toAttr();
+        actionElement.attributes.append(qMakePair(attribute.name(), attribute.value()));
+    }
+    for (QDomNode child=element.firstChild(); !child.isNull(); child=child.nextSibling()) {
+        if (child.isElement()) {
+            actionElement.children.append(FromXmlElement(child.toElement()));
         }
-        if (tag == XMLUtilities::SCXML_TAG_SEND) {
-            //newContent->AddAction(SCXMLSend::FromXmlElement(element));
-            continue;
+        else if (child.isText() || child.isCDATASection()) {
+            actionElement.text += child.toCharacterData().data();
         }
-        if (tag == XMLUtilities::SCXML_TAG_SCRIPT) {
-            //newContent->AddAction(SCXMLScript::FromXmlElement(element));
-            continue;
+    }
+    if (actionElement.text.trimmed().isEmpty()) actionElement.text.clear();
+    return actionElement;
+}
+
+SCXMLActionElement SCXMLActionElement::FromXmlStream(QXmlStreamReader &reader)
+{
+    SCXMLActionElement actionElement;
+    actionElement.tag = reader.name().toString();
+    foreach (const QXmlStreamAttribute& attribute, reader.attributes()) {
+        actionElement.attributes.append(qMakePair(attribute.qualifiedName().toString(), attribute.value().toString()));
+    }
+    while (!reader.atEnd()) {
+        reader.readNext();
+        if (reader.isEndElement()) break;
+        if (reader.isStartElement()) {
+            actionElement.children.append(FromXmlStream(reader));
         }
-        if (tag == XMLUtilities::SCXML_TAG_ASSIGN) {
-            //newContent->AddAction(SCXMLAssign::FromXmlElement(element));
-            continue;
+        else if (reader.isCharacters()) {
+            actionElement.text += reader.text();
         }
-        if (tag == XMLUtilities::SCXML_TAG_CANCEL) {
-            //newContent->AddAction(SCXMLCancel::FromXmlElement(element));
-            continue;
+    }
+    // the layout around nested elements is not kept
+    if (actionElement.text.trimmed().isEmpty()) actionElement.text.clear();
+    return actionElement;
+}
+
+//! Reads an element and its children, stopping at a depth no saved element would reach
+static void ReadActionElement(QDataStream& stream, SCXMLActionElement& element, int depth)
+{
+    quint32 attributeCount = 0;
+    stream >> element.tag >> attributeCount;
+    for (quint32 attributePos=0; attributePos<attributeCount && stream.status() == QDataStream::Ok; attributePos++) {
+        QString name;
+        QString value;
+        stream >> name >> value;
+        element.attributes.append(qMakePair(name, value));
+    }
+    quint32 childCount = 0;
+    stream >> element.text >> childCount;
+    if (childCount > 0 && depth >= MAX_DATA_STREAM_DEPTH) {
+        stream.setStatus(QDataStream::ReadCorruptData);
+        return;
+    }
+    for (quint32 childPos=0; childPos<childCount && stream.status() == QDataStream::Ok; childPos++) {
+        element.children.append(SCXMLActionElement());
+        ReadActionElement(stream, element.children.last(), depth + 1);
+    }
+}
+
+SCXMLActionElement SCXMLActionElement::FromDataStream(QDataStream &stream)
+{
+    SCXMLActionElement actionElement;
+    ReadActionElement(stream, actionElement, 0);
+    return actionElement;
+}
+
+void SCXMLActionElement::ToXmlElement(QDomDocument &doc, QDomElement containerElement) const
+{
+    QDomElement elem = doc.createElement(tag);
+    for (int attributePos=0; attributePos<attributes.count(); attributePos++) {
+        elem.setAttribute(attributes.at(attributePos).first, attributes.at(attributePos).second);
+    }
+    if (!text.isEmpty()) {
+        elem.appendChild(doc.createTextNode(text));
+    }
+    foreach (const SCXMLActionElement& child, children) {
+        child.ToXmlElement(doc, elem);
+    }
+    containerElement.appendChild(elem);
+}
+
+void SCXMLActionElement::ToXmlStream(QXmlStreamWriter &writer, int depth) const
+{
+    XMLUtilities::WriteIndent(writer, depth);
+    writer.writeStartElement(tag);
+    for (int attributePos=0; attributePos<attributes.count(); attributePos++) {
+        writer.writeAttribute(attributes.at(attributePos).first, attributes.at(attributePos).second);
+    }
+    if (!text.isEmpty()) {
+        writer.writeCharacters(text);
+    }
+    if (!children.isEmpty()) {
+        XMLUtilities::WriteNewLine(writer);
+        foreach (const SCXMLActionElement& child, children) {
+            child.ToXmlStream(writer, depth + 1);
         }
-        if (tag == XMLUtilities::SCXML_TAG_IF) {
-            //newContent->AddAction(SCXMLIf::FromXmlElement(element));
+        XMLUtilities::WriteIndent(writer, depth);
+    }
+    writer.writeEndElement();
+    XMLUtilities::WriteNewLine(writer);
+}
+
+void SCXMLActionElement::ToDataStream(QDataStream &stream) const
+{
+    stream << tag << quint32(attributes.count());
+    for (int attributePos=0; attributePos<attributes.count(); attributePos++) {
+        stream << attributes.at(attributePos).first << attributes.at(attributePos).second;
+    }
+    stream << text << quint32(children.count());
+    foreach (const SCXMLActionElement& child, children) {
+        child.ToDataStream(stream);
+    }
+}
+
+SCXMLIf::~SCXMLIf()
+{
+    foreach (const Branch& branch, mBranches) {
+        delete branch.content;
+    }
+}
+
+void SCXMLIf::AddBranch(const QString &cond, bool isElse, SCXMLExecutableContent *content)
+{
+    Branch branch;
+    branch.cond = cond;
+    branch.isElse = isElse;
+    branch.content = content;
+    mBranches.append(branch);
+}
+
+SCXMLIf* SCXMLIf::FromXmlElement(QDomElement *element)
+{
+    if (element->tagName() != XMLUtilities::SCXML_TAG_IF) return nullptr;
+
+    SCXMLIf* newIf = new SCXMLIf();
+    SCXMLExecutableContent* content = new SCXMLExecutableContent();
+    newIf->AddBranch(XMLUtilities::GetAttributeOrDefault(element, XMLUtilities::SCXML_TAG_COND, ""), false, content);
+    for (QDomElement child=element->firstChildElement(); !child.isNull(); child=child.nextSiblingElement()) {
+        if (child.tagName() == XMLUtilities::SCXML_TAG_ELSEIF || child.tagName() == XMLUtilities::SCXML_TAG_ELSE) {
+            bool isElse = (child.tagName() == XMLUtilities::SCXML_TAG_ELSE);
+            content = new SCXMLExecutableContent();
+            newIf->AddBranch(isElse ? QString() : XMLUtilities::GetAttributeOrDefault(&child, XMLUtilities::SCXML_TAG_COND, ""),
+                             isElse, content);
             continue;
         }
-        if (tag == XMLUtilities::SCXML_TAG_FOREACH) {
-            //newContent->AddAction(SCXMLForEach::FromXmlElement(element));
+        content->AddAction(SCXMLExecutableContent::ActionFromXmlElement(child));
+    }
+    return newIf;
+}
+
+SCXMLIf* SCXMLIf::FromXmlStream(QXmlStreamReader &reader)
+{
+    if (reader.name() != XMLUtilities::SCXML_TAG_IF) return nullptr;
+
+    SCXMLIf* newIf = new SCXMLIf();
+    SCXMLExecutableContent* content = new SCXMLExecutableContent();
+    newIf->AddBranch(reader.attributes().value(XMLUtilities::SCXML_TAG_COND).toString(), false, content);
+    while (reader.readNextStartElement()) {
+        if (reader.name() == XMLUtilities::SCXML_TAG_ELSEIF || reader.name() == XMLUtilities::SCXML_TAG_ELSE) {
+            bool isElse = (reader.name() == XMLUtilities::SCXML_TAG_ELSE);
+            content = new SCXMLExecutableContent();
+            newIf->AddBranch(isElse ? QString() : reader.attributes().value(XMLUtilities::SCXML_TAG_COND).toString(),
+                             isElse, content);
+            reader.skipCurrentElement();
             continue;
         }
+        content->AddAction(SCXMLExecutableContent::ActionFromXmlStream(reader));
     }
+    return newIf;
+}
 
-    return newContent;
+SCXMLIf* SCXMLIf::FromDataStream(QDataStream &stream)
+{
+    quint32 branchCount = 0;
+    stream >> branchCount;
+    SCXMLIf* newIf = new SCXMLIf();
+    for (quint32 branchPos=0; branchPos<branchCount && stream.status() == QDataStream::Ok; branchPos++) {
+        QString cond;
+        bool isElse = false;
+        stream >> cond >> isElse;
+        SCXMLExecutableContent* content = SCXMLExecutableContent::FromDataStream(stream);
+        if (content == nullptr) break;
+        newIf->AddBranch(cond, isElse, content);
+    }
+    return newIf;
 }
 
-void SCXMLExecutableContent::ToXmlElement(QDomDocument &doc, QDomElement containerElement)
+void SCXMLIf::ToXmlElement(QDomDocument &doc, QDomElement containerElement)
 {
-    foreach (SCXMLExecutableActionBase* action, mActions) {
-        action->ToXmlElement(doc, containerElement);
+    QDomElement elem = doc.createElement(XMLUtilities::SCXML_TAG_IF);
+    for (int branchPos=0; branchPos<mBranches.count(); branchPos++) {
+        const Branch& branch = mBranches.at(branchPos);
+        if (branchPos == 0) {
+            elem.setAttribute(XMLUtilities::SCXML_TAG_COND, branch.cond);
+        }
+        else {
+            QDomElement branchElement = doc.createElement(branch.isElse ? XMLUtilities::SCXML_TAG_ELSE : XMLUtilities::SCXML_TAG_ELSEIF);
+            if (!branch.isElse) branchElement.setAttribute(XMLUtilities::SCXML_TAG_COND, branch.cond);
+            elem.appendChild(branchElement);
+        }
+        branch.content->ToXmlElement(doc, elem);
+    }
+    containerElement.appendChild(elem);
+}
+
+void SCXMLIf::ToXmlStream(QXmlStreamWriter &writer, int depth)
+{
+    bool hasChildren = false;
+    for (int branchPos=0; branchPos<mBranches.count(); branchPos++) {
+        hasChildren = hasChildren || branchPos > 0 || mBranches.at(branchPos).content->HasActions();
+    }
+
+    XMLUtilities::WriteIndent(writer, depth);
+    writer.writeStartElement(XMLUtilities::SCXML_TAG_IF);
+    if (!mBranches.isEmpty()) writer.writeAttribute(XMLUtilities::SCXML_TAG_COND, mBranches.first().cond);
+    if (hasChildren) {
+        XMLUtilities::WriteNewLine(writer);
+        for (int branchPos=0; branchPos<mBranches.count(); branchPos++) {
+            const Branch& branch = mBranches.at(branchPos);
+            if (branchPos > 0) {
+                XMLUtilities::WriteIndent(writer, depth + 1);
+                writer.writeStartElement(branch.isElse ? XMLUtilities::SCXML_TAG_ELSE : XMLUtilities::SCXML_TAG_ELSEIF);
+                if (!branch.isElse) writer.writeAttribute(XMLUtilities::SCXML_TAG_COND, branch.cond);
+                writer.writeEndElement();
+                XMLUtilities::WriteNewLine(writer);
+            }
+            branch.content->ToXmlStream(writer, depth + 1);
+        }
+        XMLUtilities::WriteIndent(writer, depth);
+    }
+    writer.writeEndElement();
+    XMLUtilities::WriteNewLine(writer);
+}
+
+void SCXMLIf::ToDataStream(QDataStream &stream)
+{
+    stream << quint8(ACTION_IF) << quint32(mBranches.count());
+    foreach (const Branch& branch, mBranches) {
+        stream << branch.cond << branch.isElse;
+        branch.content->ToDataStream(stream);
+    }
+}
+
+SCXMLIf* SCXMLIf::Clone()
+{
+    SCXMLIf* copy = new SCXMLIf();
+    foreach (const Branch& branch, mBranches) {
+        copy->AddBranch(branch.cond, branch.isElse, branch.content->Clone());
+    }
+    return copy;
+}
+
+SCXMLForEach::~SCXMLForEach()
+{
+    delete mContent;
+}
+
+SCXMLForEach* SCXMLForEach::FromXmlElement(QDomElement *element)
+{
+    if (element->tagName() != XMLUtilities::SCXML_TAG_FOREACH) return nullptr;
+
+    return new SCXMLForEach(XMLUtilities::GetAttributeOrDefault(element, XMLUtilities::SCXML_TAG_ARRAY, ""),
+                            XMLUtilities::GetAttributeOrDefault(element, XMLUtilities::SCXML_TAG_ITEM, ""),
+                            XMLUtilities::GetAttributeOrDefault(element, XMLUtilities::SCXML_TAG_INDEX, ""),
+                            SCXMLExecutableContent::FromXmlElement(element->childNodes()));
+}
+
+SCXMLForEach* SCXMLForEach::FromXmlStream(QXmlStreamReader &reader)
+{
+    if (reader.name() != XMLUtilities::SCXML_TAG_FOREACH) return nullptr;
+
+    QXmlStreamAttributes attributes = reader.attributes();
+    QString array = attributes.value(XMLUtilities::SCXML_TAG_ARRAY).toString();
+    QString item = attributes.value(XMLUtilities::SCXML_TAG_ITEM).toString();
+    QString index = attributes.value(XMLUtilities::SCXML_TAG_INDEX).toString();
+    return new SCXMLForEach(array, item, index, SCXMLExecutableContent::FromXmlStream(reader));
+}
+
+SCXMLForEach* SCXMLForEach::FromDataStream(QDataStream &stream)
+{
+    QString array;
+    QString item;
+    QString index;
+    stream >> array >> item >> index;
+    SCXMLExecutableContent* content = SCXMLExecutableContent::FromDataStream(stream);
+    return new SCXMLForEach(array, item, index, content != nullptr ? content : new SCXMLExecutableContent());
+}
+
+void SCXMLForEach::ToXmlElement(QDomDocument &doc, QDomElement containerElement)
+{
+    QDomElement elem = doc.createElement(XMLUtilities::SCXML_TAG_FOREACH);
+    elem.setAttribute(XMLUtilities::SCXML_TAG_ARRAY, mArray);
+    elem.setAttribute(XMLUtilities::SCXML_TAG_ITEM, mItem);
+    if (mIndex != "") elem.setAttribute(XMLUtilities::SCXML_TAG_INDEX, mIndex);
+    mContent->ToXmlElement(doc, elem);
+    containerElement.appendChild(elem);
+}
+
+void SCXMLForEach::ToXmlStream(QXmlStreamWriter &writer, int depth)
+{
+    XMLUtilities::WriteIndent(writer, depth);
+    writer.writeStartElement(XMLUtilities::SCXML_TAG_FOREACH);
+    writer.writeAttribute(XMLUtilities::SCXML_TAG_ARRAY, mArray);
+    writer.writeAttribute(XMLUtilities::SCXML_TAG_ITEM, mItem);
+    if (mIndex != "") writer.writeAttribute(XMLUtilities::SCXML_TAG_INDEX, mIndex);
+    if (mContent->HasActions()) {
+        XMLUtilities::WriteNewLine(writer);
+        mContent->ToXmlStream(writer, depth + 1);
+        XMLUtilities::WriteIndent(writer, depth);
     }
+    writer.writeEndElement();
+    XMLUtilities::WriteNewLine(writer);
+}
+
+void SCXMLForEach::ToDataStream(QDataStream &stream)
+{
+    stream << quint8(ACTION_FOREACH) << mArray << mItem << mIndex;
+    mContent->ToDataStream(stream);
+}
+
+SCXMLForEach* SCXMLForEach::Clone()
+{
+    return new SCXMLForEach(mArray, mItem, mIndex, mContent->Clone());
 }
@@ -3,24 +3,63 @@
 
 #include <QDebug>
 #include <QList>
+#include <QPair>
 #include <QDomNode>
 #include <QDomElement>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <QDataStream>
 #include "xmlutilities.h"
 
 class SCXMLExecutableActionBase
 {
 public:
     SCXMLExecutableActionBase();
+    virtual ~SCXMLExecutableActionBase() {}
+
+    //! Identifies the action type in the binary workflow cache
+    enum ActionType {
+        ACTION_CONTENT = 0,
+        ACTION_LOG = 1,
+        ACTION_RAISE = 2,
+        ACTION_SEND = 3,
+        ACTION_ASSIGN = 4,
+        ACTION_CANCEL = 5,
+        ACTION_SCRIPT = 6,
+        ACTION_IF = 7,
+        ACTION_FOREACH = 8
+    };
 
     virtual void ToXmlElement(QDomDocument &doc, QDomElement containerElement) = 0;
-    virtual void Execute() = 0;
+    //! Writes the action at the given depth, laid out as ToXmlElement would be saved
+    virtual void ToXmlStream(QXmlStreamWriter &writer, int depth) = 0;
+    virtual void ToDataStream(QDataStream &stream) = 0;
+    //! Copies the action, e.g. for a snapshot of the workflow saved on another thread
+    virtual SCXMLExecutableActionBase* Clone() = 0;
+    virtual ActionType GetActionType() = 0;
 };
 
-class SCXMLIf : public SCXMLExecutableActionBase
+//! An element of an action kept as it was read, e.g. a send with its params
+struct SCXMLActionElement
 {
-    // if, ifelse, else
-public:
-    SCXMLIf() {}
+    QString tag;
+    //! In the order they were read, so the element is saved as it was
+    QList<QPair<QString, QString> > attributes;
+    QString text;
+    QList<SCXMLActionElement> children;
+
+    QString GetAttribute(const QString& name) const;
+    bool HasAttribute(const QString& name) const;
+
+    static SCXMLActionElement FromXmlElement(const QDomElement& element);
+    //! Reads the element at the current stream position, up to its end element
+    static SCXMLActionElement FromXmlStream(QXmlStreamReader& reader);
+    //! Reads an element written by ToDataStream, the stream status is set if it is corrupt
+    static SCXMLActionElement FromDataStream(QDataStream& stream);
+
+    void ToXmlElement(QDomDocument& doc, QDomElement containerElement) const;
+    void ToXmlStream(QXmlStreamWriter& writer, int depth) const;
+    void ToDataStream(QDataStream& stream) const;
 };
 
 ///!
@@ -42,6 +81,38 @@ public:
         return new SCXMLLog(label, expr);
     }
 
+    static SCXMLLog* FromXmlStream(QXmlStreamReader& reader) {
+        if (reader.name() != XMLUtilities::SCXML_TAG_LOG) return nullptr;
+
+        QXmlStreamAttributes attributes = reader.attributes();
+        QString label = attributes.value(XMLUtilities::SCXML_TAG_LABEL).toString();
+        QString expr = attributes.value(XMLUtilities::SCXML_TAG_EXPR).toString();
+        reader.skipCurrentElement();
+        return new SCXMLLog(label, expr);
+    }
+
+    static SCXMLLog* FromDataStream(QDataStream& stream) {
+        QString label;
+        QString expr;
+        stream >> label >> expr;
+        return new SCXMLLog(label, expr);
+    }
+
+    virtual void ToDataStream(QDataStream &stream) final
+    {
+        stream << quint8(ACTION_LOG) << mLabel << mExpr;
+    }
+
+    virtual SCXMLLog* Clone() final
+    {
+        return new SCXMLLog(mLabel, mExpr);
+    }
+
+    virtual ActionType GetActionType() final { return ACTION_LOG; }
+
+    QString GetLabel() { return mLabel; }
+    QString GetExpr() { return mExpr; }
+
     virtual void ToXmlElement(QDomDocument &doc, QDomElement containerElement) final
     {
         QDomElement elem = doc.createElement(XMLUtilities::SCXML_TAG_LOG);
@@ -50,8 +121,14 @@ public:
         containerElement.appendChild(elem);
     }
 
-    void Execute() {
-        qDebug() << mExpr;
+    virtual void ToXmlStream(QXmlStreamWriter &writer, int depth) final
+    {
+        XMLUtilities::WriteIndent(writer, depth);
+        writer.writeStartElement(XMLUtilities::SCXML_TAG_LOG);
+        if (mLabel != "") writer.writeAttribute(XMLUtilities::SCXML_TAG_LABEL, mLabel);
+        if (mExpr != "") writer.writeAttribute(XMLUtilities::SCXML_TAG_EXPR, mExpr);
+        writer.writeEndElement();
+        XMLUtilities::WriteNewLine(writer);
     }
 
 private:
@@ -59,13 +136,77 @@ private:
     QString mExpr;
 };
 
+//!
+//! \brief The SCXMLElementAction class
+//! The actions that are kept as their element: raise, send, assign, cancel and script. What
+//! they do is only worked out when the chart is compiled (see SCXMLCompiledChart)
+//! \example
+//! <raise event='ready' />
+class SCXMLElementAction : public SCXMLExecutableActionBase
+{
+public:
+    SCXMLElementAction(ActionType type, const SCXMLActionElement& element) : mType(type), mElement(element) {}
+
+    static SCXMLElementAction* FromDataStream(QDataStream& stream, ActionType type) {
+        return new SCXMLElementAction(type, SCXMLActionElement::FromDataStream(stream));
+    }
+
+    virtual void ToDataStream(QDataStream &stream) final
+    {
+        stream << quint8(mType);
+        mElement.ToDataStream(stream);
+    }
+
+    virtual SCXMLElementAction* Clone() final
+    {
+        return new SCXMLElementAction(mType, mElement);
+    }
+
+    virtual ActionType GetActionType() final { return mType; }
+
+    const SCXMLActionElement& GetElement() { return mElement; }
+
+    virtual void ToXmlElement(QDomDocument &doc, QDomElement containerElement) final
+    {
+        mElement.ToXmlElement(doc, containerElement);
+    }
+
+    virtual void ToXmlStream(QXmlStreamWriter &writer, int depth) final
+    {
+        mElement.ToXmlStream(writer, depth);
+    }
+
+private:
+    ActionType mType;
+    SCXMLActionElement mElement;
+};
+
 class SCXMLExecutableContent : public SCXMLExecutableActionBase
 {
 public:
     SCXMLExecutableContent();
+    ~SCXMLExecutableContent();
 
-    static SCXMLExecutableContent* FromXmlElement(QDomNodeList content);
+    //! Reads the actions of the nodes of a container element. If skipped is given it is set
+    //! when an element that is not executable content is left out
+    static SCXMLExecutableContent* FromXmlElement(QDomNodeList content, bool* skipped = nullptr);
+    //! Reads the actions of the container element at the current stream position, up to its end
+    //! element. If skipped is given it is set when an element that is not executable content is left out
+    static SCXMLExecutableContent* FromXmlStream(QXmlStreamReader& reader, bool* skipped = nullptr);
+
+    //! Reads the action for an element, nullptr if it is not executable content
+    static SCXMLExecutableActionBase* ActionFromXmlElement(QDomElement& element);
+    //! Reads the action at the current stream position, skipping the element if it is not
+    //! executable content
+    static SCXMLExecutableActionBase* ActionFromXmlStream(QXmlStreamReader& reader);
     virtual void ToXmlElement(QDomDocument &doc, QDomElement containerElement) final;
+    virtual void ToXmlStream(QXmlStreamWriter &writer, int depth) final;
+
+    //! Reads content written by ToDataStream, returns nullptr if the stream is corrupt
+    static SCXMLExecutableContent* FromDataStream(QDataStream& stream);
+    virtual void ToDataStream(QDataStream &stream) final;
+    virtual SCXMLExecutableContent* Clone() final;
+    virtual ActionType GetActionType() final { return ACTION_CONTENT; }
 
     void AddAction(SCXMLExecutableActionBase* action) {
         if (action != nullptr) {
@@ -73,13 +214,82 @@ public:
         }
     }
 
-    void Execute() {
-        foreach (SCXMLExecutableActionBase* action, mActions) {
-            action->Execute();
-        }
-    }
+    bool HasActions() { return !mActions.isEmpty(); }
+    const QList<SCXMLExecutableActionBase*>& GetActions() { return mActions; }
+
 private:
     QList<SCXMLExecutableActionBase*> mActions;
 };
 
+//!
+//! \brief The SCXMLIf class
+//! Each branch holds the actions up to the next elseif or else
+//! \example
+//! <if cond='In("busy")'> <log expr='1'/> <elseif cond='x'/> <log expr='2'/> <else/> </if>
+class SCXMLIf : public SCXMLExecutableActionBase
+{
+public:
+    struct Branch {
+        Branch() : isElse(false), content(nullptr) {}
+
+        //! Empty for the else branch
+        QString cond;
+        bool isElse;
+        SCXMLExecutableContent* content;
+    };
+
+    SCXMLIf() {}
+    ~SCXMLIf();
+
+    static SCXMLIf* FromXmlElement(QDomElement* element);
+    static SCXMLIf* FromXmlStream(QXmlStreamReader& reader);
+    static SCXMLIf* FromDataStream(QDataStream& stream);
+    virtual void ToXmlElement(QDomDocument &doc, QDomElement containerElement) final;
+    virtual void ToXmlStream(QXmlStreamWriter &writer, int depth) final;
+    virtual void ToDataStream(QDataStream &stream) final;
+    virtual SCXMLIf* Clone() final;
+    virtual ActionType GetActionType() final { return ACTION_IF; }
+
+    //! Starts a branch, the actions added from then on belong to it. Takes the content
+    void AddBranch(const QString& cond, bool isElse, SCXMLExecutableContent* content);
+
+    const QList<Branch>& GetBranches() { return mBranches; }
+
+private:
+    QList<Branch> mBranches;
+};
+
+//!
+//! \brief The SCXMLForEach class
+//! \example
+//! <foreach array='items' item='item' index='pos'> <log expr='item'/> </foreach>
+class SCXMLForEach : public SCXMLExecutableActionBase
+{
+public:
+    //! Takes the content
+    SCXMLForEach(QString array, QString item, QString index, SCXMLExecutableContent* content) :
+        mArray(array), mItem(item), mIndex(index), mContent(content) {}
+    ~SCXMLForEach();
+
+    static SCXMLForEach* FromXmlElement(QDomElement* element);
+    static SCXMLForEach* FromXmlStream(QXmlStreamReader& reader);
+    static SCXMLForEach* FromDataStream(QDataStream& stream);
+    virtual void ToXmlElement(QDomDocument &doc, QDomElement containerElement) final;
+    virtual void ToXmlStream(QXmlStreamWriter &writer, int depth) final;
+    virtual void ToDataStream(QDataStream &stream) final;
+    virtual SCXMLForEach* Clone() final;
+    virtual ActionType GetActionType() final { return ACTION_FOREACH; }
+
+    QString GetArray() { return mArray; }
+    QString GetItem() { return mItem; }
+    QString GetIndex() { return mIndex; }
+    SCXMLExecutableContent* GetContent() { return mContent; }
+
+private:
+    QString mArray;
+    QString mItem;
+    QString mIndex;
+    SCXMLExecutableContent* mContent;
+};
+
 #endif // SCXMLEXECUTABLECONTENT_H
@@ -0,0 +1,531 @@
+#include <cmath>
+#include <limits>
+#include <QVarLengthArray>
+#include "scxmlexpressions.h"
+
+// expressions nested deeper than this are not compiled, rather than risk the parser's stack
+#define MAX_EXPRESSION_DEPTH 256
+
+bool SCXMLValue::ToBoolean() const
+{
+    switch (type) {
+    case TYPE_BOOLEAN:
+        return number != 0;
+    case TYPE_NUMBER:
+        return number != 0 && !std::isnan(number);
+    case TYPE_STRING:
+        return string != SCXMLAtomTable::ATOM_EMPTY;
+    default:
+        return false;
+    }
+}
+
+//!
+//! \brief SCXMLValue::FromString
+//! The strings are those written in the chart, so they are made as the chart is compiled and
+//! the number each converts to is worked out then, rather than by every operator using it.
+//!
+SCXMLValue SCXMLValue::FromString(SCXMLAtom value)
+{
+    SCXMLValue result;
+    result.type = TYPE_STRING;
+    result.string = value;
+    QString text = SCXMLAtomString(value).trimmed();
+    if (text.isEmpty()) {
+        result.number = 0;
+    }
+    else {
+        bool ok = false;
+        double number = text.toDouble(&ok);
+        result.number = ok ? number : std::numeric_limits<double>::quiet_NaN();
+    }
+    return result;
+}
+
+double SCXMLValue::ToNumber() const
+{
+    switch (type) {
+    case TYPE_BOOLEAN:
+    case TYPE_NUMBER:
+    case TYPE_STRING:
+        return number;
+    default:
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+QString SCXMLValue::ToString() const
+{
+    switch (type) {
+    case TYPE_BOOLEAN:
+        return number != 0 ? "true" : "false";
+    case TYPE_NUMBER:
+        return QString::number(number, 'g', 15);
+    case TYPE_STRING:
+        return SCXMLAtomString(string);
+    default:
+        return "undefined";
+    }
+}
+
+bool SCXMLValue::Equals(const SCXMLValue &other) const
+{
+    if (type == TYPE_UNDEFINED || other.type == TYPE_UNDEFINED) {
+        return type == other.type;
+    }
+    if (type == TYPE_STRING && other.type == TYPE_STRING) {
+        return string == other.string;
+    }
+    return ToNumber() == other.ToNumber();
+}
+
+//! Recursive descent parser for SCXMLExpressions, one for each expression compiled
+class SCXMLExpressionParser
+{
+public:
+    SCXMLExpressionParser(SCXMLExpressions& expressions, const QString& text,
+                          const SCXMLExpressions::SlotResolver& slotResolver,
+                          const SCXMLExpressions::StateResolver& stateResolver) :
+        mExpressions(expressions), mText(text), mSlotResolver(slotResolver), mStateResolver(stateResolver),
+        mPos(0), mNesting(0), mStackDepth(0), mStackSize(0) {}
+
+    //! Compiles the whole text, returns false with the error set if it is not an expression
+    bool Parse() {
+        if (!ParseOr()) return false;
+        SkipSpace();
+        if (mPos < mText.length()) return Fail(QString("Unexpected '%1'").arg(mText.at(mPos)));
+        return true;
+    }
+
+    int GetStackSize() const { return mStackSize; }
+    QString GetError() const { return mError; }
+
+private:
+    //! Each level parses the operators of one precedence, lowest first
+    bool ParseOr();
+    bool ParseAnd();
+    bool ParseEquality();
+    bool ParseRelational();
+    bool ParseAdditive();
+    bool ParseMultiplicative();
+    bool ParseUnary();
+    bool ParsePrimary();
+
+    bool ParseNumber();
+    bool ParseString(QString& value);
+    bool ParseIdentifier(QString& name);
+
+    void SkipSpace() {
+        while (mPos < mText.length() && mText.at(mPos).isSpace()) mPos++;
+    }
+
+    //! Takes the operator if it is next
+    bool Accept(const char* token) {
+        SkipSpace();
+        int length = int(qstrlen(token));
+        if (mText.midRef(mPos, length) != QLatin1String(token)) return false;
+        mPos += length;
+        return true;
+    }
+
+    //! Emits an instruction that changes the stack depth by the given amount
+    void Emit(SCXMLExpressions::Opcode opcode, int stackChange) {
+        mExpressions.mCode.append(opcode);
+        mStackDepth += stackChange;
+        mStackSize = qMax(mStackSize, mStackDepth);
+    }
+    void Emit(SCXMLExpressions::Opcode opcode, qint32 operand, int stackChange) {
+        Emit(opcode, stackChange);
+        mExpressions.mCode.append(operand);
+    }
+
+    void EmitConstant(const SCXMLValue& value) {
+        Emit(SCXMLExpressions::OP_CONSTANT, mExpressions.mConstants.count(), 1);
+        mExpressions.mConstants.append(value);
+    }
+
+    bool Fail(const QString& error) {
+        if (mError.isEmpty()) mError = error;
+        return false;
+    }
+
+    SCXMLExpressions& mExpressions;
+    const QString& mText;
+    const SCXMLExpressions::SlotResolver& mSlotResolver;
+    const SCXMLExpressions::StateResolver& mStateResolver;
+    int mPos;
+    int mNesting;
+    int mStackDepth;
+    int mStackSize;
+    QString mError;
+};
+
+//!
+//! \brief SCXMLExpressionParser::ParseOr
+//!
+//! As in ECMAScript the result is the operand that decided it, so the left operand is kept
+//! and the right one is not evaluated when the left one decides. Either way one value is
+//! left on the stack, so the jump is counted as the pop.
+//!
+bool SCXMLExpressionParser::ParseOr()
+{
+    if (!ParseAnd()) return false;
+    while (Accept("||")) {
+        Emit(SCXMLExpressions::OP_OR, -1, -1);
+        int targetPos = mExpressions.mCode.count() - 1;
+        if (!ParseAnd()) return false;
+        mExpressions.mCode[targetPos] = mExpressions.mCode.count();
+    }
+    return true;
+}
+
+bool SCXMLExpressionParser::ParseAnd()
+{
+    if (!ParseEquality()) return false;
+    while (Accept("&&")) {
+        Emit(SCXMLExpressions::OP_AND, -1, -1);
+        int targetPos = mExpressions.mCode.count() - 1;
+        if (!ParseEquality()) return false;
+        mExpressions.mCode[targetPos] = mExpressions.mCode.count();
+    }
+    return true;
+}
+
+bool SCXMLExpressionParser::ParseEquality()
+{
+    if (!ParseRelational()) return false;
+    forever {
+        SCXMLExpressions::Opcode opcode;
+        // strict equality is the same here, the values are only ever compared as == does
+        if (Accept("===") || Accept("==")) opcode = SCXMLExpressions::OP_EQUAL;
+        else if (Accept("!==") || Accept("!=")) opcode = SCXMLExpressions::OP_NOT_EQUAL;
+        else return true;
+        if (!ParseRelational()) return false;
+        Emit(opcode, -1);
+    }
+}
+
+bool SCXMLExpressionParser::ParseRelational()
+{
+    if (!ParseAdditive()) return false;
+    forever {
+        SCXMLExpressions::Opcode opcode;
+        if (Accept("<=")) opcode = SCXMLExpressions::OP_LESS_EQUAL;
+        else if (Accept(">=")) opcode = SCXMLExpressions::OP_GREATER_EQUAL;
+        else if (Accept("<")) opcode = SCXMLExpressions::OP_LESS;
+        else if (Accept(">")) opcode = SCXMLExpressions::OP_GREATER;
+        else return true;
+        if (!ParseAdditive()) return false;
+        Emit(opcode, -1);
+    }
+}
+
+bool SCXMLExpressionParser::ParseAdditive()
+{
+    if (!ParseMultiplicative()) return false;
+    forever {
+        SCXMLExpressions::Opcode opcode;
+        if (Accept("+")) opcode = SCXMLExpressions::OP_ADD;
+        else if (Accept("-")) opcode = SCXMLExpressions::OP_SUBTRACT;
+        else return true;
+        if (!ParseMultiplicative()) return false;
+        Emit(opcode, -1);
+    }
+}
+
+bool SCXMLExpressionParser::ParseMultiplicative()
+{
+    if (!ParseUnary()) return false;
+    forever {
+        SCXMLExpressions::Opcode opcode;
+        if (Accept("*")) opcode = SCXMLExpressions::OP_MULTIPLY;
+        else if (Accept("/")) opcode = SCXMLExpressions::OP_DIVIDE;
+        else if (Accept("%")) opcode = SCXMLExpressions::OP_MODULO;
+        else return true;
+        if (!ParseUnary()) return false;
+        Emit(opcode, -1);
+    }
+}
+
+bool SCXMLExpressionParser::ParseUnary()
+{
+    if (++mNesting > MAX_EXPRESSION_DEPTH) return Fail("Expression is nested too deeply");
+
+    bool parsed;
+    if (Accept("!")) {
+        parsed = ParseUnary();
+        Emit(SCXMLExpressions::OP_NOT, 0);
+    }
+    else if (Accept("-")) {
+        parsed = ParseUnary();
+        Emit(SCXMLExpressions::OP_NEGATE, 0);
+    }
+    else if (Accept("+")) {
+        // unary plus converts to a number, as negating twice does
+        parsed = ParseUnary();
+        Emit(SCXMLExpressions::OP_NEGATE, 0);
+        Emit(SCXMLExpressions::OP_NEGATE, 0);
+    }
+    else {
+        parsed = ParsePrimary();
+    }
+
+    mNesting--;
+    return parsed;
+}
+
+bool SCXMLExpressionParser::ParsePrimary()
+{
+    SkipSpace();
+    if (mPos >= mText.length()) return Fail("Unexpected end of expression");
+
+    QChar next = mText.at(mPos);
+    if (Accept("(")) {
+        if (!ParseOr()) return false;
+        return Accept(")") || Fail("Expected ')'");
+    }
+    if (next.isDigit() || next == '.') {
+        return ParseNumber();
+    }
+    if (next == '\'' || next == '"') {
+        QString value;
+        if (!ParseString(value)) return false;
+        EmitConstant(SCXMLValue::FromString(SCXMLIntern(value)));
+        return true;
+    }
+
+    QString name;
+    if (!ParseIdentifier(name)) return Fail(QString("Unexpected '%1'").arg(next));
+    if (name == "true" || name == "false") {
+        EmitConstant(SCXMLValue::FromBoolean(name == "true"));
+        return true;
+    }
+    if (name == "undefined" || name == "null") {
+        EmitConstant(SCXMLValue());
+        return true;
+    }
+    if (name == "In" && Accept("(")) {
+        QString stateId;
+        SkipSpace();
+        if (!ParseString(stateId) || !Accept(")")) return Fail("In() takes the id of a state");
+        int state = mStateResolver ? mStateResolver(stateId) : -1;
+        if (state < 0) return Fail(QString("No such state: %1").arg(stateId));
+        Emit(SCXMLExpressions::OP_IN, state, 1);
+        return true;
+    }
+
+    // a data id, or a path into nested data
+    QString path = name;
+    while (Accept(".")) {
+        SkipSpace();
+        if (!ParseIdentifier(name)) return Fail("Expected a name after '.'");
+        path += "." + name;
+    }
+    SkipSpace();
+    if (mPos < mText.length() && mText.at(mPos) == '(') return Fail(QString("Unsupported function: %1").arg(path));
+    int slot = mSlotResolver ? mSlotResolver(path) : -1;
+    if (slot < 0) return Fail(QString("No such data: %1").arg(path));
+    Emit(SCXMLExpressions::OP_LOAD, slot, 1);
+    return true;
+}
+
+bool SCXMLExpressionParser::ParseNumber()
+{
+    int start = mPos;
+    while (mPos < mText.length() && (mText.at(mPos).isDigit() || mText.at(mPos) == '.')) mPos++;
+    if (mPos < mText.length() && (mText.at(mPos) == 'e' || mText.at(mPos) == 'E')) {
+        mPos++;
+        if (mPos < mText.length() && (mText.at(mPos) == '+' || mText.at(mPos) == '-')) mPos++;
+        while (mPos < mText.length() && mText.at(mPos).isDigit()) mPos++;
+    }
+
+    bool ok = false;
+    double value = mText.mid(start, mPos - start).toDouble(&ok);
+    if (!ok) return Fail(QString("Invalid number: %1").arg(mText.mid(start, mPos - start)));
+    EmitConstant(SCXMLValue::FromNumber(value));
+    return true;
+}
+
+bool SCXMLExpressionParser::ParseString(QString &value)
+{
+    if (mPos >= mText.length()) return Fail("Expected a string");
+    QChar quote = mText.at(mPos);
+    if (quote != '\'' && quote != '"') return Fail("Expected a string");
+
+    value.clear();
+    for (mPos++; mPos < mText.length(); mPos++) {
+        QChar next = mText.at(mPos);
+        if (next == quote) {
+            mPos++;
+            return true;
+        }
+        if (next == '\\' && mPos + 1 < mText.length()) {
+            next = mText.at(++mPos);
+            if (next == 'n') next = '\n';
+            else if (next == 't') next = '\t';
+        }
+        value.append(next);
+    }
+    return Fail("Unterminated string");
+}
+
+bool SCXMLExpressionParser::ParseIdentifier(QString &name)
+{
+    int start = mPos;
+    while (mPos < mText.length()) {
+        QChar next = mText.at(mPos);
+        bool isIdentifier = next.isLetter() || next == '_' || next == '$' || (mPos > start && next.isDigit());
+        if (!isIdentifier) break;
+        mPos++;
+    }
+    name = mText.mid(start, mPos - start);
+    return !name.isEmpty();
+}
+
+SCXMLExpressions::SCXMLExpressions()
+{
+}
+
+void SCXMLExpressions::Clear()
+{
+    mCode.clear();
+    mConstants.clear();
+    mExpressions.clear();
+}
+
+int SCXMLExpressions::Compile(const QString &text, const SlotResolver &slotResolver, const StateResolver &stateResolver)
+{
+    Expression expression;
+    expression.text = text;
+    expression.first = mCode.count();
+    int constantCount = mConstants.count();
+    SCXMLExpressionParser parser(*this, text, slotResolver, stateResolver);
+    if (parser.Parse()) {
+        expression.count = mCode.count() - expression.first;
+        expression.stackSize = parser.GetStackSize();
+    }
+    else {
+        // drop whatever code and constants were emitted before the error
+        mCode.resize(expression.first);
+        mConstants.resize(constantCount);
+        expression.error = parser.GetError();
+    }
+    mExpressions.append(expression);
+    return mExpressions.count() - 1;
+}
+
+//!
+//! \brief SCXMLExpressions::Evaluate
+//!
+//! The stack is sized when the expression is compiled, so it is on the C++ stack for any
+//! expression short of a very long one. Adding to a string fails, as there is nowhere to put
+//! a new string.
+//!
+bool SCXMLExpressions::Evaluate(int expressionIndex, const SCXMLExpressionContext &context, SCXMLValue &result) const
+{
+    if (expressionIndex < 0 || expressionIndex >= mExpressions.count()) return false;
+    const Expression& expression = mExpressions.at(expressionIndex);
+    if (!expression.error.isEmpty()) return false;
+
+    QVarLengthArray<SCXMLValue, 16> stack(expression.stackSize);
+    SCXMLValue* values = stack.data();
+    const SCXMLValue* data = context.GetDataSlots();
+    const qint32* code = mCode.constData();
+    int top = -1;
+    int pos = expression.first;
+    int end = expression.first + expression.count;
+    while (pos < end) {
+        int opcode = code[pos];
+        if (opcode == OP_ADD && (values[top - 1].type == SCXMLValue::TYPE_STRING || values[top].type == SCXMLValue::TYPE_STRING)) {
+            return false;
+        }
+
+        switch (opcode) {
+        case OP_CONSTANT:
+            values[++top] = mConstants.at(code[pos + 1]);
+            pos += 2;
+            continue;
+        case OP_LOAD:
+            values[++top] = data[code[pos + 1]];
+            pos += 2;
+            continue;
+        case OP_IN:
+            values[++top] = SCXMLValue::FromBoolean(context.IsInState(code[pos + 1]));
+            pos += 2;
+            continue;
+        case OP_NEGATE:
+            values[top] = SCXMLValue::FromNumber(-values[top].ToNumber());
+            break;
+        case OP_NOT:
+            values[top] = SCXMLValue::FromBoolean(!values[top].ToBoolean());
+            break;
+        case OP_ADD:
+            values[top - 1] = SCXMLValue::FromNumber(values[top - 1].ToNumber() + values[top].ToNumber());
+            top--;
+            break;
+        case OP_SUBTRACT:
+            values[top - 1] = SCXMLValue::FromNumber(values[top - 1].ToNumber() - values[top].ToNumber());
+            top--;
+            break;
+        case OP_MULTIPLY:
+            values[top - 1] = SCXMLValue::FromNumber(values[top - 1].ToNumber() * values[top].ToNumber());
+            top--;
+            break;
+        case OP_DIVIDE:
+            values[top - 1] = SCXMLValue::FromNumber(values[top - 1].ToNumber() / values[top].ToNumber());
+            top--;
+            break;
+        case OP_MODULO:
+            values[top - 1] = SCXMLValue::FromNumber(std::fmod(values[top - 1].ToNumber(), values[top].ToNumber()));
+            top--;
+            break;
+        case OP_EQUAL:
+        case OP_NOT_EQUAL:
+            values[top - 1] = SCXMLValue::FromBoolean(values[top - 1].Equals(values[top]) == (opcode == OP_EQUAL));
+            top--;
+            break;
+        case OP_LESS:
+        case OP_LESS_EQUAL:
+        case OP_GREATER:
+        case OP_GREATER_EQUAL: {
+            const SCXMLValue& left = values[top - 1];
+            const SCXMLValue& right = values[top];
+            int compared;
+            if (left.type == SCXMLValue::TYPE_STRING && right.type == SCXMLValue::TYPE_STRING) {
+                compared = QString::compare(SCXMLAtomString(left.string), SCXMLAtomString(right.string));
+            }
+            else {
+                double leftNumber = left.ToNumber();
+                double rightNumber = right.ToNumber();
+                // any comparison with NaN is false
+                if (std::isnan(leftNumber) || std::isnan(rightNumber)) {
+                    values[--top] = SCXMLValue::FromBoolean(false);
+                    break;
+                }
+                compared = (leftNumber < rightNumber) ? -1 : (leftNumber > rightNumber ? 1 : 0);
+            }
+            bool holds = (opcode == OP_LESS) ? compared < 0 : (opcode == OP_LESS_EQUAL) ? compared <= 0 :
+                         (opcode == OP_GREATER) ? compared > 0 : compared >= 0;
+            values[--top] = SCXMLValue::FromBoolean(holds);
+            break;
+        }
+        case OP_AND:
+        case OP_OR:
+            if (values[top].ToBoolean() == (opcode == OP_OR)) {
+                pos = code[pos + 1];
+            }
+            else {
+                top--;
+                pos += 2;
+            }
+            continue;
+        default:
+            return false;
+        }
+        pos++;
+    }
+
+    if (top != 0) return false;
+    result = values[0];
+    return true;
+}
@@ -0,0 +1,148 @@
+#ifndef SCXMLEXPRESSIONS_H
+#define SCXMLEXPRESSIONS_H
+
+#include <functional>
+#include <QString>
+#include <QVector>
+#include "scxmlatoms.h"
+
+//! A value of the datamodel or of an expression
+//!
+//! Strings are atoms, so values are copied and compared without allocating. The only strings
+//! are those written in the chart, expressions cannot build new ones. A value is 16 bytes, as
+//! a session holds one for each slot of the datamodel.
+struct SCXMLValue
+{
+    enum Type {
+        TYPE_UNDEFINED,
+        TYPE_BOOLEAN,
+        TYPE_NUMBER,
+        TYPE_STRING
+    };
+
+    SCXMLValue() : type(TYPE_UNDEFINED), string(SCXMLAtomTable::ATOM_EMPTY), number(0) {}
+
+    static SCXMLValue FromBoolean(bool value) {
+        SCXMLValue result;
+        result.type = TYPE_BOOLEAN;
+        result.number = value ? 1 : 0;
+        return result;
+    }
+
+    static SCXMLValue FromNumber(double value) {
+        SCXMLValue result;
+        result.type = TYPE_NUMBER;
+        result.number = value;
+        return result;
+    }
+
+    //! Parses the string as a number once, here, so converting it later does not allocate
+    static SCXMLValue FromString(SCXMLAtom value);
+
+    //! Conversions as in ECMAScript
+    bool ToBoolean() const;
+    double ToNumber() const;
+    QString ToString() const;
+
+    //! Compares as ECMAScript's == does
+    bool Equals(const SCXMLValue& other) const;
+
+    Type type;
+    SCXMLAtom string;
+    //! The number, 1 or 0 for a boolean, or what a string converts to as a number
+    double number;
+};
+
+//! What an expression reads while it is evaluated
+class SCXMLExpressionContext
+{
+public:
+    virtual ~SCXMLExpressionContext() {}
+
+    //! Gets the values of the datamodel, by slot
+    virtual const SCXMLValue* GetDataSlots() const = 0;
+
+    //! Checks whether the state with the index given by the StateResolver is active, for In()
+    virtual bool IsInState(int state) const = 0;
+};
+
+//! The expr and cond expressions of a chart, compiled once and evaluated any number of times
+//!
+//! The expressions are the ECMAScript subset used for guards and assignments: numbers,
+//! strings, true, false, data ids (with dotted paths), In('state'), the arithmetic, comparison
+//! and logical operators and parentheses. Each is compiled to code for a small stack machine
+//! with the data ids resolved to datamodel slots and the strings to atoms, so evaluating it is
+//! a loop over a few integers that does not allocate. Compiled expressions are not changed,
+//! so they can be evaluated on any number of threads at once.
+class SCXMLExpressions
+{
+public:
+    //! Gets the slot of a data id or path, -1 if there is none
+    typedef std::function<int(const QString& path)> SlotResolver;
+    //! Gets the index of a state by its id, -1 if there is none
+    typedef std::function<int(const QString& id)> StateResolver;
+
+    SCXMLExpressions();
+
+    void Clear();
+
+    //! Compiles an expression, returns its index. An expression that does not compile is
+    //! still added, but always fails to evaluate (see GetError)
+    int Compile(const QString& text, const SlotResolver& slotResolver, const StateResolver& stateResolver);
+
+    //! Evaluates an expression, returns false if it failed
+    bool Evaluate(int expression, const SCXMLExpressionContext& context, SCXMLValue& result) const;
+
+    int GetCount() const { return mExpressions.count(); }
+    QString GetText(int expression) const { return mExpressions.at(expression).text; }
+    bool IsValid(int expression) const { return mExpressions.at(expression).error.isEmpty(); }
+    //! Gets why the expression did not compile, empty if it did
+    QString GetError(int expression) const { return mExpressions.at(expression).error; }
+
+    //! An instruction is its opcode followed by its operand, if it has one
+    enum Opcode {
+        //! constant: pushes a constant
+        OP_CONSTANT,
+        //! slot: pushes the value of a datamodel slot
+        OP_LOAD,
+        //! state: pushes whether the state is active
+        OP_IN,
+        OP_NEGATE,
+        OP_NOT,
+        OP_ADD,
+        OP_SUBTRACT,
+        OP_MULTIPLY,
+        OP_DIVIDE,
+        OP_MODULO,
+        OP_EQUAL,
+        OP_NOT_EQUAL,
+        OP_LESS,
+        OP_LESS_EQUAL,
+        OP_GREATER,
+        OP_GREATER_EQUAL,
+        //! target: goes on from the code index, keeping the value, if it is false, otherwise pops it
+        OP_AND,
+        //! target: goes on from the code index, keeping the value, if it is true, otherwise pops it
+        OP_OR
+    };
+
+private:
+    struct Expression {
+        Expression() : first(0), count(0), stackSize(0) {}
+
+        int first;
+        int count;
+        //! The most values on the stack while it is evaluated
+        int stackSize;
+        QString text;
+        QString error;
+    };
+
+    friend class SCXMLExpressionParser;
+
+    QVector<qint32> mCode;
+    QVector<SCXMLValue> mConstants;
+    QVector<Expression> mExpressions;
+};
+
+#endif // SCXMLEXPRESSIONS_H
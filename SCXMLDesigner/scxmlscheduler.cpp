@@ -0,0 +1,326 @@
+#include <limits>
+#include <QThread>
+#include "scxmlscheduler.h"
+
+// the most events taken from a session's queue at once
+#define EVENT_BATCH_SIZE 64
+// the wake time of a wheel without timers
+#define NO_WAKE_TIME std::numeric_limits<qint64>::max()
+// the longest a worker sleeps at once waiting for a timer, in ms
+#define MAX_TIMER_WAIT 3600000
+
+//! A worker thread of the scheduler
+class SCXMLSchedulerWorker : public QThread
+{
+public:
+    SCXMLSchedulerWorker(SCXMLScheduler* scheduler, int worker) : mScheduler(scheduler), mWorker(worker) {}
+
+protected:
+    virtual void run() { mScheduler->RunWorker(mWorker); }
+
+private:
+    SCXMLScheduler* mScheduler;
+    int mWorker;
+};
+
+SCXMLScheduler::WorkerTimers::WorkerTimers() : wakeTime(NO_WAKE_TIME)
+{
+}
+
+SCXMLScheduler::SCXMLScheduler(QSharedPointer<const SCXMLCompiledChart> chart, int threadCount, int queueCapacity) :
+    mChart(chart), mQueueCapacity(queueCapacity), mQueuedCount(0), mBusyCount(0), mSleepingCount(0), mStealCount(0),
+    mStopping(0)
+{
+    if (threadCount <= 0) {
+        threadCount = qMax(1, QThread::idealThreadCount());
+    }
+    for (int worker=0; worker<threadCount; worker++) {
+        SCXMLEngine* engine = new SCXMLEngine(chart);
+        engine->SetTimerCallbacks(
+            [this](const SCXMLSession& session, qint64 delay, SCXMLAtom event, SCXMLAtom sendid) {
+                AddTimer(session.GetId(), delay, event, sendid);
+                return true;
+            },
+            [this](const SCXMLSession& session, SCXMLAtom sendid) { CancelTimer(session.GetId(), sendid); });
+        mEngines.append(engine);
+        mQueues.append(new WorkerQueue());
+        mTimers.append(new WorkerTimers());
+    }
+    mClock.start();
+}
+
+SCXMLScheduler::~SCXMLScheduler()
+{
+    Stop();
+    qDeleteAll(mSessions);
+    qDeleteAll(mTimers);
+    qDeleteAll(mQueues);
+    qDeleteAll(mEngines);
+}
+
+void SCXMLScheduler::SetLogCallback(SCXMLEngine::LogCallback callback)
+{
+    foreach (SCXMLEngine* engine, mEngines) {
+        engine->SetLogCallback(callback);
+    }
+}
+
+int SCXMLScheduler::AddSession()
+{
+    Q_ASSERT(mWorkers.isEmpty());
+    SessionEntry* entry = new SessionEntry(mQueueCapacity);
+    mSessions.append(entry);
+    entry->session.SetId(mSessions.count() - 1);
+    mEngines.first()->Start(entry->session);
+    return entry->session.GetId();
+}
+
+void SCXMLScheduler::Start()
+{
+    if (!mWorkers.isEmpty()) return;
+    mStopping.storeRelease(0);
+    for (int worker=0; worker<mEngines.count(); worker++) {
+        SCXMLSchedulerWorker* thread = new SCXMLSchedulerWorker(this, worker);
+        mWorkers.append(thread);
+        thread->start();
+    }
+}
+
+void SCXMLScheduler::Stop()
+{
+    if (mWorkers.isEmpty()) return;
+    {
+        QMutexLocker locker(&mIdleMutex);
+        mStopping.storeRelease(1);
+        mWorkAvailable.wakeAll();
+    }
+    foreach (SCXMLSchedulerWorker* thread, mWorkers) {
+        thread->wait();
+    }
+    qDeleteAll(mWorkers);
+    mWorkers.clear();
+}
+
+bool SCXMLScheduler::PostEvent(int session, SCXMLAtom event)
+{
+    SessionEntry& entry = *mSessions.at(session);
+    if (!entry.events.Post(event)) return false;
+    // the swap always writes, so a worker that has just set it to 0 sees the event (see RunSession)
+    if (entry.scheduled.fetchAndStoreOrdered(1) == 0) {
+        mBusyCount.ref();
+        Schedule(session, GetHomeWorker(session));
+    }
+    return true;
+}
+
+void SCXMLScheduler::WaitForIdle()
+{
+    QMutexLocker locker(&mDoneMutex);
+    while (mBusyCount.loadAcquire() > 0) {
+        mDone.wait(&mDoneMutex);
+    }
+}
+
+qint64 SCXMLScheduler::GetMicrostepCount() const
+{
+    qint64 microsteps = 0;
+    foreach (SCXMLEngine* engine, mEngines) {
+        microsteps += engine->GetMicrostepCount();
+    }
+    return microsteps;
+}
+
+//!
+//! \brief SCXMLScheduler::Schedule
+//!
+//! The session is counted once it is on the queue, so a worker may take it first and the count
+//! drop below zero for a moment. A worker only sleeps after it has said so in mSleepingCount
+//! and seen nothing queued, and the count is raised before mSleepingCount is read here, so
+//! either the worker sees the session or it is woken.
+//!
+void SCXMLScheduler::Schedule(int session, int worker)
+{
+    WorkerQueue& queue = *mQueues.at(worker);
+    {
+        QMutexLocker locker(&queue.mutex);
+        queue.sessions.append(session);
+    }
+    mQueuedCount.fetchAndAddOrdered(1);
+    if (mSleepingCount.loadAcquire() > 0) {
+        QMutexLocker locker(&mIdleMutex);
+        mWorkAvailable.wakeOne();
+    }
+}
+
+//!
+//! \brief SCXMLScheduler::RunWorker
+//!
+//! A worker with nothing to run sleeps until its wheel's next time. A timer that moves the
+//! time earlier is scheduled after the wake time is lowered, and a worker only sleeps after it
+//! has said so in mSleepingCount and then read the wake time, so either it sleeps until the new
+//! time or it is woken (see AddTimer).
+//!
+void SCXMLScheduler::RunWorker(int worker)
+{
+    WorkerTimers& timers = *mTimers.at(worker);
+    while (!mStopping.loadAcquire()) {
+        FireTimers(worker);
+        int session = TakeSession(worker);
+        if (session >= 0) {
+            RunSession(session, worker);
+            continue;
+        }
+
+        QMutexLocker locker(&mIdleMutex);
+        mSleepingCount.fetchAndAddOrdered(1);
+        while (mQueuedCount.fetchAndAddOrdered(0) <= 0 && !mStopping.loadAcquire()) {
+            qint64 wakeTime = timers.wakeTime.fetchAndAddOrdered(0);
+            if (wakeTime == NO_WAKE_TIME) {
+                mWorkAvailable.wait(&mIdleMutex);
+                continue;
+            }
+            qint64 timeout = wakeTime - mClock.elapsed();
+            if (timeout <= 0) break;
+            mWorkAvailable.wait(&mIdleMutex, ulong(qMin(timeout, qint64(MAX_TIMER_WAIT))));
+        }
+        mSleepingCount.fetchAndAddOrdered(-1);
+    }
+}
+
+int SCXMLScheduler::TakeSession(int worker)
+{
+    int queueCount = mQueues.count();
+    for (int offset=0; offset<queueCount; offset++) {
+        WorkerQueue& queue = *mQueues.at((worker + offset) % queueCount);
+        QMutexLocker locker(&queue.mutex);
+        if (queue.sessions.isEmpty()) continue;
+        // the owner takes the oldest session, a thief the newest, so they rarely meet
+        int session = (offset == 0) ? queue.sessions.takeFirst() : queue.sessions.takeLast();
+        locker.unlock();
+        if (offset > 0) {
+            mStealCount.fetchAndAddRelaxed(1);
+        }
+        mQueuedCount.fetchAndAddOrdered(-1);
+        return session;
+    }
+    return -1;
+}
+
+//!
+//! \brief SCXMLScheduler::RunSession
+//!
+//! The events waiting, up to a queue's worth, are taken in batches and processed. Events
+//! posted after that are left for the next run, so a busy session does not hold the worker.
+//! Once run the session is marked as not scheduled, then its queue is checked: an event
+//! posted before the mark was cleared is seen here, one posted after finds the session not
+//! scheduled and schedules it. Either way the session goes back on its home worker's queue,
+//! behind the sessions already waiting.
+//!
+void SCXMLScheduler::RunSession(int session, int worker)
+{
+    SessionEntry& entry = *mSessions.at(session);
+    SCXMLAtom batch[EVENT_BATCH_SIZE];
+    int capacity = entry.events.GetCapacity();
+    for (int takenCount=0; takenCount<capacity; ) {
+        int count = entry.events.Take(batch, qMin(EVENT_BATCH_SIZE, capacity - takenCount));
+        if (count == 0) break;
+        for (int eventPos=0; eventPos<count; eventPos++) {
+            entry.session.PostEvent(batch[eventPos]);
+        }
+        takenCount += count;
+    }
+    mEngines.at(worker)->ProcessEvents(entry.session);
+
+    entry.scheduled.fetchAndStoreOrdered(0);
+    if (!entry.events.IsEmpty() && entry.scheduled.fetchAndStoreOrdered(1) == 0) {
+        mBusyCount.ref();
+        // back to its home worker, as it may have been stolen, so it stays with its timers
+        Schedule(session, GetHomeWorker(session));
+    }
+    ReleaseBusy();
+}
+
+//!
+//! \brief SCXMLScheduler::AddTimer
+//!
+//! A timer that replaces one with the same sendid takes over its place in mBusyCount. The
+//! sleeping workers are only woken when the wheel's next time moves earlier, so a worker
+//! scheduling timers for its own sessions does not disturb the others.
+//!
+void SCXMLScheduler::AddTimer(int session, qint64 delay, SCXMLAtom event, SCXMLAtom sendid)
+{
+    WorkerTimers& timers = *mTimers.at(GetHomeWorker(session));
+    {
+        QMutexLocker locker(&timers.mutex);
+        if (sendid == SCXMLAtomTable::ATOM_INVALID || !timers.wheel.Cancel(session, sendid)) {
+            mBusyCount.ref();
+        }
+        timers.wheel.Schedule(mClock.elapsed() + delay, session, event, sendid);
+        qint64 wakeTime = timers.wheel.GetNextTime();
+        if (wakeTime >= timers.wakeTime.loadAcquire()) return;
+        timers.wakeTime.fetchAndStoreOrdered(wakeTime);
+    }
+    if (mSleepingCount.fetchAndAddOrdered(0) > 0) {
+        QMutexLocker locker(&mIdleMutex);
+        mWorkAvailable.wakeAll();
+    }
+}
+
+void SCXMLScheduler::CancelTimer(int session, SCXMLAtom sendid)
+{
+    WorkerTimers& timers = *mTimers.at(GetHomeWorker(session));
+    QMutexLocker locker(&timers.mutex);
+    if (!timers.wheel.Cancel(session, sendid)) return;
+    locker.unlock();
+    // the wake time is left, the worker finds nothing to fire if it was this timer's
+    ReleaseBusy();
+}
+
+//!
+//! \brief SCXMLScheduler::FireTimers
+//!
+//! The wheel is only locked once its wake time has come, so between sessions a worker
+//! usually just reads the time. The events are posted after the lock is released. An event
+//! whose session's queue is full is tried again on the next tick, no longer under its sendid
+//! as it has fired.
+//!
+void SCXMLScheduler::FireTimers(int worker)
+{
+    WorkerTimers& timers = *mTimers.at(worker);
+    qint64 wakeTime = timers.wakeTime.loadAcquire();
+    if (wakeTime == NO_WAKE_TIME) return;
+    qint64 now = mClock.elapsed();
+    if (now < wakeTime) return;
+
+    timers.expired.clear();
+    {
+        QMutexLocker locker(&timers.mutex);
+        timers.wheel.Advance(now, timers.expired);
+        qint64 nextTime = timers.wheel.GetNextTime();
+        timers.wakeTime.storeRelease(nextTime < 0 ? NO_WAKE_TIME : nextTime);
+    }
+
+    QVector<SCXMLTimerWheel::Expired> retries;
+    foreach (const SCXMLTimerWheel::Expired& fired, timers.expired) {
+        if (PostEvent(fired.session, fired.event)) {
+            ReleaseBusy();
+        }
+        else {
+            retries.append(fired);
+        }
+    }
+    if (retries.isEmpty()) return;
+    QMutexLocker locker(&timers.mutex);
+    foreach (const SCXMLTimerWheel::Expired& retry, retries) {
+        timers.wheel.Schedule(now + 1, retry.session, retry.event);
+    }
+    timers.wakeTime.storeRelease(timers.wheel.GetNextTime());
+}
+
+void SCXMLScheduler::ReleaseBusy()
+{
+    if (!mBusyCount.deref()) {
+        QMutexLocker locker(&mDoneMutex);
+        mDone.wakeAll();
+    }
+}
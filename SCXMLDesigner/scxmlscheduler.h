@@ -0,0 +1,154 @@
+#ifndef SCXMLSCHEDULER_H
+#define SCXMLSCHEDULER_H
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QVector>
+#include <QWaitCondition>
+#include <QSharedPointer>
+#include "scxmlengine.h"
+#include "scxmleventqueue.h"
+#include "scxmltimerwheel.h"
+
+class SCXMLSchedulerWorker;
+
+//! Runs the sessions of a compiled chart on a pool of worker threads
+//!
+//! A session with events waiting is scheduled on the queue of its home worker. Each worker has
+//! its own engine and runs the sessions of its queue oldest first, taking the events waiting
+//! for a session in batches. A worker whose queue is empty steals the newest session of another
+//! worker's queue, so the work spreads over the workers as they become free. A session is on
+//! at most one queue, or being run by one worker, at a time, so it is never run on two
+//! threads at once and its events are taken in the order they were posted. Independent
+//! sessions share nothing but the chart, which is not changed. Events are posted to a
+//! session's SCXMLEventQueue, so posting takes no lock unless it has to schedule the session.
+//! The delayed sends of the sessions are kept in a timer wheel for each worker, holding those
+//! of the sessions it is home to (see SCXMLTimerWheel). A worker fires its timers between
+//! sessions once the wheel's next time has come, and sleeps until then when it has no
+//! sessions, so timers that expire together are handled in one wakeup.
+class SCXMLScheduler
+{
+public:
+    //! Creates the scheduler with a worker for each thread, as many as there are cores for 0.
+    //! Each session can have up to queueCapacity events waiting
+    SCXMLScheduler(QSharedPointer<const SCXMLCompiledChart> chart, int threadCount = 0, int queueCapacity = 64);
+    ~SCXMLScheduler();
+
+    //! Sets the log callback of every worker's engine, it is called from the worker threads
+    void SetLogCallback(SCXMLEngine::LogCallback callback);
+
+    //! Adds a session and enters its initial configuration, returns its index. Sessions are
+    //! only added before the workers are started
+    int AddSession();
+
+    int GetSessionCount() const { return mSessions.count(); }
+    int GetThreadCount() const { return mEngines.count(); }
+
+    //! Starts the worker threads, which run any sessions already scheduled
+    void Start();
+
+    //! Stops the worker threads once they finish the sessions they are running. Sessions still
+    //! scheduled are run when the workers are started again
+    void Stop();
+
+    //! Queues an external event for a session, from any thread, and schedules the session if
+    //! it is not already. Returns false if the session's queue is full
+    bool PostEvent(int session, SCXMLAtom event);
+
+    //! Waits until every scheduled session has been run and has no events left, and every
+    //! delayed send has fired or been cancelled. The workers must have been started
+    void WaitForIdle();
+
+    //! Gets a session, only while the scheduler is idle or stopped
+    const SCXMLSession& GetSession(int session) const { return mSessions.at(session)->session; }
+
+    //! Gets the number of transitions taken by all the workers, only while idle or stopped
+    qint64 GetMicrostepCount() const;
+
+    //! Gets the number of sessions a worker took from another worker's queue
+    int GetStealCount() const { return mStealCount.load(); }
+
+private:
+    struct SessionEntry {
+        explicit SessionEntry(int queueCapacity) : scheduled(0), events(queueCapacity) {}
+
+        //! Set from when the session is placed on a queue until it has been run, whoever
+        //! swaps it from 0 to 1 schedules the session
+        QAtomicInt scheduled;
+        //! Events posted since the session was last run
+        SCXMLEventQueue events;
+        SCXMLSession session;
+    };
+
+    struct WorkerQueue {
+        QMutex mutex;
+        QList<int> sessions;
+    };
+
+    struct WorkerTimers {
+        WorkerTimers();
+
+        //! Guards the wheel, which the workers running the sessions schedule on
+        QMutex mutex;
+        SCXMLTimerWheel wheel;
+        //! The wheel's next time, read without the lock to see whether there is work
+        QAtomicInteger<qint64> wakeTime;
+        //! The timers fired, only used by the worker
+        QVector<SCXMLTimerWheel::Expired> expired;
+    };
+
+    friend class SCXMLSchedulerWorker;
+
+    //! Runs scheduled sessions until the scheduler is stopped, sleeping while there are none
+    void RunWorker(int worker);
+
+    //! Takes the oldest session of the worker's queue, or steals the newest session of another
+    //! queue, -1 if all the queues are empty
+    int TakeSession(int worker);
+
+    //! Runs a macrostep for each event of a session, scheduling it again if more were posted
+    void RunSession(int session, int worker);
+
+    //! Places a session on a worker's queue and wakes a sleeping worker
+    void Schedule(int session, int worker);
+
+    //! Gets the worker whose queue and timers a session belongs to
+    int GetHomeWorker(int session) const { return session % mQueues.count(); }
+
+    //! Schedules a delayed send of a session on its home worker's wheel, from the thread
+    //! running the session
+    void AddTimer(int session, qint64 delay, SCXMLAtom event, SCXMLAtom sendid);
+    void CancelTimer(int session, SCXMLAtom sendid);
+
+    //! Posts the events of the worker's timers that have expired
+    void FireTimers(int worker);
+
+    //! Ends one piece of busy work, a scheduled session or a timer
+    void ReleaseBusy();
+
+    QSharedPointer<const SCXMLCompiledChart> mChart;
+    QVector<SCXMLEngine*> mEngines;
+    QVector<WorkerQueue*> mQueues;
+    QVector<WorkerTimers*> mTimers;
+    QVector<SCXMLSchedulerWorker*> mWorkers;
+    QVector<SessionEntry*> mSessions;
+    int mQueueCapacity;
+    //! Sessions on the queues, briefly below the true number while a session is being placed
+    QAtomicInt mQueuedCount;
+    //! Sessions scheduled or being run, and timers that have not fired
+    QAtomicInt mBusyCount;
+    QAtomicInt mSleepingCount;
+    QAtomicInt mStealCount;
+    QAtomicInt mStopping;
+    QMutex mIdleMutex;
+    QWaitCondition mWorkAvailable;
+    QMutex mDoneMutex;
+    QWaitCondition mDone;
+    //! The time of the wheels, in ms
+    QElapsedTimer mClock;
+};
+
+#endif // SCXMLSCHEDULER_H
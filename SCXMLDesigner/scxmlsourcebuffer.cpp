@@ -0,0 +1,62 @@
+#include <QDebug>
+#include "scxmlsourcebuffer.h"
+
+SCXMLSourceBuffer::SCXMLSourceBuffer() :
+    mMappedData(nullptr)
+{
+}
+
+SCXMLSourceBuffer::~SCXMLSourceBuffer()
+{
+    Close();
+}
+
+bool SCXMLSourceBuffer::Open(QString filename, bool useMapping)
+{
+    Close();
+
+    mFile.setFileName(filename);
+    if (!mFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    qint64 size = mFile.size();
+    if (useMapping && size > 0) {
+        mMappedData = mFile.map(0, size);
+    }
+    if (mMappedData != nullptr) {
+        // wrap the mapping without copying, the mapping must outlive the array
+        mData = QByteArray::fromRawData(reinterpret_cast<const char*>(mMappedData), int(size));
+        return true;
+    }
+
+    // not mappable (e.g. a pipe or an empty file), read the contents instead
+    if (useMapping) {
+        qDebug() << "Unable to map" << filename << "-" << mFile.errorString();
+    }
+    mData = mFile.readAll();
+    mFile.close();
+    return true;
+}
+
+void SCXMLSourceBuffer::Close()
+{
+    mData.clear();
+    if (mMappedData != nullptr) {
+        mFile.unmap(mMappedData);
+        mMappedData = nullptr;
+    }
+    if (mFile.isOpen()) {
+        mFile.close();
+    }
+}
+
+bool SCXMLSourceBuffer::IsAscii() const
+{
+    const char* data = mData.constData();
+    int size = mData.size();
+    for (int pos=0; pos<size; pos++) {
+        if ((data[pos] & 0x80) != 0) return false;
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef SCXMLSOURCEBUFFER_H
+#define SCXMLSOURCEBUFFER_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QString>
+
+//! A range of bytes [start, end) within an SCXML source, invalid if it is not known
+struct SCXMLSourceRange
+{
+    SCXMLSourceRange() : start(-1), end(-1) {}
+    SCXMLSourceRange(qint64 start, qint64 end) : start(start), end(end) {}
+
+    bool IsValid() const { return start >= 0 && end >= start; }
+    bool operator==(const SCXMLSourceRange& other) const { return start == other.start && end == other.end; }
+
+    qint64 start;
+    qint64 end;
+};
+
+//! Holds the bytes of an SCXML source file
+//!
+//! The file is memory mapped where possible so the parsers and the raw text view can read
+//! the bytes in place, otherwise the contents are read into memory.
+class SCXMLSourceBuffer
+{
+public:
+    SCXMLSourceBuffer();
+    ~SCXMLSourceBuffer();
+
+    //! Opens the file, mapping it into memory if useMapping is set. Returns false if the file cannot be read
+    bool Open(QString filename, bool useMapping = true);
+
+    //! Releases the mapping and closes the file, any views of the data become invalid
+    void Close();
+
+    //! Gets the contents of the file. When mapped this is a view over the mapping, not a copy
+    const QByteArray& GetData() const { return mData; }
+
+    //! Gets the name of the file the buffer was opened from
+    QString GetFilename() const { return mFile.fileName(); }
+
+    //! Checks whether every byte is 7-bit ASCII, the parsers' character offsets are then also byte offsets
+    bool IsAscii() const;
+
+    bool IsMapped() const { return mMappedData != nullptr; }
+    qint64 GetSize() const { return mData.size(); }
+
+private:
+    Q_DISABLE_COPY(SCXMLSourceBuffer)
+
+    QFile mFile;
+    uchar* mMappedData;
+    QByteArray mData;
+};
+
+#endif // SCXMLSOURCEBUFFER_H
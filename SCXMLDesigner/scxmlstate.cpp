@@ -1,25 +1,36 @@
-#include <QMap>
 #include <QCursor>
 #include <QDebug>
 #include <QGraphicsSceneMouseEvent>
 #include "scxmlstate.h"
 #include "scxmltransition.h"
+#include "workflow.h"
 
 #define MIN_STATE_HEIGHT 30
 #define MIN_STATE_WIDTH 60
 
-SCXMLState::SCXMLState(QString id, QMap<QString, QString> *metaData) :
+SCXMLState::SCXMLState(QString id, const MetaData &metaData) :
+    SCXMLState(SCXMLIntern(id), metaData)
+{
+}
+
+SCXMLState::SCXMLState(SCXMLAtom id, const MetaData &metaData) :
     QState(), ConnectionPointSupport(), mId(id), mDescription(""),
     mWidth(100), mHeight(50),
     mResizing(false),
     mResizeOriginalWidth(0), mResizeOriginalHeight(0),
     mResizeStartX(0), mResizeStartY(0),
-    mFinal(false)
+    mFinal(false),
+    mOnEntry(nullptr), mOnExit(nullptr),
+    mParentState(nullptr),
+    mDirtyFlags(0),
+    mForeignContent(false)
 {
     setX(0);
     setY(0);
     setFlag(QGraphicsItem::ItemIsMovable, true);
     setFlag(QGraphicsItem::ItemIsSelectable, true);
+    // moves, including dragging a selection of states, go through itemChange
+    setFlag(QGraphicsItem::ItemSendsGeometryChanges, true);
     setCursor(Qt::OpenHandCursor);
     setAcceptHoverEvents(true);
 
@@ -101,38 +112,48 @@ void SCXMLState::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
     UpdateTransitions();
 }
 
-void SCXMLState::ApplyMetaData(QMap<QString, QString>* mapMetaData)
+void SCXMLState::ApplyMetaData(const MetaData &metaData)
 {
-    foreach(QString key, mapMetaData->keys()) {
-        QString value = mapMetaData->value(key);
-        if (key == "description") {
-            SetDescription(value);
-            continue;
-        }
-        if (key == "x") {
-            SetShapeX(value.toDouble());
-            continue;
-        }
-        if (key == "y") {
-            SetShapeY(value.toDouble());
-            continue;
-        }
-        if (key == "height") {
-            SetShapeHeight(value.toDouble());
-            continue;
-        }
-        if (key == "width") {
-            SetShapeWidth(value.toDouble());
-            continue;
-        }
-    }
+    if (metaData.Has(MetaData::FIELD_DESCRIPTION)) SetDescription(metaData.description);
+    if (metaData.Has(MetaData::FIELD_HEIGHT)) SetShapeHeight(metaData.height);
+    if (metaData.Has(MetaData::FIELD_WIDTH)) SetShapeWidth(metaData.width);
+    if (metaData.Has(MetaData::FIELD_X)) SetShapeX(metaData.x);
+    if (metaData.Has(MetaData::FIELD_Y)) SetShapeY(metaData.y);
 }
 
 QString SCXMLState::GetMetaDataString()
 {
-    QString metadata = QString(" META-DATA [x=%1] [y=%2] [width=%3] [height=%4] [description=%5]").arg(
-                GetShapeX()).arg(GetShapeY()).arg(GetShapeWidth()).arg(GetShapeHeight()).arg(GetDescription());
-    return metadata;
+    return MetaDataSupport::FormatStateMetaData(GetMetaData());
+}
+
+MetaData SCXMLState::GetMetaData()
+{
+    MetaData metaData;
+    metaData.fields = MetaData::FIELD_X | MetaData::FIELD_Y | MetaData::FIELD_WIDTH |
+            MetaData::FIELD_HEIGHT | MetaData::FIELD_DESCRIPTION;
+    metaData.x = GetShapeX();
+    metaData.y = GetShapeY();
+    metaData.width = GetShapeWidth();
+    metaData.height = GetShapeHeight();
+    metaData.description = GetDescription();
+    return metaData;
+}
+
+void SCXMLState::MarkDirty(int flags)
+{
+    mDirtyFlags |= flags;
+    Workflow* workflow = qobject_cast<Workflow*>(machine());
+    if (workflow != nullptr) {
+        workflow->StateEdited(this);
+    }
+}
+
+QVariant SCXMLState::itemChange(QGraphicsItem::GraphicsItemChange change, const QVariant &value)
+{
+    if (change == QGraphicsItem::ItemPositionHasChanged) {
+        MarkDirty(DIRTY_META_DATA);
+    }
+    return QGraphicsItem::itemChange(change, value);
 }
 
 QRectF SCXMLState::boundingRect() const
@@ -8,6 +8,8 @@
 #include "metadatasupport.h"
 #include "scxmlexecutablecontent.h"
 #include "connectionpointsupport.h"
+#include "scxmlatoms.h"
+#include "scxmlsourcebuffer.h"
 
 //! Represents an SCXML state
 //!
@@ -19,10 +21,23 @@ class SCXMLState : public QState, public QGraphicsItem, public MetaDataSupport,
     Q_INTERFACES(QGraphicsItem)
 
 public:
-    explicit SCXMLState(QString id, QMap<QString,QString> *metaData);
+    //! What has changed since the workflow was loaded or last saved
+    enum DirtyFlag {
+        //! The layout or description, written in the META-DATA comment
+        DIRTY_META_DATA = 0x01,
+        //! Anything else within the element, e.g. the executable content or child states
+        DIRTY_ELEMENT = 0x02,
+        //! A transition added to its source state since the workflow was loaded or last saved
+        DIRTY_ADDED = 0x04
+    };
+
+    explicit SCXMLState(QString id, const MetaData& metaData);
+    explicit SCXMLState(SCXMLAtom id, const MetaData& metaData);
 
     //! Retrieves the identifier of the state as defined in the SCXML file
-    QString GetId() { return mId; }
+    QString GetId() { return SCXMLAtomString(mId); }
+    //! Retrieves the interned identifier, for fast comparisons
+    SCXMLAtom GetIdAtom() { return mId; }
     qreal GetShapeX() { return x(); }
     qreal GetShapeY() { return y(); }
     qreal GetShapeWidth() { return mWidth; }
@@ -32,25 +47,52 @@ public:
     QPainterPath GetNodeOutlinePath();
     SCXMLExecutableContent* GetOnEntry() { return mOnEntry; }
     SCXMLExecutableContent* GetOnExit() { return mOnExit; }
+    SCXMLState* GetParentState() { return mParentState; }
+    QList<SCXMLState*> GetChildStates() { return mChildStates; }
 
     void SetShapeX(qreal value) { setX(value); sizeChanged(); }
     void SetShapeY(qreal value) { setY(value); sizeChanged(); }
-    void SetShapeWidth(qreal value) { mWidth = value; sizeChanged(); }
-    void SetShapeHeight(qreal value) { mHeight = value; sizeChanged(); }
-    void SetDescription(QString value) { mDescription = value; }
-    void SetFinal(bool value) { mFinal = value; }
-    void SetOnEntry(SCXMLExecutableContent* value) { mOnEntry = value; }
-    void SetOnExit(SCXMLExecutableContent* value) { mOnExit = value; }
+    void SetShapeWidth(qreal value) { mWidth = value; MarkDirty(DIRTY_META_DATA); sizeChanged(); }
+    void SetShapeHeight(qreal value) { mHeight = value; MarkDirty(DIRTY_META_DATA); sizeChanged(); }
+    void SetDescription(QString value) { mDescription = value; MarkDirty(DIRTY_META_DATA); }
+    void SetFinal(bool value) { mFinal = value; MarkDirty(DIRTY_ELEMENT); }
+    void SetOnEntry(SCXMLExecutableContent* value) { mOnEntry = value; MarkDirty(DIRTY_ELEMENT); }
+    void SetOnExit(SCXMLExecutableContent* value) { mOnExit = value; MarkDirty(DIRTY_ELEMENT); }
+
+    //! Adds a nested state. The hierarchy is kept alongside the flat QStateMachine so the
+    //! scene positions of the states are unaffected
+    void AddChildState(SCXMLState* child) { mChildStates.append(child); child->mParentState = this; MarkDirty(DIRTY_ELEMENT); }
+
+    //! Gets the DirtyFlags set since the workflow was loaded or last saved
+    int GetDirtyFlags() { return mDirtyFlags; }
+    //! Sets DirtyFlags, and tells the workflow so it can journal the edit
+    void MarkDirty(int flags);
+    void ClearDirty() { mDirtyFlags = 0; }
+
+    //! Gets where the element was in the source, invalid for a state that was not loaded from it
+    const SCXMLSourceRange& GetElementRange() { return mElementRange; }
+    //! Gets where the META-DATA comment was in the source, invalid if there was not exactly one
+    const SCXMLSourceRange& GetMetaDataRange() { return mMetaDataRange; }
+    void SetSourceRanges(const SCXMLSourceRange& element, const SCXMLSourceRange& metaData) { mElementRange = element; mMetaDataRange = metaData; }
+
+    //! Checks whether the element in the source holds anything the workflow does not keep
+    //! (e.g. an invoke or another comment), which writing the element again would lose
+    bool HasForeignContent() { return mForeignContent; }
+    void SetForeignContent(bool value) { mForeignContent = value; }
 
     void mouseMoveEvent(QGraphicsSceneMouseEvent *event);
     void mousePressEvent(QGraphicsSceneMouseEvent *event);
     void mouseReleaseEvent(QGraphicsSceneMouseEvent *event);
 
     // MetaDataSupport overrides
-    void ApplyMetaData(QMap<QString, QString>* mapMetaData);
+    void ApplyMetaData(const MetaData& metaData);
     QString GetMetaDataString();
 
+    //! Gets the layout and description as meta data, with every field set
+    MetaData GetMetaData();
+
     // QGraphicsItem overrides
+    QVariant itemChange(GraphicsItemChange change, const QVariant &value);
     QRectF boundingRect() const;
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
     void UpdateTransitions();
@@ -64,7 +106,7 @@ signals:
     void sizeChanged();
 
 private:
-  QString mId;
+  SCXMLAtom mId;
   QString mDescription;
   qreal mWidth;
   qreal mHeight;
@@ -77,6 +119,12 @@ private:
   QList<QAbstractTransition*> mIncomingTransitions;
   SCXMLExecutableContent* mOnEntry;
   SCXMLExecutableContent* mOnExit;
+  SCXMLState* mParentState;
+  QList<SCXMLState*> mChildStates;
+  int mDirtyFlags;
+  SCXMLSourceRange mElementRange;
+  SCXMLSourceRange mMetaDataRange;
+  bool mForeignContent;
 
   // QGraphicsItem interface
 
@@ -0,0 +1,205 @@
+#include <QtAlgorithms>
+#include "scxmltimerwheel.h"
+
+// each level has 1 << SLOT_BITS slots
+#define SLOT_BITS 6
+#define SLOT_COUNT 64
+#define SLOT_MASK 63
+#define LEVEL_COUNT 5
+
+//! Gets how many slots on from the position the next occupied slot is, 64 for the position
+//! itself. The mask must not be empty
+static int GetNextSlotDistance(quint64 occupied, int position)
+{
+    // rotated so the slot after the position is bit 0
+    quint64 rotated = (position == SLOT_MASK) ? occupied
+                                              : ((occupied >> (position + 1)) | (occupied << (SLOT_MASK - position)));
+    return int(qCountTrailingZeroBits(rotated)) + 1;
+}
+
+SCXMLTimerWheel::SCXMLTimerWheel(qint64 currentTime) :
+    mCurrentTime(currentTime), mCount(0), mFirstFree(-1),
+    mSlotFirst(LEVEL_COUNT * SLOT_COUNT, -1), mSlotLast(LEVEL_COUNT * SLOT_COUNT, -1), mOccupied(LEVEL_COUNT, 0)
+{
+}
+
+void SCXMLTimerWheel::Schedule(qint64 expiry, int session, SCXMLAtom event, SCXMLAtom sendid)
+{
+    if (sendid != SCXMLAtomTable::ATOM_INVALID) {
+        Cancel(session, sendid);
+    }
+
+    int timer = mFirstFree;
+    if (timer >= 0) {
+        mFirstFree = mTimers.at(timer).next;
+    }
+    else {
+        timer = mTimers.count();
+        mTimers.append(Timer());
+    }
+    Timer& added = mTimers[timer];
+    // a timer already due expires on the next tick
+    added.expiry = qMax(expiry, mCurrentTime + 1);
+    added.session = session;
+    added.event = event;
+    added.sendid = sendid;
+    Place(timer);
+    mCount++;
+
+    if (sendid != SCXMLAtomTable::ATOM_INVALID) {
+        mSendIds.insert(GetSendIdKey(session, sendid), timer);
+    }
+}
+
+bool SCXMLTimerWheel::Cancel(int session, SCXMLAtom sendid)
+{
+    QHash<quint64, int>::iterator it = mSendIds.find(GetSendIdKey(session, sendid));
+    if (it == mSendIds.end()) return false;
+    int timer = it.value();
+    mSendIds.erase(it);
+    Release(timer);
+    return true;
+}
+
+//!
+//! \brief SCXMLTimerWheel::Advance
+//!
+//! The wheel jumps from one tick with work to the next, so the time taken depends on the
+//! timers rather than how far it moves. At the start of a slot of a level above the lowest,
+//! the slot's timers are moved down, the lower levels first, then the timers of the tick's
+//! slot in the lowest level expire.
+//!
+void SCXMLTimerWheel::Advance(qint64 now, QVector<Expired> &expired)
+{
+    while (mCurrentTime < now) {
+        qint64 next = GetNextTime();
+        if (next < 0 || next > now) {
+            mCurrentTime = now;
+            return;
+        }
+        mCurrentTime = next;
+
+        for (int level=1; level<LEVEL_COUNT; level++) {
+            int shift = SLOT_BITS * level;
+            if ((mCurrentTime & ((qint64(1) << shift) - 1)) != 0) break;
+            Cascade(level, int((mCurrentTime >> shift) & SLOT_MASK));
+        }
+
+        int slot = int(mCurrentTime & SLOT_MASK);
+        while (mSlotFirst.at(slot) >= 0) {
+            int timer = mSlotFirst.at(slot);
+            const Timer& due = mTimers.at(timer);
+            Expired fired;
+            fired.session = due.session;
+            fired.event = due.event;
+            fired.sendid = due.sendid;
+            expired.append(fired);
+            if (due.sendid != SCXMLAtomTable::ATOM_INVALID) {
+                mSendIds.remove(GetSendIdKey(due.session, due.sendid));
+            }
+            Release(timer);
+        }
+    }
+}
+
+//!
+//! \brief SCXMLTimerWheel::GetNextTime
+//!
+//! For the lowest level this is the tick of the next occupied slot, for the others the tick
+//! the next occupied slot starts at, when its timers move down.
+//!
+qint64 SCXMLTimerWheel::GetNextTime() const
+{
+    if (mCount == 0) return -1;
+    qint64 next = -1;
+    for (int level=0; level<LEVEL_COUNT; level++) {
+        quint64 occupied = mOccupied.at(level);
+        if (occupied == 0) continue;
+        int shift = SLOT_BITS * level;
+        qint64 position = mCurrentTime >> shift;
+        qint64 time = (position + GetNextSlotDistance(occupied, int(position & SLOT_MASK))) << shift;
+        if (next < 0 || time < next) {
+            next = time;
+        }
+    }
+    return next;
+}
+
+//!
+//! \brief SCXMLTimerWheel::Place
+//!
+//! The level is the lowest whose 64 slots reach the expiry. A delay beyond the top level is
+//! placed in its last slot, and placed again when that slot moves down.
+//!
+void SCXMLTimerWheel::Place(int timer)
+{
+    Timer& placed = mTimers[timer];
+    qint64 expiry = qMax(placed.expiry, mCurrentTime);
+    qint64 delay = expiry - mCurrentTime;
+    int level = 0;
+    while (level < LEVEL_COUNT - 1 && delay >= (qint64(1) << (SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    qint64 span = qint64(1) << (SLOT_BITS * LEVEL_COUNT);
+    if (delay >= span) {
+        expiry = mCurrentTime + span - 1;
+    }
+
+    int slotIndex = int((expiry >> (SLOT_BITS * level)) & SLOT_MASK);
+    int slot = level * SLOT_COUNT + slotIndex;
+    placed.slot = slot;
+    placed.next = -1;
+    placed.previous = mSlotLast.at(slot);
+    if (placed.previous >= 0) {
+        mTimers[placed.previous].next = timer;
+    }
+    else {
+        mSlotFirst[slot] = timer;
+    }
+    mSlotLast[slot] = timer;
+    mOccupied[level] |= quint64(1) << slotIndex;
+}
+
+void SCXMLTimerWheel::Unlink(int timer)
+{
+    Timer& unlinked = mTimers[timer];
+    int slot = unlinked.slot;
+    if (unlinked.previous >= 0) {
+        mTimers[unlinked.previous].next = unlinked.next;
+    }
+    else {
+        mSlotFirst[slot] = unlinked.next;
+    }
+    if (unlinked.next >= 0) {
+        mTimers[unlinked.next].previous = unlinked.previous;
+    }
+    else {
+        mSlotLast[slot] = unlinked.previous;
+    }
+    if (mSlotFirst.at(slot) < 0) {
+        mOccupied[slot / SLOT_COUNT] &= ~(quint64(1) << (slot % SLOT_COUNT));
+    }
+    unlinked.slot = -1;
+    unlinked.previous = -1;
+    unlinked.next = -1;
+}
+
+void SCXMLTimerWheel::Release(int timer)
+{
+    Unlink(timer);
+    Timer& released = mTimers[timer];
+    released.session = -1;
+    released.next = mFirstFree;
+    mFirstFree = timer;
+    mCount--;
+}
+
+void SCXMLTimerWheel::Cascade(int level, int slotIndex)
+{
+    int slot = level * SLOT_COUNT + slotIndex;
+    while (mSlotFirst.at(slot) >= 0) {
+        int timer = mSlotFirst.at(slot);
+        Unlink(timer);
+        Place(timer);
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef SCXMLTIMERWHEEL_H
+#define SCXMLTIMERWHEEL_H
+
+#include <QHash>
+#include <QVector>
+#include "scxmlatoms.h"
+
+//! The delayed sends of any number of sessions, by the millisecond
+//!
+//! The wheel has levels of 64 slots, each slot of a level as long as the whole level below, so
+//! five levels cover twelve days in 1 ms ticks. A timer goes in the lowest level whose span
+//! holds its delay, in the slot of its expiry, and moves down a level each time the wheel
+//! reaches the start of that slot, until it expires from the lowest. Each slot is a linked list
+//! in a pool of timers, and the send ids of the sessions are indexed, so scheduling and
+//! cancelling take constant time whatever the number of timers. A mask of the occupied slots of
+//! each level finds the next time the wheel has work, so it can be left until then and all the
+//! timers expiring by then are taken together. Times are in ms from any start the caller
+//! chooses; the wheel is not thread safe.
+class SCXMLTimerWheel
+{
+public:
+    //! A timer that has expired
+    struct Expired {
+        int session;
+        SCXMLAtom event;
+        SCXMLAtom sendid;
+    };
+
+    explicit SCXMLTimerWheel(qint64 currentTime = 0);
+
+    //! Schedules the event for the session at the expiry time. A timer of the session with the
+    //! same send id that has not expired is cancelled. ATOM_INVALID is no send id
+    void Schedule(qint64 expiry, int session, SCXMLAtom event, SCXMLAtom sendid = SCXMLAtomTable::ATOM_INVALID);
+
+    //! Cancels the timer of the session with the send id, returns false if there is none
+    bool Cancel(int session, SCXMLAtom sendid);
+
+    //! Moves the wheel on to the time, appending the timers that have expired to expired, the
+    //! earliest first
+    void Advance(qint64 now, QVector<Expired>& expired);
+
+    //! Gets the next time the wheel has work, the earliest a timer can expire, -1 if there are
+    //! no timers. A timer may expire later than this, after it has moved down a level
+    qint64 GetNextTime() const;
+
+    qint64 GetCurrentTime() const { return mCurrentTime; }
+    int GetCount() const { return mCount; }
+
+private:
+    struct Timer {
+        Timer() : expiry(0), session(-1), event(SCXMLAtomTable::ATOM_INVALID),
+            sendid(SCXMLAtomTable::ATOM_INVALID), slot(-1), previous(-1), next(-1) {}
+
+        qint64 expiry;
+        int session;
+        SCXMLAtom event;
+        SCXMLAtom sendid;
+        //! The slot it is in, -1 for a free timer
+        int slot;
+        int previous;
+        //! The next timer of the slot, or of the free list
+        int next;
+    };
+
+    //! Places the timer in the slot for its expiry
+    void Place(int timer);
+
+    //! Takes the timer out of its slot
+    void Unlink(int timer);
+
+    //! Takes the timer out of its slot and returns it to the free list
+    void Release(int timer);
+
+    //! Moves the timers of a slot down to the levels for what is left of their delay
+    void Cascade(int level, int slotIndex);
+
+    static quint64 GetSendIdKey(int session, SCXMLAtom sendid) {
+        return (quint64(quint32(session)) << 32) | quint32(sendid);
+    }
+
+    qint64 mCurrentTime;
+    int mCount;
+    int mFirstFree;
+    QVector<Timer> mTimers;
+    //! The first and last timer of each slot, the levels one after the other
+    QVector<int> mSlotFirst;
+    QVector<int> mSlotLast;
+    //! A bit for each occupied slot of each level
+    QVector<quint64> mOccupied;
+    QHash<quint64, int> mSendIds;
+};
+
+#endif // SCXMLTIMERWHEEL_H
@@ -5,13 +5,53 @@
 #include <QStateMachine>
 #include <QSignalTransition>
 #include "scxmltransition.h"
+#include "workflow.h"
 
 #define CURVE_ITERATIONS 4
 
-SCXMLTransition::SCXMLTransition(SCXMLState *source, SCXMLState *target, QString event, QString transitionType, QMap<QString,QString> *metaData) :
+SCXMLTransition::SCXMLTransition(SCXMLState *source, SCXMLState *target, QString event, QString transitionType, const MetaData &metaData,
+                                 bool deferGeometry) :
     QSignalTransition(), ChaikinCurve(CURVE_ITERATIONS, QVector<QVector3D>()), mSourceState(source), mTargetState(target),
-    mDescription(""), mEvent(event), mTransitionType(transitionType), mStartConnectionPointIndex(0), mEndConnectionPointIndex(0)
+    mDescription(""), mEvent(SCXMLIntern(event)), mTransitionType(transitionType), mStartConnectionPointIndex(0), mEndConnectionPointIndex(0)
 {
+    Initialise();
+
+    ApplyMetaData(metaData);
+
+    if (deferGeometry) {
+        // the curve and animation are built by CompleteGeometry
+        ConnectStates();
+        return;
+    }
+
+    UpdatePoints();
+
+    Connect();
+}
+
+SCXMLTransition::SCXMLTransition(SCXMLState *source, SCXMLState *target, QString event, QString transitionType,
+                                 QVector<QVector3D> controlPoints, QString description) :
+    QSignalTransition(), ChaikinCurve(CURVE_ITERATIONS, controlPoints), mSourceState(source), mTargetState(target),
+    mDescription(description), mEvent(SCXMLIntern(event)), mTransitionType(transitionType), mStartConnectionPointIndex(0), mEndConnectionPointIndex(0)
+{
+    Initialise();
+
+    UpdatePoints();
+
+    Connect();
+}
+
+SCXMLTransition::~SCXMLTransition()
+{
+    delete mContent;
+}
+
+void SCXMLTransition::Initialise()
+{
+    mDirtyFlags = 0;
+    mForeignContent = false;
+    mContent = nullptr;
+
     // only the mid-control points can be moved - not the curve
     setFlag(QGraphicsItem::ItemIsMovable, false);
     // can select to show property dialogs
@@ -22,12 +62,6 @@ SCXMLTransition::SCXMLTransition(SCXMLState *source, SCXMLState *target, QString
 
     // for the curve animation
     SetParentObject(this);
-
-    ApplyMetaData(metaData);
-
-    UpdatePoints();
-
-    Connect();
 }
 
 //!
@@ -71,19 +105,26 @@ QString SCXMLTransition::GetControlPoints()
 //!
 QVector<QVector3D> SCXMLTransition::GetControlPoints(QString value)
 {
-    QVector<QVector3D> points;
-    QStringList pointStrings = value.split(":");
-    foreach (QString pointPair, pointStrings) {
-        QStringList coord = pointPair.split(",");
-        points.append(QVector3D(coord[0].toFloat(), coord[1].toFloat(), 0));
+    QVector<QPointF> points;
+    MetaDataSupport::ParseControlPoints(QStringRef(&value), points);
+    return ToCurvePoints(points);
+}
+
+QVector<QVector3D> SCXMLTransition::ToCurvePoints(const QVector<QPointF> &points)
+{
+    QVector<QVector3D> curvePoints;
+    curvePoints.reserve(points.count());
+    foreach (QPointF point, points) {
+        curvePoints.append(QVector3D(point));
     }
-    return points;
+    return curvePoints;
 }
 
 void SCXMLTransition::SetControlPoints(QString value)
 {
     QVector<QVector3D> points = GetControlPoints(value);
     SetStartingPoints(points);
+    MarkDirty();
 }
 
 bool SCXMLTransition::eventTest(QEvent *event)
@@ -131,6 +172,9 @@ void SCXMLTransition::UpdatePoints()
     SetStartNodeConnectionPointSupport(mSourceState);
     SetEndNodeConnectionPointSupport(mTargetState);
     SetStartingPoints(curvePoints);
+
+    // the ends follow the states, so the control points written out change too
+    MarkDirty();
 }
 
 void SCXMLTransition::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
@@ -154,33 +198,57 @@ void SCXMLTransition::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
 {
     ChaikinCurve::mouseReleaseEvent(event);
     UpdateConnectionPointIndexes();
+    MarkDirty();
 }
 
 
-void SCXMLTransition::ApplyMetaData(QMap<QString, QString> *mapMetaData)
+void SCXMLTransition::MarkDirty(int flags)
 {
-    // no meta data
-    if (mapMetaData == nullptr) return;
-
-    foreach(QString key, mapMetaData->keys()) {
-        QString value = mapMetaData->value(key);
-        if (key == "description") {
-            SetDescription(value);
-            continue;
-        }
-        if (key == "cp") {
-            SetControlPoints(value);
-            continue;
-        }
+    mDirtyFlags |= flags;
+    Workflow* workflow = mSourceState != nullptr ? qobject_cast<Workflow*>(mSourceState->machine()) : nullptr;
+    if (workflow != nullptr) {
+        workflow->TransitionEdited(this);
     }
 }
 
+void SCXMLTransition::SetContent(SCXMLExecutableContent *value)
+{
+    if (value == mContent) return;
+    delete mContent;
+    mContent = value;
+    MarkDirty(SCXMLState::DIRTY_ELEMENT);
+}
+
+void SCXMLTransition::SetCond(QString value)
+{
+    if (value == mCond) return;
+    mCond = value;
+    MarkDirty(SCXMLState::DIRTY_ELEMENT);
+}
+
+void SCXMLTransition::ApplyMetaData(const MetaData &metaData)
+{
+    if (metaData.Has(MetaData::FIELD_CONTROL_POINTS)) SetStartingPoints(ToCurvePoints(metaData.controlPoints));
+    if (metaData.Has(MetaData::FIELD_DESCRIPTION)) SetDescription(metaData.description);
+    MarkDirty();
+}
+
 QString SCXMLTransition::GetMetaDataString()
 {
-    QString metadata = QString(" META-DATA [cp=%1] [description=%2]")
-            .arg(GetControlPoints())
-            .arg(GetDescription());
-    return metadata;
+    return MetaDataSupport::FormatTransitionMetaData(GetMetaData());
+}
+
+MetaData SCXMLTransition::GetMetaData()
+{
+    MetaData metaData;
+    metaData.fields = MetaData::FIELD_CONTROL_POINTS | MetaData::FIELD_DESCRIPTION;
+    QVector<QVector3D> curvePoints = GetCurveControlPoints();
+    metaData.controlPoints.reserve(curvePoints.count());
+    foreach (QVector3D point, curvePoints) {
+        metaData.controlPoints.append(point.toPointF());
+    }
+    metaData.description = GetDescription();
+    return metaData;
 }
 
 
@@ -192,6 +260,22 @@ void SCXMLTransition::Update()
 }
 
 void SCXMLTransition::Connect()
+{
+    ConnectStates();
+
+    // add the transition animation
+    SetAnimation();
+
+    // adjust start and end points with initial forced update
+    mSourceState->UpdateTransitions();
+    mTargetState->UpdateTransitions();
+}
+
+//!
+//! \brief SCXMLTransition::ConnectStates
+//! Attaches the transition to its source and target states without updating any geometry
+//!
+void SCXMLTransition::ConnectStates()
 {
     mConnected = true;
 
@@ -204,13 +288,17 @@ void SCXMLTransition::Connect()
     // ensure size changes of the parent state are reflected in the transition start and end connectors
     connect(mSourceState, &SCXMLState::sizeChanged, this, &SCXMLTransition::UpdatePoints);
     connect(mTargetState, &SCXMLState::sizeChanged, this, &SCXMLTransition::UpdatePoints);
+}
 
-    // add the transition animation
-    SetAnimation();
-
-    // adjust start and end points with initial forced update
-    mSourceState->UpdateTransitions();
-    mTargetState->UpdateTransitions();
+//!
+//! \brief SCXMLTransition::CompleteGeometry
+//! Builds the curve and animation of a transition constructed with deferGeometry. Only this
+//! transition is updated, unlike Connect which updates every transition of both states.
+//!
+void SCXMLTransition::CompleteGeometry()
+{
+    UpdatePoints();
+    Update();
 }
 
 void SCXMLTransition::SetAnimation()
@@ -12,17 +12,53 @@ class SCXMLTransition : public QSignalTransition, public ChaikinCurve, public Me
     Q_INTERFACES(QGraphicsItem)
 
 public:
-    explicit SCXMLTransition(SCXMLState *source, SCXMLState *target, QString event, QString transitionType, QMap<QString,QString> *metaData);
+    //! With deferGeometry the transition is attached to its states but its curve and animation
+    //! are not built, nor are the other transitions of the states updated, until CompleteGeometry
+    explicit SCXMLTransition(SCXMLState *source, SCXMLState *target, QString event, QString transitionType, const MetaData& metaData,
+                             bool deferGeometry = false);
+
+    //! Constructs the transition with decoded layout rather than meta data (e.g. from the workflow cache)
+    explicit SCXMLTransition(SCXMLState *source, SCXMLState *target, QString event, QString transitionType,
+                             QVector<QVector3D> controlPoints, QString description);
+    ~SCXMLTransition();
 
     Q_PROPERTY(QPoint centrePoint READ getCentrePoint WRITE setCentrePoint NOTIFY centrePointChanged)
     Q_PROPERTY(qreal curveAnimationProgress READ getCurveAnimationProgress WRITE setCurveAnimationProgress NOTIFY curveAnimationProgressChanged)
 
     QString GetControlPoints();
     QString GetDescription() { return mDescription; }
-    QString GetEvent() { return mEvent; }
+    QString GetEvent() { return SCXMLAtomString(mEvent); }
+    SCXMLAtom GetEventAtom() { return mEvent; }
+    //! Gets the guard expression, empty if the transition is not guarded
+    QString GetCond() { return mCond; }
+    SCXMLState* GetSourceState() { return mSourceState; }
+    SCXMLState* GetTargetState() { return mTargetState; }
+    //! Gets the executable content run when the transition is taken, null if there is none
+    SCXMLExecutableContent* GetContent() { return mContent; }
 
     void SetControlPoints(QString value);
-    void SetDescription(QString value) { mDescription = value; }
+    void SetDescription(QString value) { mDescription = value; MarkDirty(); }
+    //! Sets the executable content, which the transition then owns
+    void SetContent(SCXMLExecutableContent* value);
+    void SetCond(QString value);
+
+    //! Gets the SCXMLState::DirtyFlags set since the workflow was loaded or last saved
+    int GetDirtyFlags() { return mDirtyFlags; }
+    //! Sets SCXMLState::DirtyFlags, by default for a change to the curve or description (the
+    //! META-DATA comment), and tells the workflow so it can journal the edit
+    void MarkDirty(int flags = SCXMLState::DIRTY_META_DATA);
+    void ClearDirty() { mDirtyFlags = 0; }
+
+    //! Gets where the element was in the source, invalid for a transition that was not loaded from it
+    const SCXMLSourceRange& GetElementRange() { return mElementRange; }
+    //! Gets where the META-DATA comment was in the source, invalid if there was not exactly one
+    const SCXMLSourceRange& GetMetaDataRange() { return mMetaDataRange; }
+    void SetSourceRanges(const SCXMLSourceRange& element, const SCXMLSourceRange& metaData) { mElementRange = element; mMetaDataRange = metaData; }
+
+    //! Checks whether the element in the source holds anything the workflow does not keep
+    //! (e.g. an unknown action or another comment), which writing the element again would lose
+    bool HasForeignContent() { return mForeignContent; }
+    void SetForeignContent(bool value) { mForeignContent = value; }
 
     //void setTransitionType(QString transitionType) { mTransitionType = transitionType; }
     QString getTransitionType() { return mTransitionType; }
@@ -32,21 +68,26 @@ public:
     void onTransition(QEvent * event) { Q_UNUSED(event) }
 
     // MetaDataSupport overrides
-    void ApplyMetaData(QMap<QString, QString>* mapMetaData);
+    void ApplyMetaData(const MetaData& metaData);
     QString GetMetaDataString();
 
+    //! Gets the control points and description as meta data
+    MetaData GetMetaData();
+
     void mouseMoveEvent(QGraphicsSceneMouseEvent *event);
     void mousePressEvent(QGraphicsSceneMouseEvent *event);
     void mouseReleaseEvent(QGraphicsSceneMouseEvent *event);
 
     void Update();
     void Connect();
+    void CompleteGeometry();
 
     bool CalculatePaths(QPainterPath *bezierPath, QPainterPath *arrowHeadPath,
                         QPainterPath *controlLine1Path, QPainterPath *controlLine2Path,
                         QPainterPath *startPointPath, QPainterPath *endPointPath) const;
 
     QVector<QVector3D> GetControlPoints(QString value);
+    static QVector<QVector3D> ToCurvePoints(const QVector<QPointF>& points);
     void SetConnectorPoints(qreal start, qreal end);
     void UpdateConnectionPointIndexes();
     qreal getCurveAnimationProgress() const
@@ -78,15 +119,24 @@ public slots:
     }
 
 private:
+    void Initialise();
+    void ConnectStates();
+
     SCXMLState* mParentState;
     QString mTransitionType;
     QString mDescription;
-    QString mEvent;
+    SCXMLAtom mEvent;
+    QString mCond;
     qreal mStartConnectionPointIndex;
     qreal mEndConnectionPointIndex;
     SCXMLState* mSourceState;
     SCXMLState* mTargetState;
+    SCXMLExecutableContent* mContent;
     bool mConnected;
+    int mDirtyFlags;
+    SCXMLSourceRange mElementRange;
+    SCXMLSourceRange mMetaDataRange;
+    bool mForeignContent;
     qreal m_curveAnimationProgress;
 };
 
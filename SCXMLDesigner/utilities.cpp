@@ -1,6 +1,15 @@
 #include <QMessageBox>
 #include "utilities.h"
 
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#include <io.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
 Utilities::Utilities()
 {
 }
@@ -13,3 +22,42 @@ void Utilities::ShowWarning(QString msg)
     msgBox.setText(msg);
     msgBox.exec();
 }
+
+qint64 Utilities::GetPeakMemoryUsage()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(Q_OS_MAC)
+    // reported in bytes on OS X
+    return usage.ru_maxrss;
+#else
+    // reported in kilobytes on Linux
+    return qint64(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+bool Utilities::SyncFile(QFile &file)
+{
+    if (!file.flush()) {
+        return false;
+    }
+#if defined(Q_OS_WIN)
+    return FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(file.handle()))) != 0;
+#elif defined(Q_OS_UNIX)
+    return fsync(file.handle()) == 0;
+#else
+    return true;
+#endif
+}
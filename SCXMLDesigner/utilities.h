@@ -2,6 +2,7 @@
 #define UTILITIES_H
 
 #include <QString>
+#include <QFile>
 
 class Utilities
 {
@@ -9,6 +10,12 @@ public:
     Utilities();
 
     static void ShowWarning(QString msg);
+
+    //! Gets the peak resident memory of the process in bytes (0 if not available)
+    static qint64 GetPeakMemoryUsage();
+
+    //! Flushes a file and waits for its data to reach the disk, returns false if it did not
+    static bool SyncFile(QFile& file);
 };
 
 #endif // UTILITIES_H
@@ -1,5 +1,9 @@
+#include <algorithm>
 #include <QDebug>
 #include <QGraphicsRectItem>
+#include <QBuffer>
+#include <QSaveFile>
+#include <QSet>
 #include "workflow.h"
 #include "scxmlstate.h"
 #include "scxmltransition.h"
@@ -7,7 +11,8 @@
 #include "scxmlexecutablecontent.h"
 
 Workflow::Workflow() :
-    QStateMachine()
+    QStateMachine(), mHasSourceRanges(false), mTransitionCount(0),
+    mRecordEdits(false), mRecordedDataModelRevision(0)
 {
 }
 
@@ -27,209 +32,1120 @@ void Workflow::ConstructSCXMLFromStateMachine(QDomDocument &doc)
     if (mDataModel.HasItems()) {
         QDomElement dataModelElement = doc.createElement(XMLUtilities::SCXML_TAG_DATAMODEL);
         rootElement.appendChild(dataModelElement);
-        foreach (SCXMLDataItem* dataItem, mDataModel.GetDataItemList()) {
+        // a nested item follows its parent, whose element is already made
+        QVector<QDomElement> dataElements;
+        foreach (const SCXMLDataItem& dataItem, mDataModel.GetDataItems()) {
             QDomElement dataElement = doc.createElement(XMLUtilities::SCXML_TAG_DATA);
-            dataElement.setAttribute(XMLUtilities::SCXML_TAG_ID, dataItem->GetId());
-            if (dataItem->GetSrc() != "") {
-                dataElement.setAttribute(XMLUtilities::SCXML_TAG_SRC, dataItem->GetSrc());
+            dataElement.setAttribute(XMLUtilities::SCXML_TAG_ID, dataItem.GetId());
+            if (dataItem.GetSrc() != "") {
+                dataElement.setAttribute(XMLUtilities::SCXML_TAG_SRC, dataItem.GetSrc());
             }
-            if (dataItem->GetExpr() != "") {
-                dataElement.setAttribute(XMLUtilities::SCXML_TAG_EXPR, dataItem->GetExpr());
+            if (dataItem.GetExpr() != "") {
+                dataElement.setAttribute(XMLUtilities::SCXML_TAG_EXPR, dataItem.GetExpr());
             }
-            dataModelElement.appendChild(dataElement);
+            if (dataItem.GetParent() >= 0) {
+                dataElements[dataItem.GetParent()].appendChild(dataElement);
+            }
+            else {
+                dataModelElement.appendChild(dataElement);
+            }
+            dataElements.append(dataElement);
         }
     }
 
-    // traverse the states to build up the SCXML document
-    foreach(QObject* child, this->children()) {
-        SCXMLState* state = dynamic_cast<SCXMLState*>(child);
-        if (state == nullptr) continue;
+    // traverse the top level states to build up the SCXML document, child states are nested within them
+    foreach(SCXMLState* state, GetStates()) {
+        if (state->GetParentState() != nullptr) continue;
+        rootElement.appendChild(CreateStateElement(doc, state));
+    }
+}
+
+QDomElement Workflow::CreateStateElement(QDomDocument &doc, SCXMLState *state)
+{
+    QDomElement element = doc.createElement(state->GetFinal() ? XMLUtilities::SCXML_TAG_FINAL : XMLUtilities::SCXML_TAG_STATE);
+    element.setAttribute(XMLUtilities::SCXML_TAG_ID, state->GetId());
 
-        QDomElement element = doc.createElement(state->GetFinal() ? XMLUtilities::SCXML_TAG_FINAL : XMLUtilities::SCXML_TAG_STATE);
-        element.setAttribute(XMLUtilities::SCXML_TAG_ID, state->GetId());
+    // add the state meta-data comment
+    QDomComment metaDataComment = doc.createComment(state->GetMetaDataString());
+    element.appendChild(metaDataComment);
 
-        // add the state meta-data comment
-        QDomComment metaDataComment = doc.createComment(state->GetMetaDataString());
-        element.appendChild(metaDataComment);
+    // add the onentry and onexit
+    SCXMLExecutableContent* onEntry = state->GetOnEntry();
+    if (onEntry != nullptr) {
+        QDomElement onEntryElement = doc.createElement(XMLUtilities::SCXML_TAG_ONENTRY);
+        onEntry->ToXmlElement(doc, onEntryElement);
+        element.appendChild(onEntryElement);
+    }
+    SCXMLExecutableContent* onExit = state->GetOnExit();
+    if (onExit != nullptr) {
+        QDomElement onExitElement = doc.createElement(XMLUtilities::SCXML_TAG_ONEXIT);
+        onExit->ToXmlElement(doc, onExitElement);
+        element.appendChild(onExitElement);
+    }
 
-        // add the onentry
-        SCXMLExecutableContent* onEntry = state->GetOnEntry();
-        if (onEntry != nullptr) {
-            QDomElement onEntryElement = doc.createElement(XMLUtilities::SCXML_TAG_ONENTRY);
-            onEntry->ToXmlElement(doc, onEntryElement);
-            element.appendChild(onEntryElement);
+    // add the transitions
+    foreach(QAbstractTransition* trans, state->transitions()) {
+        SCXMLTransition* transition = dynamic_cast<SCXMLTransition*>(trans);
+        if (transition == nullptr) continue;
+        QDomElement transitionElement = doc.createElement(XMLUtilities::SCXML_TAG_TRANSITION);
+        if (transition->getTransitionType() != "") {
+            transitionElement.setAttribute(XMLUtilities::SCXML_TAG_TYPE, transition->getTransitionType());
+        }
+        SCXMLState* targetState = dynamic_cast<SCXMLState*>(transition->targetState());
+        if (targetState == nullptr) continue;
+        transitionElement.setAttribute(XMLUtilities::SCXML_TAG_TARGET, targetState->GetId());
+        QString event = transition->GetEvent();
+        if (!event.isEmpty()) {
+            transitionElement.setAttribute(XMLUtilities::SCXML_TAG_EVENT, event);
         }
-        // add the transitions
-        foreach(QAbstractTransition* trans, state->transitions()) {
-            SCXMLTransition* transition = dynamic_cast<SCXMLTransition*>(trans);
+        transitionElement.setAttribute(XMLUtilities::SCXML_TAG_TARGET, targetState->GetId());
+        if (!transition->GetCond().isEmpty()) {
+            transitionElement.setAttribute(XMLUtilities::SCXML_TAG_COND, transition->GetCond());
+        }
+
+        // add the transition meta-data comment
+        QDomComment metaDataComment = doc.createComment(transition->GetMetaDataString());
+        transitionElement.appendChild(metaDataComment);
+
+        // add the executable content
+        if (transition->GetContent() != nullptr) {
+            transition->GetContent()->ToXmlElement(doc, transitionElement);
+        }
+
+        element.appendChild(transitionElement);
+    }
+
+    // add the child states
+    foreach(SCXMLState* childState, state->GetChildStates()) {
+        element.appendChild(CreateStateElement(doc, childState));
+    }
+
+    return element;
+}
+
+//!
+//! \brief Workflow::ConstructSCXMLFromStateMachine
+//!
+//! Writes the same document as the DOM overload straight to the writer's device, laid out as
+//! QDomDocument::toByteArray() would save it, without building the document in memory.
+//!
+void Workflow::ConstructSCXMLFromStateMachine(QXmlStreamWriter &writer)
+{
+    WorkflowModel model;
+    ConstructModelFromStateMachine(model);
+    writer.setAutoFormatting(false);
+    model.WriteToStream(writer);
+}
+
+//! Adds a state and the states nested within it, in the order they are written
+static void CollectNestedStates(SCXMLState* state, QList<SCXMLState*>& states)
+{
+    states.append(state);
+    foreach (SCXMLState* childState, state->GetChildStates()) {
+        CollectNestedStates(childState, states);
+    }
+}
+
+void Workflow::ConstructModelFromStateMachine(WorkflowModel &model)
+{
+    QList<SCXMLState*> states;
+    foreach (SCXMLState* state, GetStates()) {
+        if (state->GetParentState() == nullptr) CollectNestedStates(state, states);
+    }
+    ConstructModelFromStates(model, states);
+}
+
+//! Takes a snapshot of a transition, with a copy of its executable content, for a model
+static WorkflowTransitionModel ConstructTransitionModel(SCXMLTransition* transition, int sourceIndex, SCXMLState* targetState)
+{
+    WorkflowTransitionModel transitionModel;
+    transitionModel.sourceIndex = sourceIndex;
+    transitionModel.target = targetState->GetIdAtom();
+    transitionModel.event = transition->GetEvent();
+    transitionModel.type = transition->getTransitionType();
+    transitionModel.cond = transition->GetCond();
+    transitionModel.metaData = transition->GetMetaData();
+    if (transition->GetContent() != nullptr) transitionModel.content = transition->GetContent()->Clone();
+    return transitionModel;
+}
+
+//!
+//! \brief Workflow::ConstructModelFromStates
+//! The strings are shared with the workflow until either side changes them, so the snapshot
+//! costs little more than a walk over the states. The executable content is copied as the
+//! workflow owns its actions.
+//!
+void Workflow::ConstructModelFromStates(WorkflowModel &model, const QList<SCXMLState*> &states)
+{
+    model.Clear();
+    model.name = mName;
+    model.initialStateName = mInitialStateName;
+    foreach (const SCXMLDataItem& dataItem, mDataModel.GetDataItems()) {
+        WorkflowDataItemModel dataItemModel;
+        dataItemModel.id = dataItem.GetId();
+        dataItemModel.src = dataItem.GetSrc();
+        dataItemModel.expr = dataItem.GetExpr();
+        dataItemModel.parent = dataItem.GetParent();
+        model.dataItems.append(dataItemModel);
+    }
+
+    QHash<SCXMLState*, int> stateIndexes;
+    stateIndexes.reserve(states.count());
+    model.states.reserve(states.count());
+    foreach (SCXMLState* state, states) {
+        WorkflowStateModel stateModel;
+        stateModel.id = state->GetIdAtom();
+        stateModel.final = state->GetFinal();
+        stateModel.parentIndex = stateIndexes.value(state->GetParentState(), -1);
+        stateModel.metaData = state->GetMetaData();
+        if (state->GetOnEntry() != nullptr) stateModel.onEntry = state->GetOnEntry()->Clone();
+        if (state->GetOnExit() != nullptr) stateModel.onExit = state->GetOnExit()->Clone();
+        stateIndexes.insert(state, model.states.count());
+        model.states.append(stateModel);
+    }
+
+    // transitions to a state that is not in the workflow are not saved
+    for (int statePos=0; statePos<states.count(); statePos++) {
+        foreach (QAbstractTransition* abtran, states.at(statePos)->transitions()) {
+            SCXMLTransition* transition = dynamic_cast<SCXMLTransition*>(abtran);
             if (transition == nullptr) continue;
-            QDomElement transitionElement = doc.createElement(XMLUtilities::SCXML_TAG_TRANSITION);
-            if (transition->getTransitionType() != "") {
-                transitionElement.setAttribute(XMLUtilities::SCXML_TAG_TYPE, transition->getTransitionType());
-            }
             SCXMLState* targetState = dynamic_cast<SCXMLState*>(transition->targetState());
             if (targetState == nullptr) continue;
-            transitionElement.setAttribute(XMLUtilities::SCXML_TAG_TARGET, targetState->GetId());
-            QString event = transition->GetEvent();
-            if (!event.isEmpty()) {
-                transitionElement.setAttribute(XMLUtilities::SCXML_TAG_EVENT, event);
+
+            model.transitions.append(ConstructTransitionModel(transition, statePos, targetState));
+        }
+    }
+}
+
+//!
+//! \brief AlignSourceRange
+//! The stream reader's character offsets can run a character past the end of a token, as it
+//! looks ahead, so the range recorded for an element or comment is aligned with its markup in
+//! the source before it is replaced.
+//! \return The aligned range, invalid if the range does not hold an element or comment
+//!
+static SCXMLSourceRange AlignSourceRange(const QByteArray& data, const SCXMLSourceRange& range, bool comment)
+{
+    if (!range.IsValid() || range.start >= data.size()) return SCXMLSourceRange();
+    int recordedStart = int(range.start);
+    int recordedEnd = int(qMin(range.end, qint64(data.size())));
+
+    // the markup starts at or just before the recorded start, with no tag ending in between
+    int start = data.lastIndexOf('<', recordedStart);
+    if (start < 0) return SCXMLSourceRange();
+    int tagEnd = data.indexOf('>', start);
+    if (tagEnd >= 0 && tagEnd < recordedStart) return SCXMLSourceRange();
+
+    int end;
+    if (comment) {
+        if (data.mid(start, 4) != "<!--") return SCXMLSourceRange();
+        end = data.indexOf("-->", start + 4);
+        if (end < 0) return SCXMLSourceRange();
+        end += 3;
+    }
+    else {
+        if (start + 1 >= data.size() || !QChar::fromLatin1(data.at(start + 1)).isLetter()) return SCXMLSourceRange();
+        end = data.lastIndexOf('>', recordedEnd - 1) + 1;
+    }
+
+    // only white space, or the start of the next markup, may follow the recorded end
+    if (end <= start || end > recordedEnd) return SCXMLSourceRange();
+    for (int pos=end; pos<recordedEnd; pos++) {
+        char c = data.at(pos);
+        if (c != '<' && c != ' ' && c != '\t' && c != '\r' && c != '\n') return SCXMLSourceRange();
+    }
+    return SCXMLSourceRange(start, end);
+}
+
+//! Checks whether the state, or a state it is nested within, is one of the given states
+static bool IsWithinStates(SCXMLState* state, const QSet<SCXMLState*>& states)
+{
+    for (; state != nullptr; state = state->GetParentState()) {
+        if (states.contains(state)) return true;
+    }
+    return false;
+}
+
+//! Gets how deeply a state is nested, 1 for a top level state
+static int GetStateDepth(SCXMLState* state)
+{
+    int depth = 0;
+    for (; state != nullptr; state = state->GetParentState()) {
+        depth++;
+    }
+    return depth;
+}
+
+//!
+//! \brief Workflow::SaveIncrementally
+//!
+//! Copies the source straight through to the file, replacing only the META-DATA comment of
+//! each state or transition whose layout has changed, inserting added transitions at the end
+//! of their source state, and replacing the element of a transition or state that has changed
+//! otherwise. Saving a small edit to a large workflow then costs copying the file plus writing
+//! the edited elements, rather than writing every element again, and the elements that are
+//! not written keep their content and formatting. The source is then reopened on the saved
+//! file, with the ranges moved to match, for the next save.
+//!
+//! The source ranges are only known if the workflow was read by the streaming reader from an
+//! ASCII file, otherwise this returns false without saving. It also returns false if an
+//! element to be replaced holds content the workflow does not keep, such as an invoke.
+//!
+bool Workflow::SaveIncrementally(QString filename)
+{
+    IncrementalSave save;
+    if (!BeginIncrementalSave(save)) return false;
+    bool succeeded = WriteIncrementalSave(save, filename);
+    FinishIncrementalSave(save, filename, succeeded);
+    return succeeded;
+}
+
+//!
+//! \brief Workflow::BeginIncrementalSave
+//! The edits are written here, so the save holds everything it needs and the workflow can be
+//! edited while the file is written. Changes made from now on are saved by the next save.
+//!
+bool Workflow::BeginIncrementalSave(IncrementalSave &save)
+{
+    if (!mHasSourceRanges || mSource.isNull()) return false;
+
+    save.edits.clear();
+    if (!CollectSourceEdits(save.edits)) return false;
+
+    // the source goes with the save, as the file it maps may be replaced
+    save.source = mSource;
+    save.mapped = mSource->IsMapped();
+    mSource.clear();
+    MarkClean();
+    return true;
+}
+
+bool Workflow::WriteIncrementalSave(IncrementalSave &save, QString filename, QCryptographicHash* hash)
+{
+    // written to a new file and renamed over the old one, as it may be the source being read
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    auto write = [&](const char* bytes, qint64 size) {
+        file.write(bytes, size);
+        if (hash != nullptr) hash->addData(bytes, int(size));
+    };
+    const QByteArray& data = save.source->GetData();
+    qint64 pos = 0;
+    foreach (const SourceEdit& edit, save.edits) {
+        write(data.constData() + pos, edit.range.start - pos);
+        write(edit.text.constData(), edit.text.size());
+        pos = edit.range.end;
+    }
+    write(data.constData() + pos, data.size() - pos);
+
+    // the mapping of the old file must be released before it can be replaced
+    save.source.clear();
+    return file.commit();
+}
+
+void Workflow::FinishIncrementalSave(IncrementalSave &save, QString filename, bool succeeded)
+{
+    // the changes were marked as saved when the save began, so only a full save is safe now
+    if (!succeeded) {
+        mHasSourceRanges = false;
+        if (!save.source.isNull()) mSource = save.source;
+        return;
+    }
+
+    MoveSourceRanges(save.edits);
+    QSharedPointer<SCXMLSourceBuffer> source(new SCXMLSourceBuffer());
+    if (source->Open(filename, save.mapped)) {
+        mSource = source;
+    }
+    else {
+        mHasSourceRanges = false;
+    }
+}
+
+SCXMLState* Workflow::GetRewrittenState(SCXMLState *state)
+{
+    while (state != nullptr && !state->GetElementRange().IsValid()) {
+        state = state->GetParentState();
+    }
+    return state;
+}
+
+//!
+//! \brief GetAppendPosition
+//! Finds where children can be added at the end of an element, before its end tag: at the
+//! start of the line of the end tag if it has a line of its own, otherwise straight before it.
+//! \return The position, -1 if the element has no end tag (e.g. <state id="a"/>)
+//!
+static int GetAppendPosition(const QByteArray& data, const SCXMLSourceRange& range, bool& ownLine)
+{
+    int end = int(range.end);
+    if (end - range.start < 2 || data.at(end - 2) == '/') return -1;
+    int endTag = data.lastIndexOf("</", end - 1);
+    if (endTag <= range.start) return -1;
+
+    int lineStart = endTag;
+    while (lineStart > range.start && (data.at(lineStart - 1) == ' ' || data.at(lineStart - 1) == '\t')) {
+        lineStart--;
+    }
+    ownLine = (lineStart > range.start && data.at(lineStart - 1) == '\n');
+    return ownLine ? lineStart : endTag;
+}
+
+//! Writes a transition as the model writer would, the written element is found in text
+static Workflow::WrittenElement WriteTransitionElement(QXmlStreamWriter& writer, const QByteArray& text,
+                                                       SCXMLTransition* transition, int depth)
+{
+    WorkflowModel model;
+    model.transitions.append(ConstructTransitionModel(transition, -1, transition->GetTargetState()));
+
+    Workflow::WrittenElement written(nullptr, transition);
+    int start = text.size();
+    model.WriteTransitionToStream(writer, 0, depth);
+    written.elementRange = SCXMLSourceRange(start, text.size());
+    // the META-DATA comment is written first within the element
+    int metaDataStart = text.indexOf("<!--", start);
+    written.metaDataRange = SCXMLSourceRange(metaDataStart, text.indexOf("-->", metaDataStart) + 3);
+    return written;
+}
+
+//! Writes a META-DATA comment, the written comment is found in text
+static Workflow::WrittenElement WriteMetaDataComment(QXmlStreamWriter& writer, const QByteArray& text,
+                                                     SCXMLState* state, SCXMLTransition* transition)
+{
+    Workflow::WrittenElement written(state, transition);
+    int start = text.size();
+    XMLUtilities::WriteComment(writer, state != nullptr ? state->GetMetaDataString() : transition->GetMetaDataString());
+    written.metaDataRange = SCXMLSourceRange(start, text.size());
+    return written;
+}
+
+//!
+//! \brief Workflow::CollectSourceEdits
+//! Transitions added to a state, and META-DATA comments for a state or transition that had
+//! none, are inserted before the end tag of the element. A transition that has changed
+//! otherwise has its element replaced. Anything else rewrites the element of the state, with
+//! everything nested within it, so any other edits within it are dropped; if the element holds
+//! content the workflow does not keep, which a rewrite would lose, this returns false. The
+//! aligned ranges are kept by the states and transitions so they match the edits when the
+//! ranges are moved after the save.
+//!
+bool Workflow::CollectSourceEdits(QList<SourceEdit> &edits)
+{
+    const QByteArray& data = mSource->GetData();
+    QSet<SCXMLState*> rewrittenStates;
+    QList<SCXMLState*> metaDataStates;
+    QList<SCXMLTransition*> metaDataTransitions;
+    QList<SCXMLTransition*> replacedTransitions;
+    // the META-DATA comments to insert, and the transitions added to each state
+    QList<SCXMLState*> addedMetaDataStates;
+    QList<SCXMLTransition*> addedMetaDataTransitions;
+    QList<SCXMLState*> addedTransitionStates;
+
+    auto rewriteState = [&](SCXMLState* state) -> bool {
+        // a state without a range is written within the nearest state that was in the source
+        SCXMLState* rewrittenState = GetRewrittenState(state);
+        if (rewrittenState == nullptr) return false;
+        rewrittenStates.insert(rewrittenState);
+        return true;
+    };
+
+    foreach (SCXMLState* state, GetStates()) {
+        int dirtyFlags = state->GetDirtyFlags();
+        bool hasElementRange = state->GetElementRange().IsValid();
+        if ((dirtyFlags & SCXMLState::DIRTY_ELEMENT) || (dirtyFlags != 0 && !hasElementRange)) {
+            if (!rewriteState(state)) return false;
+        }
+        else if (dirtyFlags & SCXMLState::DIRTY_META_DATA) {
+            if (state->GetMetaDataRange().IsValid()) metaDataStates.append(state);
+            else addedMetaDataStates.append(state);
+        }
+
+        bool addedTransitions = false;
+        foreach (SCXMLTransition* transition, mTransitionIndex.value(state)) {
+            int transitionFlags = transition->GetDirtyFlags();
+            if (transitionFlags == 0) continue;
+            if (!hasElementRange) {
+                if (!rewriteState(state)) return false;
+            }
+            else if (transitionFlags & SCXMLState::DIRTY_ADDED) {
+                addedTransitions = true;
+            }
+            else if (!transition->GetElementRange().IsValid()) {
+                if (!rewriteState(state)) return false;
+            }
+            else if (transitionFlags & SCXMLState::DIRTY_ELEMENT) {
+                replacedTransitions.append(transition);
+            }
+            else if (transition->GetMetaDataRange().IsValid()) {
+                metaDataTransitions.append(transition);
+            }
+            else {
+                addedMetaDataTransitions.append(transition);
+            }
+        }
+        if (addedTransitions) addedTransitionStates.append(state);
+    }
+
+    // the edits within a state element, which are dropped if the state is rewritten
+    QList<SourceEdit> stateEdits;
+    QList<SCXMLState*> editStates;
+
+    // a transition without an end tag cannot have a comment inserted, so it is replaced
+    foreach (SCXMLTransition* transition, addedMetaDataTransitions) {
+        SCXMLSourceRange range = AlignSourceRange(data, transition->GetElementRange(), false);
+        if (!range.IsValid()) return false;
+        transition->SetSourceRanges(range, transition->GetMetaDataRange());
+        bool ownLine = false;
+        int position = GetAppendPosition(data, range, ownLine);
+        if (position < 0) {
+            replacedTransitions.append(transition);
+            continue;
+        }
+
+        int depth = GetStateDepth(transition->GetSourceState()) + 2;
+        SourceEdit edit;
+        edit.range = SCXMLSourceRange(position, position);
+        QBuffer buffer(&edit.text);
+        buffer.open(QIODevice::WriteOnly);
+        QXmlStreamWriter writer(&buffer);
+        writer.setAutoFormatting(false);
+        if (ownLine) XMLUtilities::WriteIndent(writer, depth);
+        edit.written.append(WriteMetaDataComment(writer, edit.text, nullptr, transition));
+        if (ownLine) XMLUtilities::WriteNewLine(writer);
+        stateEdits.append(edit);
+        editStates.append(transition->GetSourceState());
+    }
+
+    // a state without an end tag has nothing nested within it, so it is rewritten
+    QList<SCXMLState*> appendedStates = addedMetaDataStates;
+    foreach (SCXMLState* state, addedTransitionStates) {
+        if (!appendedStates.contains(state)) appendedStates.append(state);
+    }
+    foreach (SCXMLState* state, appendedStates) {
+        SCXMLSourceRange range = AlignSourceRange(data, state->GetElementRange(), false);
+        if (!range.IsValid()) return false;
+        state->SetSourceRanges(range, state->GetMetaDataRange());
+        bool ownLine = false;
+        int position = GetAppendPosition(data, range, ownLine);
+        if (position < 0) {
+            rewrittenStates.insert(state);
+            continue;
+        }
+
+        int depth = GetStateDepth(state) + 1;
+        SourceEdit edit;
+        edit.range = SCXMLSourceRange(position, position);
+        QBuffer buffer(&edit.text);
+        buffer.open(QIODevice::WriteOnly);
+        QXmlStreamWriter writer(&buffer);
+        writer.setAutoFormatting(false);
+        if (addedMetaDataStates.contains(state)) {
+            if (ownLine) XMLUtilities::WriteIndent(writer, depth);
+            edit.written.append(WriteMetaDataComment(writer, edit.text, state, nullptr));
+            if (ownLine) XMLUtilities::WriteNewLine(writer);
+        }
+        foreach (SCXMLTransition* transition, mTransitionIndex.value(state)) {
+            if (!(transition->GetDirtyFlags() & SCXMLState::DIRTY_ADDED)) continue;
+            if (ownLine) XMLUtilities::WriteIndent(writer, depth);
+            edit.written.append(WriteTransitionElement(writer, edit.text, transition, depth));
+            if (ownLine) XMLUtilities::WriteNewLine(writer);
+        }
+        stateEdits.append(edit);
+        editStates.append(state);
+    }
+
+    foreach (SCXMLTransition* transition, replacedTransitions) {
+        if (transition->HasForeignContent()) return false;
+        SCXMLSourceRange range = AlignSourceRange(data, transition->GetElementRange(), false);
+        if (!range.IsValid()) return false;
+        transition->SetSourceRanges(range, transition->GetMetaDataRange());
+
+        SourceEdit edit;
+        edit.range = range;
+        QBuffer buffer(&edit.text);
+        buffer.open(QIODevice::WriteOnly);
+        QXmlStreamWriter writer(&buffer);
+        writer.setAutoFormatting(false);
+        edit.written.append(WriteTransitionElement(writer, edit.text, transition, GetStateDepth(transition->GetSourceState()) + 1));
+        stateEdits.append(edit);
+        editStates.append(transition->GetSourceState());
+    }
+
+    foreach (SCXMLState* state, metaDataStates) {
+        SCXMLSourceRange range = AlignSourceRange(data, state->GetMetaDataRange(), true);
+        if (!range.IsValid()) return false;
+        state->SetSourceRanges(state->GetElementRange(), range);
+
+        SourceEdit edit;
+        edit.range = range;
+        QBuffer buffer(&edit.text);
+        buffer.open(QIODevice::WriteOnly);
+        QXmlStreamWriter writer(&buffer);
+        XMLUtilities::WriteComment(writer, state->GetMetaDataString());
+        stateEdits.append(edit);
+        editStates.append(state);
+    }
+
+    foreach (SCXMLTransition* transition, metaDataTransitions) {
+        SCXMLSourceRange range = AlignSourceRange(data, transition->GetMetaDataRange(), true);
+        if (!range.IsValid()) return false;
+        transition->SetSourceRanges(transition->GetElementRange(), range);
+
+        SourceEdit edit;
+        edit.range = range;
+        QBuffer buffer(&edit.text);
+        buffer.open(QIODevice::WriteOnly);
+        QXmlStreamWriter writer(&buffer);
+        XMLUtilities::WriteComment(writer, transition->GetMetaDataString());
+        stateEdits.append(edit);
+        editStates.append(transition->GetSourceState());
+    }
+
+    for (int editPos=0; editPos<stateEdits.count(); editPos++) {
+        if (!IsWithinStates(editStates.at(editPos), rewrittenStates)) edits.append(stateEdits.at(editPos));
+    }
+
+    foreach (SCXMLState* state, rewrittenStates) {
+        if (IsWithinStates(state->GetParentState(), rewrittenStates)) continue;
+        SCXMLSourceRange range = AlignSourceRange(data, state->GetElementRange(), false);
+        if (!range.IsValid()) return false;
+        state->SetSourceRanges(range, state->GetMetaDataRange());
+
+        // the element is written from what the workflow keeps, anything else in it would be lost
+        QList<SCXMLState*> nestedStates;
+        CollectNestedStates(state, nestedStates);
+        foreach (SCXMLState* nestedState, nestedStates) {
+            if (nestedState->HasForeignContent()) return false;
+            foreach (SCXMLTransition* transition, mTransitionIndex.value(nestedState)) {
+                if (transition->HasForeignContent()) return false;
             }
-            transitionElement.setAttribute(XMLUtilities::SCXML_TAG_TARGET, targetState->GetId());
+        }
 
-            // add the transition meta-data comment
-            QDomComment metaDataComment = doc.createComment(transition->GetMetaDataString());
-            transitionElement.appendChild(metaDataComment);
+        SourceEdit edit;
+        edit.range = range;
+        QBuffer buffer(&edit.text);
+        buffer.open(QIODevice::WriteOnly);
+        QXmlStreamWriter writer(&buffer);
+        writer.setAutoFormatting(false);
+        WorkflowModel model;
+        ConstructModelFromStates(model, nestedStates);
+        model.WriteStateToStream(writer, 0, GetStateDepth(state));
+        edits.append(edit);
+    }
 
-            element.appendChild(transitionElement);
+    // the data model is read from every datamodel element, so it can only replace a single one
+    if (mDataModel.IsDirty()) {
+        SCXMLSourceRange range = AlignSourceRange(data, mDataModel.GetElementRange(), false);
+        if (!range.IsValid()) return false;
+        mDataModel.SetElementRange(range);
+
+        SourceEdit edit;
+        edit.range = range;
+        if (mDataModel.HasItems()) {
+            QBuffer buffer(&edit.text);
+            buffer.open(QIODevice::WriteOnly);
+            QXmlStreamWriter writer(&buffer);
+            writer.setAutoFormatting(false);
+            WorkflowModel model;
+            ConstructModelFromStates(model, QList<SCXMLState*>());
+            model.WriteDataModelToStream(writer, 1);
         }
-        rootElement.appendChild(element);
+        edits.append(edit);
     }
+
+    std::sort(edits.begin(), edits.end(), [](const SourceEdit& first, const SourceEdit& second) {
+        return first.range.start < second.range.start;
+    });
+    for (int editPos=1; editPos<edits.count(); editPos++) {
+        if (edits.at(editPos).range.start < edits.at(editPos - 1).range.end) return false;
+    }
+    return true;
+}
+
+//!
+//! \brief Workflow::MoveSourceRanges
+//! Each range moves by the change in length of the edits before it, with the end of a range
+//! staying before anything inserted where it ends. The range of an edit becomes the range of
+//! its replacement, a range within it no longer exists, and the states and transitions
+//! written by an edit take where they were written.
+//!
+void Workflow::MoveSourceRanges(const QList<SourceEdit> &edits)
+{
+    QVector<qint64> editStarts;
+    QVector<qint64> editEnds;
+    QVector<qint64> shifts;
+    QHash<SCXMLState*, WrittenElement> writtenStates;
+    QHash<SCXMLTransition*, WrittenElement> writtenTransitions;
+    qint64 shift = 0;
+    foreach (const SourceEdit& edit, edits) {
+        editStarts.append(edit.range.start);
+        editEnds.append(edit.range.end);
+
+        qint64 textStart = edit.range.start + shift;
+        foreach (WrittenElement written, edit.written) {
+            if (written.elementRange.IsValid()) {
+                written.elementRange = SCXMLSourceRange(textStart + written.elementRange.start, textStart + written.elementRange.end);
+            }
+            written.metaDataRange = SCXMLSourceRange(textStart + written.metaDataRange.start, textStart + written.metaDataRange.end);
+            if (written.state != nullptr) writtenStates.insert(written.state, written);
+            if (written.transition != nullptr) writtenTransitions.insert(written.transition, written);
+        }
+
+        shift += edit.text.size() - (edit.range.end - edit.range.start);
+        shifts.append(shift);
+    }
+
+    auto moveOffset = [&](qint64 offset, bool rangeEnd) -> qint64 {
+        // the edits that end at or before the offset
+        int editCount = int(std::upper_bound(editEnds.begin(), editEnds.end(), offset) - editEnds.begin());
+        if (rangeEnd && editCount > 0 && editStarts.at(editCount - 1) == offset) editCount--;
+        return offset + (editCount > 0 ? shifts.at(editCount - 1) : 0);
+    };
+    auto moveRange = [&](const SCXMLSourceRange& range) -> SCXMLSourceRange {
+        if (!range.IsValid()) return range;
+        int editPos = int(std::upper_bound(editStarts.begin(), editStarts.end(), range.start) - editStarts.begin()) - 1;
+        if (editPos >= 0 && range.end <= editEnds.at(editPos) && !(range == edits.at(editPos).range)) {
+            return SCXMLSourceRange();
+        }
+        return SCXMLSourceRange(moveOffset(range.start, false), moveOffset(range.end, true));
+    };
+    auto writtenRange = [](const SCXMLSourceRange& written, const SCXMLSourceRange& moved) -> SCXMLSourceRange {
+        return written.IsValid() ? written : moved;
+    };
+
+    foreach (SCXMLState* state, GetStates()) {
+        SCXMLSourceRange elementRange = moveRange(state->GetElementRange());
+        SCXMLSourceRange metaDataRange = moveRange(state->GetMetaDataRange());
+        if (writtenStates.contains(state)) {
+            const WrittenElement& written = writtenStates[state];
+            elementRange = writtenRange(written.elementRange, elementRange);
+            metaDataRange = written.metaDataRange;
+        }
+        state->SetSourceRanges(elementRange, metaDataRange);
+
+        foreach (SCXMLTransition* transition, mTransitionIndex.value(state)) {
+            elementRange = moveRange(transition->GetElementRange());
+            metaDataRange = moveRange(transition->GetMetaDataRange());
+            if (writtenTransitions.contains(transition)) {
+                const WrittenElement& written = writtenTransitions[transition];
+                elementRange = writtenRange(written.elementRange, elementRange);
+                metaDataRange = written.metaDataRange;
+            }
+            transition->SetSourceRanges(elementRange, metaDataRange);
+        }
+    }
+    mDataModel.SetElementRange(moveRange(mDataModel.GetElementRange()));
+}
+
+void Workflow::MarkClean()
+{
+    foreach (SCXMLState* state, GetStates()) {
+        state->ClearDirty();
+        foreach (SCXMLTransition* transition, mTransitionIndex.value(state)) {
+            transition->ClearDirty();
+        }
+    }
+    mDataModel.ClearDirty();
 }
 
 void Workflow::ConstructStateMachineFromSCXML(QDomDocument &doc)
 {
-    SCXMLState* initialState = nullptr;
+    QList<PendingTransition> pendingTransitions;
 
-    mRawSCXMLText = doc.toString();
+    // keep a copy of the text only if there is no source file to view
+    if (mSource.isNull()) {
+        mRawSCXMLText = doc.toString();
+    }
 
     // ensure we have no existing state machine
-    foreach(QObject* child, this->children()) {
-        SCXMLState* state = dynamic_cast<SCXMLState*>(child);
-        removeState(state);
-    }
+    RemoveAllStates();
+    mDataModel.Clear();
+
+    // the DOM does not know where its nodes were in the source
+    mHasSourceRanges = false;
 
-    // traverse the SCXML to build up the state machine
-    QDomNodeList scxmlElements = doc.elementsByTagName(XMLUtilities::SCXML_TAG_SCXML);
-    if (scxmlElements.length() != 1) {
+    QDomElement scxmlRoot = doc.documentElement();
+    if (scxmlRoot.tagName() != XMLUtilities::SCXML_TAG_SCXML) {
         Utilities::ShowWarning("SCXML file does not have a single scxml tag");
         return;
     }
 
     // get the name of the workflow
-    QDomElement scxmlRoot = scxmlElements.at(0).toElement();
     mName = scxmlRoot.attribute(XMLUtilities::SCXML_TAG_NAME, "");
     mInitialStateName = scxmlRoot.attribute(XMLUtilities::SCXML_TAG_INITIAL, "");
 
-    // add all the states before we add transitions (they need to exist!)
-    QStringList stateTags;
-    stateTags << XMLUtilities::SCXML_TAG_STATE << XMLUtilities::SCXML_TAG_FINAL;
-    QList<QDomNode> allElements;
-    XMLUtilities::GetElementsWithTagNames(allElements, doc, stateTags);
-    for (int elementPos=0; elementPos<allElements.length(); elementPos++) {
-        QDomElement element = allElements.at(elementPos).toElement();
-        QString id = element.attribute(XMLUtilities::SCXML_TAG_ID, "unnamed");
-        QDomNodeList onEntryElements = element.elementsByTagName(XMLUtilities::SCXML_TAG_ONENTRY);
-        SCXMLExecutableContent* onEntryContent = nullptr;
-        if (onEntryElements.count() > 0) {
-            onEntryContent = SCXMLExecutableContent::FromXmlElement(onEntryElements.at(0).childNodes());
-        }
-
-        QMap<QString,QString> metaData = ExtractMetaDataFromElementComments(&element);
-        SCXMLState *newState = new SCXMLState(id, &metaData);
-        ExtractDataModelFromElement(&element, newState);
-        newState->SetFinal(element.tagName() == XMLUtilities::SCXML_TAG_FINAL);
-        newState->SetOnEntry(onEntryContent);
-
-        addState(newState);
-        if (id == mInitialStateName) {
-            initialState = newState;
-        }
-    }
-
-    // add top level data model if exists
-    ExtractDataModelFromElement(&scxmlRoot, nullptr);
-
-    // add transitions
-    for (int elementPos=0; elementPos<allElements.length(); elementPos++) {
-        QDomElement element = allElements.at(elementPos).toElement();
-        QString id = element.attribute(XMLUtilities::SCXML_TAG_ID, "unnamed");
-        SCXMLState *sourceState = GetStateById(id);
-        QDomNodeList stateTransitions = element.elementsByTagName(XMLUtilities::SCXML_TAG_TRANSITION);
-        for (int transitionPos=0; transitionPos<stateTransitions.length(); transitionPos++) {
-            QDomElement stateTransition = stateTransitions.at(transitionPos).toElement();
-            QString transitionTarget = stateTransition.attribute(XMLUtilities::SCXML_TAG_TARGET, "");
-            QString transitionType = stateTransition.attribute(XMLUtilities::SCXML_TAG_TYPE, "");
-            QString transitionEvent = stateTransition.attribute(XMLUtilities::SCXML_TAG_EVENT, "");
-
-            SCXMLState* targetState = GetStateById(transitionTarget);
-            if (targetState == nullptr) {
-                qDebug() << "No such state: " << transitionTarget;
-                continue;
+    // visit each node of the tree once, building the states as they are found. The
+    // transitions are resolved at the end since their targets may appear later in the file
+    for (QDomNode node = scxmlRoot.firstChild(); !node.isNull(); node = node.nextSibling()) {
+        if (!node.isElement()) continue;
+        QDomElement element = node.toElement();
+        QString tag = element.tagName();
+        if (tag == XMLUtilities::SCXML_TAG_STATE || tag == XMLUtilities::SCXML_TAG_FINAL) {
+            ConstructStateFromElement(element, nullptr, pendingTransitions);
+        }
+        else if (tag == XMLUtilities::SCXML_TAG_DATAMODEL) {
+            ExtractDataItemsFromElement(element);
+        }
+    }
+
+    ResolvePendingTransitions(pendingTransitions);
+}
+
+void Workflow::ConstructStateFromElement(QDomElement &element, SCXMLState *parentState, QList<PendingTransition> &pendingTransitions)
+{
+    QString id = element.attribute(XMLUtilities::SCXML_TAG_ID, "unnamed");
+
+    MetaData metaData;
+    SCXMLState *newState = new SCXMLState(id, metaData);
+    newState->SetFinal(element.tagName() == XMLUtilities::SCXML_TAG_FINAL);
+    AddState(newState);
+    if (parentState != nullptr) {
+        parentState->AddChildState(newState);
+    }
+
+    // only the direct children belong to this state, nested states are handled by recursion.
+    // Whatever the workflow does not keep marks the state as the stream loader marks it
+    bool foreignContent = false;
+    for (QDomNode node = element.firstChild(); !node.isNull(); node = node.nextSibling()) {
+        if (node.isComment()) {
+            QString text = node.toComment().data();
+            if (text.contains("META-DATA")) {
+                MetaDataSupport::ParseMetaData(text, metaData);
             }
-            QMap<QString,QString> metaData = ExtractMetaDataFromElementComments(&stateTransition);
-            SCXMLTransition* newTransition = new SCXMLTransition(sourceState, targetState, transitionEvent, transitionType, &metaData);
+            else {
+                foreignContent = true;
+            }
+            continue;
         }
+        if (!node.isElement()) continue;
+
+        QDomElement child = node.toElement();
+        QString tag = child.tagName();
+        if (tag == XMLUtilities::SCXML_TAG_STATE || tag == XMLUtilities::SCXML_TAG_FINAL) {
+            ConstructStateFromElement(child, newState, pendingTransitions);
+        }
+        else if (tag == XMLUtilities::SCXML_TAG_TRANSITION) {
+            PendingTransition pending;
+            pending.source = newState;
+            pending.target = SCXMLIntern(child.attribute(XMLUtilities::SCXML_TAG_TARGET, ""));
+            pending.type = child.attribute(XMLUtilities::SCXML_TAG_TYPE, "");
+            pending.event = child.attribute(XMLUtilities::SCXML_TAG_EVENT, "");
+            pending.cond = child.attribute(XMLUtilities::SCXML_TAG_COND, "");
+            pending.metaData = ExtractMetaDataFromElementComments(&child);
+            pending.foreignContent = false;
+            for (QDomNode transitionNode = child.firstChild(); !transitionNode.isNull(); transitionNode = transitionNode.nextSibling()) {
+                if (transitionNode.isComment() && !transitionNode.toComment().data().contains("META-DATA")) {
+                    pending.foreignContent = true;
+                }
+            }
+            pending.content = child.firstChildElement().isNull() ? nullptr :
+                    SCXMLExecutableContent::FromXmlElement(child.childNodes(), &pending.foreignContent);
+            pendingTransitions.append(pending);
+        }
+        else if (tag == XMLUtilities::SCXML_TAG_ONENTRY) {
+            // only the first is kept
+            if (newState->GetOnEntry() == nullptr) {
+                newState->SetOnEntry(SCXMLExecutableContent::FromXmlElement(child.childNodes(), &foreignContent));
+            }
+            else {
+                foreignContent = true;
+            }
+        }
+        else if (tag == XMLUtilities::SCXML_TAG_ONEXIT) {
+            if (newState->GetOnExit() == nullptr) {
+                newState->SetOnExit(SCXMLExecutableContent::FromXmlElement(child.childNodes(), &foreignContent));
+            }
+            else {
+                foreignContent = true;
+            }
+        }
+        else if (tag == XMLUtilities::SCXML_TAG_DATAMODEL) {
+            ExtractDataItemsFromElement(child);
+            foreignContent = true;
+        }
+        else {
+            foreignContent = true;
+        }
+    }
+
+    newState->ApplyMetaData(metaData);
+    newState->SetForeignContent(foreignContent);
+}
+
+void Workflow::ResolvePendingTransitions(QList<PendingTransition> &pendingTransitions)
+{
+    foreach (const PendingTransition& pending, pendingTransitions) {
+        SCXMLState* targetState = GetStateById(pending.target);
+        if (targetState == nullptr) {
+            qDebug() << "No such state: " << SCXMLAtomString(pending.target);
+            delete pending.content;
+            // as for a workflow built from a model, the state holds a transition it does not keep
+            pending.source->SetForeignContent(true);
+            continue;
+        }
+        SCXMLTransition* transition = CreateDeferredTransition(pending.source, targetState, pending.event, pending.type, pending.metaData);
+        transition->SetCond(pending.cond);
+        transition->SetContent(pending.content);
+        transition->SetForeignContent(pending.foreignContent);
+    }
+    CompleteDeferredTransitions();
+
+    // set the initial state of the state machine
+    SCXMLState* initialState = GetStateById(mInitialStateName);
+    if (initialState != nullptr) {
+        setInitialState(initialState);
+    }
+}
+
+void Workflow::ConstructCacheFromStateMachine(QDataStream &stream)
+{
+    WorkflowModel model;
+    ConstructModelFromStateMachine(model);
+    model.WriteToCache(stream);
+}
+
+bool Workflow::ConstructStateMachineFromCache(QDataStream &stream)
+{
+    WorkflowModel model;
+    if (!model.ReadFromCache(stream)) {
+        return false;
+    }
+    ConstructStateMachineFromModel(model);
+    return true;
+}
+
+bool Workflow::ConstructStateMachineFromSCXML(QXmlStreamReader &reader)
+{
+    WorkflowModel model;
+    if (!model.ReadFromStream(reader)) {
+        return false;
+    }
+    ConstructStateMachineFromModel(model);
+    return true;
+}
 
-        // need to adjust start and end points with update
-        sourceState->UpdateTransitions();
+void Workflow::ConstructStateMachineFromModel(WorkflowModel &model)
+{
+    BeginConstructFromModel(model);
+    ConstructStatesFromModel(model, 0, model.states.count());
+    ConstructTransitionsFromModel(model, 0, model.transitions.count());
+    FinishConstructFromModel();
+}
 
-        // set the initial state of the state machine
-        if (initialState != nullptr) {
-            setInitialState(initialState);
+void Workflow::BeginConstructFromModel(WorkflowModel &model)
+{
+    // ensure we have no existing state machine
+    RemoveAllStates();
+    mDataModel.Clear();
+
+    mName = model.name;
+    mInitialStateName = model.initialStateName;
+    foreach (const WorkflowDataItemModel& dataItem, model.dataItems) {
+        mDataModel.AddDataItem(SCXMLDataItem(dataItem.id, dataItem.src, dataItem.expr, dataItem.parent));
+    }
+    mHasSourceRanges = model.hasSourceRanges;
+    mDataModel.SetElementRange(model.dataModelRange);
+
+    mModelStates.clear();
+    mModelStates.reserve(model.states.count());
+    mStateIndex.reserve(model.states.count());
+}
+
+//!
+//! \brief Workflow::ConstructStatesFromModel
+//! Creates up to count states from index first onwards. The states must be created in order
+//! as a parent has to exist before its children.
+//! \return The states created
+//!
+QList<SCXMLState*> Workflow::ConstructStatesFromModel(WorkflowModel &model, int first, int count)
+{
+    QList<SCXMLState*> created;
+    int last = qMin(first + count, model.states.count());
+    for (int statePos=first; statePos<last; statePos++) {
+        WorkflowStateModel& stateModel = model.states[statePos];
+        SCXMLState* state = new SCXMLState(stateModel.id, stateModel.metaData);
+        state->SetFinal(stateModel.final);
+
+        // the workflow now owns the executable content
+        state->SetOnEntry(stateModel.onEntry);
+        state->SetOnExit(stateModel.onExit);
+        stateModel.onEntry = nullptr;
+        stateModel.onExit = nullptr;
+        state->SetSourceRanges(stateModel.elementRange, stateModel.metaDataRange);
+        state->SetForeignContent(stateModel.foreignContent);
+
+        AddState(state);
+        if (stateModel.parentIndex >= 0 && stateModel.parentIndex < mModelStates.count()) {
+            mModelStates[stateModel.parentIndex]->AddChildState(state);
+        }
+        mModelStates.append(state);
+        created.append(state);
+    }
+    return created;
+}
+
+//!
+//! \brief Workflow::ConstructTransitionsFromModel
+//! Creates up to count transitions from index first onwards, once all the states exist.
+//! \return The transitions created, transitions to unknown states are skipped
+//!
+QList<SCXMLTransition*> Workflow::ConstructTransitionsFromModel(WorkflowModel &model, int first, int count)
+{
+    QList<SCXMLTransition*> created;
+    int last = qMin(first + count, model.transitions.count());
+    for (int transitionPos=first; transitionPos<last; transitionPos++) {
+        WorkflowTransitionModel& transitionModel = model.transitions[transitionPos];
+        if (transitionModel.sourceIndex < 0 || transitionModel.sourceIndex >= mModelStates.count()) continue;
+        SCXMLState* sourceState = mModelStates.at(transitionModel.sourceIndex);
+        SCXMLState* targetState = GetStateById(transitionModel.target);
+        if (targetState == nullptr) {
+            qDebug() << "No such state: " << SCXMLAtomString(transitionModel.target);
+            // the transition is left in the source, so the state cannot be written again
+            sourceState->SetForeignContent(true);
+            continue;
         }
+        SCXMLTransition* transition = CreateDeferredTransition(sourceState, targetState, transitionModel.event,
+                                                               transitionModel.type, transitionModel.metaData);
+        transition->SetSourceRanges(transitionModel.elementRange, transitionModel.metaDataRange);
+        transition->SetForeignContent(transitionModel.foreignContent);
+
+        // the workflow now owns the executable content
+        transition->SetCond(transitionModel.cond);
+        transition->SetContent(transitionModel.content);
+        transitionModel.content = nullptr;
+        created.append(transition);
+    }
+    CompleteDeferredTransitions();
+    return created;
+}
+
+void Workflow::FinishConstructFromModel()
+{
+    mModelStates.clear();
+
+    // building the workflow marks everything as changed, saves compare against the source
+    MarkClean();
+
+    // set the initial state of the state machine
+    SCXMLState* initialState = GetStateById(mInitialStateName);
+    if (initialState != nullptr) {
+        setInitialState(initialState);
+    }
+}
+
+void Workflow::RemoveAllStates()
+{
+    foreach(QObject* child, this->children()) {
+        SCXMLState* state = dynamic_cast<SCXMLState*>(child);
+        if (state == nullptr) continue;
+        removeState(state);
     }
+    mStateIndex.clear();
+    mTransitionIndex.clear();
+    mDeferredTransitions.clear();
+    mTransitionCount = 0;
 }
 
-void Workflow::ExtractDataModelFromElement(QDomElement* element, SCXMLState* state)
+void Workflow::ExtractDataItemsFromElement(QDomElement &dataModelElement, int parent)
 {
-    QDomNodeList allSubNodes = element->childNodes();
-    for (int subPos=0; subPos<allSubNodes.length(); subPos++) {
-        QDomNode node = allSubNodes.at(subPos);
+    // found the data model, now traverse the data items, each nested one under its parent
+    for (QDomNode node = dataModelElement.firstChild(); !node.isNull(); node = node.nextSibling()) {
         if (!node.isElement()) continue;
-        QDomElement elementDataModel = node.toElement();
-        if (elementDataModel.nodeName() != "datamodel") continue;
-
-        // found the data model, now traverse the data items
-        QDomNodeList dataNodes = elementDataModel.elementsByTagName("data");
-        for (int dataPos=0; dataPos<dataNodes.length(); dataPos++) {
-            QDomNamedNodeMap attrMap = dataNodes.at(dataPos).attributes();
-            QString src = "";
-            QString expr = "";
-            if (attrMap.contains("src")) src = attrMap.namedItem("src").toAttr().value();
-            if (attrMap.contains("expr")) expr = attrMap.namedItem("expr").toAttr().value();
-            if (attrMap.contains("id")) {
-                SCXMLDataItem* dataItem = new SCXMLDataItem(attrMap.namedItem("id").toAttr().value(), src, expr);
-                mDataModel.AddDataItem(dataItem);
-                if (state != nullptr) {
-                    //TODO: add details to state
-                }
-            }
+        QDomElement dataElement = node.toElement();
+        if (dataElement.tagName() != XMLUtilities::SCXML_TAG_DATA) continue;
+        QDomNamedNodeMap attrMap = dataElement.attributes();
+        QString src = "";
+        QString expr = "";
+        if (attrMap.contains("src")) src = attrMap.namedItem("src").toAttr().value();
+        if (attrMap.contains("expr")) expr = attrMap.namedItem("expr").toAttr().value();
+        int dataParent = parent;
+        if (attrMap.contains("id")) {
+            dataParent = mDataModel.AddDataItem(SCXMLDataItem(attrMap.namedItem("id").toAttr().value(), src, expr, parent));
         }
+        ExtractDataItemsFromElement(dataElement, dataParent);
     }
 }
 
-QMap<QString, QString> Workflow::ExtractMetaDataFromElementComments(QDomElement* element)
+MetaData Workflow::ExtractMetaDataFromElementComments(QDomElement* element)
 {
-    QMap<QString, QString> mapMetaData;
-    QDomNodeList allSubNodes = element->childNodes();
-    for (int subPos=0; subPos<allSubNodes.length(); subPos++) {
-        QDomNode node = allSubNodes.at(subPos);
+    MetaData metaData;
+    for (QDomNode node = element->firstChild(); !node.isNull(); node = node.nextSibling()) {
         if (!node.isComment()) continue;
 
         // comment detected - is it meta data?
-        QDomComment comment = node.toComment();
-        QString text = comment.data();
+        QString text = node.toComment().data();
         if (text.contains("META-DATA")) {
-            ParseMetaData(text, mapMetaData);
+            MetaDataSupport::ParseMetaData(text, metaData);
         }
     }
 
-    return mapMetaData;
+    return metaData;
 }
 
 SCXMLState* Workflow::GetStateById(QString id)
 {
+    // an id that was never interned cannot belong to a state
+    SCXMLAtom atom = SCXMLAtomTable::Instance()->Find(id);
+    if (atom == SCXMLAtomTable::ATOM_INVALID) return nullptr;
+    return GetStateById(atom);
+}
+
+void Workflow::AddState(SCXMLState *state)
+{
+    addState(state);
+
+    // the first state with an id wins, as it did with the linear search
+    if (!mStateIndex.contains(state->GetIdAtom())) {
+        mStateIndex.insert(state->GetIdAtom(), state);
+    }
+}
+
+QList<SCXMLState*> Workflow::GetStates()
+{
+    QList<SCXMLState*> states;
     foreach(QObject* child, this->children()) {
         SCXMLState* state = dynamic_cast<SCXMLState*>(child);
-        if (state->GetId() == id) return state;
+        if (state != nullptr) states.append(state);
     }
-    return NULL;
+    return states;
+}
+
+void Workflow::AddTransition(SCXMLTransition *transition)
+{
+    mTransitionIndex[transition->GetSourceState()].append(transition);
+    TransitionEdited(transition);
+    mTransitionCount++;
+    // an incremental save adds it within the element of its source state
+    transition->MarkDirty(SCXMLState::DIRTY_ADDED);
+}
+
+SCXMLTransition* Workflow::CreateDeferredTransition(SCXMLState *source, SCXMLState *target, QString event, QString type, const MetaData &metaData)
+{
+    SCXMLTransition* transition = new SCXMLTransition(source, target, event, type, metaData, true);
+    AddTransition(transition);
+    mDeferredTransitions.append(transition);
+    return transition;
+}
+
+//!
+//! \brief Workflow::CompleteDeferredTransitions
+//! Builds the curve and animation of each deferred transition exactly once. Creating the
+//! transitions one at a time rebuilds every transition of both their states each time, which
+//! for a state with N transitions costs O(N^2) curve and animation rebuilds.
+//!
+void Workflow::CompleteDeferredTransitions()
+{
+    foreach (SCXMLTransition* transition, mDeferredTransitions) {
+        transition->CompleteGeometry();
+    }
+    mDeferredTransitions.clear();
 }
 
 void Workflow::CreateSceneObjects(QGraphicsScene* scene)
 {
     foreach(QObject* child, this->children()) {
         SCXMLState* state = dynamic_cast<SCXMLState*>(child);
+        if (state == nullptr) continue;
         QGraphicsItem* item = dynamic_cast<QGraphicsItem*>(state);
         scene->addItem(item);
 
@@ -241,18 +1157,38 @@ void Workflow::CreateSceneObjects(QGraphicsScene* scene)
     }
 }
 
-void Workflow::ParseMetaData(QString text, QMap<QString, QString> &map)
+void Workflow::SetRecordEdits(bool value)
 {
-    // may need to change this to handle more complex meta-data, for now looks for "[data]" and assumes a single = sign
-    QRegExp rx(tr("\\[([^\\[]+)\\]"));
-    int pos = 0;
-    while ((pos = rx.indexIn(text, pos)) != -1) {
-        QString metaData = rx.cap(1);
-        QStringList parts = metaData.split('=');
-        if (parts.length() > 1) {
-            map.remove(parts[0]);
-            map.insert(parts[0], parts[1]);
-        }
-        pos += rx.matchedLength();
+    mRecordEdits = value;
+    mEditedStates.clear();
+    mEditedTransitions.clear();
+    mRecordedDataModelRevision = mDataModel.GetRevision();
+}
+
+//!
+//! \brief Workflow::TakeEdits
+//! A state edited many times, e.g. while it is dragged, is only taken once. The states are
+//! ordered by how deeply they are nested so a new state comes after its new parent.
+//!
+void Workflow::TakeEdits(Edits &edits)
+{
+    edits.dataModel = (mDataModel.GetRevision() != mRecordedDataModelRevision);
+
+    QList<QPair<int, SCXMLState*> > depthStates;
+    depthStates.reserve(mEditedStates.count());
+    foreach (SCXMLState* state, mEditedStates) {
+        depthStates.append(qMakePair(GetStateDepth(state), state));
     }
+    std::sort(depthStates.begin(), depthStates.end(), [](const QPair<int, SCXMLState*>& first, const QPair<int, SCXMLState*>& second) {
+        return first.first < second.first;
+    });
+    edits.states.clear();
+    for (int statePos=0; statePos<depthStates.count(); statePos++) {
+        edits.states.append(depthStates.at(statePos).second);
+    }
+    edits.transitions = mEditedTransitions.toList();
+
+    mEditedStates.clear();
+    mEditedTransitions.clear();
+    mRecordedDataModelRevision = mDataModel.GetRevision();
 }
@@ -2,10 +2,22 @@
 #define WORKFLOW_H
 
 #include <QStateMachine>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QSharedPointer>
 #include <QDomDocument>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <QDataStream>
+#include <QCryptographicHash>
 #include <QGraphicsScene>
 #include "scxmlstate.h"
 #include "scxmldatamodel.h"
+#include "scxmlsourcebuffer.h"
+#include "workflowmodel.h"
+
+class SCXMLTransition;
 
 //! Represents an SCXML workflow
 //!
@@ -19,41 +31,223 @@ public:
     //! Builds an SCXML representation of this workflow
     void ConstructSCXMLFromStateMachine(QDomDocument& doc);
 
+    //! Writes the SCXML of this workflow straight to the writer's device, with the same
+    //! layout as the DOM. Check writer.hasError() for write errors
+    void ConstructSCXMLFromStateMachine(QXmlStreamWriter& writer);
+
+    //! Takes a snapshot of the workflow as a model, which can be written out on another thread
+    //! while the workflow is edited
+    void ConstructModelFromStateMachine(WorkflowModel& model);
+
+    //! A state or transition an incremental save writes, with where its element and META-DATA
+    //! comment are within the text of the edit. An invalid element range leaves the element
+    //! where it was
+    struct WrittenElement {
+        WrittenElement(SCXMLState* state = nullptr, SCXMLTransition* transition = nullptr) :
+            state(state), transition(transition) {}
+
+        SCXMLState* state;
+        SCXMLTransition* transition;
+        SCXMLSourceRange elementRange;
+        SCXMLSourceRange metaDataRange;
+    };
+
+    //! A part of the source replaced by an incremental save, an empty range inserts the text
+    struct SourceEdit {
+        SCXMLSourceRange range;
+        QByteArray text;
+        QList<WrittenElement> written;
+    };
+
+    //! Everything an incremental save writes, taken from the workflow when the save begins
+    struct IncrementalSave {
+        IncrementalSave() : mapped(false) {}
+
+        QSharedPointer<SCXMLSourceBuffer> source;
+        bool mapped;
+        QList<SourceEdit> edits;
+    };
+
+    //! Saves to a file by copying the source and rewriting only what has changed since the
+    //! workflow was loaded or last saved this way. Returns false, having saved nothing, if the
+    //! changes cannot be saved like this (e.g. they would rewrite an element holding content
+    //! the workflow does not keep), the workflow must then be saved in full
+    bool SaveIncrementally(QString filename);
+
+    //! The steps of SaveIncrementally, so the file can be written on a worker thread: begin
+    //! (returns false if the workflow must be saved in full), write on any thread, then finish
+    //! with whether the write succeeded. The bytes written are added to hash if it is given,
+    //! so the saved file need not be read again to hash it
+    bool BeginIncrementalSave(IncrementalSave& save);
+    static bool WriteIncrementalSave(IncrementalSave& save, QString filename, QCryptographicHash* hash = nullptr);
+    void FinishIncrementalSave(IncrementalSave& save, QString filename, bool succeeded);
+
     //! Builds a state machine representation from the SCXML
     void ConstructStateMachineFromSCXML(QDomDocument& doc);
 
+    //! Builds a state machine representation from the SCXML in a single streaming pass.
+    //! Returns false if the stream could not be parsed (see reader.errorString())
+    bool ConstructStateMachineFromSCXML(QXmlStreamReader& reader);
+
+    //! Writes a binary snapshot of the workflow (see WorkflowCache)
+    void ConstructCacheFromStateMachine(QDataStream& stream);
+
+    //! Builds the state machine from a binary snapshot, returns false if the snapshot is corrupt
+    bool ConstructStateMachineFromCache(QDataStream& stream);
+
+    //! Builds the state machine from a model, taking ownership of its executable content
+    void ConstructStateMachineFromModel(WorkflowModel& model);
+
+    //! Builds the state machine from a model in steps, so a large model can be built over
+    //! several turns of the event loop: begin, create all the states then all the
+    //! transitions in batches, then finish
+    void BeginConstructFromModel(WorkflowModel& model);
+    QList<SCXMLState*> ConstructStatesFromModel(WorkflowModel& model, int first, int count);
+    QList<SCXMLTransition*> ConstructTransitionsFromModel(WorkflowModel& model, int first, int count);
+    void FinishConstructFromModel();
+
     //! Gets the name of the workflow
     QString GetWorkflowName() { return mName; }
 
     //! Gets the raw SCXML for this workflow
     QString GetRawSCXML() { return mRawSCXMLText; }
 
+    //! Sets the raw SCXML for this workflow (used when the source text is not a DOM)
+    void SetRawSCXML(QString text) { mRawSCXMLText = text; }
+
+    //! Sets the file the workflow was loaded from, the raw SCXML is then a view over its bytes
+    void SetSource(QSharedPointer<SCXMLSourceBuffer> source) { mSource = source; }
+
+    //! Gets the file the workflow was loaded from, null if there is none
+    QSharedPointer<SCXMLSourceBuffer> GetSource() { return mSource; }
+
+    //! Releases the source file, e.g. before it is overwritten
+    void ReleaseSource() { mSource.clear(); }
+
     //! Gets a state defined by id if it exists, NULL otherwise
     SCXMLState* GetStateById(QString id);
+    SCXMLState* GetStateById(SCXMLAtom id) { return mStateIndex.value(id, nullptr); }
+
+    //! Adds a state to the state machine and the id index
+    void AddState(SCXMLState* state);
+
+    //! Gets all the states of the workflow in document order
+    QList<SCXMLState*> GetStates();
+
+    //! Adds a transition to the transition index (the transition connects itself to its states)
+    void AddTransition(SCXMLTransition* transition);
+
+    //! Creates a transition for a bulk build, its curve and animation are not built until
+    //! CompleteDeferredTransitions so the other transitions of its states are left alone
+    SCXMLTransition* CreateDeferredTransition(SCXMLState* source, SCXMLState* target, QString event, QString type, const MetaData& metaData);
+
+    //! Builds the curves and animations of the transitions created since the last call
+    void CompleteDeferredTransitions();
+
+    //! Gets the transitions that leave the given state
+    QList<SCXMLTransition*> GetTransitionsFrom(SCXMLState* state) { return mTransitionIndex.value(state); }
+
+    //! Gets the number of transitions in the workflow
+    int GetTransitionCount() { return mTransitionCount; }
 
     //! Creates the scene objects that correspond with the workflow
     void CreateSceneObjects(QGraphicsScene *scene);
 
-    //! Parser the meta data comment text
-    void ParseMetaData(QString text, QMap<QString, QString>& map);
-
     //! Extract the meta data from an element comment child nodes
-    QMap<QString, QString> ExtractMetaDataFromElementComments(QDomElement *element);
+    MetaData ExtractMetaDataFromElementComments(QDomElement *element);
 
-    //! Extracts the data model from a given element (looks in the child nodes)
-    void ExtractDataModelFromElement(QDomElement* element, SCXMLState* state);
+    //! Extracts the data items of a datamodel element, or those nested in a data element under
+    //! the item with the parent index
+    void ExtractDataItemsFromElement(QDomElement& dataModelElement, int parent = -1);
 
     //! Gets the underlying data model
     SCXMLDataModel *GetDataModel() { return &mDataModel; }
+
+    //! The edits made to the workflow since they were last taken, for its journal
+    struct Edits {
+        Edits() : dataModel(false) {}
+
+        bool IsEmpty() const { return !dataModel && states.isEmpty() && transitions.isEmpty(); }
+
+        bool dataModel;
+        //! Parents come before the states nested within them
+        QList<SCXMLState*> states;
+        QList<SCXMLTransition*> transitions;
+    };
+
+    //! Starts or stops keeping the edits made to the workflow (see WorkflowJournal)
+    void SetRecordEdits(bool value);
+
+    //! Called by the states and transitions when they change
+    void StateEdited(SCXMLState* state) { if (mRecordEdits) mEditedStates.insert(state); }
+    void TransitionEdited(SCXMLTransition* transition) { if (mRecordEdits) mEditedTransitions.insert(transition); }
+
+    //! Takes the edits made since they were last taken
+    void TakeEdits(Edits& edits);
 signals:
     
 public slots:
     
 private:
+    //! A transition read from the DOM whose target may not have been read yet
+    struct PendingTransition {
+        SCXMLState* source;
+        SCXMLAtom target;
+        QString event;
+        QString type;
+        QString cond;
+        MetaData metaData;
+        //! Owned by the pending transition until the transition is created
+        SCXMLExecutableContent* content;
+        bool foreignContent;
+    };
+
+    //! Removes all existing states from the state machine
+    void RemoveAllStates();
+
+    //! Clears the dirty flags of the states, transitions and data model
+    void MarkClean();
+
+    //! Finds the parts of the source an incremental save replaces, in source order. Returns
+    //! false if a change cannot be described as replacements of the source
+    bool CollectSourceEdits(QList<SourceEdit>& edits);
+
+    //! Gets the state whose element is rewritten for a change to the given state, the nearest
+    //! one with a source range, null if there is none
+    SCXMLState* GetRewrittenState(SCXMLState* state);
+
+    //! Moves the source ranges to where they are in the file written with the edits
+    void MoveSourceRanges(const QList<SourceEdit>& edits);
+
+    //! Creates the element for a state, with its transitions and child states nested within it
+    QDomElement CreateStateElement(QDomDocument& doc, SCXMLState* state);
+
+    //! Takes a snapshot of the given states, and the name and data model of the workflow, as a
+    //! model. A parent must come before the states nested within it
+    void ConstructModelFromStates(WorkflowModel& model, const QList<SCXMLState*>& states);
+
+    //! Builds a state (and any nested states) from the direct children of its element
+    void ConstructStateFromElement(QDomElement& element, SCXMLState* parentState, QList<PendingTransition>& pendingTransitions);
+
+    //! Creates the transitions once all the states exist and sets the initial state
+    void ResolvePendingTransitions(QList<PendingTransition>& pendingTransitions);
+
     QString mName;
     QString mInitialStateName;
     QString mRawSCXMLText;
+    QSharedPointer<SCXMLSourceBuffer> mSource;
+    //! Set when the states, transitions and data model know where they are in the source
+    bool mHasSourceRanges;
     SCXMLDataModel mDataModel;
+    QHash<SCXMLAtom, SCXMLState*> mStateIndex;
+    QVector<SCXMLState*> mModelStates;
+    QHash<SCXMLState*, QList<SCXMLTransition*> > mTransitionIndex;
+    QList<SCXMLTransition*> mDeferredTransitions;
+    int mTransitionCount;
+    bool mRecordEdits;
+    QSet<SCXMLState*> mEditedStates;
+    QSet<SCXMLTransition*> mEditedTransitions;
+    int mRecordedDataModelRevision;
 };
 
 #endif // WORKFLOW_H
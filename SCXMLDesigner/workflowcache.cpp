@@ -0,0 +1,96 @@
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include "workflowcache.h"
+
+const quint32 WorkflowCache::CACHE_MAGIC = 0x53435843;   // "SCXC"
+const quint32 WorkflowCache::CACHE_VERSION = 3;
+// only detects changes to the source, so a fast hash is sufficient
+const QCryptographicHash::Algorithm WorkflowCache::HASH_ALGORITHM = QCryptographicHash::Md5;
+
+WorkflowCache::WorkflowCache()
+{
+}
+
+QString WorkflowCache::GetCacheFilename(QString workflowFilename)
+{
+    QFileInfo info(workflowFilename);
+    return info.path() + "/" + info.completeBaseName() + ".scxmlc";
+}
+
+QByteArray WorkflowCache::HashSource(const QByteArray &source)
+{
+    return QCryptographicHash::hash(source, HASH_ALGORITHM);
+}
+
+//!
+//! \brief WorkflowCache::Read
+//!
+//! The cache file is read with a single read and decoded from memory. Nothing in the model
+//! is read unless the header and hash match.
+//!
+bool WorkflowCache::Read(WorkflowModel *model, QString cacheFilename, QByteArray sourceHash,
+                         WorkflowModel::ProgressCallback progress)
+{
+    QFile cacheFile(cacheFilename);
+    if (!cacheFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QByteArray data = cacheFile.readAll();
+    cacheFile.close();
+
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic = 0;
+    quint32 version = 0;
+    QByteArray hash;
+    stream >> magic >> version >> hash;
+    if (magic != CACHE_MAGIC || version != CACHE_VERSION || hash != sourceHash) {
+        return false;
+    }
+
+    if (!model->ReadFromCache(stream, progress)) {
+        qDebug() << "Workflow cache is corrupt or the read was cancelled:" << cacheFilename;
+        model->Clear();
+        return false;
+    }
+    return true;
+}
+
+bool WorkflowCache::Read(Workflow *workflow, QString cacheFilename, QByteArray sourceHash)
+{
+    WorkflowModel model;
+    if (!Read(&model, cacheFilename, sourceHash)) {
+        return false;
+    }
+    workflow->ConstructStateMachineFromModel(model);
+    return true;
+}
+
+bool WorkflowCache::Write(Workflow *workflow, QString cacheFilename, QByteArray sourceHash)
+{
+    WorkflowModel model;
+    workflow->ConstructModelFromStateMachine(model);
+    return Write(&model, cacheFilename, sourceHash);
+}
+
+bool WorkflowCache::Write(const WorkflowModel *model, QString cacheFilename, QByteArray sourceHash)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << CACHE_MAGIC << CACHE_VERSION << sourceHash;
+    model->WriteToCache(stream);
+
+    // write to a temporary file first so a partial cache is never left behind
+    QSaveFile cacheFile(cacheFilename);
+    if (!cacheFile.open(QIODevice::WriteOnly)) {
+        qDebug() << "Workflow cache cannot be written:" << cacheFilename;
+        return false;
+    }
+    cacheFile.write(data);
+    return cacheFile.commit();
+}
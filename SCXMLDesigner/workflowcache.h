@@ -0,0 +1,47 @@
+#ifndef WORKFLOWCACHE_H
+#define WORKFLOWCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QCryptographicHash>
+#include "workflow.h"
+#include "workflowmodel.h"
+
+//! Precompiled binary snapshot of a workflow (.scxmlc)
+//!
+//! The snapshot is written next to the SCXML file and keyed by a hash of the SCXML, so it is
+//! only used while the SCXML is unchanged. It holds the states, transitions, data model,
+//! executable content and layout, with state references stored as indexes.
+class WorkflowCache
+{
+public:
+    WorkflowCache();
+
+    //! Gets the name of the cache file for an SCXML file, e.g. Adder.scxml -> Adder.scxmlc
+    static QString GetCacheFilename(QString workflowFilename);
+
+    //! Gets the hash of the SCXML that keys the cache
+    static QByteArray HashSource(const QByteArray& source);
+
+    //! The algorithm of HashSource, for hashing SCXML as it is written
+    static const QCryptographicHash::Algorithm HASH_ALGORITHM;
+
+    //! Reads the cache file into a model if it matches the hash of the SCXML
+    static bool Read(WorkflowModel* model, QString cacheFilename, QByteArray sourceHash,
+                     WorkflowModel::ProgressCallback progress = WorkflowModel::ProgressCallback());
+
+    //! Builds the workflow from the cache file if it matches the hash of the SCXML
+    static bool Read(Workflow* workflow, QString cacheFilename, QByteArray sourceHash);
+
+    //! Writes the cache file for the workflow, keyed with the hash of its SCXML
+    static bool Write(Workflow* workflow, QString cacheFilename, QByteArray sourceHash);
+
+    //! Writes the cache file from a snapshot of a workflow, may be called on any thread
+    static bool Write(const WorkflowModel* model, QString cacheFilename, QByteArray sourceHash);
+
+private:
+    static const quint32 CACHE_MAGIC;
+    static const quint32 CACHE_VERSION;
+};
+
+#endif // WORKFLOWCACHE_H
@@ -0,0 +1,555 @@
+#include <QDebug>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QMutexLocker>
+#include <QtConcurrent/QtConcurrentRun>
+#include <algorithm>
+#include "workflowjournal.h"
+#include "scxmltransition.h"
+#include "utilities.h"
+
+const quint32 WorkflowJournal::JOURNAL_MAGIC = 0x5343584A;   // "SCXJ"
+const quint32 WorkflowJournal::JOURNAL_VERSION = 3;
+
+// edits are taken from the workflow this often
+#define FLUSH_INTERVAL_MS 1000
+// the journal is compacted once there have been no edits for this long
+#define COMPACT_IDLE_MS 30000
+
+// the records in a batch, each a type followed by its fields
+enum JournalRecord {
+    //! Id, parent id, final, x, y, width, height, description, onentry and onexit
+    RECORD_STATE = 1,
+    //! Source id, position among the transitions of the source, target id, event, type,
+    //! cond, description, control points and content
+    RECORD_TRANSITION,
+    //! Count, then the id, src and expr of each data item
+    RECORD_DATA_MODEL,
+    //! The whole workflow, as written to the cache
+    RECORD_SNAPSHOT
+};
+
+//! Writes a batch of records with its length and checksum, so a batch cut short is detected
+static void WriteBatch(QIODevice& device, const QByteArray& records)
+{
+    QDataStream stream(&device);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << records << qChecksum(records.constData(), uint(records.size()));
+}
+
+static void WriteExecutableContent(QDataStream& stream, SCXMLExecutableContent* content)
+{
+    stream << (content != nullptr);
+    if (content != nullptr) {
+        content->ToDataStream(stream);
+    }
+}
+
+static SCXMLExecutableContent* ReadExecutableContent(QDataStream& stream)
+{
+    bool hasContent = false;
+    stream >> hasContent;
+    return hasContent ? SCXMLExecutableContent::FromDataStream(stream) : nullptr;
+}
+
+//!
+//! \brief Encodes the edits taken from a workflow as a batch of records
+//!
+//! Each record holds the whole of what it describes as it is now, so replaying it again, or
+//! onto a workflow that already has it, does no harm. A transition is identified by its
+//! position among the transitions of its source, which is the order they are saved in.
+//!
+static QByteArray EncodeEdits(Workflow* workflow, const Workflow::Edits& edits)
+{
+    QByteArray records;
+    QDataStream stream(&records, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    if (edits.dataModel) {
+        const QVector<SCXMLDataItem>& dataItems = workflow->GetDataModel()->GetDataItems();
+        stream << quint8(RECORD_DATA_MODEL) << quint32(dataItems.count());
+        foreach (const SCXMLDataItem& dataItem, dataItems) {
+            stream << dataItem.GetId() << dataItem.GetSrc() << dataItem.GetExpr() << qint32(dataItem.GetParent());
+        }
+    }
+
+    foreach (SCXMLState* state, edits.states) {
+        SCXMLState* parentState = state->GetParentState();
+        stream << quint8(RECORD_STATE) << state->GetId() << (parentState != nullptr ? parentState->GetId() : QString())
+               << state->GetFinal() << state->GetShapeX() << state->GetShapeY()
+               << state->GetShapeWidth() << state->GetShapeHeight() << state->GetDescription();
+        WriteExecutableContent(stream, state->GetOnEntry());
+        WriteExecutableContent(stream, state->GetOnExit());
+    }
+
+    // new transitions of a state are added in order on replay
+    QList<QPair<int, SCXMLTransition*> > positionTransitions;
+    foreach (SCXMLTransition* transition, edits.transitions) {
+        int position = workflow->GetTransitionsFrom(transition->GetSourceState()).indexOf(transition);
+        if (position < 0 || transition->GetTargetState() == nullptr) continue;
+        positionTransitions.append(qMakePair(position, transition));
+    }
+    std::sort(positionTransitions.begin(), positionTransitions.end(),
+              [](const QPair<int, SCXMLTransition*>& first, const QPair<int, SCXMLTransition*>& second) {
+        return first.first < second.first;
+    });
+    for (int transitionPos=0; transitionPos<positionTransitions.count(); transitionPos++) {
+        SCXMLTransition* transition = positionTransitions.at(transitionPos).second;
+        stream << quint8(RECORD_TRANSITION) << transition->GetSourceState()->GetId()
+               << qint32(positionTransitions.at(transitionPos).first) << transition->GetTargetState()->GetId()
+               << transition->GetEvent() << transition->getTransitionType() << transition->GetCond()
+               << transition->GetDescription()
+               << transition->GetMetaData().controlPoints;
+        WriteExecutableContent(stream, transition->GetContent());
+    }
+    return records;
+}
+
+//! Applies the records of a journal to a model
+class JournalReplay
+{
+public:
+    explicit JournalReplay(WorkflowModel* model) : mModel(model) { Index(); }
+
+    //! Applies a batch, returns the number of records applied or -1 if the batch is corrupt
+    int Apply(const QByteArray& records);
+
+private:
+    //! Indexes the states by id, and their transitions by position
+    void Index();
+
+    void ReadState(QDataStream& stream);
+    void ReadTransition(QDataStream& stream);
+    void ReadDataModel(QDataStream& stream);
+
+    WorkflowModel* mModel;
+    QHash<SCXMLAtom, int> mStateIndexes;
+    QHash<int, QList<int> > mStateTransitions;
+};
+
+int JournalReplay::Apply(const QByteArray &records)
+{
+    QDataStream stream(records);
+    stream.setVersion(QDataStream::Qt_5_0);
+    int applied = 0;
+    while (!stream.atEnd()) {
+        quint8 type = 0;
+        stream >> type;
+        switch (type) {
+        case RECORD_STATE:
+            ReadState(stream);
+            break;
+        case RECORD_TRANSITION:
+            ReadTransition(stream);
+            break;
+        case RECORD_DATA_MODEL:
+            ReadDataModel(stream);
+            break;
+        case RECORD_SNAPSHOT:
+            // replaces everything before it
+            if (!mModel->ReadFromCache(stream)) return -1;
+            Index();
+            break;
+        default:
+            return -1;
+        }
+        if (stream.status() != QDataStream::Ok) return -1;
+        applied++;
+    }
+    return applied;
+}
+
+void JournalReplay::Index()
+{
+    mStateIndexes.clear();
+    mStateTransitions.clear();
+    for (int statePos=0; statePos<mModel->states.count(); statePos++) {
+        SCXMLAtom id = mModel->states.at(statePos).id;
+        if (!mStateIndexes.contains(id)) {
+            mStateIndexes.insert(id, statePos);
+        }
+    }
+
+    // transitions to unknown states are dropped when the workflow is built, so have no position
+    for (int transitionPos=0; transitionPos<mModel->transitions.count(); transitionPos++) {
+        const WorkflowTransitionModel& transition = mModel->transitions.at(transitionPos);
+        if (transition.sourceIndex < 0 || transition.sourceIndex >= mModel->states.count()) continue;
+        if (!mStateIndexes.contains(transition.target)) continue;
+        mStateTransitions[transition.sourceIndex].append(transitionPos);
+    }
+}
+
+void JournalReplay::ReadState(QDataStream &stream)
+{
+    QString id;
+    QString parentId;
+    bool final = false;
+    MetaData metaData;
+    stream >> id >> parentId >> final >> metaData.x >> metaData.y >> metaData.width >> metaData.height >> metaData.description;
+    SCXMLExecutableContent* onEntry = ReadExecutableContent(stream);
+    SCXMLExecutableContent* onExit = ReadExecutableContent(stream);
+    if (stream.status() != QDataStream::Ok) {
+        delete onEntry;
+        delete onExit;
+        return;
+    }
+    metaData.fields = MetaData::FIELD_X | MetaData::FIELD_Y | MetaData::FIELD_WIDTH |
+            MetaData::FIELD_HEIGHT | MetaData::FIELD_DESCRIPTION;
+
+    SCXMLAtom atom = SCXMLIntern(id);
+    int stateIndex = mStateIndexes.value(atom, -1);
+    if (stateIndex < 0) {
+        // a new state comes after its parent, as the edits are ordered by depth
+        WorkflowStateModel state;
+        state.id = atom;
+        state.parentIndex = parentId.isEmpty() ? -1 : mStateIndexes.value(SCXMLIntern(parentId), -1);
+        stateIndex = mModel->states.count();
+        mModel->states.append(state);
+        mStateIndexes.insert(atom, stateIndex);
+    }
+
+    WorkflowStateModel& state = mModel->states[stateIndex];
+    state.final = final;
+    state.metaData = metaData;
+    delete state.onEntry;
+    delete state.onExit;
+    state.onEntry = onEntry;
+    state.onExit = onExit;
+}
+
+void JournalReplay::ReadTransition(QDataStream &stream)
+{
+    QString sourceId;
+    qint32 position = -1;
+    QString targetId;
+    QString event;
+    QString type;
+    QString cond;
+    MetaData metaData;
+    stream >> sourceId >> position >> targetId >> event >> type >> cond >> metaData.description >> metaData.controlPoints;
+    SCXMLExecutableContent* content = ReadExecutableContent(stream);
+    int sourceIndex = mStateIndexes.value(SCXMLIntern(sourceId), -1);
+    if (stream.status() != QDataStream::Ok || sourceIndex < 0) {
+        delete content;
+        return;
+    }
+    metaData.fields = MetaData::FIELD_DESCRIPTION | MetaData::FIELD_CONTROL_POINTS;
+
+    QList<int>& sourceTransitions = mStateTransitions[sourceIndex];
+    if (position < 0 || position >= sourceTransitions.count()) {
+        WorkflowTransitionModel transition;
+        transition.sourceIndex = sourceIndex;
+        sourceTransitions.append(mModel->transitions.count());
+        mModel->transitions.append(transition);
+        position = sourceTransitions.count() - 1;
+    }
+
+    WorkflowTransitionModel& transition = mModel->transitions[sourceTransitions.at(position)];
+    transition.target = SCXMLIntern(targetId);
+    transition.event = event;
+    transition.type = type;
+    transition.cond = cond;
+    transition.metaData = metaData;
+    delete transition.content;
+    transition.content = content;
+}
+
+void JournalReplay::ReadDataModel(QDataStream &stream)
+{
+    quint32 dataItemCount = 0;
+    stream >> dataItemCount;
+    QList<WorkflowDataItemModel> dataItems;
+    for (quint32 dataPos=0; dataPos<dataItemCount && stream.status() == QDataStream::Ok; dataPos++) {
+        WorkflowDataItemModel dataItem;
+        qint32 parent = -1;
+        stream >> dataItem.id >> dataItem.src >> dataItem.expr >> parent;
+        dataItem.parent = (parent >= 0 && parent < dataItems.count()) ? parent : -1;
+        dataItems.append(dataItem);
+    }
+    if (stream.status() == QDataStream::Ok) {
+        mModel->dataItems = dataItems;
+    }
+}
+
+WorkflowJournal::WorkflowJournal(Workflow *workflow, QString workflowFilename, QByteArray sourceHash,
+                                 bool keepExisting, QObject *parent) :
+    QObject(parent), mWorkflow(workflow), mFilename(GetJournalFilename(workflowFilename)),
+    mSourceHash(sourceHash), mEditedSinceCompact(keepExisting), mSaving(false)
+{
+    connect(&mWatcher, SIGNAL(finished()), this, SLOT(Written()));
+    connect(&mFlushTimer, SIGNAL(timeout()), this, SLOT(FlushTimeout()));
+
+    // a journal that was not replayed is for another version of the file, or is empty
+    if (!keepExisting) {
+        Job job;
+        job.restart = true;
+        job.filename = mFilename;
+        job.sourceHash = mSourceHash;
+        Queue(job);
+    }
+
+    mWorkflow->SetRecordEdits(true);
+    mIdleTimer.start();
+    mFlushTimer.start(FLUSH_INTERVAL_MS);
+}
+
+WorkflowJournal::~WorkflowJournal()
+{
+    mFlushTimer.stop();
+    mWorkflow->SetRecordEdits(false);
+
+    // the worker thread uses this object, so it must stop first
+    mWatcher.waitForFinished();
+    mFile.close();
+
+    // closed normally, so there is nothing to recover
+    QFile::remove(mFilename);
+}
+
+QString WorkflowJournal::GetJournalFilename(QString workflowFilename)
+{
+    QFileInfo info(workflowFilename);
+    return info.path() + "/" + info.completeBaseName() + ".scxmlj";
+}
+
+//!
+//! \brief WorkflowJournal::Replay
+//!
+//! The journal is read with a single read and decoded from memory. Nothing in the model is
+//! changed unless the header and hash match. The recovered edits are not in the SCXML, so
+//! the next save of the workflow must be in full.
+//!
+int WorkflowJournal::Replay(WorkflowModel *model, QString journalFilename, QByteArray sourceHash)
+{
+    QFile journalFile(journalFilename);
+    if (!journalFile.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    QByteArray data = journalFile.readAll();
+    journalFile.close();
+
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic = 0;
+    quint32 version = 0;
+    QByteArray hash;
+    stream >> magic >> version >> hash;
+    if (magic != JOURNAL_MAGIC || version != JOURNAL_VERSION || hash != sourceHash) {
+        return 0;
+    }
+
+    JournalReplay replay(model);
+    int replayed = 0;
+    while (!stream.atEnd()) {
+        QByteArray records;
+        quint16 checksum = 0;
+        stream >> records >> checksum;
+        if (stream.status() != QDataStream::Ok || checksum != qChecksum(records.constData(), uint(records.size()))) {
+            qDebug() << "Workflow journal ends with a partly written batch:" << journalFilename;
+            break;
+        }
+        int applied = replay.Apply(records);
+        if (applied < 0) {
+            qDebug() << "Workflow journal is corrupt:" << journalFilename;
+            break;
+        }
+        replayed += applied;
+    }
+
+    if (replayed > 0) {
+        model->hasSourceRanges = false;
+    }
+    return replayed;
+}
+
+void WorkflowJournal::Flush()
+{
+    Workflow::Edits edits;
+    mWorkflow->TakeEdits(edits);
+    if (edits.IsEmpty()) return;
+    mIdleTimer.start();
+    mEditedSinceCompact = true;
+
+    Job job;
+    job.records = EncodeEdits(mWorkflow, edits);
+    job.filename = mFilename;
+    if (mSaving) {
+        mRecordsSinceSave.append(job.records);
+    }
+    Queue(job);
+}
+
+void WorkflowJournal::BeginSave()
+{
+    Flush();
+    mSaving = true;
+    mRecordsSinceSave.clear();
+}
+
+//!
+//! \brief WorkflowJournal::FinishSave
+//! The edits made while the save was written are not in the saved file, so they start the
+//! journal of the saved file. The journal of the file saved over, or saved from, is replaced.
+//!
+void WorkflowJournal::FinishSave(QString workflowFilename, QByteArray savedHash, bool succeeded)
+{
+    Flush();
+    mSaving = false;
+    if (succeeded) {
+        QString oldFilename = mFilename;
+        mFilename = GetJournalFilename(workflowFilename);
+        mSourceHash = savedHash;
+        mEditedSinceCompact = !mRecordsSinceSave.isEmpty();
+
+        Job job;
+        job.restart = true;
+        job.filename = mFilename;
+        if (oldFilename != mFilename) job.replacedFilename = oldFilename;
+        job.sourceHash = mSourceHash;
+        job.records = mRecordsSinceSave;
+        Queue(job);
+    }
+    mRecordsSinceSave.clear();
+}
+
+void WorkflowJournal::FlushTimeout()
+{
+    Flush();
+
+    // the edits kept for a save that is being written have to stay as records
+    if (mEditedSinceCompact && !mSaving && mIdleTimer.elapsed() >= COMPACT_IDLE_MS) {
+        Compact();
+    }
+}
+
+//!
+//! \brief WorkflowJournal::Compact
+//! The snapshot is taken on the GUI thread, which costs little more than a walk over the
+//! states, and written on the worker thread. Replaying it replaces the model read from the
+//! SCXML, so the records before it are no longer needed.
+//!
+void WorkflowJournal::Compact()
+{
+    Job job;
+    job.restart = true;
+    job.filename = mFilename;
+    job.sourceHash = mSourceHash;
+    job.snapshot = QSharedPointer<WorkflowModel>(new WorkflowModel());
+    mWorkflow->ConstructModelFromStateMachine(*job.snapshot);
+    Queue(job);
+    mEditedSinceCompact = false;
+}
+
+//!
+//! \brief WorkflowJournal::WaitForWrites
+//! Jobs queued while the worker was busy are otherwise started from Written(), which needs
+//! the event loop, so once the worker has stopped they are written here.
+//!
+void WorkflowJournal::WaitForWrites()
+{
+    mWatcher.waitForFinished();
+    WriteJobs();
+}
+
+void WorkflowJournal::Queue(const Job &job)
+{
+    {
+        QMutexLocker locker(&mJobsLock);
+        mJobs.append(job);
+    }
+
+    // only one worker writes at a time, so the jobs are written in order
+    if (!mWatcher.isRunning()) {
+        mWatcher.setFuture(QtConcurrent::run(this, &WorkflowJournal::WriteJobs));
+    }
+}
+
+void WorkflowJournal::Written()
+{
+    bool queued = false;
+    {
+        QMutexLocker locker(&mJobsLock);
+        queued = !mJobs.isEmpty();
+    }
+    if (queued && !mWatcher.isRunning()) {
+        mWatcher.setFuture(QtConcurrent::run(this, &WorkflowJournal::WriteJobs));
+    }
+}
+
+//!
+//! \brief WorkflowJournal::WriteJobs
+//!
+//! Runs on the worker thread. Everything queued is written before the file is synced once,
+//! so the edits queued while the last sync was waiting on the disk share the next one.
+//!
+void WorkflowJournal::WriteJobs()
+{
+    QList<Job> jobs;
+    {
+        QMutexLocker locker(&mJobsLock);
+        jobs.swap(mJobs);
+    }
+
+    bool appended = false;
+    foreach (const Job& job, jobs) {
+        if (job.restart) {
+            if (!RestartFile(job)) {
+                qDebug() << "Workflow journal cannot be written:" << job.filename;
+            }
+            continue;
+        }
+
+        // a journal that was replayed is appended to as it is
+        if (!mFile.isOpen() || mFile.fileName() != job.filename) {
+            mFile.close();
+            mFile.setFileName(job.filename);
+            if (!mFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+                qDebug() << "Workflow journal cannot be written:" << job.filename;
+                continue;
+            }
+        }
+        WriteBatch(mFile, job.records);
+        appended = true;
+    }
+
+    if (appended && !Utilities::SyncFile(mFile)) {
+        qDebug() << "Workflow journal cannot be synced:" << mFile.fileName();
+    }
+}
+
+bool WorkflowJournal::RestartFile(const Job &job)
+{
+    mFile.close();
+
+    // written to a temporary file first so the old journal stands until the new one is complete
+    QSaveFile journalFile(job.filename);
+    if (!journalFile.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    {
+        QDataStream stream(&journalFile);
+        stream.setVersion(QDataStream::Qt_5_0);
+        stream << JOURNAL_MAGIC << JOURNAL_VERSION << job.sourceHash;
+    }
+    if (!job.snapshot.isNull()) {
+        QByteArray records;
+        QDataStream stream(&records, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_0);
+        stream << quint8(RECORD_SNAPSHOT);
+        job.snapshot->WriteToCache(stream);
+        WriteBatch(journalFile, records);
+    }
+    if (!job.records.isEmpty()) {
+        WriteBatch(journalFile, job.records);
+    }
+    if (!journalFile.commit()) {
+        return false;
+    }
+    if (!job.replacedFilename.isEmpty()) {
+        QFile::remove(job.replacedFilename);
+    }
+
+    mFile.setFileName(job.filename);
+    return mFile.open(QIODevice::WriteOnly | QIODevice::Append);
+}
@@ -0,0 +1,105 @@
+#ifndef WORKFLOWJOURNAL_H
+#define WORKFLOWJOURNAL_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QSharedPointer>
+#include "workflow.h"
+#include "workflowmodel.h"
+
+//! Append-only journal of the edits made to a workflow since it was saved (.scxmlj)
+//!
+//! The edits are taken from the workflow every second and encoded on the GUI thread as
+//! records holding the new value of each state, transition or data model edited. A worker
+//! thread appends each batch and syncs the file to disk. The journal is keyed by a hash of
+//! the saved SCXML, like the cache, so after a crash it is replayed onto the same file when
+//! the file is next opened. Once editing has been idle for a while the journal is compacted
+//! into a single snapshot of the workflow. The journal is deleted when it is closed.
+class WorkflowJournal : public QObject
+{
+    Q_OBJECT
+public:
+    //! Journals the edits to a workflow read from the SCXML with the given hash. A journal
+    //! already replayed onto the workflow is kept and appended to, any other is replaced
+    explicit WorkflowJournal(Workflow* workflow, QString workflowFilename, QByteArray sourceHash,
+                             bool keepExisting, QObject *parent = 0);
+    ~WorkflowJournal();
+
+    //! Gets the name of the journal file for an SCXML file, e.g. Adder.scxml -> Adder.scxmlj
+    static QString GetJournalFilename(QString workflowFilename);
+
+    //! Replays the journal onto a model read from the SCXML with the given hash, stopping at
+    //! a batch that was not written in full. Returns the number of records replayed, 0 if the
+    //! journal is missing or for another version of the SCXML. May be called on any thread
+    static int Replay(WorkflowModel* model, QString journalFilename, QByteArray sourceHash);
+
+    //! Takes the edits made to the workflow and queues them to be written
+    void Flush();
+
+    //! Called either side of saving the workflow. Once saved the journal is started again
+    //! for the saved file, with the edits made while the save was written
+    void BeginSave();
+    void FinishSave(QString workflowFilename, QByteArray savedHash, bool succeeded);
+
+    //! Takes a snapshot of the workflow and queues it to replace the journal
+    void Compact();
+
+    //! Blocks until everything queued has been written and synced
+    void WaitForWrites();
+
+private slots:
+    void FlushTimeout();
+    void Written();
+
+private:
+    //! Work for the worker thread, done in the order queued
+    struct Job {
+        Job() : restart(false) {}
+
+        //! Records appended to the journal
+        QByteArray records;
+        //! Replace the journal, with a snapshot if there is one, before the records
+        bool restart;
+        QString filename;
+        //! A journal the restarted one takes over from, deleted once it is written
+        QString replacedFilename;
+        QByteArray sourceHash;
+        QSharedPointer<WorkflowModel> snapshot;
+    };
+
+    void Queue(const Job& job);
+
+    //! Writes the queued jobs and syncs the file, runs on the worker thread
+    void WriteJobs();
+
+    //! Replaces the journal file, runs on the worker thread
+    bool RestartFile(const Job& job);
+
+    Workflow* mWorkflow;
+    QString mFilename;
+    QByteArray mSourceHash;
+    QTimer mFlushTimer;
+    QElapsedTimer mIdleTimer;
+    bool mEditedSinceCompact;
+    bool mSaving;
+    QByteArray mRecordsSinceSave;
+    QFutureWatcher<void> mWatcher;
+
+    // queued by the GUI thread, taken by the worker thread
+    QMutex mJobsLock;
+    QList<Job> mJobs;
+
+    // only used by the worker thread, or once it has finished
+    QFile mFile;
+
+    static const quint32 JOURNAL_MAGIC;
+    static const quint32 JOURNAL_VERSION;
+};
+
+#endif // WORKFLOWJOURNAL_H
@@ -0,0 +1,219 @@
+#include <QDebug>
+#include <QBuffer>
+#include <QFile>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QXmlStreamReader>
+#include <QtConcurrent/QtConcurrentRun>
+#include "workflowloader.h"
+#include "workflowcache.h"
+#include "workflowjournal.h"
+#include "scxmlcompresseddevice.h"
+#include "scxmltransition.h"
+
+// the GUI thread builds for at most this long before returning to the event loop
+#define BATCH_TIME_MS 15
+#define BATCH_SIZE 64
+
+WorkflowLoader::WorkflowLoader(WorkflowTab *tab, QString workflowFilename, QObject *parent) :
+    QObject(parent), mTab(tab), mFilename(workflowFilename),
+    mUseMapping(true), mUseCache(true), mCancelled(0), mFinished(false),
+    mModelRead(false), mRecoveredEdits(0), mReportedPercent(-1),
+    mNextState(0), mNextTransition(0)
+{
+    connect(&mWatcher, SIGNAL(finished()), this, SLOT(ModelRead()));
+}
+
+WorkflowLoader::~WorkflowLoader()
+{
+    // the worker thread uses this object, so it must stop first
+    mCancelled.storeRelease(1);
+    mWatcher.waitForFinished();
+}
+
+void WorkflowLoader::Start()
+{
+    emit Progress(tr("Reading"), 0);
+    mWatcher.setFuture(QtConcurrent::run(this, &WorkflowLoader::ReadModel));
+}
+
+void WorkflowLoader::Cancel()
+{
+    mCancelled.storeRelease(1);
+}
+
+//!
+//! \brief WorkflowLoader::ReadModel
+//!
+//! Runs on the worker thread, so it only touches the model and the results read by the GUI
+//! thread once the worker has finished.
+//!
+void WorkflowLoader::ReadModel()
+{
+    QSharedPointer<SCXMLSourceBuffer> source(new SCXMLSourceBuffer());
+    if (!source->Open(mFilename, mUseMapping)) {
+        mErrorString = "SCXML file cannot be read";
+        return;
+    }
+    mSource = source;
+    mSourceHash = WorkflowCache::HashSource(source->GetData());
+
+    if (mUseCache) {
+        mLoaderName = "cache";
+        WorkflowModel::ProgressCallback cacheProgress = [this](qint64 done, qint64 total) {
+            return ReportReadProgress(tr("Reading cache"), done, total);
+        };
+        mModelRead = WorkflowCache::Read(&mModel, WorkflowCache::GetCacheFilename(mFilename), mSourceHash, cacheProgress);
+        if (mModelRead) RecoverJournal();
+        if (mModelRead || mCancelled.loadAcquire()) return;
+    }
+
+    // the reader pulls small chunks through a buffer over the source bytes
+    mLoaderName = "stream";
+    QByteArray data = source->GetData();
+    QBuffer device(&data);
+    device.open(QIODevice::ReadOnly);
+    if (SCXMLCompressedDevice::IsCompressed(data)) {
+        ReadCompressedModel(device);
+        return;
+    }
+    QXmlStreamReader reader(&device);
+    WorkflowModel::ProgressCallback streamProgress = [this](qint64 done, qint64 total) {
+        return ReportReadProgress(tr("Reading"), done, total);
+    };
+    mReportedPercent = -1;
+    mModelRead = mModel.ReadFromStream(reader, streamProgress);
+    if (!mModelRead) {
+        mErrorString = QString("%1 (line %2, column %3)").arg(reader.errorString())
+                .arg(reader.lineNumber()).arg(reader.columnNumber());
+        return;
+    }
+
+    // the reader's offsets count characters, which only match the bytes of an ASCII file
+    if (!source->IsAscii()) {
+        mModel.hasSourceRanges = false;
+    }
+    RecoverJournal();
+}
+
+//!
+//! \brief WorkflowLoader::ReadCompressedModel
+//!
+//! The frames are decompressed as the reader reaches them, so the SCXML is never held in
+//! full. Progress is measured through the compressed bytes.
+//!
+void WorkflowLoader::ReadCompressedModel(QBuffer &device)
+{
+    mLoaderName = "compressed";
+    SCXMLCompressedDevice scxmlDevice(&device);
+    if (!scxmlDevice.open(QIODevice::ReadOnly)) {
+        mErrorString = "Compressed SCXML file is corrupt";
+        return;
+    }
+    QXmlStreamReader reader(&scxmlDevice);
+    WorkflowModel::ProgressCallback compressedProgress = [this, &device](qint64, qint64) {
+        return ReportReadProgress(tr("Reading"), device.pos(), device.size());
+    };
+    mReportedPercent = -1;
+    mModelRead = mModel.ReadFromStream(reader, compressedProgress);
+    if (!mModelRead) {
+        mErrorString = scxmlDevice.HasError() ? QString("Compressed SCXML file is corrupt")
+                                              : QString("%1 (line %2, column %3)").arg(reader.errorString())
+                                                .arg(reader.lineNumber()).arg(reader.columnNumber());
+        return;
+    }
+
+    // the reader's offsets are into the SCXML, not the compressed file
+    mModel.hasSourceRanges = false;
+    RecoverJournal();
+}
+
+void WorkflowLoader::RecoverJournal()
+{
+    QString journalFilename = WorkflowJournal::GetJournalFilename(mFilename);
+    if (QFile::exists(journalFilename)) {
+        mRecoveredEdits = WorkflowJournal::Replay(&mModel, journalFilename, mSourceHash);
+    }
+}
+
+bool WorkflowLoader::ReportReadProgress(QString stage, qint64 done, qint64 total)
+{
+    if (total > 0) {
+        // only signal the GUI thread when there is something new to show
+        int percent = int(done * 100 / total);
+        if (percent != mReportedPercent) {
+            mReportedPercent = percent;
+            emit Progress(stage, percent);
+        }
+    }
+    return !mCancelled.loadAcquire();
+}
+
+void WorkflowLoader::ModelRead()
+{
+    if (mCancelled.loadAcquire() || mTab.isNull()) {
+        Finish(false);
+        return;
+    }
+    if (!mModelRead) {
+        qDebug() << "Workflow read failed:" << mErrorString;
+        Finish(false);
+        return;
+    }
+
+    mTab->GetWorkflow()->SetSource(mSource);
+    mTab->GetWorkflow()->BeginConstructFromModel(mModel);
+    emit Progress(tr("Building"), 0);
+    QTimer::singleShot(0, this, SLOT(ConstructBatch()));
+}
+
+//!
+//! \brief WorkflowLoader::ConstructBatch
+//!
+//! Creates the next batch of states, then transitions, and adds them to the scene. The
+//! transitions are created once all the states exist as their targets may be anywhere.
+//!
+void WorkflowLoader::ConstructBatch()
+{
+    if (mCancelled.loadAcquire() || mTab.isNull()) {
+        Finish(false);
+        return;
+    }
+
+    Workflow* workflow = mTab->GetWorkflow();
+    int stateCount = mModel.states.count();
+    int transitionCount = mModel.transitions.count();
+    QElapsedTimer batchTimer;
+    batchTimer.start();
+    while (batchTimer.elapsed() < BATCH_TIME_MS) {
+        if (mNextState < stateCount) {
+            foreach (SCXMLState* state, workflow->ConstructStatesFromModel(mModel, mNextState, BATCH_SIZE)) {
+                mTab->AddItemToScene(state);
+            }
+            mNextState += BATCH_SIZE;
+        }
+        else if (mNextTransition < transitionCount) {
+            foreach (SCXMLTransition* transition, workflow->ConstructTransitionsFromModel(mModel, mNextTransition, BATCH_SIZE)) {
+                mTab->AddItemToScene(transition);
+            }
+            mNextTransition += BATCH_SIZE;
+        }
+        else {
+            workflow->FinishConstructFromModel();
+            mModel.Clear();
+            Finish(true);
+            return;
+        }
+    }
+
+    int built = qMin(mNextState, stateCount) + qMin(mNextTransition, transitionCount);
+    emit Progress(tr("Building"), int(qint64(built) * 100 / qMax(1, stateCount + transitionCount)));
+    QTimer::singleShot(0, this, SLOT(ConstructBatch()));
+}
+
+void WorkflowLoader::Finish(bool succeeded)
+{
+    if (mFinished) return;
+    mFinished = true;
+    emit Finished(succeeded, !succeeded && mCancelled.loadAcquire());
+}
@@ -0,0 +1,105 @@
+#ifndef WORKFLOWLOADER_H
+#define WORKFLOWLOADER_H
+
+#include <QObject>
+#include <QBuffer>
+#include <QPointer>
+#include <QAtomicInt>
+#include <QFutureWatcher>
+#include <QSharedPointer>
+#include "workflowmodel.h"
+#include "workflowtab.h"
+#include "scxmlsourcebuffer.h"
+
+//! Loads an SCXML file into a workflow tab without blocking the GUI
+//!
+//! The file is read (from the cache or with the streaming reader) into a WorkflowModel on a
+//! worker thread. The states, transitions and their scene items are then created on the GUI
+//! thread in short batches, one per turn of the event loop. Progress is reported throughout
+//! and the load can be cancelled at any point.
+class WorkflowLoader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit WorkflowLoader(WorkflowTab* tab, QString workflowFilename, QObject *parent = 0);
+    ~WorkflowLoader();
+
+    void SetUseMapping(bool value) { mUseMapping = value; }
+    void SetUseCache(bool value) { mUseCache = value; }
+
+    //! Starts reading the file on a worker thread, Finished is emitted once when the load ends
+    void Start();
+
+    //! Gets the tab being loaded, null if it has been deleted
+    WorkflowTab* GetTab() { return mTab; }
+    QString GetFilename() { return mFilename; }
+
+    //! Gets the name of the loader that read the file ("cache", "stream" or "compressed")
+    QString GetLoaderName() { return mLoaderName; }
+
+    //! Gets the file being loaded, null if it could not be opened
+    QSharedPointer<SCXMLSourceBuffer> GetSource() { return mSource; }
+
+    //! Gets the hash of the file, which keys its cache and journal
+    QByteArray GetSourceHash() { return mSourceHash; }
+
+    //! Gets the number of edits recovered from the journal of the file
+    int GetRecoveredEdits() { return mRecoveredEdits; }
+
+    //! Gets the reason the file could not be read
+    QString GetErrorString() { return mErrorString; }
+
+signals:
+    //! Progress through the current stage of the load
+    void Progress(QString stage, int percent);
+
+    //! The load has ended, the workflow is only complete if it succeeded
+    void Finished(bool succeeded, bool cancelled);
+
+public slots:
+    //! Cancels the load, Finished is still emitted once the worker thread has stopped
+    void Cancel();
+
+private slots:
+    void ModelRead();
+    void ConstructBatch();
+
+private:
+    //! Reads the model, runs on the worker thread
+    void ReadModel();
+
+    //! Reads the model from a compressed file (see SCXMLCompressedDevice), runs on the worker thread
+    void ReadCompressedModel(QBuffer& device);
+
+    //! Replays the journal left by a session that did not close, onto the model read
+    void RecoverJournal();
+
+    //! Reports read progress from the worker thread, returns false once cancelled
+    bool ReportReadProgress(QString stage, qint64 done, qint64 total);
+
+    void Finish(bool succeeded);
+
+    QPointer<WorkflowTab> mTab;
+    QString mFilename;
+    bool mUseMapping;
+    bool mUseCache;
+    QAtomicInt mCancelled;
+    bool mFinished;
+    QFutureWatcher<void> mWatcher;
+
+    // written by the worker thread, only read once it has finished
+    WorkflowModel mModel;
+    bool mModelRead;
+    QSharedPointer<SCXMLSourceBuffer> mSource;
+    QByteArray mSourceHash;
+    int mRecoveredEdits;
+    QString mLoaderName;
+    QString mErrorString;
+    int mReportedPercent;
+
+    // progress through the model on the GUI thread
+    int mNextState;
+    int mNextTransition;
+};
+
+#endif // WORKFLOWLOADER_H
@@ -0,0 +1,571 @@
+#include <QHash>
+#include <QVector3D>
+#include "workflowmodel.h"
+#include "xmlutilities.h"
+
+// how often progress is reported while reading
+#define PROGRESS_STATE_INTERVAL 256
+
+WorkflowModel::WorkflowModel() :
+    hasSourceRanges(false), mDataModelCount(0)
+{
+}
+
+WorkflowModel::~WorkflowModel()
+{
+    Clear();
+}
+
+void WorkflowModel::Clear()
+{
+    foreach (const WorkflowStateModel& state, states) {
+        delete state.onEntry;
+        delete state.onExit;
+    }
+    foreach (const WorkflowTransitionModel& transition, transitions) {
+        delete transition.content;
+    }
+    name.clear();
+    initialStateName.clear();
+    dataItems.clear();
+    states.clear();
+    transitions.clear();
+    hasSourceRanges = false;
+    dataModelRange = SCXMLSourceRange();
+    mDataModelCount = 0;
+}
+
+//!
+//! \brief WorkflowModel::ReadFromStream
+//!
+//! Single pass over the document, transition targets are left as ids since they may appear
+//! later in the file. Where each state, transition and META-DATA comment starts and ends is
+//! kept so a save can copy the elements that have not changed (see Workflow::SaveIncrementally).
+//!
+bool WorkflowModel::ReadFromStream(QXmlStreamReader &reader, ProgressCallback progress)
+{
+    Clear();
+    mProgress = progress;
+
+    if (!reader.readNextStartElement() || reader.name() != XMLUtilities::SCXML_TAG_SCXML) {
+        reader.raiseError("SCXML file does not have a single scxml tag");
+        mProgress = ProgressCallback();
+        return false;
+    }
+
+    // get the name of the workflow
+    QXmlStreamAttributes rootAttributes = reader.attributes();
+    name = rootAttributes.value(XMLUtilities::SCXML_TAG_NAME).toString();
+    initialStateName = rootAttributes.value(XMLUtilities::SCXML_TAG_INITIAL).toString();
+
+    // read token by token rather than with readNextStartElement, so the offset where each
+    // element starts is known
+    hasSourceRanges = true;
+    while (!reader.atEnd()) {
+        qint64 tokenStart = reader.characterOffset();
+        reader.readNext();
+        if (reader.isEndElement()) break;
+        if (!reader.isStartElement()) continue;
+
+        switch (SCXMLAtomTable::Instance()->Find(reader.name())) {
+        case SCXMLAtomTable::ATOM_STATE:
+        case SCXMLAtomTable::ATOM_FINAL:
+            ReadStateFromStream(reader, -1, tokenStart);
+            break;
+        case SCXMLAtomTable::ATOM_DATAMODEL:
+            ReadDataModelFromStream(reader, true, tokenStart);
+            break;
+        default:
+            reader.skipCurrentElement();
+            break;
+        }
+    }
+
+    mProgress = ProgressCallback();
+    return !reader.hasError();
+}
+
+void WorkflowModel::ReadStateFromStream(QXmlStreamReader &reader, int parentIndex, qint64 elementStart)
+{
+    ReportStreamProgress(reader);
+
+    // nested states are appended while this one is read, so it is only accessed by index
+    int stateIndex = states.count();
+    states.append(WorkflowStateModel());
+
+    QStringRef idText = reader.attributes().value(XMLUtilities::SCXML_TAG_ID);
+    states[stateIndex].id = idText.isEmpty() ? SCXMLIntern(QString("unnamed")) : SCXMLIntern(idText);
+    states[stateIndex].final = (reader.name() == XMLUtilities::SCXML_TAG_FINAL);
+    states[stateIndex].parentIndex = parentIndex;
+
+    // the meta data comment may appear anywhere within the element, so apply it at the end
+    MetaData metaData;
+    SCXMLSourceRange metaDataRange;
+    int metaDataCount = 0;
+    while (!reader.atEnd()) {
+        qint64 tokenStart = reader.characterOffset();
+        reader.readNext();
+        if (reader.isEndElement()) break;
+        if (reader.isComment()) {
+            if (ReadMetaDataFromStream(reader, metaData)) {
+                metaDataRange = SCXMLSourceRange(tokenStart, reader.characterOffset());
+                metaDataCount++;
+            }
+            else {
+                states[stateIndex].foreignContent = true;
+            }
+            continue;
+        }
+        if (!reader.isStartElement()) continue;
+
+        // dispatch on the interned tag rather than comparing against each tag name
+        switch (SCXMLAtomTable::Instance()->Find(reader.name())) {
+        case SCXMLAtomTable::ATOM_STATE:
+        case SCXMLAtomTable::ATOM_FINAL:
+            ReadStateFromStream(reader, stateIndex, tokenStart);
+            break;
+        case SCXMLAtomTable::ATOM_TRANSITION:
+            ReadTransitionFromStream(reader, stateIndex, tokenStart);
+            break;
+        case SCXMLAtomTable::ATOM_ONENTRY:
+            if (states[stateIndex].onEntry == nullptr) {
+                states[stateIndex].onEntry = SCXMLExecutableContent::FromXmlStream(reader, &states[stateIndex].foreignContent);
+            }
+            else {
+                reader.skipCurrentElement();
+                states[stateIndex].foreignContent = true;
+            }
+            break;
+        case SCXMLAtomTable::ATOM_ONEXIT:
+            if (states[stateIndex].onExit == nullptr) {
+                states[stateIndex].onExit = SCXMLExecutableContent::FromXmlStream(reader, &states[stateIndex].foreignContent);
+            }
+            else {
+                reader.skipCurrentElement();
+                states[stateIndex].foreignContent = true;
+            }
+            break;
+        case SCXMLAtomTable::ATOM_DATAMODEL:
+            // the items join the data model of the workflow, which is written at the top level
+            ReadDataModelFromStream(reader, false, tokenStart);
+            states[stateIndex].foreignContent = true;
+            break;
+        default:
+            reader.skipCurrentElement();
+            states[stateIndex].foreignContent = true;
+            break;
+        }
+    }
+
+    states[stateIndex].metaData = metaData;
+    states[stateIndex].elementRange = SCXMLSourceRange(elementStart, reader.characterOffset());
+    // with more than one META-DATA comment the whole element is rewritten when it changes
+    if (metaDataCount == 1) {
+        states[stateIndex].metaDataRange = metaDataRange;
+    }
+}
+
+void WorkflowModel::ReadTransitionFromStream(QXmlStreamReader &reader, int sourceIndex, qint64 elementStart)
+{
+    QXmlStreamAttributes attributes = reader.attributes();
+    WorkflowTransitionModel transition;
+    transition.sourceIndex = sourceIndex;
+    transition.target = SCXMLIntern(attributes.value(XMLUtilities::SCXML_TAG_TARGET));
+    transition.type = attributes.value(XMLUtilities::SCXML_TAG_TYPE).toString();
+    transition.event = attributes.value(XMLUtilities::SCXML_TAG_EVENT).toString();
+    transition.cond = attributes.value(XMLUtilities::SCXML_TAG_COND).toString();
+
+    int metaDataCount = 0;
+    while (!reader.atEnd()) {
+        qint64 tokenStart = reader.characterOffset();
+        reader.readNext();
+        if (reader.isEndElement()) break;
+        if (reader.isComment()) {
+            if (ReadMetaDataFromStream(reader, transition.metaData)) {
+                transition.metaDataRange = SCXMLSourceRange(tokenStart, reader.characterOffset());
+                metaDataCount++;
+            }
+            else {
+                transition.foreignContent = true;
+            }
+        }
+        else if (reader.isStartElement()) {
+            if (transition.content == nullptr) {
+                transition.content = new SCXMLExecutableContent();
+            }
+            SCXMLExecutableActionBase* action = SCXMLExecutableContent::ActionFromXmlStream(reader);
+            if (action == nullptr) transition.foreignContent = true;
+            transition.content->AddAction(action);
+        }
+    }
+
+    transition.elementRange = SCXMLSourceRange(elementStart, reader.characterOffset());
+    if (metaDataCount != 1) {
+        transition.metaDataRange = SCXMLSourceRange();
+    }
+    transitions.append(transition);
+}
+
+void WorkflowModel::ReadDataModelFromStream(QXmlStreamReader &reader, bool topLevel, qint64 elementStart)
+{
+    mDataModelCount++;
+
+    // data elements may be nested, each open element holds the item a data element in it is
+    // nested in, -2 for other elements, whose data is left out as the DOM loader does
+    QVector<int> openParents;
+    openParents.append(-1);
+    while (!openParents.isEmpty() && !reader.atEnd()) {
+        reader.readNext();
+        if (reader.isEndElement()) {
+            openParents.removeLast();
+            continue;
+        }
+        if (!reader.isStartElement()) continue;
+        int parent = openParents.last();
+        if (reader.name() != XMLUtilities::SCXML_TAG_DATA) {
+            openParents.append(-2);
+            continue;
+        }
+
+        QXmlStreamAttributes attributes = reader.attributes();
+        if (parent != -2 && attributes.hasAttribute(XMLUtilities::SCXML_TAG_ID)) {
+            WorkflowDataItemModel dataItem;
+            dataItem.id = attributes.value(XMLUtilities::SCXML_TAG_ID).toString();
+            dataItem.src = attributes.value(XMLUtilities::SCXML_TAG_SRC).toString();
+            dataItem.expr = attributes.value(XMLUtilities::SCXML_TAG_EXPR).toString();
+            dataItem.parent = parent;
+            dataItems.append(dataItem);
+            parent = dataItems.count() - 1;
+        }
+        openParents.append(parent);
+    }
+
+    // the data model is written as a single top level element, so only then can it replace this one
+    if (topLevel && mDataModelCount == 1) {
+        dataModelRange = SCXMLSourceRange(elementStart, reader.characterOffset());
+    }
+    else {
+        dataModelRange = SCXMLSourceRange();
+    }
+}
+
+bool WorkflowModel::ReadMetaDataFromStream(QXmlStreamReader &reader, MetaData &metaData)
+{
+    // parse the comment text in place
+    QStringRef text = reader.text();
+    if (!text.contains(QLatin1String("META-DATA"))) return false;
+    MetaDataSupport::ParseMetaData(text, metaData);
+    return true;
+}
+
+void WorkflowModel::ReportStreamProgress(QXmlStreamReader &reader)
+{
+    if (!mProgress || (states.count() % PROGRESS_STATE_INTERVAL) != 0) return;
+
+    QIODevice* device = reader.device();
+    bool keepReading = (device != nullptr) ? mProgress(device->pos(), device->size())
+                                           : mProgress(reader.characterOffset(), 0);
+    if (!keepReading) {
+        // stops the reader, the callers unwind as they would for a parse error
+        reader.raiseError("Load cancelled");
+    }
+}
+
+//! Reads optional executable content from the cache
+static SCXMLExecutableContent* ReadExecutableContentFromCache(QDataStream& stream)
+{
+    bool hasContent = false;
+    stream >> hasContent;
+    if (!hasContent || stream.status() != QDataStream::Ok) return nullptr;
+    return SCXMLExecutableContent::FromDataStream(stream);
+}
+
+//!
+//! \brief WorkflowModel::ReadFromCache
+//!
+//! The snapshot holds the decoded layout, which is set as meta data with every field present
+//! so the workflow is built exactly as it was when the snapshot was written.
+//!
+bool WorkflowModel::ReadFromCache(QDataStream &stream, ProgressCallback progress)
+{
+    Clear();
+
+    stream >> name >> initialStateName;
+
+    quint32 dataItemCount = 0;
+    stream >> dataItemCount;
+    for (quint32 dataPos=0; dataPos<dataItemCount && stream.status() == QDataStream::Ok; dataPos++) {
+        WorkflowDataItemModel dataItem;
+        qint32 parent = -1;
+        stream >> dataItem.id >> dataItem.src >> dataItem.expr >> parent;
+        // a parent must come before the items nested in it
+        dataItem.parent = (parent >= 0 && parent < dataItems.count()) ? parent : -1;
+        dataItems.append(dataItem);
+    }
+
+    quint32 stateCount = 0;
+    stream >> stateCount;
+    for (quint32 statePos=0; statePos<stateCount && stream.status() == QDataStream::Ok; statePos++) {
+        if (progress && (statePos % PROGRESS_STATE_INTERVAL) == 0 && !progress(statePos, stateCount)) {
+            return false;
+        }
+
+        QString id;
+        WorkflowStateModel state;
+        stream >> id >> state.metaData.description >> state.final >> state.parentIndex
+               >> state.metaData.x >> state.metaData.y >> state.metaData.width >> state.metaData.height;
+        if (stream.status() != QDataStream::Ok || state.parentIndex >= states.count()) return false;
+        state.id = SCXMLIntern(id);
+        state.metaData.fields = MetaData::FIELD_X | MetaData::FIELD_Y | MetaData::FIELD_WIDTH |
+                MetaData::FIELD_HEIGHT | MetaData::FIELD_DESCRIPTION;
+
+        // appended before the content is read so it is deleted with the model on failure
+        states.append(state);
+        states.last().onEntry = ReadExecutableContentFromCache(stream);
+        states.last().onExit = ReadExecutableContentFromCache(stream);
+    }
+
+    // the snapshot refers to states by index, the model by id
+    quint32 transitionCount = 0;
+    stream >> transitionCount;
+    for (quint32 transitionPos=0; transitionPos<transitionCount && stream.status() == QDataStream::Ok; transitionPos++) {
+        qint32 targetIndex = -1;
+        QVector<QVector3D> controlPoints;
+        WorkflowTransitionModel transition;
+        stream >> transition.sourceIndex >> targetIndex >> transition.event >> transition.type >> transition.cond
+               >> transition.metaData.description >> controlPoints;
+        if (stream.status() != QDataStream::Ok) return false;
+        if (transition.sourceIndex < 0 || transition.sourceIndex >= states.count() ||
+                targetIndex < 0 || targetIndex >= states.count()) return false;
+
+        transition.target = states[targetIndex].id;
+        transition.metaData.fields = MetaData::FIELD_DESCRIPTION | MetaData::FIELD_CONTROL_POINTS;
+        transition.metaData.controlPoints.reserve(controlPoints.count());
+        foreach (QVector3D point, controlPoints) {
+            transition.metaData.controlPoints.append(point.toPointF());
+        }
+        transitions.append(transition);
+        transitions.last().content = ReadExecutableContentFromCache(stream);
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+void WorkflowModel::GetStateChildren(StateChildren &children) const
+{
+    children.states.resize(states.count());
+    children.transitions.resize(states.count());
+    for (int statePos=0; statePos<states.count(); statePos++) {
+        int parentIndex = states.at(statePos).parentIndex;
+        if (parentIndex >= 0 && parentIndex < states.count()) {
+            children.states[parentIndex].append(statePos);
+        }
+        else {
+            children.topLevelStates.append(statePos);
+        }
+    }
+    for (int transitionPos=0; transitionPos<transitions.count(); transitionPos++) {
+        int sourceIndex = transitions.at(transitionPos).sourceIndex;
+        if (sourceIndex >= 0 && sourceIndex < states.count()) {
+            children.transitions[sourceIndex].append(transitionPos);
+        }
+    }
+}
+
+//!
+//! \brief WorkflowModel::WriteToStream
+//!
+//! Writes the same document as Workflow::ConstructSCXMLFromStateMachine(QDomDocument&)
+//! straight to the writer's device, without building the document in memory.
+//!
+void WorkflowModel::WriteToStream(QXmlStreamWriter &writer) const
+{
+    StateChildren children;
+    GetStateChildren(children);
+
+    // the root element with name attribute
+    writer.writeStartElement(XMLUtilities::SCXML_TAG_SCXML);
+    writer.writeDefaultNamespace("http://www.w3.org/2005/07/scxml");
+    if (name != "") writer.writeAttribute(XMLUtilities::SCXML_TAG_NAME, name);
+    if (initialStateName != "") writer.writeAttribute(XMLUtilities::SCXML_TAG_INITIAL, initialStateName);
+    writer.writeAttribute(XMLUtilities::SCXML_TAG_VERSION, "1.0");
+    if (!dataItems.isEmpty() || !children.topLevelStates.isEmpty()) {
+        XMLUtilities::WriteNewLine(writer);
+    }
+
+    if (!dataItems.isEmpty()) {
+        XMLUtilities::WriteIndent(writer, 1);
+        WriteDataModelToStream(writer, 1);
+        XMLUtilities::WriteNewLine(writer);
+    }
+
+    // child states are nested within the top level states
+    foreach (int stateIndex, children.topLevelStates) {
+        XMLUtilities::WriteIndent(writer, 1);
+        WriteStateToStream(writer, children, stateIndex, 1);
+        XMLUtilities::WriteNewLine(writer);
+    }
+
+    writer.writeEndElement();
+    XMLUtilities::WriteNewLine(writer);
+}
+
+void WorkflowModel::WriteDataModelToStream(QXmlStreamWriter &writer, int depth) const
+{
+    // the top level items are the first list, as with the states
+    QVector<QList<int> > children(dataItems.count() + 1);
+    for (int dataIndex=0; dataIndex<dataItems.count(); dataIndex++) {
+        children[dataItems.at(dataIndex).parent + 1].append(dataIndex);
+    }
+
+    writer.writeStartElement(XMLUtilities::SCXML_TAG_DATAMODEL);
+    XMLUtilities::WriteNewLine(writer);
+    foreach (int dataIndex, children.first()) {
+        XMLUtilities::WriteIndent(writer, depth + 1);
+        WriteDataItemToStream(writer, children, dataIndex, depth + 1);
+        XMLUtilities::WriteNewLine(writer);
+    }
+    XMLUtilities::WriteIndent(writer, depth);
+    writer.writeEndElement();
+}
+
+void WorkflowModel::WriteDataItemToStream(QXmlStreamWriter &writer, const QVector<QList<int> > &children, int dataIndex,
+                                          int depth) const
+{
+    const WorkflowDataItemModel& dataItem = dataItems.at(dataIndex);
+    writer.writeStartElement(XMLUtilities::SCXML_TAG_DATA);
+    writer.writeAttribute(XMLUtilities::SCXML_TAG_ID, dataItem.id);
+    if (dataItem.src != "") writer.writeAttribute(XMLUtilities::SCXML_TAG_SRC, dataItem.src);
+    if (dataItem.expr != "") writer.writeAttribute(XMLUtilities::SCXML_TAG_EXPR, dataItem.expr);
+
+    const QList<int>& nestedItems = children.at(dataIndex + 1);
+    if (!nestedItems.isEmpty()) {
+        XMLUtilities::WriteNewLine(writer);
+        foreach (int nestedIndex, nestedItems) {
+            XMLUtilities::WriteIndent(writer, depth + 1);
+            WriteDataItemToStream(writer, children, nestedIndex, depth + 1);
+            XMLUtilities::WriteNewLine(writer);
+        }
+        XMLUtilities::WriteIndent(writer, depth);
+    }
+    writer.writeEndElement();
+}
+
+void WorkflowModel::WriteStateToStream(QXmlStreamWriter &writer, int stateIndex, int depth) const
+{
+    StateChildren children;
+    GetStateChildren(children);
+    WriteStateToStream(writer, children, stateIndex, depth);
+}
+
+//! Writes an onentry or onexit element if there is content
+static void WriteExecutableContentToStream(QXmlStreamWriter& writer, QString tag, SCXMLExecutableContent* content, int depth)
+{
+    if (content == nullptr) return;
+
+    XMLUtilities::WriteIndent(writer, depth);
+    writer.writeStartElement(tag);
+    if (content->HasActions()) {
+        XMLUtilities::WriteNewLine(writer);
+        content->ToXmlStream(writer, depth + 1);
+        XMLUtilities::WriteIndent(writer, depth);
+    }
+    writer.writeEndElement();
+    XMLUtilities::WriteNewLine(writer);
+}
+
+void WorkflowModel::WriteStateToStream(QXmlStreamWriter &writer, const StateChildren &children, int stateIndex, int depth) const
+{
+    const WorkflowStateModel& state = states.at(stateIndex);
+    writer.writeStartElement(state.final ? XMLUtilities::SCXML_TAG_FINAL : XMLUtilities::SCXML_TAG_STATE);
+    writer.writeAttribute(XMLUtilities::SCXML_TAG_ID, SCXMLAtomString(state.id));
+
+    // the state meta-data comment, so the state always has children
+    XMLUtilities::WriteNewLine(writer);
+    XMLUtilities::WriteComment(writer, MetaDataSupport::FormatStateMetaData(state.metaData), depth + 1);
+
+    WriteExecutableContentToStream(writer, XMLUtilities::SCXML_TAG_ONENTRY, state.onEntry, depth + 1);
+    WriteExecutableContentToStream(writer, XMLUtilities::SCXML_TAG_ONEXIT, state.onExit, depth + 1);
+
+    foreach (int transitionIndex, children.transitions.at(stateIndex)) {
+        XMLUtilities::WriteIndent(writer, depth + 1);
+        WriteTransitionToStream(writer, transitionIndex, depth + 1);
+        XMLUtilities::WriteNewLine(writer);
+    }
+
+    foreach (int childIndex, children.states.at(stateIndex)) {
+        XMLUtilities::WriteIndent(writer, depth + 1);
+        WriteStateToStream(writer, children, childIndex, depth + 1);
+        XMLUtilities::WriteNewLine(writer);
+    }
+
+    XMLUtilities::WriteIndent(writer, depth);
+    writer.writeEndElement();
+}
+
+void WorkflowModel::WriteTransitionToStream(QXmlStreamWriter &writer, int transitionIndex, int depth) const
+{
+    const WorkflowTransitionModel& transition = transitions.at(transitionIndex);
+    writer.writeStartElement(XMLUtilities::SCXML_TAG_TRANSITION);
+    if (transition.type != "") writer.writeAttribute(XMLUtilities::SCXML_TAG_TYPE, transition.type);
+    writer.writeAttribute(XMLUtilities::SCXML_TAG_TARGET, SCXMLAtomString(transition.target));
+    if (!transition.event.isEmpty()) writer.writeAttribute(XMLUtilities::SCXML_TAG_EVENT, transition.event);
+    if (!transition.cond.isEmpty()) writer.writeAttribute(XMLUtilities::SCXML_TAG_COND, transition.cond);
+    XMLUtilities::WriteNewLine(writer);
+    XMLUtilities::WriteComment(writer, MetaDataSupport::FormatTransitionMetaData(transition.metaData), depth + 1);
+    if (transition.content != nullptr) {
+        transition.content->ToXmlStream(writer, depth + 1);
+    }
+    XMLUtilities::WriteIndent(writer, depth);
+    writer.writeEndElement();
+}
+
+//! Writes optional executable content to the cache
+static void WriteExecutableContentToCache(QDataStream& stream, SCXMLExecutableContent* content)
+{
+    stream << (content != nullptr);
+    if (content != nullptr) {
+        content->ToDataStream(stream);
+    }
+}
+
+//!
+//! \brief WorkflowModel::WriteToCache
+//!
+//! Transitions refer to their target by state index in the cache, the first state with the
+//! id as when the workflow is built.
+//!
+void WorkflowModel::WriteToCache(QDataStream &stream) const
+{
+    stream << name << initialStateName;
+
+    stream << quint32(dataItems.count());
+    foreach (const WorkflowDataItemModel& dataItem, dataItems) {
+        stream << dataItem.id << dataItem.src << dataItem.expr << qint32(dataItem.parent);
+    }
+
+    QHash<SCXMLAtom, qint32> stateIndexes;
+    stream << quint32(states.count());
+    for (int statePos=0; statePos<states.count(); statePos++) {
+        const WorkflowStateModel& state = states.at(statePos);
+        if (!stateIndexes.contains(state.id)) {
+            stateIndexes.insert(state.id, statePos);
+        }
+        stream << SCXMLAtomString(state.id) << state.metaData.description << state.final << qint32(state.parentIndex)
+               << state.metaData.x << state.metaData.y << state.metaData.width << state.metaData.height;
+        WriteExecutableContentToCache(stream, state.onEntry);
+        WriteExecutableContentToCache(stream, state.onExit);
+    }
+
+    stream << quint32(transitions.count());
+    foreach (const WorkflowTransitionModel& transition, transitions) {
+        QVector<QVector3D> controlPoints;
+        controlPoints.reserve(transition.metaData.controlPoints.count());
+        foreach (QPointF point, transition.metaData.controlPoints) {
+            controlPoints.append(QVector3D(point));
+        }
+        stream << qint32(transition.sourceIndex) << stateIndexes.value(transition.target, -1)
+               << transition.event << transition.type << transition.cond << transition.metaData.description << controlPoints;
+        WriteExecutableContentToCache(stream, transition.content);
+    }
+}
@@ -0,0 +1,171 @@
+#ifndef WORKFLOWMODEL_H
+#define WORKFLOWMODEL_H
+
+#include <functional>
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <QDataStream>
+#include "metadatasupport.h"
+#include "scxmlatoms.h"
+#include "scxmlexecutablecontent.h"
+#include "scxmlsourcebuffer.h"
+
+//! A state of a WorkflowModel
+struct WorkflowStateModel
+{
+    WorkflowStateModel() : id(SCXMLAtomTable::ATOM_EMPTY), final(false), parentIndex(-1),
+        onEntry(nullptr), onExit(nullptr), foreignContent(false) {}
+
+    SCXMLAtom id;
+    bool final;
+    //! Index of the parent state in the model, -1 for a top level state
+    int parentIndex;
+    MetaData metaData;
+    //! Executable content, owned by the model until a workflow takes it
+    SCXMLExecutableContent* onEntry;
+    SCXMLExecutableContent* onExit;
+    //! Where the element and its META-DATA comment are in the source
+    SCXMLSourceRange elementRange;
+    SCXMLSourceRange metaDataRange;
+    //! Set when the element holds something the model leaves out, e.g. an invoke, donedata,
+    //! a datamodel or another comment, so it cannot be written again from the model
+    bool foreignContent;
+};
+
+//! A transition of a WorkflowModel, the target is resolved by id when the workflow is built
+struct WorkflowTransitionModel
+{
+    WorkflowTransitionModel() : sourceIndex(-1), target(SCXMLAtomTable::ATOM_EMPTY), content(nullptr),
+        foreignContent(false) {}
+
+    int sourceIndex;
+    SCXMLAtom target;
+    QString event;
+    QString type;
+    //! The guard expression, empty if the transition is not guarded
+    QString cond;
+    MetaData metaData;
+    //! Executable content run when the transition is taken, owned by the model until a
+    //! workflow takes it
+    SCXMLExecutableContent* content;
+    //! Where the element and its META-DATA comment are in the source
+    SCXMLSourceRange elementRange;
+    SCXMLSourceRange metaDataRange;
+    //! Set when the element holds something the model leaves out, e.g. an unknown action or
+    //! another comment
+    bool foreignContent;
+};
+
+//! A data item of a WorkflowModel
+struct WorkflowDataItemModel
+{
+    WorkflowDataItemModel() : parent(-1) {}
+
+    QString id;
+    QString src;
+    QString expr;
+    //! The index of the item this one is nested in, which comes before it, -1 for a top level
+    //! item
+    int parent;
+};
+
+//! Plain description of a workflow
+//!
+//! The model holds no QObjects or graphics items, so it can be read on a worker thread. The
+//! Workflow (and its scene items) are then built from it on the GUI thread. In the other
+//! direction a snapshot of the workflow is taken as a model, which can then be written out on
+//! a worker thread while the workflow is edited. States are in document order, so a parent
+//! always comes before its children.
+class WorkflowModel
+{
+public:
+    //! Called periodically while reading with how far the read has got, returns false to
+    //! cancel the read. The total is 0 if it is not known
+    typedef std::function<bool(qint64 done, qint64 total)> ProgressCallback;
+
+    WorkflowModel();
+    ~WorkflowModel();
+
+    //! Empties the model, deleting any executable content still owned by it
+    void Clear();
+
+    //! Reads the model in a single streaming pass. Returns false if the stream could not be
+    //! parsed or the read was cancelled (see reader.errorString())
+    bool ReadFromStream(QXmlStreamReader& reader, ProgressCallback progress = ProgressCallback());
+
+    //! Reads a binary snapshot written by Workflow::ConstructCacheFromStateMachine,
+    //! returns false if the snapshot is corrupt or the read was cancelled
+    bool ReadFromCache(QDataStream& stream, ProgressCallback progress = ProgressCallback());
+
+    //! Writes the model as SCXML, laid out as QDomDocument::toByteArray() would save the DOM
+    //! of the workflow. Auto formatting of the writer must be off
+    void WriteToStream(QXmlStreamWriter& writer) const;
+
+    //! Writes a state with its transitions and nested states, from its start tag to its end
+    //! tag. The indent before it and the line break after are left to the caller
+    void WriteStateToStream(QXmlStreamWriter& writer, int stateIndex, int depth) const;
+
+    //! Writes a transition, from its start tag to its end tag
+    void WriteTransitionToStream(QXmlStreamWriter& writer, int transitionIndex, int depth) const;
+
+    //! Writes the datamodel element, from its start tag to its end tag
+    void WriteDataModelToStream(QXmlStreamWriter& writer, int depth) const;
+
+    //! Writes the binary snapshot read by ReadFromCache
+    void WriteToCache(QDataStream& stream) const;
+
+    QString name;
+    QString initialStateName;
+    QList<WorkflowDataItemModel> dataItems;
+    QVector<WorkflowStateModel> states;
+    QVector<WorkflowTransitionModel> transitions;
+
+    //! Set when the model was read from a stream with the source ranges of its elements. The
+    //! ranges are character offsets, which are only byte offsets for an ASCII source
+    bool hasSourceRanges;
+    //! Where the datamodel element is in the source, invalid unless it is the only one
+    SCXMLSourceRange dataModelRange;
+
+private:
+    Q_DISABLE_COPY(WorkflowModel)
+
+    //! The indexes of the nested states and transitions of each state
+    struct StateChildren {
+        QList<int> topLevelStates;
+        QVector<QList<int> > states;
+        QVector<QList<int> > transitions;
+    };
+
+    void GetStateChildren(StateChildren& children) const;
+    void WriteStateToStream(QXmlStreamWriter& writer, const StateChildren& children, int stateIndex, int depth) const;
+
+    //! Writes a data element with the items nested in it, children holds the nested items of
+    //! each item
+    void WriteDataItemToStream(QXmlStreamWriter& writer, const QVector<QList<int> >& children, int dataIndex,
+                               int depth) const;
+
+    //! Reads a state or final element (and any nested states) from the stream, the element
+    //! starts at elementStart
+    void ReadStateFromStream(QXmlStreamReader& reader, int parentIndex, qint64 elementStart);
+
+    //! Reads a transition element from the stream
+    void ReadTransitionFromStream(QXmlStreamReader& reader, int sourceIndex, qint64 elementStart);
+
+    //! Reads the data items of a datamodel element from the stream
+    void ReadDataModelFromStream(QXmlStreamReader& reader, bool topLevel, qint64 elementStart);
+
+    //! Parses the meta data if the comment at the current stream position contains it,
+    //! returns true if it did
+    bool ReadMetaDataFromStream(QXmlStreamReader& reader, MetaData& metaData);
+
+    //! Reports progress every so many states, raises an error on the reader if cancelled
+    void ReportStreamProgress(QXmlStreamReader& reader);
+
+    ProgressCallback mProgress;
+    int mDataModelCount;
+};
+
+#endif // WORKFLOWMODEL_H
@@ -0,0 +1,124 @@
+#include <QDebug>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QXmlStreamWriter>
+#include <QtConcurrent/QtConcurrentRun>
+#include "workflowsaver.h"
+#include "workflowcache.h"
+#include "scxmlcompresseddevice.h"
+
+WorkflowSaver::WorkflowSaver(WorkflowTab *tab, QString workflowFilename, QObject *parent) :
+    QObject(parent), mTab(tab), mFilename(workflowFilename),
+    mUseCache(true), mIncremental(false), mSucceeded(false)
+{
+    connect(&mWatcher, SIGNAL(finished()), this, SLOT(Written()));
+}
+
+WorkflowSaver::~WorkflowSaver()
+{
+    // the worker thread uses this object, so it must stop first
+    mWatcher.waitForFinished();
+}
+
+//!
+//! \brief WorkflowSaver::Start
+//!
+//! Copies only what has changed where possible (see Workflow::SaveIncrementally), otherwise
+//! the whole workflow is taken as a model. Either way the snapshot shares its strings with
+//! the workflow, so taking it costs little more than a walk over the states.
+//!
+void WorkflowSaver::Start()
+{
+    if (mTab.isNull()) {
+        mErrorString = "The workflow has been closed";
+        emit Finished(false);
+        return;
+    }
+
+    // the edits are copied into plain SCXML, so a compressed file is always written in full
+    Workflow* workflow = mTab->GetWorkflow();
+    mIncremental = !SCXMLCompressedDevice::IsCompressedFilename(mFilename) && workflow->BeginIncrementalSave(mIncrementalSave);
+    if (!mIncremental) {
+        workflow->ConstructModelFromStateMachine(mModel);
+
+        // replacing a mapped file would invalidate the mapping
+        QSharedPointer<SCXMLSourceBuffer> source = workflow->GetSource();
+        if (!source.isNull() && QFileInfo(source->GetFilename()) == QFileInfo(mFilename)) {
+            workflow->ReleaseSource();
+            source->Close();
+        }
+    }
+    mWatcher.setFuture(QtConcurrent::run(this, &WorkflowSaver::Write));
+}
+
+//!
+//! \brief WorkflowSaver::Write
+//!
+//! Runs on the worker thread, so it only touches the snapshot and the results read by the GUI
+//! thread once the worker has finished. The file is only replaced once it has been written in
+//! full, so a failed save leaves the old file as it was.
+//!
+void WorkflowSaver::Write()
+{
+    if (mIncremental) {
+        // hashed as it is written, reading the saved file again would cost as much as the copy
+        QCryptographicHash hash(WorkflowCache::HASH_ALGORITHM);
+        mSucceeded = Workflow::WriteIncrementalSave(mIncrementalSave, mFilename, &hash);
+        if (!mSucceeded) {
+            mErrorString = "SCXML file cannot be written";
+            return;
+        }
+        mSavedHash = hash.result();
+        return;
+    }
+
+    QSaveFile scxmlFile(mFilename);
+    if (!scxmlFile.open(QIODevice::WriteOnly)) {
+        mErrorString = "SCXML file cannot be written";
+        return;
+    }
+
+    // written as it is generated, without a document or buffer of the whole file
+    SCXMLCompressedDevice compressedDevice(&scxmlFile);
+    bool compressed = SCXMLCompressedDevice::IsCompressedFilename(mFilename);
+    if (compressed) {
+        compressedDevice.open(QIODevice::WriteOnly);
+    }
+    QXmlStreamWriter writer(compressed ? static_cast<QIODevice*>(&compressedDevice) : &scxmlFile);
+    writer.setAutoFormatting(false);
+    mModel.WriteToStream(writer);
+    if (writer.hasError() || (compressed && !compressedDevice.Finish()) || !scxmlFile.commit()) {
+        mErrorString = "SCXML file cannot be written";
+        return;
+    }
+    mSucceeded = true;
+
+    // refresh the cache so the saved file reopens from it
+    HashSavedFile();
+    if (mUseCache && !mSavedHash.isEmpty()) {
+        WorkflowCache::Write(&mModel, WorkflowCache::GetCacheFilename(mFilename), mSavedHash);
+    }
+}
+
+void WorkflowSaver::HashSavedFile()
+{
+    SCXMLSourceBuffer saved;
+    if (saved.Open(mFilename)) {
+        mSavedHash = WorkflowCache::HashSource(saved.GetData());
+    }
+}
+
+void WorkflowSaver::Written()
+{
+    // the incremental save moves the source ranges of the workflow to match the saved file
+    if (mIncremental && !mTab.isNull()) {
+        mTab->GetWorkflow()->FinishIncrementalSave(mIncrementalSave, mFilename, mSucceeded);
+    }
+    mIncrementalSave.edits.clear();
+    mModel.Clear();
+
+    if (!mSucceeded) {
+        qDebug() << "Workflow save failed:" << mErrorString;
+    }
+    emit Finished(mSucceeded);
+}
@@ -0,0 +1,72 @@
+#ifndef WORKFLOWSAVER_H
+#define WORKFLOWSAVER_H
+
+#include <QObject>
+#include <QPointer>
+#include <QFutureWatcher>
+#include "workflow.h"
+#include "workflowmodel.h"
+#include "workflowtab.h"
+
+//! Saves the workflow of a tab without blocking the GUI
+//!
+//! A snapshot is taken on the GUI thread, the edits of an incremental save or else a model of
+//! the whole workflow, and written on a worker thread to a temporary file that is renamed
+//! over the SCXML file once it is complete. The workflow can be edited while it is written.
+class WorkflowSaver : public QObject
+{
+    Q_OBJECT
+public:
+    explicit WorkflowSaver(WorkflowTab* tab, QString workflowFilename, QObject *parent = 0);
+    ~WorkflowSaver();
+
+    void SetUseCache(bool value) { mUseCache = value; }
+
+    //! Takes the snapshot and starts writing it on a worker thread, Finished is emitted once
+    //! when the save ends
+    void Start();
+
+    //! Gets the tab being saved, null if it has been deleted
+    WorkflowTab* GetTab() { return mTab; }
+    QString GetFilename() { return mFilename; }
+
+    //! Whether only the changes since the last save were written, over a copy of the source
+    bool IsIncremental() { return mIncremental; }
+
+    //! Gets the hash of the saved file, which keys its cache and journal
+    QByteArray GetSavedHash() { return mSavedHash; }
+
+    //! Gets the reason the file could not be written
+    QString GetErrorString() { return mErrorString; }
+
+signals:
+    //! The save has ended, the file is unchanged unless it succeeded
+    void Finished(bool succeeded);
+
+private slots:
+    void Written();
+
+private:
+    //! Writes the snapshot, runs on the worker thread
+    void Write();
+
+    //! Hashes the file once it has been saved, runs on the worker thread
+    void HashSavedFile();
+
+    QPointer<WorkflowTab> mTab;
+    QString mFilename;
+    bool mUseCache;
+    bool mIncremental;
+    QFutureWatcher<void> mWatcher;
+
+    // the snapshot, only read by the worker thread until it has finished
+    Workflow::IncrementalSave mIncrementalSave;
+    WorkflowModel mModel;
+
+    // written by the worker thread, only read once it has finished
+    bool mSucceeded;
+    QByteArray mSavedHash;
+    QString mErrorString;
+};
+
+#endif // WORKFLOWSAVER_H
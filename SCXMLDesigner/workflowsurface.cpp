@@ -1,5 +1,8 @@
 #include "workflowsurface.h"
 
+// the text view holds its own copy of the text, so limit it for very large files
+#define MAX_SCXML_TEXT_PREVIEW (8 * 1024 * 1024)
+
 WorkflowSurface::WorkflowSurface(QWidget *parent) :
     QWidget(parent)
 {
@@ -22,7 +25,8 @@ void WorkflowSurface::CreateWidgets()
     splitter->setOrientation(Qt::Vertical);
     graphicsView = new WorkflowGraphicsView(splitter);
     splitter->addWidget(graphicsView);
-    textSCXML = new QTextEdit(splitter);
+    textSCXML = new QPlainTextEdit(splitter);
+    textSCXML->setLineWrapMode(QPlainTextEdit::NoWrap);
     textSCXML->setMinimumSize(QSize(0, 0));
     textSCXML->setBaseSize(QSize(0, 0));
     splitter->addWidget(textSCXML);
@@ -36,7 +40,21 @@ WorkflowSurface::~WorkflowSurface()
 
 void WorkflowSurface::SetSCMLText(QString scxml)
 {
-    this->textSCXML->setText(scxml);
+    this->textSCXML->setPlainText(scxml);
+}
+
+void WorkflowSurface::SetSCMLText(const QByteArray &scxml)
+{
+    if (scxml.size() <= MAX_SCXML_TEXT_PREVIEW) {
+        this->textSCXML->setPlainText(QString::fromUtf8(scxml.constData(), scxml.size()));
+        return;
+    }
+
+    // decode only the start of the file, a split multi-byte character at the end is harmless
+    QString preview = QString::fromUtf8(scxml.constData(), MAX_SCXML_TEXT_PREVIEW);
+    preview.append(QString("\n\n<!-- preview truncated: showing %1 of %2 MB -->")
+                   .arg(MAX_SCXML_TEXT_PREVIEW / (1024 * 1024)).arg(scxml.size() / (1024 * 1024)));
+    this->textSCXML->setPlainText(preview);
 }
 
 QGraphicsView *WorkflowSurface::GetSurface()
@@ -7,7 +7,7 @@
 #include <QtWidgets/QButtonGroup>
 #include <QtWidgets/QHeaderView>
 #include <QtWidgets/QSplitter>
-#include <QtWidgets/QTextEdit>
+#include <QtWidgets/QPlainTextEdit>
 #include <QtWidgets/QVBoxLayout>
 #include <QtWidgets/QWidget>
 #include <QtWidgets/QGraphicsView>
@@ -23,6 +23,9 @@ public:
     ~WorkflowSurface();
 
     void SetSCMLText(QString scxml);
+
+    //! Shows the SCXML from the raw bytes of the file, large files are truncated to a preview
+    void SetSCMLText(const QByteArray& scxml);
     QGraphicsView *GetSurface();
 
     void CreateWidgets();
@@ -31,6 +34,7 @@ private:
     QVBoxLayout* verticalLayout;
     QSplitter* splitter;
     WorkflowGraphicsView* graphicsView;
-    QTextEdit* textSCXML;};
+    QPlainTextEdit* textSCXML;
+};
 
 #endif // WORKFLOWSURFACE_H
@@ -1,8 +1,10 @@
 #include <QModelIndex>
 #include "workflowtab.h"
+#include "workflowjournal.h"
+#include "scxmlcompresseddevice.h"
 
 WorkflowTab::WorkflowTab(QWidget *parent, QString filename) :
-    WorkflowSurface(parent), mFilename(filename)
+    WorkflowSurface(parent), mJournal(nullptr), mFilename(filename)
 {
     mTabWidget = dynamic_cast<QTabWidget*>(parent);
     mScene = new QGraphicsScene();
@@ -11,6 +13,18 @@ WorkflowTab::WorkflowTab(QWidget *parent, QString filename) :
     GetSurface()->setScene(mScene);
 }
 
+WorkflowTab::~WorkflowTab()
+{
+    // the journal stops recording the workflow, so it goes first
+    delete mJournal;
+}
+
+void WorkflowTab::SetJournal(WorkflowJournal *journal)
+{
+    delete mJournal;
+    mJournal = journal;
+}
+
 void WorkflowTab::SetFilename(QString filename)
 {
     mFilename = filename;
@@ -31,8 +45,29 @@ void WorkflowTab::SetWorkflowName(QString workflowName)
 
 void WorkflowTab::Update()
 {
-    QString scxml = mWorkflow.GetRawSCXML();
-    SetSCMLText(scxml);
+    UpdateSCXMLText();
+    CreateSceneObjects();
+}
+
+void WorkflowTab::UpdateSCXMLText()
+{
+    QSharedPointer<SCXMLSourceBuffer> source = mWorkflow.GetSource();
+    if (!source.isNull() && SCXMLCompressedDevice::IsCompressed(source->GetData())) {
+        // the text view needs the whole of the SCXML, the loaders do not
+        QByteArray scxml;
+        SCXMLCompressedDevice::Decompress(source->GetData(), scxml);
+        SetSCMLText(scxml);
+    }
+    else if (!source.isNull()) {
+        SetSCMLText(source->GetData());
+    }
+    else {
+        SetSCMLText(mWorkflow.GetRawSCXML());
+    }
+}
+
+void WorkflowTab::CreateSceneObjects()
+{
     GetWorkflow()->CreateSceneObjects(mScene);
 }
 
@@ -41,11 +76,11 @@ void WorkflowTab::TestDataModel(QTableWidget *dataView)
 {
     SCXMLDataModel* dataModel = GetWorkflow()->GetDataModel();
 
-    foreach (SCXMLDataItem* dataItem, dataModel->GetDataItemList()) {
+    foreach (const SCXMLDataItem& dataItem, dataModel->GetDataItems()) {
         dataView->insertRow(0);
-        dataView->setItem(0, 0, new QTableWidgetItem(dataItem->GetId()));
-        dataView->setItem(0, 1, new QTableWidgetItem(dataItem->GetExpr()));
-        dataView->setItem(0, 2, new QTableWidgetItem(dataItem->GetSrc()));
+        dataView->setItem(0, 0, new QTableWidgetItem(dataItem.GetPath()));
+        dataView->setItem(0, 1, new QTableWidgetItem(dataItem.GetExpr()));
+        dataView->setItem(0, 2, new QTableWidgetItem(dataItem.GetSrc()));
     }
 }
 
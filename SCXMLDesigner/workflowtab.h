@@ -7,16 +7,27 @@
 #include "workflow.h"
 #include "workflowsurface.h"
 
+class WorkflowJournal;
+
 class WorkflowTab : public WorkflowSurface
 {
     Q_OBJECT
 public:
     explicit WorkflowTab(QWidget *parent = 0, QString filename = "");
+    ~WorkflowTab();
     Workflow* GetWorkflow() { return &mWorkflow; }
+    //! Gets the journal of the edits to the workflow, null if they are not journaled
+    WorkflowJournal* GetJournal() { return mJournal; }
+    //! Sets the journal, taking ownership of it and deleting any previous one
+    void SetJournal(WorkflowJournal* journal);
     QString GetFilename() { return mFilename; }
     void SetFilename(QString filename);
     void SetWorkflowName(QString workflowName);
     void Update();
+    //! Shows the SCXML of the workflow in the text pane
+    void UpdateSCXMLText();
+    //! Adds all the states and transitions of the workflow to the scene
+    void CreateSceneObjects();
     void AddItemToScene(QGraphicsItem *item);
 
     void TestDataModel(QTableWidget *dataView);
@@ -29,6 +40,7 @@ public slots:
     
 private:
     Workflow mWorkflow;
+    WorkflowJournal* mJournal;
     QTabWidget *mTabWidget;
     QString mFilename;
     QString mWorkflowName;
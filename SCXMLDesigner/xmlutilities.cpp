@@ -1,29 +1,45 @@
 #include "xmlutilities.h"
 
+const QString XMLUtilities::SCXML_TAG_ARRAY = "array";
 const QString XMLUtilities::SCXML_TAG_ASSIGN = "assign";
 const QString XMLUtilities::SCXML_TAG_CANCEL = "cancel";
+const QString XMLUtilities::SCXML_TAG_COND = "cond";
 const QString XMLUtilities::SCXML_TAG_DATA = "data";
 const QString XMLUtilities::SCXML_TAG_DATAMODEL = "datamodel";
+const QString XMLUtilities::SCXML_TAG_DELAY = "delay";
+const QString XMLUtilities::SCXML_TAG_DELAYEXPR = "delayexpr";
+const QString XMLUtilities::SCXML_TAG_ELSE = "else";
+const QString XMLUtilities::SCXML_TAG_ELSEIF = "elseif";
 const QString XMLUtilities::SCXML_TAG_EXPR = "expr";
 const QString XMLUtilities::SCXML_TAG_EVENT = "event";
+const QString XMLUtilities::SCXML_TAG_EVENTEXPR = "eventexpr";
 const QString XMLUtilities::SCXML_TAG_FINAL = "final";
 const QString XMLUtilities::SCXML_TAG_FOREACH = "foreach";
 const QString XMLUtilities::SCXML_TAG_ID = "id";
+const QString XMLUtilities::SCXML_TAG_IDLOCATION = "idlocation";
 const QString XMLUtilities::SCXML_TAG_IF = "if";
+const QString XMLUtilities::SCXML_TAG_INDEX = "index";
 const QString XMLUtilities::SCXML_TAG_INITIAL = "initial";
+const QString XMLUtilities::SCXML_TAG_ITEM = "item";
 const QString XMLUtilities::SCXML_TAG_LABEL = "label";
+const QString XMLUtilities::SCXML_TAG_LOCATION = "location";
 const QString XMLUtilities::SCXML_TAG_LOG = "log";
 const QString XMLUtilities::SCXML_TAG_NAME = "name";
 const QString XMLUtilities::SCXML_TAG_ONENTRY = "onentry";
+const QString XMLUtilities::SCXML_TAG_ONEXIT = "onexit";
 const QString XMLUtilities::SCXML_TAG_RAISE = "raise";
 const QString XMLUtilities::SCXML_TAG_SCRIPT = "script";
 const QString XMLUtilities::SCXML_TAG_SCXML = "scxml";
 const QString XMLUtilities::SCXML_TAG_SEND = "send";
+const QString XMLUtilities::SCXML_TAG_SENDID = "sendid";
+const QString XMLUtilities::SCXML_TAG_SENDIDEXPR = "sendidexpr";
 const QString XMLUtilities::SCXML_TAG_SRC = "src";
 const QString XMLUtilities::SCXML_TAG_STATE = "state";
 const QString XMLUtilities::SCXML_TAG_TARGET = "target";
+const QString XMLUtilities::SCXML_TAG_TARGETEXPR = "targetexpr";
 const QString XMLUtilities::SCXML_TAG_TRANSITION = "transition";
 const QString XMLUtilities::SCXML_TAG_TYPE = "type";
+const QString XMLUtilities::SCXML_TAG_TYPEEXPR = "typeexpr";
 const QString XMLUtilities::SCXML_TAG_VERSION = "version";
 
 
@@ -66,3 +82,32 @@ bool XMLUtilities::GetSingleElementWithTagName(QDomNode &elem, QDomDocument &doc
     elem = elements.at(0);
     return true;
 }
+
+void XMLUtilities::WriteIndent(QXmlStreamWriter &writer, int depth)
+{
+    // writing nothing would still close an open start tag
+    if (depth > 0) {
+        writer.writeCharacters(QString(depth, ' '));
+    }
+}
+
+void XMLUtilities::WriteNewLine(QXmlStreamWriter &writer)
+{
+    writer.writeCharacters("\n");
+}
+
+void XMLUtilities::WriteComment(QXmlStreamWriter &writer, QString text, int depth)
+{
+    WriteIndent(writer, depth);
+    WriteComment(writer, text);
+    WriteNewLine(writer);
+}
+
+void XMLUtilities::WriteComment(QXmlStreamWriter &writer, QString text)
+{
+    // as with QDom, keep a trailing '-' from running into the end of the comment
+    if (text.endsWith('-')) {
+        text.append(' ');
+    }
+    writer.writeComment(text);
+}
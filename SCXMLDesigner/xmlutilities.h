@@ -6,36 +6,53 @@
 #include <QList>
 #include <QDomDocument>
 #include <QStringList>
+#include <QXmlStreamWriter>
 
 class XMLUtilities
 {
 public:
     XMLUtilities();
 
+    static const QString SCXML_TAG_ARRAY;
     static const QString SCXML_TAG_ASSIGN;
     static const QString SCXML_TAG_CANCEL;
+    static const QString SCXML_TAG_COND;
     static const QString SCXML_TAG_DATA;
     static const QString SCXML_TAG_DATAMODEL;
+    static const QString SCXML_TAG_DELAY;
+    static const QString SCXML_TAG_DELAYEXPR;
+    static const QString SCXML_TAG_ELSE;
+    static const QString SCXML_TAG_ELSEIF;
     static const QString SCXML_TAG_EXPR;
     static const QString SCXML_TAG_EVENT;
+    static const QString SCXML_TAG_EVENTEXPR;
     static const QString SCXML_TAG_FINAL;
     static const QString SCXML_TAG_FOREACH;
     static const QString SCXML_TAG_ID;
+    static const QString SCXML_TAG_IDLOCATION;
     static const QString SCXML_TAG_IF;
+    static const QString SCXML_TAG_INDEX;
     static const QString SCXML_TAG_INITIAL;
+    static const QString SCXML_TAG_ITEM;
     static const QString SCXML_TAG_LABEL;
+    static const QString SCXML_TAG_LOCATION;
     static const QString SCXML_TAG_LOG;
     static const QString SCXML_TAG_NAME;
     static const QString SCXML_TAG_ONENTRY;
+    static const QString SCXML_TAG_ONEXIT;
     static const QString SCXML_TAG_RAISE;
     static const QString SCXML_TAG_SCRIPT;
     static const QString SCXML_TAG_SCXML;
     static const QString SCXML_TAG_SEND;
+    static const QString SCXML_TAG_SENDID;
+    static const QString SCXML_TAG_SENDIDEXPR;
     static const QString SCXML_TAG_SRC;
     static const QString SCXML_TAG_STATE;
     static const QString SCXML_TAG_TARGET;
+    static const QString SCXML_TAG_TARGETEXPR;
     static const QString SCXML_TAG_TRANSITION;
     static const QString SCXML_TAG_TYPE;
+    static const QString SCXML_TAG_TYPEEXPR;
     static const QString SCXML_TAG_VERSION;
 
     static QString GetAttributeOrDefault(QDomElement *element, QString tag, QString fallback);
@@ -44,6 +61,16 @@ public:
     static bool GetElementsWithTagNames(QList<QDomNode> &elems, QDomDocument &doc, QStringList tags, bool clear = false);
     static bool GetElementsWithTagName(QList<QDomNode> &elems, QDomDocument &doc, QString tag, bool clear = false);
     static bool GetSingleElementWithTagName(QDomNode &elem, QDomDocument &doc, QString tag);
+
+    //! Layout for QXmlStreamWriter that matches QDomDocument::toByteArray(): a node at depth d
+    //! is indented by d spaces and followed by a new line, as is the start tag of an element
+    //! with children. Auto formatting must be off
+    static void WriteIndent(QXmlStreamWriter& writer, int depth);
+    static void WriteNewLine(QXmlStreamWriter& writer);
+    static void WriteComment(QXmlStreamWriter& writer, QString text, int depth);
+
+    //! Writes just the comment, padded as QDom does so a trailing '-' cannot end it early
+    static void WriteComment(QXmlStreamWriter& writer, QString text);
 };
 
 #endif // XMLUTILITIES_H
@@ -0,0 +1,61 @@
+#-------------------------------------------------
+#
+# Benchmarks for the SCXML designer
+#
+#-------------------------------------------------
+
+QT       += core gui xml widgets qml
+
+TARGET = SCXMLDesignerBenchmarks
+CONFIG   += console c++11
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += $$PWD/../SCXMLDesigner/
+
+SOURCES += main.cpp \
+    ../SCXMLDesigner/scxmlstate.cpp \
+    ../SCXMLDesigner/workflow.cpp \
+    ../SCXMLDesigner/utilities.cpp \
+    ../SCXMLDesigner/scxmltransition.cpp \
+    ../SCXMLDesigner/metadatasupport.cpp \
+    ../SCXMLDesigner/scxmldatamodel.cpp \
+    ../SCXMLDesigner/chaikincurve.cpp \
+    ../SCXMLDesigner/scxmlexecutablecontent.cpp \
+    ../SCXMLDesigner/xmlutilities.cpp \
+    ../SCXMLDesigner/connectionpointsupport.cpp \
+    ../SCXMLDesigner/scxmlsourcebuffer.cpp \
+    ../SCXMLDesigner/workflowcache.cpp \
+    ../SCXMLDesigner/scxmlatoms.cpp \
+    ../SCXMLDesigner/workflowmodel.cpp \
+    ../SCXMLDesigner/scxmlcompresseddevice.cpp \
+    ../SCXMLDesigner/scxmlcompiledchart.cpp \
+    ../SCXMLDesigner/scxmlengine.cpp \
+    ../SCXMLDesigner/scxmlexpressions.cpp \
+    ../SCXMLDesigner/scxmlscheduler.cpp \
+    ../SCXMLDesigner/scxmleventqueue.cpp \
+    ../SCXMLDesigner/scxmltimerwheel.cpp
+
+HEADERS += benchmarkNestedLoad.h \
+    benchmarkMetaData.h \
+    benchmarkHubTransitions.h \
+    benchmarkChartGenerator.h \
+    benchmarkLoadSave.h \
+    benchmarkSave.h \
+    benchmarkCompressed.h \
+    benchmarkEngine.h \
+    benchmarkExpressions.h \
+    benchmarkSessions.h \
+    benchmarkScheduler.h \
+    benchmarkEventQueue.h \
+    benchmarkTimerWheel.h \
+    ../SCXMLDesigner/scxmlstate.h \
+    ../SCXMLDesigner/workflow.h \
+    ../SCXMLDesigner/scxmltransition.h \
+    ../SCXMLDesigner/scxmlcompresseddevice.h
+
+RESOURCES += \
+    ../SCXMLDesigner/resources.qrc
+
+win32: LIBS += -lpsapi
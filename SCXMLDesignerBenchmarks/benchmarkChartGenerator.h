@@ -0,0 +1,128 @@
+#ifndef BENCHMARKCHARTGENERATOR_H
+#define BENCHMARKCHARTGENERATOR_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <QJsonObject>
+
+//! Shape of a generated chart
+struct ChartParameters
+{
+    ChartParameters() : stateCount(1000), fanOut(2), depth(4), dataItemCount(16), actionsPerState(2) {}
+
+    int stateCount;
+    //! Transitions leaving each state
+    int fanOut;
+    //! States nested inside each other in each chain, 1 for a flat chart
+    int depth;
+    //! Items in the top level datamodel
+    int dataItemCount;
+    //! Log actions of each state, split between onentry and onexit
+    int actionsPerState;
+
+    QJsonObject ToJson() const {
+        QJsonObject json;
+        json.insert("states", stateCount);
+        json.insert("fan_out", fanOut);
+        json.insert("depth", depth);
+        json.insert("data_items", dataItemCount);
+        json.insert("actions_per_state", actionsPerState);
+        return json;
+    }
+};
+
+//!
+//! \brief Reads the chart shape from the command line
+//!
+//! --fanout N, --depth N, --data N and --actions N set the shape, --states N,N,... the sizes
+//! of chart to generate (1k, 10k and 100k states by default).
+//!
+static ChartParameters ParseChartParameters(const QStringList& arguments, QList<int>& stateCounts)
+{
+    ChartParameters parameters;
+    for (int argPos=0; argPos+1<arguments.count(); argPos++) {
+        QString name = arguments.at(argPos);
+        QString value = arguments.at(argPos + 1);
+        if (name == "--fanout") parameters.fanOut = qMax(0, value.toInt());
+        else if (name == "--depth") parameters.depth = qMax(1, value.toInt());
+        else if (name == "--data") parameters.dataItemCount = qMax(0, value.toInt());
+        else if (name == "--actions") parameters.actionsPerState = qMax(0, value.toInt());
+        else if (name == "--states") {
+            foreach (QString count, value.split(',', QString::SkipEmptyParts)) {
+                if (count.toInt() > 0) stateCounts.append(count.toInt());
+            }
+        }
+    }
+    if (stateCounts.isEmpty()) {
+        stateCounts << 1000 << 10000 << 100000;
+    }
+    return parameters;
+}
+
+//!
+//! \brief Generates an SCXML chart with the given shape
+//!
+//! The states are laid out in chains of depth nested states on a grid, each with fanOut
+//! transitions to states spread across the chart. The chart is the same for the same
+//! parameters so results can be compared between runs.
+//!
+static QByteArray GenerateChart(const ChartParameters& parameters)
+{
+    QByteArray scxml;
+    QTextStream out(&scxml);
+    out.setCodec("UTF-8");
+
+    int stateCount = qMax(1, parameters.stateCount);
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    out << "<scxml xmlns=\"http://www.w3.org/2005/07/scxml\" name=\"Generated\" initial=\"s0\" version=\"1.0\">\n";
+    if (parameters.dataItemCount > 0) {
+        out << "<datamodel>\n";
+        for (int dataPos=0; dataPos<parameters.dataItemCount; dataPos++) {
+            out << "<data id=\"d" << dataPos << "\" expr=\"" << dataPos << "\"/>\n";
+        }
+        out << "</datamodel>\n";
+    }
+
+    int entryActions = (parameters.actionsPerState + 1) / 2;
+    int exitActions = parameters.actionsPerState / 2;
+    for (int statePos=0; statePos<stateCount; statePos++) {
+        int level = statePos % parameters.depth;
+        out << "<state id=\"s" << statePos << "\">\n";
+        out << "<!-- META-DATA [x=" << (statePos % 64) * 130 << "] [y=" << (statePos / 64) * 70
+            << "] [width=100] [height=50] [description=state " << statePos << "]-->\n";
+        if (entryActions > 0) {
+            out << "<onentry>";
+            for (int actionPos=0; actionPos<entryActions; actionPos++) {
+                out << "<log label=\"s" << statePos << "\" expr=\"d" << (actionPos % qMax(1, parameters.dataItemCount)) << " + 1\"/>";
+            }
+            out << "</onentry>\n";
+        }
+        if (exitActions > 0) {
+            out << "<onexit>";
+            for (int actionPos=0; actionPos<exitActions; actionPos++) {
+                out << "<log label=\"s" << statePos << "\" expr=\"" << actionPos << "\"/>";
+            }
+            out << "</onexit>\n";
+        }
+        for (int transitionPos=0; transitionPos<parameters.fanOut; transitionPos++) {
+            // spread the targets over the chart without any randomness
+            int target = int((qint64(statePos) * 7919 + qint64(transitionPos) * 104729 + 1) % stateCount);
+            out << "<transition target=\"s" << target << "\" event=\"ev." << transitionPos << "." << (statePos % 8) << "\"/>\n";
+        }
+
+        // close the chain once it is deep enough, or at the end of the chart
+        bool lastInChain = (level == parameters.depth - 1) || (statePos == stateCount - 1);
+        if (lastInChain) {
+            for (int closePos=0; closePos<=level; closePos++) {
+                out << "</state>\n";
+            }
+        }
+    }
+    out << "</scxml>\n";
+    out.flush();
+    return scxml;
+}
+
+#endif // BENCHMARKCHARTGENERATOR_H
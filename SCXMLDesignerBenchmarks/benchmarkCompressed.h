@@ -0,0 +1,109 @@
+#ifndef BENCHMARKCOMPRESSED_H
+#define BENCHMARKCOMPRESSED_H
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QBuffer>
+#include <QTemporaryFile>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include "benchmarkChartGenerator.h"
+#include "workflowmodel.h"
+#include "scxmlcompresseddevice.h"
+
+//!
+//! \brief Writes a model to a file as SCXML, compressed or not, as the saver does
+//!
+static qint64 TimeModelSave(const WorkflowModel& model, bool compressed, QByteArray& saved)
+{
+    QTemporaryFile file;
+    file.open();
+    QElapsedTimer timer;
+    timer.start();
+    {
+        SCXMLCompressedDevice compressedDevice(&file);
+        if (compressed) {
+            compressedDevice.open(QIODevice::WriteOnly);
+        }
+        QXmlStreamWriter writer(compressed ? static_cast<QIODevice*>(&compressedDevice) : &file);
+        model.WriteToStream(writer);
+        compressedDevice.close();
+    }
+    file.flush();
+    qint64 elapsed = timer.nsecsElapsed();
+    file.seek(0);
+    saved = file.readAll();
+    return elapsed;
+}
+
+//!
+//! \brief Reads the bytes of a file into a model, as the loader does
+//!
+static qint64 TimeModelLoad(QByteArray data, int& stateCount)
+{
+    QElapsedTimer timer;
+    timer.start();
+    WorkflowModel model;
+    QBuffer device(&data);
+    device.open(QIODevice::ReadOnly);
+    SCXMLCompressedDevice compressedDevice(&device);
+    bool compressed = SCXMLCompressedDevice::IsCompressed(data);
+    if (compressed) {
+        compressedDevice.open(QIODevice::ReadOnly);
+    }
+    QXmlStreamReader reader(compressed ? static_cast<QIODevice*>(&compressedDevice) : &device);
+    bool read = model.ReadFromStream(reader);
+    qint64 elapsed = timer.nsecsElapsed();
+    stateCount = read ? model.states.count() : -1;
+    return elapsed;
+}
+
+//!
+//! \brief Compares compressed SCXML (.scxmlz) with plain SCXML on generated charts
+//!
+//! Each chart is saved both ways from the same model, then each file is read back into a
+//! model. The compressed file must decompress to the same bytes as the plain file.
+//!
+static void BenchmarkCompressed(const QStringList& arguments)
+{
+    QList<int> stateCounts;
+    ChartParameters parameters = ParseChartParameters(arguments, stateCounts);
+
+    QTextStream out(stdout);
+    out << "Compressed SCXML (fan out " << parameters.fanOut << ", depth " << parameters.depth << ")\n";
+    out << "states\tplain KB\tcompressed KB\tratio\tplain save ms\tcompressed save ms\tplain load ms\tcompressed load ms\tverified\n";
+    foreach (int stateCount, stateCounts) {
+        parameters.stateCount = stateCount;
+        WorkflowModel model;
+        {
+            QByteArray scxml = GenerateChart(parameters);
+            QXmlStreamReader reader(scxml);
+            model.ReadFromStream(reader);
+        }
+
+        QByteArray plain;
+        QByteArray compressed;
+        qint64 plainSaveTime = TimeModelSave(model, false, plain);
+        qint64 compressedSaveTime = TimeModelSave(model, true, compressed);
+        model.Clear();
+
+        int plainStates = 0;
+        int compressedStates = 0;
+        qint64 plainLoadTime = TimeModelLoad(plain, plainStates);
+        qint64 compressedLoadTime = TimeModelLoad(compressed, compressedStates);
+
+        QByteArray decompressed;
+        bool verified = SCXMLCompressedDevice::Decompress(compressed, decompressed) && decompressed == plain
+                && plainStates == compressedStates && plainStates > 0;
+
+        out << stateCount << "\t"
+            << plain.size() / 1024 << "\t" << compressed.size() / 1024 << "\t"
+            << double(plain.size()) / qMax(1, compressed.size()) << "\t"
+            << double(plainSaveTime) / 1000000.0 << "\t" << double(compressedSaveTime) / 1000000.0 << "\t"
+            << double(plainLoadTime) / 1000000.0 << "\t" << double(compressedLoadTime) / 1000000.0 << "\t"
+            << (verified ? "yes" : "no") << "\n";
+        out.flush();
+    }
+}
+
+#endif // BENCHMARKCOMPRESSED_H
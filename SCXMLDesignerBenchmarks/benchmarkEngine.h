@@ -0,0 +1,219 @@
+#ifndef BENCHMARKENGINE_H
+#define BENCHMARKENGINE_H
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QCoreApplication>
+#include <QStateMachine>
+#include <QState>
+#include <QAbstractTransition>
+#include <QSet>
+#include "benchmarkChartGenerator.h"
+#include "workflowmodel.h"
+#include "scxmlcompiledchart.h"
+#include "scxmlengine.h"
+
+//! A named event for the QStateMachine, as the engine takes them
+class BenchmarkEvent : public QEvent
+{
+public:
+    explicit BenchmarkEvent(SCXMLAtom name) : QEvent(GetEventType()), name(name) {}
+
+    static QEvent::Type GetEventType() {
+        static int type = QEvent::registerEventType();
+        return QEvent::Type(type);
+    }
+
+    SCXMLAtom name;
+};
+
+//! Takes the event named by the first descriptor of a compiled transition
+class BenchmarkTransition : public QAbstractTransition
+{
+public:
+    explicit BenchmarkTransition(SCXMLAtom event) : mEvent(event) {}
+
+protected:
+    bool eventTest(QEvent *event) {
+        return event->type() == BenchmarkEvent::GetEventType() && static_cast<BenchmarkEvent*>(event)->name == mEvent;
+    }
+    void onTransition(QEvent *event) { Q_UNUSED(event) }
+
+private:
+    SCXMLAtom mEvent;
+};
+
+//! Counts the log actions it would run on entry and exit, as the engine's log callback does
+class BenchmarkState : public QState
+{
+public:
+    BenchmarkState(QState* parent, int entryActions, int exitActions, qint64* actionCount) :
+        QState(parent), mEntryActions(entryActions), mExitActions(exitActions), mActionCount(actionCount) {}
+
+protected:
+    void onEntry(QEvent *event) { Q_UNUSED(event) *mActionCount += mEntryActions; }
+    void onExit(QEvent *event) { Q_UNUSED(event) *mActionCount += mExitActions; }
+
+private:
+    int mEntryActions;
+    int mExitActions;
+    qint64* mActionCount;
+};
+
+//! Counts the events it has taken, so the benchmark knows when the queue is empty
+class BenchmarkStateMachine : public QStateMachine
+{
+public:
+    BenchmarkStateMachine() : processedEvents(0) {}
+
+    qint64 processedEvents;
+
+protected:
+    void beginSelectTransitions(QEvent *event) {
+        if (event != nullptr && event->type() == BenchmarkEvent::GetEventType()) processedEvents++;
+    }
+};
+
+//! Counts the log instructions of a block of the chart's code
+static int CountLogActions(const SCXMLCompiledChart& chart, const SCXMLCompiledChart::Range& actions)
+{
+    int logCount = 0;
+    const qint32* code = chart.GetCode();
+    int end = actions.first + actions.count;
+    for (int pos=actions.first; pos<end; pos+=SCXMLCompiledChart::GetInstructionLength(SCXMLCompiledChart::Opcode(code[pos]))) {
+        if (code[pos] == SCXMLCompiledChart::OP_LOG) logCount++;
+    }
+    return logCount;
+}
+
+//!
+//! \brief Builds a QStateMachine with the states and evented transitions of a compiled chart
+//!
+//! The states are returned by their index in the chart, state 0 being the machine.
+//!
+static QVector<QState*> BuildBenchmarkStateMachine(const SCXMLCompiledChart& chart, BenchmarkStateMachine* machine,
+                                                   qint64* actionCount)
+{
+    QVector<QState*> states(chart.GetStateCount(), nullptr);
+    states[0] = machine;
+    for (int statePos=1; statePos<chart.GetStateCount(); statePos++) {
+        const SCXMLCompiledChart::State& state = chart.GetState(statePos);
+        states[statePos] = new BenchmarkState(states.at(state.parent), CountLogActions(chart, state.onEntry),
+                                              CountLogActions(chart, state.onExit), actionCount);
+    }
+    for (int statePos=0; statePos<chart.GetStateCount(); statePos++) {
+        int initial = chart.GetState(statePos).initial;
+        if (initial < 0) continue;
+        // QStateMachine only takes a child as the initial state
+        while (chart.GetState(initial).parent != statePos) {
+            initial = chart.GetState(initial).parent;
+        }
+        states.at(statePos)->setInitialState(states.at(initial));
+    }
+    for (int transitionPos=0; transitionPos<chart.GetTransitionCount(); transitionPos++) {
+        const SCXMLCompiledChart::Transition& transition = chart.GetTransition(transitionPos);
+        if (transition.descriptors.count == 0 || transition.target < 0) continue;
+        BenchmarkTransition* benchmarkTransition = new BenchmarkTransition(chart.GetDescriptor(transition.descriptors.first).event);
+        benchmarkTransition->setTargetState(states.at(transition.target));
+        states.at(transition.source)->addTransition(benchmarkTransition);
+    }
+    return states;
+}
+
+//!
+//! \brief Gets the events sent to both engines, the same for the same chart
+//!
+//! The events are spread over those of the generated transitions, so some are taken by the
+//! active state or an ancestor and the rest are discarded.
+//!
+static QVector<SCXMLAtom> GenerateBenchmarkEvents(const ChartParameters& parameters, int eventCount)
+{
+    QVector<SCXMLAtom> events;
+    events.reserve(eventCount);
+    quint32 seed = 12345;
+    for (int eventPos=0; eventPos<eventCount; eventPos++) {
+        seed = seed * 1103515245 + 12345;
+        int transitionPos = int((seed >> 16) % quint32(qMax(1, parameters.fanOut)));
+        int group = int((seed >> 8) % 8);
+        events.append(SCXMLIntern(QString("ev.%1.%2").arg(transitionPos).arg(group)));
+    }
+    return events;
+}
+
+//!
+//! \brief Sends the same events to the compiled engine and to a QStateMachine of each chart
+//!
+//! Both must end in the same state having run the same number of actions. --events N sets the
+//! number of events sent (100k by default).
+//!
+static void BenchmarkEngine(const QStringList& arguments, int eventCount)
+{
+    QList<int> stateCounts;
+    ChartParameters parameters = ParseChartParameters(arguments, stateCounts);
+
+    QTextStream out(stdout);
+    out << "Engine (fan out " << parameters.fanOut << ", depth " << parameters.depth << ", " << eventCount << " events)\n";
+    out << "states\tcompile ms\tengine ms\tengine events/s\tqstatemachine ms\tqstatemachine events/s\tspeed up\tverified\n";
+    foreach (int stateCount, stateCounts) {
+        parameters.stateCount = stateCount;
+        QSharedPointer<SCXMLCompiledChart> chart(new SCXMLCompiledChart());
+        QElapsedTimer timer;
+        {
+            WorkflowModel model;
+            QByteArray scxml = GenerateChart(parameters);
+            QXmlStreamReader reader(scxml);
+            model.ReadFromStream(reader);
+            timer.start();
+            chart->Compile(model);
+        }
+        qint64 compileTime = timer.nsecsElapsed();
+        QVector<SCXMLAtom> events = GenerateBenchmarkEvents(parameters, eventCount);
+
+        qint64 engineActions = 0;
+        SCXMLEngine engine(chart);
+        SCXMLSession session;
+        engine.SetLogCallback([&engineActions](const QString&, const QString&) { engineActions++; });
+        engine.Start(session);
+        timer.start();
+        foreach (SCXMLAtom event, events) {
+            session.PostEvent(event);
+        }
+        engine.ProcessEvents(session);
+        qint64 engineTime = timer.nsecsElapsed();
+
+        qint64 machineActions = 0;
+        BenchmarkStateMachine* machine = new BenchmarkStateMachine();
+        QVector<QState*> states = BuildBenchmarkStateMachine(*chart, machine, &machineActions);
+        machine->start();
+        while (!machine->isRunning()) {
+            QCoreApplication::processEvents();
+        }
+        timer.start();
+        foreach (SCXMLAtom event, events) {
+            machine->postEvent(new BenchmarkEvent(event));
+        }
+        while (machine->processedEvents < events.count()) {
+            QCoreApplication::processEvents();
+        }
+        qint64 machineTime = timer.nsecsElapsed();
+
+        // the active state of the machine is the deepest in its configuration
+        int machineState = 0;
+        QSet<QAbstractState*> configuration = machine->configuration();
+        for (int statePos=1; statePos<states.count(); statePos++) {
+            if (configuration.contains(states.at(statePos)) && chart->GetState(statePos).depth > chart->GetState(machineState).depth) {
+                machineState = statePos;
+            }
+        }
+        delete machine;
+        bool verified = (machineState == session.GetActiveState() && machineActions == engineActions);
+
+        out << stateCount << "\t" << double(compileTime) / 1000000.0 << "\t"
+            << double(engineTime) / 1000000.0 << "\t" << qint64(double(eventCount) * 1e9 / qMax(qint64(1), engineTime)) << "\t"
+            << double(machineTime) / 1000000.0 << "\t" << qint64(double(eventCount) * 1e9 / qMax(qint64(1), machineTime)) << "\t"
+            << double(machineTime) / qMax(qint64(1), engineTime) << "\t" << (verified ? "yes" : "no") << "\n";
+        out.flush();
+    }
+}
+
+#endif // BENCHMARKENGINE_H
@@ -0,0 +1,108 @@
+#ifndef BENCHMARKEVENTQUEUE_H
+#define BENCHMARKEVENTQUEUE_H
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QThread>
+#include <QMutex>
+#include <QQueue>
+#include "scxmleventqueue.h"
+
+//! Posts events to one of the queues, waiting while the lock free queue is full
+class BenchmarkEventProducer : public QThread
+{
+public:
+    BenchmarkEventProducer(SCXMLEventQueue* queue, QMutex* mutex, QQueue<SCXMLAtom>* lockedQueue, int eventCount) :
+        mQueue(queue), mMutex(mutex), mLockedQueue(lockedQueue), mEventCount(eventCount) {}
+
+protected:
+    virtual void run() {
+        for (int eventPos=0; eventPos<mEventCount; eventPos++) {
+            if (mQueue != nullptr) {
+                while (!mQueue->Post(eventPos)) {
+                    QThread::yieldCurrentThread();
+                }
+            }
+            else {
+                QMutexLocker locker(mMutex);
+                mLockedQueue->enqueue(eventPos);
+            }
+        }
+    }
+
+private:
+    SCXMLEventQueue* mQueue;
+    QMutex* mMutex;
+    QQueue<SCXMLAtom>* mLockedQueue;
+    int mEventCount;
+};
+
+//! Takes the events of the producers from one of the queues, returns how long it took in ns
+static qint64 RunEventQueue(int producerCount, int eventCount, SCXMLEventQueue* queue, QMutex* mutex,
+                            QQueue<SCXMLAtom>* lockedQueue)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QVector<BenchmarkEventProducer*> producers;
+    for (int producerPos=0; producerPos<producerCount; producerPos++) {
+        producers.append(new BenchmarkEventProducer(queue, mutex, lockedQueue, eventCount));
+        producers.last()->start();
+    }
+
+    qint64 total = qint64(producerCount) * eventCount;
+    SCXMLAtom batch[64];
+    for (qint64 takenCount=0; takenCount<total; ) {
+        int count = 0;
+        if (queue != nullptr) {
+            count = queue->Take(batch, 64);
+        }
+        else {
+            // drained in batches too, so only the locking differs
+            QMutexLocker locker(mutex);
+            while (count < 64 && !lockedQueue->isEmpty()) {
+                batch[count++] = lockedQueue->dequeue();
+            }
+        }
+        if (count == 0) {
+            QThread::yieldCurrentThread();
+        }
+        takenCount += count;
+    }
+    qint64 time = timer.nsecsElapsed();
+
+    foreach (BenchmarkEventProducer* producer, producers) {
+        producer->wait();
+    }
+    qDeleteAll(producers);
+    return time;
+}
+
+//!
+//! \brief Compares posting events to SCXMLEventQueue with a QQueue guarded by a QMutex
+//!
+//! 1, 2, 4... producer threads each post --queue-events N events (1M by default) while one
+//! consumer takes them in batches of 64, as a scheduler worker does.
+//!
+static void BenchmarkEventQueue(int eventCount)
+{
+    int maxProducerCount = qMax(1, QThread::idealThreadCount());
+    QTextStream out(stdout);
+    out << "Event queue (" << eventCount << " events per producer)\n";
+    out << "producers\tlock free events/s\tmutex events/s\tspeed up\n";
+    for (int producerCount=1; producerCount<=maxProducerCount; producerCount*=2) {
+        SCXMLEventQueue queue(1024);
+        qint64 lockFreeTime = RunEventQueue(producerCount, eventCount, &queue, nullptr, nullptr);
+
+        QMutex mutex;
+        QQueue<SCXMLAtom> lockedQueue;
+        qint64 mutexTime = RunEventQueue(producerCount, eventCount, nullptr, &mutex, &lockedQueue);
+
+        double total = double(producerCount) * eventCount;
+        out << producerCount << "\t" << qint64(total * 1e9 / qMax(qint64(1), lockFreeTime)) << "\t"
+            << qint64(total * 1e9 / qMax(qint64(1), mutexTime)) << "\t"
+            << double(mutexTime) / qMax(qint64(1), lockFreeTime) << "\n";
+        out.flush();
+    }
+}
+
+#endif // BENCHMARKEVENTQUEUE_H
@@ -0,0 +1,116 @@
+#ifndef BENCHMARKEXPRESSIONS_H
+#define BENCHMARKEXPRESSIONS_H
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QJSEngine>
+#include <QJSValue>
+#include "scxmlexpressions.h"
+
+//! The datamodel the guards are evaluated against, with busy as the only active state
+class BenchmarkExpressionContext : public SCXMLExpressionContext
+{
+public:
+    BenchmarkExpressionContext() {
+        AddData("first", SCXMLValue::FromNumber(20));
+        AddData("second", SCXMLValue::FromNumber(22));
+        AddData("multiplier", SCXMLValue::FromNumber(3));
+        AddData("addResult", SCXMLValue::FromNumber(42));
+        AddData("count", SCXMLValue::FromNumber(7));
+        AddData("limit", SCXMLValue::FromNumber(10));
+        AddData("retries", SCXMLValue::FromNumber(6));
+        AddData("status", SCXMLValue::FromString(SCXMLIntern(QString("ready"))));
+    }
+
+    virtual const SCXMLValue* GetDataSlots() const { return data.constData(); }
+    virtual bool IsInState(int state) const { return state == 0; }
+
+    int FindData(const QString& path) const { return ids.indexOf(path); }
+
+    //! Sets the same data as globals of a QJSEngine
+    void SetGlobals(QJSEngine& engine) const {
+        for (int slot=0; slot<ids.count(); slot++) {
+            const SCXMLValue& value = data.at(slot);
+            if (value.type == SCXMLValue::TYPE_STRING) {
+                engine.globalObject().setProperty(ids.at(slot), value.ToString());
+            }
+            else {
+                engine.globalObject().setProperty(ids.at(slot), value.ToNumber());
+            }
+        }
+        engine.evaluate("function In(id) { return id == 'busy'; }");
+    }
+
+    QStringList ids;
+    QVector<SCXMLValue> data;
+
+private:
+    void AddData(const QString& id, const SCXMLValue& value) {
+        ids.append(id);
+        data.append(value);
+    }
+};
+
+//!
+//! \brief Compares guards compiled once with SCXMLExpressions with the same guards in QJSEngine
+//!
+//! The guards are typical of the workflows' cond and expr attributes. Each is compiled once,
+//! then evaluated --evaluations times (1M by default) by both. QJSEngine calls a function
+//! wrapping the guard, so it is not parsed again either. Both must give the same value.
+//!
+static void BenchmarkExpressions(int evaluationCount)
+{
+    QStringList guards;
+    guards << "addResult * multiplier"
+           << "(first + second) * multiplier - 1 >= 100"
+           << "count < limit && status == 'ready'"
+           << "In('busy') || retries % 3 == 0"
+           << "!(count >= limit) && -retries < 0";
+
+    BenchmarkExpressionContext context;
+    QJSEngine jsEngine;
+    context.SetGlobals(jsEngine);
+
+    QTextStream out(stdout);
+    out << "Expressions (" << evaluationCount << " evaluations)\n";
+    out << "expression\tcompile us\tcompiled ns/eval\tqjsengine ns/eval\tspeed up\tverified\n";
+    foreach (QString guard, guards) {
+        SCXMLExpressions expressions;
+        QElapsedTimer timer;
+        timer.start();
+        int expression = expressions.Compile(guard,
+            [&context](const QString& path) { return context.FindData(path); },
+            [](const QString& id) { return id == "busy" ? 0 : -1; });
+        qint64 compileTime = timer.nsecsElapsed();
+
+        SCXMLValue result;
+        int trueCount = 0;
+        timer.start();
+        for (int evaluationPos=0; evaluationPos<evaluationCount; evaluationPos++) {
+            expressions.Evaluate(expression, context, result);
+            if (result.ToBoolean()) trueCount++;
+        }
+        qint64 compiledTime = timer.nsecsElapsed();
+
+        QJSValue function = jsEngine.evaluate("(function() { return " + guard + "; })");
+        QJSValue jsResult;
+        int jsTrueCount = 0;
+        timer.start();
+        for (int evaluationPos=0; evaluationPos<evaluationCount; evaluationPos++) {
+            jsResult = function.call();
+            if (jsResult.toBool()) jsTrueCount++;
+        }
+        qint64 jsTime = timer.nsecsElapsed();
+
+        bool verified = expressions.IsValid(expression) && trueCount == jsTrueCount &&
+                (result.type == SCXMLValue::TYPE_BOOLEAN ? jsResult.isBool() && jsResult.toBool() == result.ToBoolean()
+                                                         : jsResult.toNumber() == result.ToNumber());
+
+        out << guard << "\t" << double(compileTime) / 1000.0 << "\t"
+            << double(compiledTime) / evaluationCount << "\t" << double(jsTime) / evaluationCount << "\t"
+            << double(jsTime) / qMax(qint64(1), compiledTime) << "\t" << (verified ? "yes" : "no") << "\n";
+        out.flush();
+    }
+}
+
+#endif // BENCHMARKEXPRESSIONS_H
@@ -0,0 +1,78 @@
+#ifndef BENCHMARKHUBTRANSITIONS_H
+#define BENCHMARKHUBTRANSITIONS_H
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include "workflow.h"
+#include "scxmltransition.h"
+
+//!
+//! \brief Creates a hub state with a transition to and from each of the other states
+//!
+static QList<SCXMLState*> CreateHubStates(Workflow* workflow, int spokeCount)
+{
+    QList<SCXMLState*> states;
+    for (int statePos=0; statePos<=spokeCount; statePos++) {
+        MetaData metaData;
+        metaData.x = (statePos % 32) * 120;
+        metaData.y = (statePos / 32) * 60;
+        metaData.fields = MetaData::FIELD_X | MetaData::FIELD_Y;
+        SCXMLState* state = new SCXMLState(QString("hub_%1").arg(statePos), metaData);
+        workflow->AddState(state);
+        states.append(state);
+    }
+    return states;
+}
+
+//!
+//! \brief Times adding the transitions of a hub state one at a time
+//!
+static qint64 TimeHubTransitions(int spokeCount, bool deferred)
+{
+    Workflow* workflow = new Workflow();
+    QList<SCXMLState*> states = CreateHubStates(workflow, spokeCount);
+    SCXMLState* hub = states.first();
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int statePos=1; statePos<=spokeCount; statePos++) {
+        if (deferred) {
+            workflow->CreateDeferredTransition(hub, states[statePos], "out", "", MetaData());
+            workflow->CreateDeferredTransition(states[statePos], hub, "in", "", MetaData());
+        }
+        else {
+            workflow->AddTransition(new SCXMLTransition(hub, states[statePos], "out", "", MetaData()));
+            workflow->AddTransition(new SCXMLTransition(states[statePos], hub, "in", "", MetaData()));
+        }
+    }
+    if (deferred) {
+        workflow->CompleteDeferredTransitions();
+    }
+    qint64 elapsed = timer.nsecsElapsed();
+    delete workflow;
+    return elapsed;
+}
+
+//!
+//! \brief Adds the transitions of a hub state of doubling size, eagerly then deferred
+//!
+//! The eager time grows with the square of the transitions on the hub, the deferred time
+//! per transition should stay flat.
+//!
+static void BenchmarkHubTransitions()
+{
+    QTextStream out(stdout);
+    out << "Hub transitions\n";
+    out << "transitions\teager ms\teager us/transition\tdeferred ms\tdeferred us/transition\n";
+    for (int spokeCount=64; spokeCount<=1024; spokeCount*=2) {
+        int transitionCount = spokeCount * 2;
+        qint64 eagerTime = TimeHubTransitions(spokeCount, false);
+        qint64 deferredTime = TimeHubTransitions(spokeCount, true);
+        out << transitionCount << "\t"
+            << eagerTime / 1000000 << "\t" << double(eagerTime) / 1000.0 / transitionCount << "\t"
+            << deferredTime / 1000000 << "\t" << double(deferredTime) / 1000.0 / transitionCount << "\n";
+        out.flush();
+    }
+}
+
+#endif // BENCHMARKHUBTRANSITIONS_H
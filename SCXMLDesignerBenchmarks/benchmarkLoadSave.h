@@ -0,0 +1,140 @@
+#ifndef BENCHMARKLOADSAVE_H
+#define BENCHMARKLOADSAVE_H
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QBuffer>
+#include <QFile>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QXmlStreamReader>
+#include <QDomDocument>
+#include <QGraphicsScene>
+#include <QGraphicsView>
+#include <QImage>
+#include <QPainter>
+#include "benchmarkChartGenerator.h"
+#include "workflow.h"
+#include "utilities.h"
+#include "version.h"
+
+static double ElapsedMs(const QElapsedTimer& timer)
+{
+    return double(timer.nsecsElapsed()) / 1000000.0;
+}
+
+//!
+//! \brief Loads, saves, adds to a scene and paints one generated chart
+//!
+//! The peak memory of the process only grows, so the charts should be run smallest first.
+//!
+static QJsonObject RunLoadSave(const ChartParameters& parameters)
+{
+    QJsonObject result = parameters.ToJson();
+    QByteArray scxml = GenerateChart(parameters);
+    result.insert("bytes", double(scxml.size()));
+    qint64 peakMemoryBefore = Utilities::GetPeakMemoryUsage();
+    QElapsedTimer timer;
+
+    // the DOM loader is measured on its own workflow
+    {
+        timer.start();
+        QDomDocument doc;
+        doc.setContent(scxml);
+        Workflow workflow;
+        workflow.ConstructStateMachineFromSCXML(doc);
+        result.insert("construct_dom_ms", ElapsedMs(timer));
+    }
+
+    // the streaming loader builds the workflow used for the rest of the run
+    Workflow* workflow = new Workflow();
+    QBuffer device(&scxml);
+    device.open(QIODevice::ReadOnly);
+    QXmlStreamReader reader(&device);
+    timer.start();
+    workflow->ConstructStateMachineFromSCXML(reader);
+    result.insert("construct_stream_ms", ElapsedMs(timer));
+    result.insert("transitions", workflow->GetTransitionCount());
+
+    timer.start();
+    QDomDocument saveDoc;
+    workflow->ConstructSCXMLFromStateMachine(saveDoc);
+    QByteArray saved = saveDoc.toByteArray();
+    result.insert("save_ms", ElapsedMs(timer));
+    result.insert("saved_bytes", double(saved.size()));
+
+    QGraphicsScene* scene = new QGraphicsScene();
+    timer.start();
+    workflow->CreateSceneObjects(scene);
+    result.insert("create_scene_objects_ms", ElapsedMs(timer));
+
+    // the first paint builds the scene index, as it would when the tab is first shown
+    {
+        QGraphicsView view(scene);
+        view.resize(1280, 800);
+        QImage image(view.size(), QImage::Format_ARGB32_Premultiplied);
+        QPainter painter(&image);
+        timer.start();
+        view.render(&painter);
+        result.insert("first_paint_ms", ElapsedMs(timer));
+    }
+
+    qint64 peakMemoryAfter = Utilities::GetPeakMemoryUsage();
+    result.insert("peak_memory_kb", double(peakMemoryAfter / 1024));
+    result.insert("peak_memory_increase_kb", double((peakMemoryAfter - peakMemoryBefore) / 1024));
+
+    // the states delete their scene items, so the workflow goes first
+    delete workflow;
+    delete scene;
+    return result;
+}
+
+//!
+//! \brief Runs the load and save benchmark over charts of each size
+//!
+//! A table is written to stdout and the full results, with the version and the parameters of
+//! each run, to jsonFilename so they can be tracked between releases.
+//!
+static void BenchmarkLoadSave(const QStringList& arguments, QString jsonFilename)
+{
+    QList<int> stateCounts;
+    ChartParameters parameters = ParseChartParameters(arguments, stateCounts);
+
+    QTextStream out(stdout);
+    out << "Load and save (fan out " << parameters.fanOut << ", depth " << parameters.depth
+        << ", data items " << parameters.dataItemCount << ", actions " << parameters.actionsPerState << ")\n";
+    out << "states\tdom ms\tstream ms\tsave ms\tscene ms\tpaint ms\tpeak KB\n";
+
+    QJsonArray results;
+    foreach (int stateCount, stateCounts) {
+        parameters.stateCount = stateCount;
+        QJsonObject result = RunLoadSave(parameters);
+        results.append(result);
+        out << stateCount << "\t"
+            << result.value("construct_dom_ms").toDouble() << "\t"
+            << result.value("construct_stream_ms").toDouble() << "\t"
+            << result.value("save_ms").toDouble() << "\t"
+            << result.value("create_scene_objects_ms").toDouble() << "\t"
+            << result.value("first_paint_ms").toDouble() << "\t"
+            << qint64(result.value("peak_memory_kb").toDouble()) << "\n";
+        out.flush();
+    }
+
+    QJsonObject report;
+    report.insert("benchmark", QString("load_save"));
+    report.insert("version", QString("%1").arg(VERSION));
+    report.insert("qt_version", QString(qVersion()));
+    report.insert("timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    report.insert("results", results);
+
+    QFile jsonFile(jsonFilename);
+    if (!jsonFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        out << "Results cannot be written to " << jsonFilename << "\n";
+        return;
+    }
+    jsonFile.write(QJsonDocument(report).toJson());
+    out << "Results written to " << jsonFilename << "\n";
+}
+
+#endif // BENCHMARKLOADSAVE_H
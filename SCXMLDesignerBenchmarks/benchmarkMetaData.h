@@ -0,0 +1,97 @@
+#ifndef BENCHMARKMETADATA_H
+#define BENCHMARKMETADATA_H
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QStringList>
+#include <QRegExp>
+#include <QMap>
+#include "metadatasupport.h"
+
+//! The QRegExp based parser that MetaDataSupport::ParseMetaData replaced, kept for comparison
+static void LegacyParseMetaData(QString text, QMap<QString, QString> &map)
+{
+    QRegExp rx("\\[([^\\[]+)\\]");
+    int pos = 0;
+    while ((pos = rx.indexIn(text, pos)) != -1) {
+        QString metaData = rx.cap(1);
+        QStringList parts = metaData.split('=');
+        if (parts.length() > 1) {
+            map.remove(parts[0]);
+            map.insert(parts[0], parts[1]);
+        }
+        pos += rx.matchedLength();
+    }
+}
+
+//! The chained key compares of the legacy ApplyMetaData, decoding into the same fields
+static void LegacyApplyMetaData(QMap<QString, QString> &map, MetaData &metaData)
+{
+    foreach(QString key, map.keys()) {
+        QString value = map.value(key);
+        if (key == "description") { metaData.description = value; continue; }
+        if (key == "x") { metaData.x = value.toDouble(); continue; }
+        if (key == "y") { metaData.y = value.toDouble(); continue; }
+        if (key == "height") { metaData.height = value.toDouble(); continue; }
+        if (key == "width") { metaData.width = value.toDouble(); continue; }
+        if (key == "cp") {
+            metaData.controlPoints.clear();
+            foreach (QString pointPair, value.split(":")) {
+                QStringList coord = pointPair.split(",");
+                metaData.controlPoints.append(QPointF(coord[0].toDouble(), coord[1].toDouble()));
+            }
+            continue;
+        }
+    }
+}
+
+//!
+//! \brief Parses typical state and transition comments with the legacy and current parsers
+//!
+static void BenchmarkMetaData()
+{
+    const int commentCount = 100000;
+    QStringList comments;
+    for (int pos=0; pos<commentCount; pos++) {
+        if (pos % 2 == 0) {
+            comments << QString(" META-DATA [x=%1] [y=%2] [width=100] [height=50] [description=state %3]")
+                        .arg(pos % 1000).arg(pos / 1000).arg(pos);
+        }
+        else {
+            comments << QString(" META-DATA [cp=%1,2:-120,75:77,74:138,%2] [description=]").arg(pos % 500).arg(pos % 300);
+        }
+    }
+
+    QElapsedTimer timer;
+    qreal checksum = 0;
+    timer.start();
+    foreach (const QString& comment, comments) {
+        QMap<QString, QString> map;
+        MetaData metaData;
+        LegacyParseMetaData(comment, map);
+        LegacyApplyMetaData(map, metaData);
+        checksum += metaData.x + metaData.controlPoints.count();
+    }
+    qint64 legacyTime = timer.nsecsElapsed();
+
+    timer.restart();
+    MetaData metaData;
+    foreach (const QString& comment, comments) {
+        metaData.Clear();
+        MetaDataSupport::ParseMetaData(comment, metaData);
+        checksum -= metaData.x + metaData.controlPoints.count();
+    }
+    qint64 scannerTime = timer.nsecsElapsed();
+
+    QTextStream out(stdout);
+    out << "Meta data parsing (" << commentCount << " comments)\n";
+    out << "parser\tms\tns/comment\n";
+    out << "legacy\t" << legacyTime / 1000000 << "\t" << legacyTime / commentCount << "\n";
+    out << "scanner\t" << scannerTime / 1000000 << "\t" << scannerTime / commentCount << "\n";
+    if (checksum != 0) {
+        out << "parsers disagree, checksum " << checksum << "\n";
+    }
+    out.flush();
+}
+
+#endif // BENCHMARKMETADATA_H
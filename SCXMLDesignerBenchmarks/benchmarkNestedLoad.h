@@ -0,0 +1,87 @@
+#ifndef BENCHMARKNESTEDLOAD_H
+#define BENCHMARKNESTEDLOAD_H
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QXmlStreamReader>
+#include <QDomDocument>
+#include "workflow.h"
+
+//!
+//! \brief Generates a chart of nested state chains
+//!
+//! Each chain nests depth states inside each other, every state has an onentry log, a
+//! transition to its parent and a transition to the first state of the next chain. This is
+//! the worst case for a descendant search per state.
+//!
+static QString GenerateNestedChart(int stateCount, int depth)
+{
+    QString scxml;
+    QTextStream out(&scxml);
+    int chainCount = (stateCount + depth - 1) / depth;
+    out << "<scxml xmlns=\"http://www.w3.org/2005/07/scxml\" name=\"Nested\" initial=\"s0_0\" version=\"1.0\">\n";
+    for (int chain=0; chain<chainCount; chain++) {
+        int chainDepth = qMin(depth, stateCount - chain*depth);
+        for (int level=0; level<chainDepth; level++) {
+            out << QString("<state id=\"s%1_%2\">\n").arg(chain).arg(level);
+            out << QString("<!-- META-DATA [x=%1] [y=%2] [width=100] [height=50] [description=]-->\n").arg(chain*120).arg(level*60);
+            out << QString("<onentry><log expr=\"s%1_%2\"/></onentry>\n").arg(chain).arg(level);
+            out << QString("<transition target=\"s%1_0\" event=\"next\"/>\n").arg((chain + 1) % chainCount);
+            if (level > 0) {
+                out << QString("<transition target=\"s%1_%2\" event=\"up\"/>\n").arg(chain).arg(level - 1);
+            }
+        }
+        for (int level=0; level<chainDepth; level++) {
+            out << "</state>\n";
+        }
+    }
+    out << "</scxml>\n";
+    return scxml;
+}
+
+static qint64 TimeNestedDomLoad(const QString& scxml)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QDomDocument doc;
+    doc.setContent(scxml);
+    Workflow* workflow = new Workflow();
+    workflow->ConstructStateMachineFromSCXML(doc);
+    qint64 elapsed = timer.nsecsElapsed();
+    delete workflow;
+    return elapsed;
+}
+
+static qint64 TimeNestedStreamLoad(const QString& scxml)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QXmlStreamReader reader(scxml);
+    Workflow* workflow = new Workflow();
+    workflow->ConstructStateMachineFromSCXML(reader);
+    qint64 elapsed = timer.nsecsElapsed();
+    delete workflow;
+    return elapsed;
+}
+
+//!
+//! \brief Loads nested charts of doubling size, the time per state should stay flat
+//!
+static void BenchmarkNestedLoad()
+{
+    QTextStream out(stdout);
+    const int depth = 64;
+    out << "Nested load (depth " << depth << ")\n";
+    out << "states\tdom ms\tdom us/state\tstream ms\tstream us/state\n";
+    for (int stateCount=1000; stateCount<=32000; stateCount*=2) {
+        QString scxml = GenerateNestedChart(stateCount, depth);
+        qint64 domTime = TimeNestedDomLoad(scxml);
+        qint64 streamTime = TimeNestedStreamLoad(scxml);
+        out << stateCount << "\t"
+            << domTime / 1000000 << "\t" << double(domTime) / 1000.0 / stateCount << "\t"
+            << streamTime / 1000000 << "\t" << double(streamTime) / 1000.0 / stateCount << "\n";
+        out.flush();
+    }
+}
+
+#endif // BENCHMARKNESTEDLOAD_H
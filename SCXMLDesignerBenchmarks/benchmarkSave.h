@@ -0,0 +1,183 @@
+#ifndef BENCHMARKSAVE_H
+#define BENCHMARKSAVE_H
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QBuffer>
+#include <QFile>
+#include <QTemporaryFile>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <QDomDocument>
+#include <QStringList>
+#include "benchmarkChartGenerator.h"
+#include "workflow.h"
+#include "scxmlsourcebuffer.h"
+#include "utilities.h"
+
+//!
+//! \brief Reduces a document to its elements, sorted attributes, text and comments
+//!
+//! QDom writes attributes in hash order and escapes differently from QXmlStreamWriter, so the
+//! two saves are also compared on what they contain.
+//!
+static QStringList CanonicalXml(const QByteArray& xml)
+{
+    QStringList tokens;
+    QXmlStreamReader reader(xml);
+    while (!reader.atEnd()) {
+        switch (reader.readNext()) {
+        case QXmlStreamReader::StartElement: {
+            QStringList attributes;
+            foreach (const QXmlStreamAttribute& attribute, reader.attributes()) {
+                attributes.append(attribute.qualifiedName().toString() + "=" + attribute.value().toString());
+            }
+            attributes.sort();
+            tokens.append("<" + reader.name().toString() + " " + attributes.join(" "));
+            break;
+        }
+        case QXmlStreamReader::EndElement:
+            tokens.append("</" + reader.name().toString());
+            break;
+        case QXmlStreamReader::Characters:
+        case QXmlStreamReader::Comment:
+            tokens.append(reader.text().toString());
+            break;
+        default:
+            break;
+        }
+    }
+    return tokens;
+}
+
+static QByteArray ReadBack(QTemporaryFile& file)
+{
+    file.seek(0);
+    return file.readAll();
+}
+
+//!
+//! \brief Moves one state of a workflow read from a file, then saves just that change
+//!
+//! The saved file is read back to check the state moved and nothing was lost.
+//!
+static qint64 TimeIncrementalSave(const QByteArray& scxml, bool& verified)
+{
+    verified = false;
+    QTemporaryFile sourceFile;
+    sourceFile.open();
+    sourceFile.write(scxml);
+    sourceFile.close();
+
+    QSharedPointer<SCXMLSourceBuffer> source(new SCXMLSourceBuffer());
+    source->Open(sourceFile.fileName());
+    Workflow* workflow = new Workflow();
+    {
+        QXmlStreamReader reader(source->GetData());
+        workflow->ConstructStateMachineFromSCXML(reader);
+    }
+    workflow->SetSource(source);
+    source.clear();
+
+    QList<SCXMLState*> states = workflow->GetStates();
+    SCXMLState* movedState = states.at(states.count() / 2);
+    QString movedId = movedState->GetId();
+    qreal movedX = movedState->GetShapeX() + 25;
+    movedState->SetShapeX(movedX);
+
+    QTemporaryFile savedFile;
+    savedFile.open();
+    QString savedFilename = savedFile.fileName();
+    savedFile.close();
+    QElapsedTimer timer;
+    timer.start();
+    bool saved = workflow->SaveIncrementally(savedFilename);
+    qint64 elapsed = timer.nsecsElapsed();
+    int stateCount = states.count();
+    delete workflow;
+    if (!saved) return -1;
+
+    QFile readBackFile(savedFilename);
+    readBackFile.open(QIODevice::ReadOnly);
+    QXmlStreamReader reader(&readBackFile);
+    Workflow readBack;
+    if (readBack.ConstructStateMachineFromSCXML(reader)) {
+        SCXMLState* state = readBack.GetStateById(movedId);
+        verified = (state != nullptr && state->GetShapeX() == movedX && readBack.GetStates().count() == stateCount);
+    }
+    return elapsed;
+}
+
+//!
+//! \brief Saves a workflow of each size with the streaming writer then the DOM
+//!
+//! The streaming writer goes first as the peak memory of the process only grows, so its
+//! increase is not hidden by the DOM that follows. Saving a single moved state incrementally
+//! is timed last.
+//!
+static void BenchmarkSave(const QStringList& arguments)
+{
+    QList<int> stateCounts;
+    ChartParameters parameters = ParseChartParameters(arguments, stateCounts);
+
+    QTextStream out(stdout);
+    out << "Save (fan out " << parameters.fanOut << ", depth " << parameters.depth << ")\n";
+    out << "states\tstream ms\tstream peak +KB\tdom ms\tdom peak +KB\tidentical\tequivalent\tone change ms\tverified\n";
+    foreach (int stateCount, stateCounts) {
+        parameters.stateCount = stateCount;
+        QByteArray scxml = GenerateChart(parameters);
+        Workflow* workflow = new Workflow();
+        {
+            QBuffer device(&scxml);
+            device.open(QIODevice::ReadOnly);
+            QXmlStreamReader reader(&device);
+            workflow->ConstructStateMachineFromSCXML(reader);
+        }
+
+        QElapsedTimer timer;
+        QTemporaryFile streamFile;
+        streamFile.open();
+        qint64 peakMemoryBefore = Utilities::GetPeakMemoryUsage();
+        timer.start();
+        {
+            QXmlStreamWriter writer(&streamFile);
+            workflow->ConstructSCXMLFromStateMachine(writer);
+        }
+        streamFile.flush();
+        qint64 streamTime = timer.nsecsElapsed();
+        qint64 streamMemory = Utilities::GetPeakMemoryUsage() - peakMemoryBefore;
+
+        QTemporaryFile domFile;
+        domFile.open();
+        peakMemoryBefore = Utilities::GetPeakMemoryUsage();
+        timer.start();
+        {
+            QDomDocument doc;
+            workflow->ConstructSCXMLFromStateMachine(doc);
+            domFile.write(doc.toByteArray());
+        }
+        domFile.flush();
+        qint64 domTime = timer.nsecsElapsed();
+        qint64 domMemory = Utilities::GetPeakMemoryUsage() - peakMemoryBefore;
+        delete workflow;
+
+        QByteArray streamSaved = ReadBack(streamFile);
+        QByteArray domSaved = ReadBack(domFile);
+        bool identical = (streamSaved == domSaved);
+        bool equivalent = identical || (CanonicalXml(streamSaved) == CanonicalXml(domSaved));
+        streamSaved.clear();
+        domSaved.clear();
+
+        bool verified = false;
+        qint64 incrementalTime = TimeIncrementalSave(scxml, verified);
+
+        out << stateCount << "\t"
+            << streamTime / 1000000 << "\t" << streamMemory / 1024 << "\t"
+            << domTime / 1000000 << "\t" << domMemory / 1024 << "\t"
+            << (identical ? "yes" : "no") << "\t" << (equivalent ? "yes" : "no") << "\t"
+            << (incrementalTime < 0 ? -1.0 : double(incrementalTime) / 1000000.0) << "\t" << (verified ? "yes" : "no") << "\n";
+        out.flush();
+    }
+}
+
+#endif // BENCHMARKSAVE_H
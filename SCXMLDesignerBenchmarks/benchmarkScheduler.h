@@ -0,0 +1,85 @@
+#ifndef BENCHMARKSCHEDULER_H
+#define BENCHMARKSCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QThread>
+#include "benchmarkChartGenerator.h"
+#include "benchmarkEngine.h"
+#include "workflowmodel.h"
+#include "scxmlcompiledchart.h"
+#include "scxmlscheduler.h"
+
+//!
+//! \brief Runs the same sessions and events on the scheduler with 1, 2, 4... threads
+//!
+//! The chart is the first of --states. --sessions N sessions (10k by default) are each posted
+//! --session-events N events (10 by default) before the workers start, so only the workers
+//! are timed. The session queues are made large enough to hold them. --threads N sets the most threads (the number of cores by default). Each run
+//! must end with every session in the same state as the single thread run.
+//!
+static void BenchmarkScheduler(const QStringList& arguments, int sessionCount, int eventCount, int maxThreadCount)
+{
+    QList<int> stateCounts;
+    ChartParameters parameters = ParseChartParameters(arguments, stateCounts);
+    parameters.stateCount = stateCounts.first();
+    QSharedPointer<SCXMLCompiledChart> chart(new SCXMLCompiledChart());
+    {
+        WorkflowModel model;
+        QByteArray scxml = GenerateChart(parameters);
+        QXmlStreamReader reader(scxml);
+        model.ReadFromStream(reader);
+        chart->Compile(model);
+    }
+    QVector<SCXMLAtom> events = GenerateBenchmarkEvents(parameters, eventCount);
+    qint64 sentCount = qint64(sessionCount) * events.count();
+
+    QTextStream out(stdout);
+    out << "Scheduler (" << parameters.stateCount << " states, " << sessionCount << " sessions, "
+        << eventCount << " events each)\n";
+    out << "threads\tms\tevents/s\tscaling\tsteals\tverified\n";
+    QList<int> threadCounts;
+    for (int threadCount=1; threadCount<maxThreadCount; threadCount*=2) {
+        threadCounts.append(threadCount);
+    }
+    threadCounts.append(maxThreadCount);
+
+    QVector<int> expectedStates;
+    qint64 singleThreadTime = 0;
+    foreach (int threadCount, threadCounts) {
+        SCXMLScheduler scheduler(chart, threadCount, eventCount);
+        scheduler.SetLogCallback([](const QString&, const QString&) {});
+        for (int sessionPos=0; sessionPos<sessionCount; sessionPos++) {
+            scheduler.AddSession();
+        }
+        foreach (SCXMLAtom event, events) {
+            for (int sessionPos=0; sessionPos<sessionCount; sessionPos++) {
+                scheduler.PostEvent(sessionPos, event);
+            }
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        scheduler.Start();
+        scheduler.WaitForIdle();
+        qint64 runTime = timer.nsecsElapsed();
+        scheduler.Stop();
+
+        QVector<int> states(sessionCount);
+        for (int sessionPos=0; sessionPos<sessionCount; sessionPos++) {
+            states[sessionPos] = scheduler.GetSession(sessionPos).GetActiveState();
+        }
+        if (threadCount == 1) {
+            expectedStates = states;
+            singleThreadTime = runTime;
+        }
+
+        out << threadCount << "\t" << double(runTime) / 1000000.0 << "\t"
+            << qint64(double(sentCount) * 1e9 / qMax(qint64(1), runTime)) << "\t"
+            << double(singleThreadTime) / qMax(qint64(1), runTime) << "\t" << scheduler.GetStealCount() << "\t"
+            << (states == expectedStates ? "yes" : "no") << "\n";
+        out.flush();
+    }
+}
+
+#endif // BENCHMARKSCHEDULER_H
@@ -0,0 +1,72 @@
+#ifndef BENCHMARKSESSIONS_H
+#define BENCHMARKSESSIONS_H
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include "benchmarkChartGenerator.h"
+#include "benchmarkEngine.h"
+#include "workflowmodel.h"
+#include "scxmlcompiledchart.h"
+#include "scxmlengine.h"
+
+//!
+//! \brief Runs many sessions of each chart on one engine, sharing the compiled chart
+//!
+//! --sessions N sessions (100k by default) are started, then each is sent --session-events N events
+//! (10 by default) in turn, as concurrent sessions would receive them. The memory of a
+//! session is what it allocates itself, the chart is compiled once for all of them.
+//!
+static void BenchmarkSessions(const QStringList& arguments, int sessionCount, int eventCount)
+{
+    QList<int> stateCounts;
+    ChartParameters parameters = ParseChartParameters(arguments, stateCounts);
+
+    QTextStream out(stdout);
+    out << "Sessions (" << sessionCount << " sessions, " << eventCount << " events each, "
+        << parameters.dataItemCount << " data items)\n";
+    out << "states\tstart ms\tevents/s\tbytes/session\tmicrosteps\n";
+    foreach (int stateCount, stateCounts) {
+        parameters.stateCount = stateCount;
+        QSharedPointer<SCXMLCompiledChart> chart(new SCXMLCompiledChart());
+        {
+            WorkflowModel model;
+            QByteArray scxml = GenerateChart(parameters);
+            QXmlStreamReader reader(scxml);
+            model.ReadFromStream(reader);
+            chart->Compile(model);
+        }
+        QVector<SCXMLAtom> events = GenerateBenchmarkEvents(parameters, eventCount);
+
+        SCXMLEngine engine(chart);
+        engine.SetLogCallback([](const QString&, const QString&) {});
+        QVector<SCXMLSession> sessions(sessionCount);
+        QElapsedTimer timer;
+        timer.start();
+        for (int sessionPos=0; sessionPos<sessionCount; sessionPos++) {
+            engine.Start(sessions[sessionPos]);
+        }
+        qint64 startTime = timer.nsecsElapsed();
+
+        timer.start();
+        foreach (SCXMLAtom event, events) {
+            for (int sessionPos=0; sessionPos<sessionCount; sessionPos++) {
+                sessions[sessionPos].PostEvent(event);
+                engine.ProcessEvents(sessions[sessionPos]);
+            }
+        }
+        qint64 runTime = timer.nsecsElapsed();
+
+        qint64 sessionBytes = 0;
+        foreach (const SCXMLSession& session, sessions) {
+            sessionBytes += session.GetAllocatedBytes();
+        }
+
+        qint64 sentCount = qint64(sessionCount) * events.count();
+        out << stateCount << "\t" << double(startTime) / 1000000.0 << "\t"
+            << qint64(double(sentCount) * 1e9 / qMax(qint64(1), runTime)) << "\t"
+            << double(sessionBytes) / sessionCount << "\t" << engine.GetMicrostepCount() << "\n";
+        out.flush();
+    }
+}
+
+#endif // BENCHMARKSESSIONS_H
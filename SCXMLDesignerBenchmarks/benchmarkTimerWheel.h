@@ -0,0 +1,137 @@
+#ifndef BENCHMARKTIMERWHEEL_H
+#define BENCHMARKTIMERWHEEL_H
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QMultiMap>
+#include <QHash>
+#include "scxmltimerwheel.h"
+
+//! Timers in a map sorted by expiry, with an index of the send ids, as a baseline for the wheel
+class BenchmarkSortedTimers
+{
+public:
+    void Schedule(qint64 expiry, int session, SCXMLAtom event, SCXMLAtom sendid) {
+        quint64 key = GetKey(session, sendid);
+        Cancel(session, sendid);
+        mSendIds.insert(key, mTimers.insert(expiry, Timer(key, event)));
+    }
+
+    bool Cancel(int session, SCXMLAtom sendid) {
+        QHash<quint64, QMultiMap<qint64, Timer>::iterator>::iterator it = mSendIds.find(GetKey(session, sendid));
+        if (it == mSendIds.end()) return false;
+        mTimers.erase(it.value());
+        mSendIds.erase(it);
+        return true;
+    }
+
+    void Advance(qint64 now, QVector<SCXMLTimerWheel::Expired>& expired) {
+        while (!mTimers.isEmpty() && mTimers.firstKey() <= now) {
+            const Timer& timer = mTimers.first();
+            SCXMLTimerWheel::Expired fired;
+            fired.session = int(timer.key >> 32);
+            fired.event = timer.event;
+            fired.sendid = SCXMLAtom(quint32(timer.key));
+            expired.append(fired);
+            mSendIds.remove(timer.key);
+            mTimers.erase(mTimers.begin());
+        }
+    }
+
+    qint64 GetNextTime() const { return mTimers.isEmpty() ? -1 : mTimers.firstKey(); }
+    int GetCount() const { return mTimers.count(); }
+
+private:
+    struct Timer {
+        Timer(quint64 key, SCXMLAtom event) : key(key), event(event) {}
+
+        quint64 key;
+        SCXMLAtom event;
+    };
+
+    static quint64 GetKey(int session, SCXMLAtom sendid) {
+        return (quint64(quint32(session)) << 32) | quint32(sendid);
+    }
+
+    QMultiMap<qint64, Timer> mTimers;
+    QHash<quint64, QMultiMap<qint64, Timer>::iterator> mSendIds;
+};
+
+//! Schedules the timers, four send ids for each session with delays of up to 10 minutes,
+//! cancels every other one and fires the rest. Sets the time each step took in ns, and
+//! returns the number of timers fired
+template <class Timers>
+static int RunTimers(Timers& timers, int timerCount, const QVector<SCXMLAtom>& sendids, qint64* scheduleTime,
+                     qint64* cancelTime, qint64* fireTime)
+{
+    SCXMLAtom event = SCXMLIntern(QString("timeout"));
+    quint32 seed = 1;
+    QElapsedTimer timer;
+    timer.start();
+    for (int timerPos=0; timerPos<timerCount; timerPos++) {
+        seed = seed * 1103515245 + 12345;
+        timers.Schedule(1 + (seed >> 8) % 600000, timerPos / sendids.count(), event,
+                        sendids.at(timerPos % sendids.count()));
+    }
+    *scheduleTime = timer.nsecsElapsed();
+
+    timer.restart();
+    for (int timerPos=0; timerPos<timerCount; timerPos+=2) {
+        timers.Cancel(timerPos / sendids.count(), sendids.at(timerPos % sendids.count()));
+    }
+    *cancelTime = timer.nsecsElapsed();
+
+    // as a scheduler worker does, woken at each next time
+    int firedCount = 0;
+    QVector<SCXMLTimerWheel::Expired> expired;
+    timer.restart();
+    while (timers.GetCount() > 0) {
+        expired.clear();
+        timers.Advance(timers.GetNextTime(), expired);
+        firedCount += expired.count();
+    }
+    *fireTime = timer.nsecsElapsed();
+    return firedCount;
+}
+
+//!
+//! \brief Compares SCXMLTimerWheel with timers in a sorted map
+//!
+//! --timers N timers (1M by default) are scheduled for N / 4 sessions, half are cancelled by
+//! send id and the others fired, as the timeouts of a workflow mostly are.
+//!
+static void BenchmarkTimerWheel(int timerCount)
+{
+    QVector<SCXMLAtom> sendids;
+    for (int sendidPos=0; sendidPos<4; sendidPos++) {
+        sendids.append(SCXMLIntern(QString("t%1").arg(sendidPos)));
+    }
+
+    QTextStream out(stdout);
+    out << "Timer wheel (" << timerCount << " timers)\n";
+    out << "timers\tschedule ns\tcancel ns\tfire ns\tfired\n";
+    qint64 times[2][3];
+    int firedCounts[2];
+    {
+        SCXMLTimerWheel wheel;
+        firedCounts[0] = RunTimers(wheel, timerCount, sendids, &times[0][0], &times[0][1], &times[0][2]);
+    }
+    {
+        BenchmarkSortedTimers sorted;
+        firedCounts[1] = RunTimers(sorted, timerCount, sendids, &times[1][0], &times[1][1], &times[1][2]);
+    }
+
+    const char* names[2] = { "wheel", "sorted map" };
+    int cancelCount = (timerCount + 1) / 2;
+    for (int run=0; run<2; run++) {
+        out << names[run] << "\t" << double(times[run][0]) / timerCount << "\t"
+            << double(times[run][1]) / cancelCount << "\t"
+            << double(times[run][2]) / qMax(1, firedCounts[run]) << "\t" << firedCounts[run] << "\n";
+    }
+    out << "speed up\t" << double(times[1][0]) / qMax(qint64(1), times[0][0]) << "\t"
+        << double(times[1][1]) / qMax(qint64(1), times[0][1]) << "\t"
+        << double(times[1][2]) / qMax(qint64(1), times[0][2]) << "\n";
+    out.flush();
+}
+
+#endif // BENCHMARKTIMERWHEEL_H
@@ -0,0 +1,71 @@
+#include <QApplication>
+#include <QStringList>
+#include "benchmarkNestedLoad.h"
+#include "benchmarkMetaData.h"
+#include "benchmarkHubTransitions.h"
+#include "benchmarkLoadSave.h"
+#include "benchmarkSave.h"
+#include "benchmarkCompressed.h"
+#include "benchmarkEngine.h"
+#include "benchmarkExpressions.h"
+#include "benchmarkSessions.h"
+#include "benchmarkScheduler.h"
+#include "benchmarkEventQueue.h"
+#include "benchmarkTimerWheel.h"
+
+//! Gets the value following an option on the command line, or the default if it is not given
+static QString GetOption(const QStringList& arguments, QString name, QString defaultValue)
+{
+    int pos = arguments.indexOf(name);
+    if (pos < 0 || pos + 1 >= arguments.count()) return defaultValue;
+    return arguments.at(pos + 1);
+}
+
+//!
+//! Runs all the benchmarks, or only the one named with --only (nested, metadata, hub, loadsave,
+//! save, compressed, engine, expressions, sessions, scheduler, eventqueue or timers). See ParseChartParameters for the options of the load and
+//! save benchmarks, the results of loadsave are written to the file given with --json, engine sends the number of
+//! events given with --events, expressions evaluates each guard the number of times given with --evaluations and
+//! sessions runs the number of sessions given with --sessions, sending each the number of events given with
+//! --session-events. scheduler runs the same sessions on up to --threads threads and eventqueue posts
+//! --queue-events events from each producer. timers schedules and cancels the number of timers given with
+//! --timers. On a machine without a display, run with -platform offscreen.
+//!
+int main(int argc, char **argv) {
+    // the states and transitions are graphics items, so a gui application is needed
+    QApplication app(argc, argv);
+    QStringList arguments = app.arguments();
+    QString only = GetOption(arguments, "--only", "");
+
+    if (only.isEmpty() || only == "nested") BenchmarkNestedLoad();
+    if (only.isEmpty() || only == "metadata") BenchmarkMetaData();
+    if (only.isEmpty() || only == "hub") BenchmarkHubTransitions();
+    if (only.isEmpty() || only == "loadsave") {
+        BenchmarkLoadSave(arguments, GetOption(arguments, "--json", "loadsave-benchmark.json"));
+    }
+    if (only.isEmpty() || only == "save") BenchmarkSave(arguments);
+    if (only.isEmpty() || only == "compressed") BenchmarkCompressed(arguments);
+    if (only.isEmpty() || only == "engine") {
+        BenchmarkEngine(arguments, qMax(1, GetOption(arguments, "--events", "100000").toInt()));
+    }
+    if (only.isEmpty() || only == "expressions") {
+        BenchmarkExpressions(qMax(1, GetOption(arguments, "--evaluations", "1000000").toInt()));
+    }
+    if (only.isEmpty() || only == "sessions") {
+        BenchmarkSessions(arguments, qMax(1, GetOption(arguments, "--sessions", "100000").toInt()),
+                          qMax(1, GetOption(arguments, "--session-events", "10").toInt()));
+    }
+    if (only.isEmpty() || only == "scheduler") {
+        BenchmarkScheduler(arguments, qMax(1, GetOption(arguments, "--sessions", "10000").toInt()),
+                           qMax(1, GetOption(arguments, "--session-events", "10").toInt()),
+                           qMax(1, GetOption(arguments, "--threads", QString::number(QThread::idealThreadCount())).toInt()));
+    }
+    if (only.isEmpty() || only == "eventqueue") {
+        BenchmarkEventQueue(qMax(1, GetOption(arguments, "--queue-events", "1000000").toInt()));
+    }
+    if (only.isEmpty() || only == "timers") {
+        BenchmarkTimerWheel(qMax(1, GetOption(arguments, "--timers", "1000000").toInt()));
+    }
+
+    return 0;
+}
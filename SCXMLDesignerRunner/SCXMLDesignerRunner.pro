@@ -0,0 +1,40 @@
+#-------------------------------------------------
+#
+# Headless runner for SCXML workflows
+#
+#-------------------------------------------------
+
+# gui is only needed for the vector types of the layout meta data, no window is opened
+QT       += core gui xml
+
+TARGET = SCXMLDesignerRunner
+CONFIG   += console c++11
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += $$PWD/../SCXMLDesigner/
+
+SOURCES += main.cpp \
+    ../SCXMLDesigner/metadatasupport.cpp \
+    ../SCXMLDesigner/scxmlexecutablecontent.cpp \
+    ../SCXMLDesigner/xmlutilities.cpp \
+    ../SCXMLDesigner/scxmlatoms.cpp \
+    ../SCXMLDesigner/workflowmodel.cpp \
+    ../SCXMLDesigner/scxmlcompresseddevice.cpp \
+    ../SCXMLDesigner/scxmlcompiledchart.cpp \
+    ../SCXMLDesigner/scxmlengine.cpp \
+    ../SCXMLDesigner/scxmlexpressions.cpp \
+    ../SCXMLDesigner/scxmlscheduler.cpp \
+    ../SCXMLDesigner/scxmleventqueue.cpp \
+    ../SCXMLDesigner/scxmltimerwheel.cpp
+
+HEADERS += \
+    ../SCXMLDesigner/workflowmodel.h \
+    ../SCXMLDesigner/scxmlcompresseddevice.h \
+    ../SCXMLDesigner/scxmlcompiledchart.h \
+    ../SCXMLDesigner/scxmlengine.h \
+    ../SCXMLDesigner/scxmlexpressions.h \
+    ../SCXMLDesigner/scxmlscheduler.h \
+    ../SCXMLDesigner/scxmleventqueue.h \
+    ../SCXMLDesigner/scxmltimerwheel.h
@@ -0,0 +1,314 @@
+#include <algorithm>
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QSharedPointer>
+#include <QXmlStreamReader>
+#include "workflowmodel.h"
+#include "scxmlcompresseddevice.h"
+#include "scxmlcompiledchart.h"
+#include "scxmlengine.h"
+#include "scxmlscheduler.h"
+
+//! Gets the value following an option on the command line, or the default if it is not given
+static QString GetOption(const QStringList& arguments, QString name, QString defaultValue)
+{
+    int pos = arguments.indexOf(name);
+    if (pos < 0 || pos + 1 >= arguments.count()) return defaultValue;
+    return arguments.at(pos + 1);
+}
+
+//!
+//! \brief Reads a workflow file, compressed or not, into a model
+//!
+static bool LoadModel(const QString& filename, WorkflowModel& model, QString& errorString)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        errorString = file.errorString();
+        return false;
+    }
+
+    // the frames are decompressed as the reader reaches them, so neither the file nor the
+    // SCXML is held in full
+    if (SCXMLCompressedDevice::IsCompressed(file.peek(4))) {
+        SCXMLCompressedDevice scxmlDevice(&file);
+        if (!scxmlDevice.open(QIODevice::ReadOnly)) {
+            errorString = "The compressed workflow is corrupt";
+            return false;
+        }
+        QXmlStreamReader reader(&scxmlDevice);
+        if (!model.ReadFromStream(reader)) {
+            errorString = scxmlDevice.HasError() ? QString("The compressed workflow is corrupt") : reader.errorString();
+            return false;
+        }
+        return true;
+    }
+
+    QXmlStreamReader reader(&file);
+    if (!model.ReadFromStream(reader)) {
+        errorString = reader.errorString();
+        return false;
+    }
+    return true;
+}
+
+//!
+//! \brief Reads the events to send, one per line, ignoring blank lines and # comments
+//!
+static bool LoadEventScript(const QString& filename, QList<SCXMLAtom>& events, QString& errorString)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        errorString = file.errorString();
+        return false;
+    }
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) continue;
+        events.append(SCXMLIntern(line));
+    }
+    return true;
+}
+
+//! Gets the active states of a session from the outermost down, e.g. AdderState/working
+static QString GetConfiguration(const SCXMLCompiledChart& chart, const SCXMLSession& session)
+{
+    QStringList ids;
+    for (int state=session.GetActiveState(); state>0; state=chart.GetState(state).parent) {
+        ids.prepend(SCXMLAtomString(chart.GetState(state).id));
+    }
+    return ids.join('/') + (session.IsRunning() ? "" : " (done)");
+}
+
+//! Gets the latency at the percentile of the sorted latencies
+static double GetPercentile(const QVector<qint64>& sortedLatencies, double percentile)
+{
+    if (sortedLatencies.isEmpty()) return 0;
+    int pos = qMin(sortedLatencies.count() - 1, int(percentile / 100.0 * sortedLatencies.count()));
+    return double(sortedLatencies.at(pos)) / 1000.0;
+}
+
+//! Prints how many sessions ended in each configuration, the most common first
+static void PrintConfigurations(QTextStream& out, const QMap<QString, int>& configurations)
+{
+    QList<QPair<int, QString> > byCount;
+    for (QMap<QString, int>::const_iterator it=configurations.constBegin(); it!=configurations.constEnd(); ++it) {
+        byCount.append(qMakePair(it.value(), it.key()));
+    }
+    std::sort(byCount.begin(), byCount.end(), [](const QPair<int, QString>& a, const QPair<int, QString>& b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    });
+    out << "final configurations\n";
+    for (int configurationPos=0; configurationPos<byCount.count(); configurationPos++) {
+        out << "\t" << byCount.at(configurationPos).first << "\t" << byCount.at(configurationPos).second << "\n";
+    }
+}
+
+//!
+//! \brief Runs the sessions on an SCXMLScheduler with the given number of worker threads
+//!
+//! The events are posted to every session in turn, as in the single threaded run, while the
+//! workers run the sessions. A session whose queue is full is posted to again once the workers
+//! have had a chance to take its events. Prints the throughput of the run and returns the
+//! configurations the sessions ended in.
+//!
+static QMap<QString, int> RunScheduled(QTextStream& out, QSharedPointer<SCXMLCompiledChart> chart, int threadCount,
+                                       int sessionCount, const QList<SCXMLAtom>& script, int repeatCount,
+                                       SCXMLEngine::LogCallback logCallback)
+{
+    SCXMLScheduler scheduler(chart, threadCount);
+    scheduler.SetLogCallback(logCallback);
+    QElapsedTimer timer;
+    timer.start();
+    for (int sessionPos=0; sessionPos<sessionCount; sessionPos++) {
+        scheduler.AddSession();
+    }
+    qint64 startTime = timer.nsecsElapsed();
+
+    timer.start();
+    scheduler.Start();
+    qint64 eventCount = 0;
+    for (int repeatPos=0; repeatPos<repeatCount; repeatPos++) {
+        foreach (SCXMLAtom event, script) {
+            for (int sessionPos=0; sessionPos<sessionCount; sessionPos++) {
+                while (!scheduler.PostEvent(sessionPos, event)) {
+                    QThread::yieldCurrentThread();
+                }
+                eventCount++;
+            }
+        }
+    }
+    scheduler.WaitForIdle();
+    qint64 runTime = timer.nsecsElapsed();
+    scheduler.Stop();
+
+    out << "threads\t" << scheduler.GetThreadCount() << "\tstart ms " << double(startTime) / 1000000.0
+        << "\trun ms " << double(runTime) / 1000000.0
+        << "\tevents/s " << qint64(double(eventCount) * 1e9 / qMax(qint64(1), runTime))
+        << "\tmicrosteps " << scheduler.GetMicrostepCount() << "\tsteals " << scheduler.GetStealCount() << "\n";
+
+    QMap<QString, int> configurations;
+    for (int sessionPos=0; sessionPos<sessionCount; sessionPos++) {
+        configurations[GetConfiguration(*chart, scheduler.GetSession(sessionPos))]++;
+    }
+    return configurations;
+}
+
+static void PrintUsage(QTextStream& out)
+{
+    out << "Usage: SCXMLDesignerRunner <workflow.scxml|workflow.scxmlz> [options]\n"
+        << "  --sessions N     independent sessions of the workflow (1 by default)\n"
+        << "  --events a,b,c   events sent to each session, in order\n"
+        << "  --script FILE    events sent to each session, one per line\n"
+        << "  --repeat N       times the events are sent (1 by default)\n"
+        << "  --threads 1,2,4  run the sessions on a scheduler with each number of worker threads in\n"
+        << "                   turn, 0 for one per core, and print the throughput of each\n"
+        << "  --log            print the log actions executed\n";
+}
+
+//!
+//! Runs a workflow headless: the chart is compiled once and the sessions are all run by one
+//! SCXMLEngine. The events are sent to the sessions in turn, so they progress together as
+//! concurrent sessions would, and the time of each macrostep is recorded. The throughput, the
+//! latency percentiles and how many sessions ended in each configuration are printed. With
+//! --threads the sessions are run on an SCXMLScheduler instead, once for each thread count,
+//! and the throughput of each run is printed.
+//!
+int main(int argc, char **argv) {
+    QCoreApplication app(argc, argv);
+    QStringList arguments = app.arguments();
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    if (arguments.count() < 2 || arguments.at(1).startsWith("--")) {
+        PrintUsage(err);
+        return 2;
+    }
+    int sessionCount = qMax(1, GetOption(arguments, "--sessions", "1").toInt());
+    int repeatCount = qMax(1, GetOption(arguments, "--repeat", "1").toInt());
+    bool log = arguments.contains("--log");
+
+    QString errorString;
+    QList<SCXMLAtom> script;
+    QString scriptFile = GetOption(arguments, "--script", "");
+    if (!scriptFile.isEmpty() && !LoadEventScript(scriptFile, script, errorString)) {
+        err << "Could not read " << scriptFile << ": " << errorString << "\n";
+        return 1;
+    }
+    foreach (QString event, GetOption(arguments, "--events", "").split(',', QString::SkipEmptyParts)) {
+        script.append(SCXMLIntern(event.trimmed()));
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QSharedPointer<SCXMLCompiledChart> chart(new SCXMLCompiledChart());
+    {
+        WorkflowModel model;
+        if (!LoadModel(arguments.at(1), model, errorString)) {
+            err << "Could not load " << arguments.at(1) << ": " << errorString << "\n";
+            return 1;
+        }
+        if (!chart->Compile(model)) {
+            err << "Could not compile " << arguments.at(1) << ": " << chart->GetErrorString() << "\n";
+            return 1;
+        }
+    }
+    qint64 loadTime = timer.nsecsElapsed();
+
+    QString threadsOption = GetOption(arguments, "--threads", "");
+    if (!threadsOption.isEmpty()) {
+        // the workers log from their own threads
+        QMutex logMutex;
+        SCXMLEngine::LogCallback logCallback = [](const QString&, const QString&) {};
+        if (log) {
+            logCallback = [&logMutex, &out](const QString& label, const QString& expr) {
+                QMutexLocker locker(&logMutex);
+                out << label << "\t" << expr << "\n";
+            };
+        }
+
+        out << "workflow\t" << chart->GetName() << " (" << chart->GetStateCount() - 1 << " states, "
+            << chart->GetTransitionCount() << " transitions)\n";
+        out << "load ms\t" << double(loadTime) / 1000000.0 << "\n";
+        out << "sessions\t" << sessionCount << "\n";
+        out << "events\t" << qint64(script.count()) * repeatCount * sessionCount << " (" << script.count() * repeatCount
+            << " per session)\n";
+        QMap<QString, int> configurations;
+        foreach (QString threads, threadsOption.split(',', QString::SkipEmptyParts)) {
+            configurations = RunScheduled(out, chart, qMax(0, threads.trimmed().toInt()), sessionCount, script,
+                                          repeatCount, logCallback);
+            out.flush();
+        }
+        PrintConfigurations(out, configurations);
+        return 0;
+    }
+
+    int currentSession = 0;
+    SCXMLEngine engine(chart);
+    if (log) {
+        engine.SetLogCallback([&currentSession, &out](const QString& label, const QString& expr) {
+            out << currentSession << "\t" << label << "\t" << expr << "\n";
+        });
+    }
+    else {
+        engine.SetLogCallback([](const QString&, const QString&) {});
+    }
+
+    timer.start();
+    QVector<SCXMLSession> sessions(sessionCount);
+    for (currentSession=0; currentSession<sessionCount; currentSession++) {
+        engine.Start(sessions[currentSession]);
+    }
+    qint64 startTime = timer.nsecsElapsed();
+
+    QVector<qint64> latencies;
+    latencies.reserve(script.count() * repeatCount * sessionCount);
+    QElapsedTimer eventTimer;
+    timer.start();
+    for (int repeatPos=0; repeatPos<repeatCount; repeatPos++) {
+        foreach (SCXMLAtom event, script) {
+            for (currentSession=0; currentSession<sessionCount; currentSession++) {
+                eventTimer.start();
+                SCXMLSession& session = sessions[currentSession];
+                session.PostEvent(event);
+                engine.ProcessEvents(session);
+                latencies.append(eventTimer.nsecsElapsed());
+            }
+        }
+    }
+    qint64 runTime = timer.nsecsElapsed();
+
+    qint64 sessionBytes = 0;
+    QMap<QString, int> configurations;
+    foreach (const SCXMLSession& session, sessions) {
+        sessionBytes += session.GetAllocatedBytes();
+        configurations[GetConfiguration(*chart, session)]++;
+    }
+    sessions.clear();
+    std::sort(latencies.begin(), latencies.end());
+
+    out << "workflow\t" << chart->GetName() << " (" << chart->GetStateCount() - 1 << " states, "
+        << chart->GetTransitionCount() << " transitions)\n";
+    out << "load ms\t" << double(loadTime) / 1000000.0 << "\n";
+    out << "sessions\t" << sessionCount << " (started in " << double(startTime) / 1000000.0 << " ms)\n";
+    out << "events\t" << latencies.count() << " (" << script.count() * repeatCount << " per session)\n";
+    out << "run ms\t" << double(runTime) / 1000000.0 << "\n";
+    out << "events/s\t" << qint64(double(latencies.count()) * 1e9 / qMax(qint64(1), runTime)) << "\n";
+    out << "microsteps\t" << engine.GetMicrostepCount() << "\n";
+    out << "bytes/session\t" << sessionBytes / sessionCount << "\n";
+    out << "latency us\tp50 " << GetPercentile(latencies, 50) << "\tp90 " << GetPercentile(latencies, 90)
+        << "\tp99 " << GetPercentile(latencies, 99) << "\tp99.9 " << GetPercentile(latencies, 99.9)
+        << "\tmax " << GetPercentile(latencies, 100) << "\n";
+
+    PrintConfigurations(out, configurations);
+
+    return 0;
+}
@@ -4,10 +4,10 @@
 #
 #-------------------------------------------------
 
-QT       += core testlib widgets gui xml
+QT       += core testlib widgets gui xml concurrent
 
 TARGET = SCXMLDesignerTests
-CONFIG   += console
+CONFIG   += console c++11
 CONFIG   -= app_bundle
 
 TEMPLATE = app
@@ -17,10 +17,47 @@ INCLUDEPATH += $$PWD/../../../../gtest/gtest-1.7.0/include
 INCLUDEPATH += $$PWD/../SCXMLDesigner/
 
 DEFINES += "_VARIADIC_MAX=10"
+DEFINES += SCXML_EXAMPLES_DIR=\\\"$$PWD/../SCXMLDesigner/Examples\\\"
 
 SOURCES += main.cpp
 
 SOURCES += $$PWD/../../../../gtest/gtest-1.7.0/src/gtest-all.cc \
     "../SCXMLDesigner/xmlutilities.cpp" \
-
-HEADERS += testSCXMLParser.h
+    "../SCXMLDesigner/metadatasupport.cpp" \
+    "../SCXMLDesigner/scxmlcompresseddevice.cpp" \
+    "../SCXMLDesigner/scxmlatoms.cpp" \
+    "../SCXMLDesigner/scxmlexecutablecontent.cpp" \
+    "../SCXMLDesigner/workflowmodel.cpp" \
+    "../SCXMLDesigner/scxmlcompiledchart.cpp" \
+    "../SCXMLDesigner/scxmlengine.cpp" \
+    "../SCXMLDesigner/scxmlexpressions.cpp" \
+    "../SCXMLDesigner/scxmlscheduler.cpp" \
+    "../SCXMLDesigner/scxmleventqueue.cpp" \
+    "../SCXMLDesigner/scxmltimerwheel.cpp" \
+    "../SCXMLDesigner/scxmldatamodel.cpp" \
+    "../SCXMLDesigner/scxmlsourcebuffer.cpp" \
+    "../SCXMLDesigner/scxmlstate.cpp" \
+    "../SCXMLDesigner/scxmltransition.cpp" \
+    "../SCXMLDesigner/chaikincurve.cpp" \
+    "../SCXMLDesigner/connectionpointsupport.cpp" \
+    "../SCXMLDesigner/utilities.cpp" \
+    "../SCXMLDesigner/workflow.cpp" \
+    "../SCXMLDesigner/workflowcache.cpp" \
+    "../SCXMLDesigner/workflowjournal.cpp" \
+
+HEADERS += testSCXMLParser.h \
+    testMetaDataSupport.h \
+    testSCXMLCompressedDevice.h \
+    testSCXMLEngine.h \
+    testSCXMLExpressions.h \
+    testSCXMLScheduler.h \
+    testSCXMLEventQueue.h \
+    testSCXMLTimerWheel.h \
+    testWorkflow.h \
+    testSCXMLAtoms.h \
+    testWorkflowJournal.h \
+    "../SCXMLDesigner/scxmlcompresseddevice.h" \
+    "../SCXMLDesigner/scxmlstate.h" \
+    "../SCXMLDesigner/scxmltransition.h" \
+    "../SCXMLDesigner/workflow.h" \
+    "../SCXMLDesigner/workflowjournal.h"
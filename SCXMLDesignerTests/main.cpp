@@ -1,8 +1,24 @@
 #include <gtest/gtest.h>
+#include <QApplication>
 #include "testSCXMLParser.h"
+#include "testMetaDataSupport.h"
+#include "testSCXMLCompressedDevice.h"
+#include "testSCXMLEngine.h"
+#include "testSCXMLExpressions.h"
+#include "testSCXMLScheduler.h"
+#include "testSCXMLEventQueue.h"
+#include "testSCXMLTimerWheel.h"
+#include "testWorkflow.h"
+#include "testSCXMLAtoms.h"
+#include "testWorkflowJournal.h"
 //#include "testSCXMLState.h"
 
 int main(int argc, char **argv) {
+  // the workflow tests build states and transitions, which are graphics items
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+  QApplication app(argc, argv);
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
 }
@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+#include "metadatasupport.h"
+
+TEST(MetaDataSupportTests, ParseMetaDataDecodesStateFields) {
+    MetaData metaData;
+    MetaDataSupport::ParseMetaData(QString(" META-DATA [x=-227] [y=48.5] [width=100] [height=50] [description=Loops around]"), metaData);
+    EXPECT_TRUE(metaData.Has(MetaData::FIELD_X));
+    EXPECT_TRUE(metaData.Has(MetaData::FIELD_HEIGHT));
+    EXPECT_EQ(-227, metaData.x);
+    EXPECT_EQ(48.5, metaData.y);
+    EXPECT_EQ(100, metaData.width);
+    EXPECT_EQ(50, metaData.height);
+    EXPECT_EQ(QString("Loops around"), metaData.description);
+    EXPECT_EQ(0, metaData.extra.count());
+}
+
+TEST(MetaDataSupportTests, ParseMetaDataDecodesControlPoints) {
+    MetaData metaData;
+    MetaDataSupport::ParseMetaData(QString(" META-DATA [cp=-181,2:-120,75:77,74:138,-20] [description=]"), metaData);
+    EXPECT_TRUE(metaData.Has(MetaData::FIELD_CONTROL_POINTS));
+    EXPECT_TRUE(metaData.Has(MetaData::FIELD_DESCRIPTION));
+    EXPECT_FALSE(metaData.Has(MetaData::FIELD_X));
+    ASSERT_EQ(4, metaData.controlPoints.count());
+    EXPECT_EQ(QPointF(-181, 2), metaData.controlPoints.at(0));
+    EXPECT_EQ(QPointF(138, -20), metaData.controlPoints.at(3));
+    EXPECT_TRUE(metaData.description.isEmpty());
+}
+
+TEST(MetaDataSupportTests, ParseMetaDataKeepsUnknownKeysAndSkipsMalformedEntries) {
+    MetaData metaData;
+    MetaDataSupport::ParseMetaData(QString(" META-DATA [x1=10] [novalue] [x=abc] [x1=20] [y=5"), metaData);
+    EXPECT_FALSE(metaData.Has(MetaData::FIELD_X));
+    EXPECT_FALSE(metaData.Has(MetaData::FIELD_Y));
+    ASSERT_EQ(1, metaData.extra.count());
+    EXPECT_EQ(QString("x1"), metaData.extra.at(0).first);
+    EXPECT_EQ(QString("20"), metaData.extra.at(0).second);
+}
+
+TEST(MetaDataSupportTests, ParseMetaDataFromStringRefUsesOnlyTheReferencedText) {
+    QString text("[x=1] META-DATA [y=2] [x=3]");
+    MetaData metaData;
+    MetaDataSupport::ParseMetaData(text.midRef(6), metaData);
+    EXPECT_EQ(3, metaData.x);
+    EXPECT_EQ(2, metaData.y);
+}
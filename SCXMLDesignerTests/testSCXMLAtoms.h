@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+#include <QThread>
+#include <QVector>
+#include "scxmlatoms.h"
+
+//! Interns count strings with the given prefix, keeping the atoms
+class AtomInterner : public QThread
+{
+public:
+    AtomInterner(QString prefix, int count) : mPrefix(prefix), mCount(count) {}
+
+    QVector<SCXMLAtom> atoms;
+
+protected:
+    virtual void run() {
+        for (int textPos=0; textPos<mCount; textPos++) {
+            atoms.append(SCXMLIntern(mPrefix + QString::number(textPos)));
+        }
+    }
+
+private:
+    QString mPrefix;
+    int mCount;
+};
+
+TEST(SCXMLAtomTableTests, KnownAtomsAreInternedInOrder) {
+    EXPECT_EQ(int(SCXMLAtomTable::ATOM_EMPTY), SCXMLIntern(QString("")));
+    EXPECT_EQ(int(SCXMLAtomTable::ATOM_TRANSITION), SCXMLIntern(QString("transition")));
+    EXPECT_EQ(QString("foreach"), SCXMLAtomString(SCXMLAtomTable::ATOM_FOREACH));
+    EXPECT_EQ(QString(), SCXMLAtomString(SCXMLAtomTable::ATOM_INVALID));
+    EXPECT_EQ(int(SCXMLAtomTable::ATOM_INVALID), SCXMLAtomTable::Instance()->Find(QString("atoms.never.interned")));
+}
+
+TEST(SCXMLAtomTableTests, ThreadsInterningTheSameStringsAgree) {
+    // enough strings to grow the index several times while the threads read it
+    const int count = 20000;
+    AtomInterner first("atoms.shared.", count);
+    AtomInterner second("atoms.shared.", count);
+    first.start();
+    second.start();
+    first.wait();
+    second.wait();
+
+    ASSERT_EQ(count, first.atoms.count());
+    EXPECT_EQ(first.atoms, second.atoms);
+    for (int textPos=0; textPos<count; textPos+=997) {
+        QString text = QString("atoms.shared.") + QString::number(textPos);
+        EXPECT_EQ(text, SCXMLAtomString(first.atoms.at(textPos)));
+        EXPECT_EQ(first.atoms.at(textPos), SCXMLAtomTable::Instance()->Find(text));
+    }
+}
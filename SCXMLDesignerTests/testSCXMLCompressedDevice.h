@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <QBuffer>
+#include <QtEndian>
+#include "scxmlcompresseddevice.h"
+
+static QByteArray CompressForTest(const QByteArray& scxml)
+{
+    QByteArray compressed;
+    QBuffer buffer(&compressed);
+    buffer.open(QIODevice::WriteOnly);
+    SCXMLCompressedDevice device(&buffer);
+    device.open(QIODevice::WriteOnly);
+    // written in pieces, as a stream writer would
+    for (int pos=0; pos<scxml.size(); pos+=1000) {
+        device.write(scxml.mid(pos, 1000));
+    }
+    EXPECT_TRUE(device.Finish());
+    return compressed;
+}
+
+TEST(SCXMLCompressedDeviceTests, RoundTripsAcrossFrames) {
+    QByteArray scxml;
+    for (int statePos=0; statePos<20000; statePos++) {
+        scxml += QString("<state id=\"s%1\"><!-- META-DATA [x=%1] [y=0] --></state>\n").arg(statePos).toUtf8();
+    }
+    QByteArray compressed = CompressForTest(scxml);
+    EXPECT_TRUE(SCXMLCompressedDevice::IsCompressed(compressed));
+    EXPECT_FALSE(SCXMLCompressedDevice::IsCompressed(scxml));
+    EXPECT_LT(compressed.size(), scxml.size() / 4);
+
+    QByteArray decompressed;
+    EXPECT_TRUE(SCXMLCompressedDevice::Decompress(compressed, decompressed));
+    EXPECT_EQ(scxml, decompressed);
+}
+
+TEST(SCXMLCompressedDeviceTests, SplitsASingleLargeWriteAcrossFrames) {
+    QByteArray scxml;
+    for (int statePos=0; statePos<40000; statePos++) {
+        scxml += QString("<state id=\"s%1\"><!-- META-DATA [x=%2] [y=%3] --></state>\n")
+                .arg(statePos).arg(qrand()).arg(qrand()).toUtf8();
+    }
+    QByteArray compressed;
+    QBuffer buffer(&compressed);
+    buffer.open(QIODevice::WriteOnly);
+    SCXMLCompressedDevice device(&buffer);
+    ASSERT_TRUE(device.open(QIODevice::WriteOnly));
+    // as a DOM is saved, with the whole document in one write
+    EXPECT_EQ(qint64(scxml.size()), device.write(scxml));
+    EXPECT_TRUE(device.Finish());
+
+    // the first frame, after the magic and version, holds only part of the document
+    QByteArray firstFrame = compressed.mid(8, 4);
+    quint32 firstFrameSize = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(firstFrame.constData()));
+    EXPECT_LT(firstFrameSize, quint32(scxml.size() / 2));
+
+    QByteArray decompressed;
+    EXPECT_TRUE(SCXMLCompressedDevice::Decompress(compressed, decompressed));
+    EXPECT_EQ(scxml, decompressed);
+}
+
+TEST(SCXMLCompressedDeviceTests, ReportsTruncatedContainers) {
+    QByteArray compressed = CompressForTest(QByteArray("<scxml name=\"Truncated\"/>"));
+    QByteArray decompressed;
+    EXPECT_FALSE(SCXMLCompressedDevice::Decompress(compressed.left(compressed.size() - 6), decompressed));
+}
+
+TEST(SCXMLCompressedDeviceTests, RejectsFramesClaimingAnImpossibleSize) {
+    QByteArray compressed = CompressForTest(QByteArray("<scxml name=\"Oversized\"/>"));
+    // the size qUncompress allocates leads the data of the first frame, after the magic, version
+    // and frame length
+    foreach (quint32 frameSize, QList<quint32>() << 0xFFFFFF00 << 0) {
+        QByteArray corrupt = compressed;
+        qToBigEndian(frameSize, reinterpret_cast<uchar*>(corrupt.data() + 12));
+        QByteArray decompressed;
+        EXPECT_FALSE(SCXMLCompressedDevice::Decompress(corrupt, decompressed));
+    }
+}
+
+TEST(SCXMLCompressedDeviceTests, RecognisesCompressedFilenames) {
+    EXPECT_TRUE(SCXMLCompressedDevice::IsCompressedFilename("Examples/Adder.scxmlz"));
+    EXPECT_FALSE(SCXMLCompressedDevice::IsCompressedFilename("Examples/Adder.scxml"));
+}
@@ -0,0 +1,265 @@
+#include <gtest/gtest.h>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QXmlStreamReader>
+#include "workflowmodel.h"
+#include "scxmlcompiledchart.h"
+#include "scxmlengine.h"
+
+static QSharedPointer<SCXMLEngine> StartEngine(const QString& scxml, SCXMLSession& session)
+{
+    WorkflowModel model;
+    QXmlStreamReader reader(scxml);
+    model.ReadFromStream(reader);
+    QSharedPointer<SCXMLCompiledChart> chart(new SCXMLCompiledChart());
+    EXPECT_TRUE(chart->Compile(model));
+    QSharedPointer<SCXMLEngine> engine(new SCXMLEngine(chart));
+    engine->Start(session);
+    return engine;
+}
+
+static QString GetActiveId(QSharedPointer<SCXMLEngine> engine, const SCXMLSession& session)
+{
+    return SCXMLAtomString(engine->GetChart()->GetState(session.GetActiveState()).id);
+}
+
+static QString SendEvent(QSharedPointer<SCXMLEngine> engine, SCXMLSession& session, const QString& event)
+{
+    session.PostEvent(event);
+    engine->ProcessEvents(session);
+    return GetActiveId(engine, session);
+}
+
+const QString dispatchChart =
+        "<scxml initial=\"idle\">"
+        "<state id=\"idle\">"
+        "<transition event=\"error.*\" target=\"failed\"/>"
+        "<transition event=\"done.invoke.adder start\" target=\"running\"/>"
+        "</state>"
+        "<state id=\"running\">"
+        "<transition event=\"*\" target=\"idle\"/>"
+        "<transition event=\"stop\" target=\"failed\"/>"
+        "</state>"
+        "<state id=\"failed\"/>"
+        "</scxml>";
+
+TEST(SCXMLEngineTests, DescriptorsMatchEventsTheyArePrefixesOf) {
+    SCXMLSession session;
+    QSharedPointer<SCXMLEngine> engine = StartEngine(dispatchChart, session);
+    EXPECT_EQ(QString("idle"), SendEvent(engine, session, "errors"));
+    EXPECT_EQ(QString("idle"), SendEvent(engine, session, "done.invoke"));
+    EXPECT_EQ(QString("running"), SendEvent(engine, session, "done.invoke.adder.1"));
+    EXPECT_EQ(QString("idle"), SendEvent(engine, session, "anything"));
+    EXPECT_EQ(QString("failed"), SendEvent(engine, session, "error.send.failed"));
+}
+
+TEST(SCXMLEngineTests, FirstMatchingTransitionInDocumentOrderIsTaken) {
+    SCXMLSession session;
+    QSharedPointer<SCXMLEngine> engine = StartEngine(dispatchChart, session);
+    EXPECT_EQ(QString("running"), SendEvent(engine, session, "start"));
+    // the wildcard comes first, so stop does not reach failed
+    EXPECT_EQ(QString("idle"), SendEvent(engine, session, "stop"));
+}
+
+TEST(SCXMLEngineTests, FinalChildRaisesDoneEventAndTopLevelFinalStops) {
+    SCXMLSession session;
+    QSharedPointer<SCXMLEngine> engine = StartEngine(
+                "<scxml initial=\"job\">"
+                "<state id=\"job\">"
+                "<transition event=\"done.state.job\" target=\"end\"/>"
+                "<state id=\"work\"><transition target=\"finished\"/></state>"
+                "<final id=\"finished\"/>"
+                "</state>"
+                "<final id=\"end\"/>"
+                "</scxml>", session);
+    EXPECT_EQ(QString("end"), GetActiveId(engine, session));
+    EXPECT_FALSE(session.IsRunning());
+    EXPECT_EQ(2, engine->GetMicrostepCount());
+}
+
+TEST(SCXMLEngineTests, ExecutableContentRunsOnExitTransitionThenOnEntry) {
+    SCXMLSession session;
+    QSharedPointer<SCXMLEngine> engine = StartEngine(
+                "<scxml initial=\"a\">"
+                "<state id=\"a\">"
+                "<onexit><log label=\"exit\" expr=\"a\"/></onexit>"
+                "<transition event=\"go\" target=\"b\"><log label=\"transition\" expr=\"go\"/></transition>"
+                "</state>"
+                "<state id=\"b\">"
+                "<onentry>"
+                "<if cond=\"In('a')\"><log label=\"if\" expr=\"a\"/>"
+                "<elseif cond=\"In('b')\"/><log label=\"if\" expr=\"b\"/><raise event=\"next\"/>"
+                "<else/><log label=\"if\" expr=\"else\"/>"
+                "</if>"
+                "</onentry>"
+                "<transition event=\"next\" target=\"c\"/>"
+                "</state>"
+                "<state id=\"c\">"
+                "<onentry><assign location=\"x\" expr=\"1\"/><log label=\"after\" expr=\"assign\"/></onentry>"
+                "<transition event=\"error.execution\" target=\"failed\"/>"
+                "</state>"
+                "<state id=\"failed\"/>"
+                "</scxml>", session);
+    QStringList logged;
+    engine->SetLogCallback([&logged](const QString& label, const QString& expr) { logged.append(label + ":" + expr); });
+    // the raise in b is taken in the same macrostep, the assign fails without a datamodel
+    EXPECT_EQ(QString("failed"), SendEvent(engine, session, "go"));
+    EXPECT_EQ(QString("exit:a transition:go if:b"), logged.join(" "));
+}
+
+TEST(SCXMLEngineTests, SendPlacesEventsOnTheExternalQueue) {
+    SCXMLSession session;
+    QSharedPointer<SCXMLEngine> engine = StartEngine(
+                "<scxml initial=\"a\">"
+                "<state id=\"a\">"
+                "<onentry><send event=\"later\"/><raise event=\"now\"/></onentry>"
+                "<transition event=\"now\" target=\"b\"/>"
+                "</state>"
+                "<state id=\"b\"><transition event=\"later\" target=\"c\"/></state>"
+                "<state id=\"c\"/>"
+                "</scxml>", session);
+    EXPECT_EQ(QString("b"), GetActiveId(engine, session));
+    EXPECT_EQ(1, engine->ProcessEvents(session));
+    EXPECT_EQ(QString("c"), GetActiveId(engine, session));
+}
+
+TEST(SCXMLEngineTests, GuardsAndAssignmentsUseTheDatamodel) {
+    SCXMLSession session;
+    QSharedPointer<SCXMLEngine> engine = StartEngine(
+                "<scxml initial=\"counting\">"
+                "<datamodel><data id=\"count\" expr=\"0\"/><data id=\"limit\" expr=\"3\"/></datamodel>"
+                "<state id=\"counting\">"
+                "<transition event=\"tick\" cond=\"count + 1 &gt;= limit\" target=\"done\"/>"
+                "<transition event=\"tick\"><assign location=\"count\" expr=\"count + 1\"/></transition>"
+                "</state>"
+                "<state id=\"done\"/>"
+                "</scxml>", session);
+    EXPECT_EQ(QString("counting"), SendEvent(engine, session, "tick"));
+    EXPECT_EQ(QString("counting"), SendEvent(engine, session, "tick"));
+    EXPECT_EQ(2.0, session.GetDataValue(engine->GetChart()->FindData("count")).ToNumber());
+    EXPECT_EQ(QString("done"), SendEvent(engine, session, "tick"));
+}
+
+TEST(SCXMLEngineTests, SessionsSharingAChartRunIndependently) {
+    const QString scxml =
+            "<scxml initial=\"counting\">"
+            "<datamodel><data id=\"count\" expr=\"0\"/></datamodel>"
+            "<state id=\"counting\">"
+            "<transition event=\"tick\" cond=\"count &gt;= 1\" target=\"done\"/>"
+            "<transition event=\"tick\"><assign location=\"count\" expr=\"count + 1\"/></transition>"
+            "</state>"
+            "<final id=\"done\"/>"
+            "</scxml>";
+    SCXMLSession first;
+    QSharedPointer<SCXMLEngine> engine = StartEngine(scxml, first);
+    SCXMLSession second;
+    engine->Start(second);
+    int count = engine->GetChart()->FindData("count");
+
+    first.PostEvent("tick");
+    first.PostEvent("tick");
+    second.PostEvent("tick");
+    EXPECT_EQ(2, engine->ProcessEvents(first));
+    EXPECT_EQ(1, engine->ProcessEvents(second));
+    EXPECT_FALSE(first.IsRunning());
+    EXPECT_EQ(QString("done"), GetActiveId(engine, first));
+    EXPECT_TRUE(second.IsRunning());
+    EXPECT_EQ(QString("counting"), GetActiveId(engine, second));
+    EXPECT_EQ(1.0, second.GetDataValue(count).ToNumber());
+    EXPECT_FALSE(second.HasEvents());
+}
+
+TEST(SCXMLEngineTests, InternalEventsDoNotOutliveTheirSession) {
+    const QString scxml =
+            "<scxml initial=\"idle\">"
+            "<state id=\"idle\">"
+            "<onexit><raise event=\"leak\"/></onexit>"
+            "<transition event=\"finish\" target=\"end\"/>"
+            "<transition event=\"leak\" target=\"leaked\"/>"
+            "</state>"
+            "<state id=\"leaked\"/>"
+            "<final id=\"end\"/>"
+            "</scxml>";
+    SCXMLSession first;
+    QSharedPointer<SCXMLEngine> engine = StartEngine(scxml, first);
+    SCXMLSession second;
+    engine->Start(second);
+
+    // the event raised on the way to the top level final is left when the first session stops
+    EXPECT_EQ(QString("end"), SendEvent(engine, first, "finish"));
+    EXPECT_FALSE(first.IsRunning());
+    EXPECT_EQ(QString("idle"), SendEvent(engine, second, "poke"));
+}
+
+TEST(SCXMLEngineTests, DelayedSendsAndCancelsGoToTheTimerCallbacks) {
+    SCXMLSession session;
+    session.SetId(7);
+    QSharedPointer<SCXMLEngine> engine = StartEngine(
+                "<scxml initial=\"idle\">"
+                "<state id=\"idle\"><transition event=\"arm\" target=\"armed\"/></state>"
+                "<state id=\"armed\">"
+                "<onentry><send event=\"timeout\" delay=\"1.5s\" id=\"t\"/><send event=\"ping\" delayexpr=\"'20ms'\"/></onentry>"
+                "<transition event=\"disarm\" target=\"idle\"><cancel sendid=\"t\"/></transition>"
+                "<transition event=\"timeout\" target=\"expired\"/>"
+                "<transition event=\"error.execution\" target=\"failed\"/>"
+                "</state>"
+                "<state id=\"expired\"/>"
+                "<state id=\"failed\"/>"
+                "</scxml>", session);
+    QStringList timers;
+    engine->SetTimerCallbacks(
+        [&timers](const SCXMLSession& session, qint64 delay, SCXMLAtom event, SCXMLAtom sendid) {
+            timers.append(QString("%1:%2:%3:%4").arg(session.GetId()).arg(SCXMLAtomString(event)).arg(delay)
+                          .arg(sendid == SCXMLAtomTable::ATOM_INVALID ? QString() : SCXMLAtomString(sendid)));
+            return true;
+        },
+        [&timers](const SCXMLSession& session, SCXMLAtom sendid) {
+            timers.append(QString("%1:cancel:%2").arg(session.GetId()).arg(SCXMLAtomString(sendid)));
+        });
+
+    EXPECT_EQ(QString("armed"), SendEvent(engine, session, "arm"));
+    EXPECT_EQ(QString("idle"), SendEvent(engine, session, "disarm"));
+    EXPECT_EQ(QString("7:timeout:1500:t 7:ping:20: 7:cancel:t"), timers.join(" "));
+    EXPECT_EQ(QString("armed"), SendEvent(engine, session, "arm"));
+    EXPECT_EQ(QString("expired"), SendEvent(engine, session, "timeout"));
+
+    // without the callbacks a delayed send cannot be made
+    engine->SetTimerCallbacks(SCXMLEngine::DelayedSendCallback(), SCXMLEngine::CancelCallback());
+    engine->Start(session);
+    EXPECT_EQ(QString("failed"), SendEvent(engine, session, "arm"));
+}
+
+TEST(SCXMLEngineTests, NestedDataHasASlotForItsPath) {
+    const QString scxml =
+            "<scxml initial=\"adding\">"
+            "<datamodel>"
+            "<data id=\"parameters\"><data id=\"first\" expr=\"20\"/><data id=\"multiplier\" expr=\"3\"/></data>"
+            "<data id=\"first\" expr=\"1\"/>"
+            "</datamodel>"
+            "<state id=\"adding\">"
+            "<transition event=\"add\" cond=\"parameters.first * parameters.multiplier == 60\" target=\"done\">"
+            "<assign location=\"parameters.first\" expr=\"parameters.first + first\"/>"
+            "</transition>"
+            "</state>"
+            "<state id=\"done\"/>"
+            "</scxml>";
+    WorkflowModel model;
+    QXmlStreamReader reader(scxml);
+    model.ReadFromStream(reader);
+    ASSERT_EQ(4, model.dataItems.count());
+    EXPECT_EQ(-1, model.dataItems.at(0).parent);
+    EXPECT_EQ(0, model.dataItems.at(1).parent);
+    EXPECT_EQ(0, model.dataItems.at(2).parent);
+    EXPECT_EQ(-1, model.dataItems.at(3).parent);
+
+    SCXMLSession session;
+    QSharedPointer<SCXMLEngine> engine = StartEngine(scxml, session);
+    const SCXMLCompiledChart* chart = engine->GetChart();
+    EXPECT_EQ(4, chart->GetDataCount());
+    int nestedFirst = chart->FindData("parameters.first");
+    ASSERT_GE(nestedFirst, 0);
+    EXPECT_NE(chart->FindData("first"), nestedFirst);
+    EXPECT_EQ(chart->FindData("parameters"), chart->GetData(nestedFirst).parent);
+    EXPECT_EQ(QString("done"), SendEvent(engine, session, "add"));
+    EXPECT_EQ(21.0, session.GetDataValue(nestedFirst).ToNumber());
+}
@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+#include <QThread>
+#include <QVector>
+#include "scxmleventqueue.h"
+
+//! Posts count events numbered from first, waiting while the queue is full
+class EventQueueProducer : public QThread
+{
+public:
+    EventQueueProducer(SCXMLEventQueue* queue, int first, int count) : mQueue(queue), mFirst(first), mCount(count) {}
+
+protected:
+    virtual void run() {
+        for (int eventPos=0; eventPos<mCount; eventPos++) {
+            while (!mQueue->Post(mFirst + eventPos)) {
+                QThread::yieldCurrentThread();
+            }
+        }
+    }
+
+private:
+    SCXMLEventQueue* mQueue;
+    int mFirst;
+    int mCount;
+};
+
+TEST(SCXMLEventQueueTests, PostFailsWhenFullAndTakeIsInOrder) {
+    SCXMLEventQueue queue(3);
+    EXPECT_EQ(4, queue.GetCapacity());
+    EXPECT_TRUE(queue.IsEmpty());
+    for (int eventPos=0; eventPos<4; eventPos++) {
+        EXPECT_TRUE(queue.Post(eventPos));
+    }
+    EXPECT_FALSE(queue.Post(4));
+
+    SCXMLAtom events[4];
+    EXPECT_EQ(3, queue.Take(events, 3));
+    EXPECT_EQ(2, events[2]);
+    EXPECT_TRUE(queue.Post(4));
+    EXPECT_EQ(2, queue.Take(events, 4));
+    EXPECT_EQ(3, events[0]);
+    EXPECT_EQ(4, events[1]);
+    EXPECT_TRUE(queue.IsEmpty());
+}
+
+TEST(SCXMLEventQueueTests, EventsOfEachProducerArriveInOrder) {
+    const int producerCount = 4;
+    const int eventCount = 20000;
+    SCXMLEventQueue queue(64);
+    QVector<EventQueueProducer*> producers;
+    for (int producerPos=0; producerPos<producerCount; producerPos++) {
+        producers.append(new EventQueueProducer(&queue, producerPos * eventCount, eventCount));
+        producers.last()->start();
+    }
+
+    QVector<int> nextEvents(producerCount, 0);
+    bool ordered = true;
+    SCXMLAtom events[16];
+    for (int takenCount=0; takenCount<producerCount*eventCount; ) {
+        int count = queue.Take(events, 16);
+        if (count == 0) {
+            QThread::yieldCurrentThread();
+        }
+        for (int eventPos=0; eventPos<count; eventPos++) {
+            int producer = events[eventPos] / eventCount;
+            if (events[eventPos] % eventCount != nextEvents[producer]) ordered = false;
+            nextEvents[producer]++;
+        }
+        takenCount += count;
+    }
+    foreach (EventQueueProducer* producer, producers) {
+        producer->wait();
+    }
+    qDeleteAll(producers);
+
+    EXPECT_TRUE(ordered);
+    EXPECT_TRUE(queue.IsEmpty());
+}
@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include <QStringList>
+#include "scxmlexpressions.h"
+
+//! x is 6, y is 4, name is "ready" and only state 1 is active
+class TestExpressionContext : public SCXMLExpressionContext
+{
+public:
+    TestExpressionContext() {
+        data << SCXMLValue::FromNumber(6) << SCXMLValue::FromNumber(4)
+             << SCXMLValue::FromString(SCXMLIntern(QString("ready")));
+    }
+
+    virtual const SCXMLValue* GetDataSlots() const { return data.constData(); }
+    virtual bool IsInState(int state) const { return state == 1; }
+
+    QVector<SCXMLValue> data;
+};
+
+static QString EvaluateExpression(const QString& text)
+{
+    SCXMLExpressions expressions;
+    int expression = expressions.Compile(text,
+        [](const QString& path) { return QStringList({"x", "y", "name"}).indexOf(path); },
+        [](const QString& id) { return id == "busy" ? 1 : (id == "idle" ? 2 : -1); });
+    SCXMLValue result;
+    if (!expressions.Evaluate(expression, TestExpressionContext(), result)) return "error";
+    return result.ToString();
+}
+
+TEST(SCXMLExpressionsTests, ArithmeticFollowsPrecedence) {
+    EXPECT_EQ(QString("22"), EvaluateExpression("x + y * 4"));
+    EXPECT_EQ(QString("40"), EvaluateExpression("(x + y) * 4"));
+    EXPECT_EQ(QString("2"), EvaluateExpression("x % y"));
+    EXPECT_EQ(QString("-2"), EvaluateExpression("-x + y"));
+    EXPECT_EQ(QString("1.5"), EvaluateExpression("x / y"));
+}
+
+TEST(SCXMLExpressionsTests, ComparisonsAndLogicalOperators) {
+    EXPECT_EQ(QString("true"), EvaluateExpression("x > y && name == 'ready'"));
+    EXPECT_EQ(QString("false"), EvaluateExpression("x <= y || name != \"ready\""));
+    EXPECT_EQ(QString("true"), EvaluateExpression("In('busy') && !In('idle')"));
+    // the operand that decided the result is kept
+    EXPECT_EQ(QString("6"), EvaluateExpression("0 || x"));
+    EXPECT_EQ(QString("0"), EvaluateExpression("0 && x"));
+    EXPECT_EQ(QString("true"), EvaluateExpression("'6' == x"));
+}
+
+TEST(SCXMLExpressionsTests, InvalidExpressionsFailToEvaluate) {
+    EXPECT_EQ(QString("error"), EvaluateExpression("x +"));
+    EXPECT_EQ(QString("error"), EvaluateExpression("missing * 2"));
+    EXPECT_EQ(QString("error"), EvaluateExpression("In('nowhere')"));
+    EXPECT_EQ(QString("error"), EvaluateExpression("x = 1"));
+    EXPECT_EQ(QString("error"), EvaluateExpression("Math.max(x, y)"));
+    // there is nowhere to put a new string
+    EXPECT_EQ(QString("error"), EvaluateExpression("name + x"));
+}
+
+TEST(SCXMLExpressionsTests, StringsConvertToNumbers) {
+    EXPECT_EQ(QString("16"), EvaluateExpression("' 8 ' * 2"));
+    EXPECT_EQ(QString("true"), EvaluateExpression("'' == 0"));
+    EXPECT_EQ(QString("true"), EvaluateExpression("'10' > x"));
+    // a string that is not a number is NaN, which compares false either way
+    EXPECT_EQ(QString("false"), EvaluateExpression("name < 1 || name >= 1"));
+}
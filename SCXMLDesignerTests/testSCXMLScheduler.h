@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include <QSharedPointer>
+#include <QThread>
+#include <QXmlStreamReader>
+#include "workflowmodel.h"
+#include "scxmlcompiledchart.h"
+#include "scxmlscheduler.h"
+
+TEST(SCXMLSchedulerTests, SessionsTakeTheirEventsInOrderOnAnyWorker) {
+    WorkflowModel model;
+    QXmlStreamReader reader(
+                "<scxml initial=\"a\">"
+                "<datamodel><data id=\"count\" expr=\"0\"/></datamodel>"
+                "<state id=\"a\">"
+                "<transition event=\"next\" target=\"b\"><assign location=\"count\" expr=\"count + 1\"/></transition>"
+                "</state>"
+                "<state id=\"b\">"
+                "<transition event=\"next\" target=\"a\"><assign location=\"count\" expr=\"count + 1\"/></transition>"
+                "<transition event=\"stop\" target=\"end\"/>"
+                "</state>"
+                "<final id=\"end\"/>"
+                "</scxml>");
+    model.ReadFromStream(reader);
+    QSharedPointer<SCXMLCompiledChart> chart(new SCXMLCompiledChart());
+    ASSERT_TRUE(chart->Compile(model));
+
+    // a small queue, so posting has to wait for the workers to take events
+    SCXMLScheduler scheduler(chart, 4, 8);
+    for (int sessionPos=0; sessionPos<100; sessionPos++) {
+        scheduler.AddSession();
+    }
+    scheduler.Start();
+    SCXMLAtom next = SCXMLIntern(QString("next"));
+    SCXMLAtom stop = SCXMLIntern(QString("stop"));
+    // session n is sent n + 1 next events then stop, so it is stopped in end for an even n and
+    // still waiting in a for an odd n
+    for (int eventPos=0; eventPos<100; eventPos++) {
+        for (int sessionPos=eventPos; sessionPos<100; sessionPos++) {
+            while (!scheduler.PostEvent(sessionPos, next)) {
+                QThread::yieldCurrentThread();
+            }
+        }
+    }
+    for (int sessionPos=0; sessionPos<100; sessionPos++) {
+        while (!scheduler.PostEvent(sessionPos, stop)) {
+            QThread::yieldCurrentThread();
+        }
+    }
+    scheduler.WaitForIdle();
+    scheduler.Stop();
+
+    int count = chart->FindData("count");
+    for (int sessionPos=0; sessionPos<100; sessionPos++) {
+        const SCXMLSession& session = scheduler.GetSession(sessionPos);
+        EXPECT_EQ(double(sessionPos + 1), session.GetDataValue(count).ToNumber());
+        EXPECT_EQ(sessionPos % 2 == 1, session.IsRunning());
+    }
+}
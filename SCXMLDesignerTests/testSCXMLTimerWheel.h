@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <QSharedPointer>
+#include <QXmlStreamReader>
+#include "workflowmodel.h"
+#include "scxmlcompiledchart.h"
+#include "scxmlscheduler.h"
+#include "scxmltimerwheel.h"
+
+TEST(SCXMLTimerWheelTests, TimersExpireInOrderAcrossLevels) {
+    SCXMLTimerWheel wheel(1000);
+    // in the lowest level, two levels up and beyond the top level's span
+    wheel.Schedule(1010, 0, 1);
+    wheel.Schedule(1000 + 5000, 1, 2);
+    wheel.Schedule(1000 + 300000, 2, 3);
+    wheel.Schedule(1000 + (qint64(1) << 32), 3, 4);
+    wheel.Schedule(1010, 4, 5);
+    EXPECT_EQ(5, wheel.GetCount());
+    EXPECT_LE(wheel.GetNextTime(), 1010);
+
+    QVector<SCXMLTimerWheel::Expired> expired;
+    wheel.Advance(1009, expired);
+    EXPECT_TRUE(expired.isEmpty());
+    wheel.Advance(1010, expired);
+    ASSERT_EQ(2, expired.count());
+    EXPECT_EQ(1, expired.at(0).event);
+    EXPECT_EQ(5, expired.at(1).event);
+
+    expired.clear();
+    wheel.Advance(1000 + 299999, expired);
+    ASSERT_EQ(1, expired.count());
+    EXPECT_EQ(2, expired.at(0).event);
+    wheel.Advance(1000 + 300000, expired);
+    ASSERT_EQ(2, expired.count());
+    EXPECT_EQ(3, expired.at(1).event);
+
+    expired.clear();
+    wheel.Advance(1000 + (qint64(1) << 32) - 1, expired);
+    EXPECT_TRUE(expired.isEmpty());
+    wheel.Advance(1000 + (qint64(1) << 32), expired);
+    ASSERT_EQ(1, expired.count());
+    EXPECT_EQ(3, expired.at(0).session);
+    EXPECT_EQ(0, wheel.GetCount());
+    EXPECT_EQ(-1, wheel.GetNextTime());
+}
+
+TEST(SCXMLTimerWheelTests, SendIdsAreCancelledAndReplacedPerSession) {
+    SCXMLTimerWheel wheel;
+    SCXMLAtom timeout = SCXMLIntern(QString("timeout"));
+    SCXMLAtom sendid = SCXMLIntern(QString("t"));
+    wheel.Schedule(100, 0, timeout, sendid);
+    wheel.Schedule(100, 1, timeout, sendid);
+    // replaces the first timer of session 0
+    wheel.Schedule(200, 0, timeout, sendid);
+    EXPECT_EQ(2, wheel.GetCount());
+
+    EXPECT_TRUE(wheel.Cancel(1, sendid));
+    EXPECT_FALSE(wheel.Cancel(1, sendid));
+    QVector<SCXMLTimerWheel::Expired> expired;
+    wheel.Advance(150, expired);
+    EXPECT_TRUE(expired.isEmpty());
+    wheel.Advance(200, expired);
+    ASSERT_EQ(1, expired.count());
+    EXPECT_EQ(0, expired.at(0).session);
+    EXPECT_EQ(sendid, expired.at(0).sendid);
+    // a timer that has fired can no longer be cancelled
+    EXPECT_FALSE(wheel.Cancel(0, sendid));
+}
+
+TEST(SCXMLTimerWheelTests, SchedulerFiresDelayedSendsUnlessCancelled) {
+    WorkflowModel model;
+    QXmlStreamReader reader(
+                "<scxml initial=\"waiting\">"
+                "<state id=\"waiting\">"
+                "<onentry><send event=\"timeout\" delay=\"200ms\" id=\"t\"/><send event=\"late\" delay=\"300ms\"/></onentry>"
+                "<transition event=\"stop\"><cancel sendid=\"t\"/></transition>"
+                "<transition event=\"timeout\" target=\"timedout\"/>"
+                "</state>"
+                "<state id=\"timedout\"><transition event=\"late\" target=\"end\"/></state>"
+                "<final id=\"end\"/>"
+                "</scxml>");
+    model.ReadFromStream(reader);
+    QSharedPointer<SCXMLCompiledChart> chart(new SCXMLCompiledChart());
+    ASSERT_TRUE(chart->Compile(model));
+
+    SCXMLScheduler scheduler(chart, 4);
+    for (int sessionPos=0; sessionPos<100; sessionPos++) {
+        scheduler.AddSession();
+    }
+    scheduler.Start();
+    // the even sessions cancel their timeout, well before it is due
+    SCXMLAtom stop = SCXMLIntern(QString("stop"));
+    for (int sessionPos=0; sessionPos<100; sessionPos+=2) {
+        EXPECT_TRUE(scheduler.PostEvent(sessionPos, stop));
+    }
+    // returns once every timer has fired or been cancelled
+    scheduler.WaitForIdle();
+    scheduler.Stop();
+
+    for (int sessionPos=0; sessionPos<100; sessionPos++) {
+        const SCXMLSession& session = scheduler.GetSession(sessionPos);
+        EXPECT_EQ(sessionPos % 2 == 0, session.IsRunning());
+        EXPECT_EQ(sessionPos % 2 == 0 ? QString("waiting") : QString("end"),
+                  SCXMLAtomString(chart->GetState(session.GetActiveState()).id));
+    }
+}
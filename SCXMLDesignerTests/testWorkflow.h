@@ -0,0 +1,274 @@
+#include <gtest/gtest.h>
+#include <QSharedPointer>
+#include <QDomDocument>
+#include <QXmlStreamReader>
+#include <QFile>
+#include <QDir>
+#include <QTemporaryDir>
+#include "workflow.h"
+#include "scxmltransition.h"
+#include "workflowcache.h"
+#include "workflowmodel.h"
+#include "scxmlcompiledchart.h"
+#include "scxmlengine.h"
+
+const QString guardedChart =
+        "<scxml initial=\"idle\">"
+        "<datamodel><data id=\"count\" expr=\"0\"/></datamodel>"
+        "<state id=\"idle\">"
+        "<transition event=\"go\" cond=\"count &gt; 0\" target=\"guarded\"/>"
+        "<transition event=\"go\" target=\"counted\"><assign location=\"count\" expr=\"count + 1\"/></transition>"
+        "</state>"
+        "<state id=\"guarded\"/>"
+        "<state id=\"counted\"><transition event=\"check\" cond=\"count == 1\" target=\"done\"/></state>"
+        "<state id=\"done\"/>"
+        "</scxml>";
+
+//! Runs a snapshot of the workflow on the compiled engine, as the GUI does, and returns the
+//! state each event leaves it in
+static QStringList RunSnapshot(Workflow& workflow, const QStringList& events)
+{
+    WorkflowModel model;
+    workflow.ConstructModelFromStateMachine(model);
+    QSharedPointer<SCXMLCompiledChart> chart(new SCXMLCompiledChart());
+    EXPECT_TRUE(chart->Compile(model));
+    SCXMLEngine engine(chart);
+    SCXMLSession session;
+    engine.Start(session);
+    QStringList activeIds;
+    foreach (const QString& event, events) {
+        session.PostEvent(event);
+        engine.ProcessEvents(session);
+        activeIds.append(SCXMLAtomString(chart->GetState(session.GetActiveState()).id));
+    }
+    return activeIds;
+}
+
+TEST(WorkflowTests, SnapshotsKeepTransitionGuardsAndContent) {
+    Workflow streamed;
+    QXmlStreamReader reader(guardedChart);
+    ASSERT_TRUE(streamed.ConstructStateMachineFromSCXML(reader));
+    QDomDocument doc;
+    ASSERT_TRUE(doc.setContent(guardedChart));
+    Workflow dom;
+    dom.ConstructStateMachineFromSCXML(doc);
+
+    foreach (Workflow* workflow, QList<Workflow*>() << &streamed << &dom) {
+        WorkflowModel model;
+        workflow->ConstructModelFromStateMachine(model);
+        ASSERT_EQ(3, model.transitions.count());
+        EXPECT_EQ(QString("count > 0"), model.transitions.at(0).cond);
+        EXPECT_EQ(nullptr, model.transitions.at(0).content);
+        EXPECT_TRUE(model.transitions.at(1).cond.isEmpty());
+        ASSERT_NE(nullptr, model.transitions.at(1).content);
+        EXPECT_TRUE(model.transitions.at(1).content->HasActions());
+
+        EXPECT_EQ(QStringList() << "counted" << "done", RunSnapshot(*workflow, QStringList() << "go" << "check"));
+    }
+}
+
+//! Writes executable content as SCXML
+static QString WriteContent(SCXMLExecutableContent* content)
+{
+    QString scxml;
+    QXmlStreamWriter writer(&scxml);
+    content->ToXmlStream(writer, 0);
+    return scxml;
+}
+
+TEST(WorkflowTests, CacheKeepsTransitionGuardsAndContent) {
+    WorkflowModel streamed;
+    QXmlStreamReader reader(guardedChart);
+    ASSERT_TRUE(streamed.ReadFromStream(reader));
+
+    QByteArray cache;
+    QDataStream out(&cache, QIODevice::WriteOnly);
+    streamed.WriteToCache(out);
+    WorkflowModel cached;
+    QDataStream in(cache);
+    ASSERT_TRUE(cached.ReadFromCache(in));
+
+    ASSERT_EQ(3, cached.transitions.count());
+    EXPECT_EQ(QString("count > 0"), cached.transitions.at(0).cond);
+    ASSERT_NE(nullptr, cached.transitions.at(1).content);
+    EXPECT_EQ(WriteContent(streamed.transitions.at(1).content), WriteContent(cached.transitions.at(1).content));
+}
+
+//! Loads a workflow as the streaming loader does, keeping the file as its source
+static bool LoadWithSource(Workflow& workflow, QString filename, WorkflowModel& model)
+{
+    QSharedPointer<SCXMLSourceBuffer> source(new SCXMLSourceBuffer());
+    if (!source->Open(filename, false)) return false;
+    QXmlStreamReader reader(source->GetData());
+    if (!model.ReadFromStream(reader)) return false;
+    workflow.ConstructStateMachineFromModel(model);
+    workflow.SetSource(source);
+    return true;
+}
+
+static QByteArray ReadFile(QString filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) return QByteArray();
+    return file.readAll();
+}
+
+//! Finds the transition with the given event in a model, -1 if there is none
+static int FindTransition(const WorkflowModel& model, QString event)
+{
+    for (int transitionPos=0; transitionPos<model.transitions.count(); transitionPos++) {
+        if (model.transitions.at(transitionPos).event == event) return transitionPos;
+    }
+    return -1;
+}
+
+TEST(WorkflowTests, IncrementalSaveKeepsContentTheWorkflowDoesNotKeep) {
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    foreach (QString example, QStringList() << "MultiplyAdder.scxml" << "TestLog.scxml") {
+        QString filename = dir.path() + "/" + example;
+        ASSERT_TRUE(QFile::copy(QString(SCXML_EXAMPLES_DIR) + "/" + example, filename));
+        QByteArray original = ReadFile(filename);
+
+        // the invokes, donedata and the old style comments are in states that get a new transition
+        Workflow workflow;
+        WorkflowModel loaded;
+        ASSERT_TRUE(LoadWithSource(workflow, filename, loaded));
+        QList<SCXMLState*> states = workflow.GetStates();
+        SCXMLTransition* added = new SCXMLTransition(states.first(), states.last(), "added", "external", MetaData());
+        workflow.AddTransition(added);
+        ASSERT_TRUE(workflow.SaveIncrementally(filename));
+
+        QByteArray saved = ReadFile(filename);
+        foreach (QByteArray markup, QList<QByteArray>() << "<invoke" << "<finalize>" << "<donedata>" << "<!--x=" << "cond=") {
+            EXPECT_EQ(original.count(markup), saved.count(markup)) << example.toStdString() << " " << markup.constData();
+        }
+        Workflow reloaded;
+        WorkflowModel model;
+        ASSERT_TRUE(LoadWithSource(reloaded, filename, model));
+        EXPECT_EQ(loaded.transitions.count() + 1, model.transitions.count());
+        int addedPos = FindTransition(model, "added");
+        ASSERT_GE(addedPos, 0);
+        EXPECT_EQ(0, model.transitions.at(addedPos).sourceIndex);
+        EXPECT_EQ(states.last()->GetIdAtom(), model.transitions.at(addedPos).target);
+
+        // the added transition knows where it was written, so a later change only replaces its comment
+        added->SetDescription("Added");
+        ASSERT_TRUE(workflow.SaveIncrementally(filename));
+        QByteArray resaved = ReadFile(filename);
+        EXPECT_EQ(saved.count("<transition"), resaved.count("<transition"));
+        WorkflowModel remodel;
+        QXmlStreamReader reader(resaved);
+        ASSERT_TRUE(remodel.ReadFromStream(reader));
+        addedPos = FindTransition(remodel, "added");
+        ASSERT_GE(addedPos, 0);
+        EXPECT_EQ(QString("Added"), remodel.transitions.at(addedPos).metaData.description);
+    }
+}
+
+TEST(WorkflowTests, IncrementalSaveDoesNotRewriteContentTheWorkflowDoesNotKeep) {
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    QString filename = dir.path() + "/MultiplyAdder.scxml";
+    ASSERT_TRUE(QFile::copy(QString(SCXML_EXAMPLES_DIR) + "/MultiplyAdder.scxml", filename));
+    QByteArray original = ReadFile(filename);
+
+    // making the state final rewrites its element, which would lose the invoke
+    Workflow workflow;
+    WorkflowModel loaded;
+    ASSERT_TRUE(LoadWithSource(workflow, filename, loaded));
+    workflow.GetStates().first()->SetFinal(true);
+    EXPECT_FALSE(workflow.SaveIncrementally(filename));
+    EXPECT_EQ(original, ReadFile(filename));
+}
+
+TEST(WorkflowTests, IncrementalSaveHashesWhatItWrites) {
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    QString filename = dir.path() + "/TestLog.scxml";
+    ASSERT_TRUE(QFile::copy(QString(SCXML_EXAMPLES_DIR) + "/TestLog.scxml", filename));
+
+    Workflow workflow;
+    WorkflowModel loaded;
+    ASSERT_TRUE(LoadWithSource(workflow, filename, loaded));
+    workflow.GetStates().last()->SetDescription("Hashed");
+    Workflow::IncrementalSave save;
+    ASSERT_TRUE(workflow.BeginIncrementalSave(save));
+    QCryptographicHash hash(WorkflowCache::HASH_ALGORITHM);
+    bool succeeded = Workflow::WriteIncrementalSave(save, filename, &hash);
+    workflow.FinishIncrementalSave(save, filename, succeeded);
+    ASSERT_TRUE(succeeded);
+    EXPECT_EQ(WorkflowCache::HashSource(ReadFile(filename)), hash.result());
+}
+
+//! Describes everything a workflow keeps, in the order the states were built
+static QStringList DescribeWorkflow(Workflow& workflow)
+{
+    QStringList description;
+    description << "name " + workflow.GetWorkflowName();
+    foreach (const SCXMLDataItem& dataItem, workflow.GetDataModel()->GetDataItems()) {
+        description << QString("data %1 src=%2 expr=%3 parent=%4").arg(dataItem.GetId()).arg(dataItem.GetSrc())
+                       .arg(dataItem.GetExpr()).arg(dataItem.GetParent());
+    }
+    foreach (SCXMLState* state, workflow.GetStates()) {
+        SCXMLState* parentState = state->GetParentState();
+        description << QString("state %1 parent=%2 final=%3 foreign=%4 %5").arg(state->GetId())
+                       .arg(parentState != nullptr ? parentState->GetId() : QString()).arg(state->GetFinal())
+                       .arg(state->HasForeignContent()).arg(state->GetMetaDataString());
+        if (state->GetOnEntry() != nullptr) description << "onentry " + WriteContent(state->GetOnEntry());
+        if (state->GetOnExit() != nullptr) description << "onexit " + WriteContent(state->GetOnExit());
+        foreach (SCXMLTransition* transition, workflow.GetTransitionsFrom(state)) {
+            description << QString("transition %1 -> %2 type=%3 cond=%4 foreign=%5 %6").arg(transition->GetEvent())
+                           .arg(transition->GetTargetState()->GetId()).arg(transition->getTransitionType())
+                           .arg(transition->GetCond()).arg(transition->HasForeignContent())
+                           .arg(MetaDataSupport::FormatTransitionMetaData(transition->GetMetaData()));
+            if (transition->GetContent() != nullptr) description << "content " + WriteContent(transition->GetContent());
+        }
+    }
+    return description;
+}
+
+TEST(WorkflowTests, StreamingLoaderBuildsWhatTheDomLoaderBuilds) {
+    QDir examples(SCXML_EXAMPLES_DIR);
+    QStringList filenames = examples.entryList(QStringList() << "*.scxml", QDir::Files);
+    ASSERT_FALSE(filenames.isEmpty());
+    foreach (QString filename, filenames) {
+        QByteArray data = ReadFile(examples.filePath(filename));
+        ASSERT_FALSE(data.isEmpty()) << filename.toStdString();
+
+        QDomDocument doc;
+        ASSERT_TRUE(doc.setContent(data)) << filename.toStdString();
+        Workflow dom;
+        dom.ConstructStateMachineFromSCXML(doc);
+
+        Workflow streamed;
+        QXmlStreamReader reader(data);
+        ASSERT_TRUE(streamed.ConstructStateMachineFromSCXML(reader)) << filename.toStdString();
+
+        QStringList domDescription = DescribeWorkflow(dom);
+        QStringList streamedDescription = DescribeWorkflow(streamed);
+        EXPECT_EQ(dom.GetStates().count(), streamed.GetStates().count()) << filename.toStdString();
+        EXPECT_EQ(dom.GetTransitionCount(), streamed.GetTransitionCount()) << filename.toStdString();
+        EXPECT_EQ(domDescription.join("\n").toStdString(), streamedDescription.join("\n").toStdString())
+                << filename.toStdString();
+    }
+}
+
+TEST(WorkflowTests, LoadersMarkContentTheWorkflowDoesNotKeep) {
+    QDir examples(SCXML_EXAMPLES_DIR);
+    QByteArray data = ReadFile(examples.filePath("TestLog.scxml"));
+    QDomDocument doc;
+    ASSERT_TRUE(doc.setContent(data));
+    Workflow dom;
+    dom.ConstructStateMachineFromSCXML(doc);
+    Workflow streamed;
+    QXmlStreamReader reader(data);
+    ASSERT_TRUE(streamed.ConstructStateMachineFromSCXML(reader));
+
+    // CalculatorState holds an invoke, the other states hold only what the workflow keeps
+    foreach (Workflow* workflow, QList<Workflow*>() << &dom << &streamed) {
+        EXPECT_TRUE(workflow->GetStateById(QString("CalculatorState"))->HasForeignContent());
+        EXPECT_FALSE(workflow->GetStateById(QString("LoopState"))->HasForeignContent());
+        EXPECT_FALSE(workflow->GetStateById(QString("CheckState"))->HasForeignContent());
+    }
+}
@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+#include <QMap>
+#include <QScopedPointer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QXmlStreamReader>
+#include "workflow.h"
+#include "scxmltransition.h"
+#include "workflowcache.h"
+#include "workflowjournal.h"
+#include "workflowmodel.h"
+
+//! A workflow read from a copy of an example, journaled as the GUI journals it
+class WorkflowJournalTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp() {
+        ASSERT_TRUE(mDir.isValid());
+        mFilename = mDir.path() + "/TestLog.scxml";
+        ASSERT_TRUE(QFile::copy(QString(SCXML_EXAMPLES_DIR) + "/TestLog.scxml", mFilename));
+        QFile file(mFilename);
+        ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+        mSource = file.readAll();
+        mSourceHash = WorkflowCache::HashSource(mSource);
+
+        WorkflowModel model;
+        ASSERT_TRUE(ReadModel(model));
+        mWorkflow.ConstructStateMachineFromModel(model);
+        mJournal.reset(new WorkflowJournal(&mWorkflow, mFilename, mSourceHash, false));
+    }
+
+    virtual void TearDown() {
+        mJournal.reset();
+    }
+
+    //! Reads the model of the file as it was before any edits
+    bool ReadModel(WorkflowModel& model) {
+        QXmlStreamReader reader(mSource);
+        return model.ReadFromStream(reader);
+    }
+
+    //! Takes the edits made so far and waits for them to be on disk
+    void FlushJournal() {
+        mJournal->Flush();
+        mJournal->WaitForWrites();
+    }
+
+    SCXMLTransition* GetTransition(QString sourceId, QString event) {
+        foreach (SCXMLTransition* transition, mWorkflow.GetTransitionsFrom(mWorkflow.GetStateById(sourceId))) {
+            if (transition->GetEvent() == event) return transition;
+        }
+        return nullptr;
+    }
+
+    //! Describes the states and transitions of a model by id, so models built in a different
+    //! order compare equal
+    static QMap<QString, QStringList> Describe(const WorkflowModel& model) {
+        QMap<QString, QStringList> description;
+        foreach (const WorkflowStateModel& state, model.states) {
+            QString parentId = state.parentIndex >= 0 ? SCXMLAtomString(model.states.at(state.parentIndex).id) : QString();
+            description["state " + SCXMLAtomString(state.id)] << parentId << (state.final ? "final" : "")
+                                                              << state.metaData.description;
+        }
+        foreach (const WorkflowTransitionModel& transition, model.transitions) {
+            description["transitions " + SCXMLAtomString(model.states.at(transition.sourceIndex).id)]
+                    << QString("%1 -> %2 [%3] %4").arg(transition.event).arg(SCXMLAtomString(transition.target))
+                       .arg(transition.cond).arg(transition.metaData.description);
+        }
+        return description;
+    }
+
+    QTemporaryDir mDir;
+    QString mFilename;
+    QByteArray mSource;
+    QByteArray mSourceHash;
+    Workflow mWorkflow;
+    QScopedPointer<WorkflowJournal> mJournal;
+};
+
+TEST_F(WorkflowJournalTest, ReplaysEditsOntoTheModelReadFromTheFile) {
+    mWorkflow.GetStateById(QString("CheckState"))->SetDescription("Journaled");
+    GetTransition("LoopState", "test.log")->SetCond("parameters.value > 0");
+    SCXMLTransition* added = new SCXMLTransition(mWorkflow.GetStateById(QString("CheckState")),
+                                                 mWorkflow.GetStateById(QString("LoopState")), "added", "external", MetaData());
+    mWorkflow.AddTransition(added);
+    FlushJournal();
+
+    WorkflowModel expected;
+    mWorkflow.ConstructModelFromStateMachine(expected);
+    WorkflowModel replayed;
+    ASSERT_TRUE(ReadModel(replayed));
+    EXPECT_EQ(3, WorkflowJournal::Replay(&replayed, WorkflowJournal::GetJournalFilename(mFilename), mSourceHash));
+    EXPECT_FALSE(replayed.hasSourceRanges);
+    EXPECT_EQ(Describe(expected), Describe(replayed));
+}
+
+TEST_F(WorkflowJournalTest, IgnoresAJournalForAnotherVersionOfTheFile) {
+    mWorkflow.GetStateById(QString("CheckState"))->SetDescription("Journaled");
+    FlushJournal();
+
+    WorkflowModel original;
+    ASSERT_TRUE(ReadModel(original));
+    WorkflowModel replayed;
+    ASSERT_TRUE(ReadModel(replayed));
+    EXPECT_EQ(0, WorkflowJournal::Replay(&replayed, WorkflowJournal::GetJournalFilename(mFilename), QByteArray("other")));
+    EXPECT_TRUE(replayed.hasSourceRanges);
+    EXPECT_EQ(Describe(original), Describe(replayed));
+}
+
+TEST_F(WorkflowJournalTest, StopsAtABatchThatWasNotWrittenInFull) {
+    SCXMLState* state = mWorkflow.GetStateById(QString("CheckState"));
+    state->SetDescription("First");
+    FlushJournal();
+    state->SetDescription("Second");
+    FlushJournal();
+
+    QFile journalFile(WorkflowJournal::GetJournalFilename(mFilename));
+    ASSERT_TRUE(journalFile.open(QIODevice::ReadOnly));
+    QByteArray journal = journalFile.readAll();
+
+    // cut within the last batch, then with the last batch in full but its checksum wrong
+    QByteArray damaged = journal;
+    damaged[damaged.size() - 1] = char(damaged.at(damaged.size() - 1) ^ 0xFF);
+    foreach (QByteArray data, QList<QByteArray>() << journal.left(journal.size() - 3) << damaged) {
+        QString damagedFilename = mDir.path() + "/Damaged.scxmlj";
+        QFile damagedFile(damagedFilename);
+        ASSERT_TRUE(damagedFile.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        damagedFile.write(data);
+        damagedFile.close();
+
+        WorkflowModel replayed;
+        ASSERT_TRUE(ReadModel(replayed));
+        EXPECT_EQ(1, WorkflowJournal::Replay(&replayed, damagedFilename, mSourceHash));
+        EXPECT_EQ(QStringList() << "LoggerState" << "" << "First", Describe(replayed).value("state CheckState"));
+    }
+}
+
+TEST_F(WorkflowJournalTest, ReplaysRecordsAfterASnapshot) {
+    SCXMLTransition* added = new SCXMLTransition(mWorkflow.GetStateById(QString("CheckState")),
+                                                 mWorkflow.GetStateById(QString("LoopState")), "added", "external", MetaData());
+    mWorkflow.AddTransition(added);
+    FlushJournal();
+    mJournal->Compact();
+
+    // the transition added before the snapshot is found by its position in the snapshot
+    added->SetCond("parameters.value > 0");
+    mWorkflow.GetStateById(QString("LoopState"))->SetDescription("After the snapshot");
+    FlushJournal();
+
+    WorkflowModel expected;
+    mWorkflow.ConstructModelFromStateMachine(expected);
+    WorkflowModel replayed;
+    ASSERT_TRUE(ReadModel(replayed));
+    EXPECT_EQ(3, WorkflowJournal::Replay(&replayed, WorkflowJournal::GetJournalFilename(mFilename), mSourceHash));
+    EXPECT_EQ(expected.states.count(), replayed.states.count());
+    EXPECT_EQ(expected.transitions.count(), replayed.transitions.count());
+    EXPECT_EQ(Describe(expected), Describe(replayed));
+}
+
+TEST_F(WorkflowJournalTest, SaveStartsTheJournalOfTheSavedFileWithTheEditsMadeWhileSaving) {
+    SCXMLState* state = mWorkflow.GetStateById(QString("CheckState"));
+    state->SetDescription("Saved");
+    mJournal->BeginSave();
+    mWorkflow.GetStateById(QString("LoopState"))->SetDescription("Made while saving");
+    QString savedFilename = mDir.path() + "/Saved.scxml";
+    mJournal->FinishSave(savedFilename, QByteArray("saved"), true);
+    mJournal->WaitForWrites();
+    EXPECT_FALSE(QFile::exists(WorkflowJournal::GetJournalFilename(mFilename)));
+
+    // the edit made before the save is in the saved file, so only the one made while saving is
+    // replayed, here onto the file as it was read
+    WorkflowModel replayed;
+    ASSERT_TRUE(ReadModel(replayed));
+    EXPECT_EQ(1, WorkflowJournal::Replay(&replayed, WorkflowJournal::GetJournalFilename(savedFilename), QByteArray("saved")));
+    QMap<QString, QStringList> description = Describe(replayed);
+    EXPECT_EQ(QString("Loops around"), description.value("state CheckState").last());
+    EXPECT_EQ(QString("Made while saving"), description.value("state LoopState").last());
+}